@@ -0,0 +1,90 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef COLLISION_SPACE_CONVEX_DISTANCE_
+#define COLLISION_SPACE_CONVEX_DISTANCE_
+
+#include <tf/LinearMath/Transform.h>
+
+namespace collision_space
+{
+
+/** \brief Description of a convex body for distance computation. The
+    body only needs to provide a support mapping; meshes are described
+    by their vertex set, which means they are treated as their convex
+    hull. */
+struct ConvexBody
+{
+  enum Type
+  {
+    SPHERE,
+    BOX,
+    CYLINDER,
+    POINTS
+  };
+
+  ConvexBody(void) : type(SPHERE), vertices(NULL), vertex_count(0)
+  {
+    dims[0] = dims[1] = dims[2] = 0.0;
+    pose.setIdentity();
+  }
+
+  /** \brief The support point (farthest point in the direction \e dir) in the world frame */
+  tf::Vector3 support(const tf::Vector3 &dir) const;
+
+  Type type;
+
+  /** \brief Radius for spheres; half extents for boxes; radius and half length (along z) for cylinders */
+  double dims[3];
+
+  /** \brief Vertices (x, y, z triplets) in the body frame, for POINTS. The memory is not owned by this structure */
+  const double *vertices;
+  unsigned int vertex_count;
+
+  /** \brief The pose of the body in the world frame */
+  tf::Transform pose;
+};
+
+/** \brief Compute the distance between two convex bodies using the
+    GJK algorithm. The closest points of each body are returned in
+    the world frame. If the bodies overlap, 0 is returned and the
+    closest points are not meaningful. The result is within \e
+    tolerance of the true distance. */
+double computeConvexDistance(const ConvexBody &a, const ConvexBody &b,
+                             tf::Vector3 &point_a, tf::Vector3 &point_b,
+                             double tolerance = 1e-6);
+
+}
+
+#endif
@@ -87,6 +87,26 @@ public:
     BodyType body_type_2;
   };
 
+  /** \brief Result of a distance query between two bodies */
+  struct DistanceResult
+  {
+    /** \brief signed distance between the bodies; a negative value is the penetration depth */
+    double distance;
+
+    /** \brief closest point on the first body, in the world frame */
+    tf::Vector3 point_1;
+    /** \brief closest point on the second body, in the world frame */
+    tf::Vector3 point_2;
+
+    /** \brief The first body involved in the query */
+    std::string body_name_1;
+    BodyType body_type_1;
+
+    /** \brief The second body involved in the query */
+    std::string body_name_2;
+    BodyType body_type_2;
+  };
+
   /** \brief Definition of a contact that is allowed */
   struct AllowedContact
   {
@@ -262,6 +282,31 @@ public:
   /** \brief This function will get the complete list of contacts between any two potentially colliding bodies.  The num per contacts specifies the number of contacts per pair that will be returned */
   virtual bool getAllCollisionContacts(std::vector<Contact> &contacts, unsigned int num_per_contact = 1) const = 0;
 
+  /**********************************************************************/
+  /* Distance Queries                                                   */
+  /**********************************************************************/
+
+  /** \brief Get the minimum distance between the robot and the
+      environment and, if \e include_self is set, between pairs of
+      robot bodies. Pairs whose bounding boxes are farther apart than
+      \e max_distance (or than the best distance found so far) are not
+      evaluated. If a colliding pair is found the search stops and
+      that pair is returned with a negative distance. Returns false if
+      no pair is closer than \e max_distance */
+  virtual bool getClearance(DistanceResult &result, double max_distance, bool include_self = true) const = 0;
+
+  /** \brief Get the minimum distance from each robot link and attached
+      body to the environment and, if \e include_self is set, to the
+      other robot bodies. Only bodies closer than \e max_distance to
+      something are reported, keyed by body name */
+  virtual void getLinkClearances(std::map<std::string, DistanceResult> &clearances, double max_distance, bool include_self = true) const = 0;
+
+  /** \brief Get the distance between two bodies, each of which can be a
+      link, an attached body or an object namespace. Allowed
+      collisions are not taken into account. Returns false if either
+      body is not known */
+  virtual bool getPairDistance(const std::string &name1, const std::string &name2, DistanceResult &result) const = 0;
+
   /**********************************************************************/
   /* Collision Bodies                                                   */
   /**********************************************************************/
@@ -38,8 +38,16 @@
 #define COLLISION_SPACE_ENVIRONMENT_MODEL_ODE_
 
 #include "collision_space/environment.h"
+#include "collision_space/convex_distance.h"
 #include <ode/ode.h>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/noncopyable.hpp>
 #include <map>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
 
 namespace collision_space
 {
@@ -84,6 +92,19 @@ public:
                                                          std::vector<Contact> &contacts,
                                                          unsigned int num_contacts_per_pair) const;
 	
+  /** \brief Get the minimum distance between the robot and the
+      environment (padded robot bodies) and, if \e include_self is
+      set, between pairs of robot bodies (unpadded). Meshes are
+      approximated by their convex hull, so distances to non-convex
+      meshes are lower bounds */
+  virtual bool getClearance(DistanceResult &result, double max_distance, bool include_self = true) const;
+
+  /** \brief Get the minimum distance from each robot link and attached body to the environment and, optionally, the rest of the robot */
+  virtual void getLinkClearances(std::map<std::string, DistanceResult> &clearances, double max_distance, bool include_self = true) const;
+
+  /** \brief Get the distance between two bodies (links, attached bodies or object namespaces) */
+  virtual bool getPairDistance(const std::string &name1, const std::string &name2, DistanceResult &result) const;
+	
   /** \brief Remove all objects from collision model */
   virtual void clearObjects(void);
 	
@@ -139,48 +160,77 @@ protected:
   /** \brief Structure for maintaining ODE temporary data */
   struct ODEStorage
   {	
-    struct Element
+    /** \brief Trimesh data built from a mesh with some padding. Geoms
+        created from identical meshes with the same padding share one
+        instance, which is freed with the last geom that uses it */
+    struct Element : private boost::noncopyable
     {
+      Element(void) : vertices(NULL), indices(NULL), data(NULL), n_indices(0), n_vertices(0)
+      {
+      }
+      
+      ~Element(void)
+      {
+        if (data)
+          dGeomTriMeshDataDestroy(data);
+        delete[] indices;
+        delete[] vertices;
+      }
+
+      /** \brief Check whether this data was built from a mesh with the same vertices and triangles */
+      bool builtFrom(const shapes::Mesh *mesh) const
+      {
+        if (source_vertices.size() != mesh->vertexCount * 3 || n_indices != (int)mesh->triangleCount * 3)
+          return false;
+        for (int i = 0 ; i < n_indices ; ++i)
+          if (indices[i] != mesh->triangles[i])
+            return false;
+        return std::equal(source_vertices.begin(), source_vertices.end(), mesh->vertices);
+      }
+      
+      /* the unpadded vertices of the source mesh; indices are kept as given */
+      std::vector<double> source_vertices;
       double *vertices;
       dTriIndex *indices;
       dTriMeshDataID data;
       int n_indices;
       int n_vertices;
     };
+    typedef boost::shared_ptr<Element> ElementPtr;
 	    
-    ~ODEStorage(void)
-    {
-      clear();
-    }
-
     void remove(dGeomID id) {
-      
-      if(meshes.find(id) == meshes.end()) {
-        return;
-      }
-
-      Element& e = meshes[id];
-      delete[] e.indices;
-      delete[] e.vertices;
-      dGeomTriMeshDataDestroy(e.data);
       meshes.erase(id);
     }
 	    
     void clear(void)
     {
-      for(std::map<dGeomID, Element>::iterator it = meshes.begin();
-          it != meshes.end();
-          it++)
-      {
-        delete[] it->second.indices;
-        delete[] it->second.vertices;
-        dGeomTriMeshDataDestroy(it->second.data);
-      }
       meshes.clear();
     }
 	    
     /* Pointers for ODE indices; we need this around in ODE's assumed datatype */
-    std::map<dGeomID, Element> meshes;
+    std::map<dGeomID, ElementPtr> meshes;
+  };
+
+  /** \brief Identifies the trimesh data built for a mesh: a hash of
+      the vertices and triangles, their counts and the padding. The
+      contents are compared on a match before the data is shared */
+  struct MeshDataKey
+  {
+    uint64_t hash;
+    unsigned int vertex_count;
+    unsigned int triangle_count;
+    double padding;
+    
+    bool operator<(const MeshDataKey &other) const
+    {
+      if (hash != other.hash)
+        return hash < other.hash;
+      if (vertex_count != other.vertex_count)
+        return vertex_count < other.vertex_count;
+      if (triangle_count != other.triangle_count)
+        return triangle_count < other.triangle_count;
+      return padding < other.padding;
+    }
   };
 	
   class ODECollide2
@@ -285,6 +335,30 @@ protected:
                    Geom *g, void *data, dNearCallback *nearCallback) const;
   };
 
+  /** \brief A set of padded geoms that is not currently in use. The
+      geoms are kept out of the environment space so that switching
+      back to this padding does not require rebuilding them */
+  struct PaddedGeomVariant
+  {
+    double padding;
+    std::vector<dGeomID> geoms;
+  };
+
+  /** \brief The maximum number of inactive padded variants kept for
+      each link or attached body */
+  static const unsigned int MAX_PADDED_VARIANTS = 3;
+
+  static void destroyPaddedVariants(ODEStorage& storage, std::list<PaddedGeomVariant>& variants)
+  {
+    for(std::list<PaddedGeomVariant>::iterator it = variants.begin(); it != variants.end(); it++) {
+      for(unsigned int i = 0; i < it->geoms.size(); i++) {
+        dGeomDestroy(it->geoms[i]);
+        storage.remove(it->geoms[i]);
+      }
+    }
+    variants.clear();
+  }
+
   struct AttGeom
   {
     AttGeom(ODEStorage& s) : storage(s){
@@ -300,11 +374,14 @@ protected:
         dGeomDestroy(padded_geom[i]);
         storage.remove(padded_geom[i]);
       }
+      destroyPaddedVariants(storage, padded_variants);
     }
 
     ODEStorage& storage;
     std::vector<dGeomID> geom;
     std::vector<dGeomID> padded_geom;
+    double padding;
+    std::list<PaddedGeomVariant> padded_variants;
     const planning_models::KinematicModel::AttachedBodyModel *att;
     unsigned int index;
   };
@@ -321,6 +398,7 @@ protected:
       for(unsigned int i = 0; i < padded_geom.size(); i++) {
         dGeomDestroy(padded_geom[i]);
       }
+      destroyPaddedVariants(storage, padded_variants);
       deleteAttachedBodies();
     }
     
@@ -335,6 +413,8 @@ protected:
     ODEStorage& storage;
     std::vector<dGeomID> geom;
     std::vector<dGeomID> padded_geom;
+    double padding;
+    std::list<PaddedGeomVariant> padded_variants;
     std::vector<AttGeom*> att_bodies;
     const planning_models::KinematicModel::LinkModel *link;
     unsigned int index;
@@ -422,6 +502,35 @@ protected:
   };
 	
 	
+  /** \brief A geom taking part in a distance query */
+  struct DistanceBody
+  {
+    dGeomID geom;
+    dReal aabb[6];
+    bool plane;
+    dVector4 plane_params;
+    ConvexBody convex;
+    std::string name;
+    BodyType type;
+  };
+
+  /** \brief Fill in the description of a geom for distance queries. Returns false for unsupported geom classes */
+  bool getDistanceBody(dGeomID geom, const ODEStorage &storage, const std::string &name, BodyType type, DistanceBody &body) const;
+
+  /** \brief Get the padded or unpadded geoms of the links and attached bodies */
+  void getRobotDistanceBodies(std::vector<DistanceBody> &bodies, bool padded) const;
+
+  /** \brief Get the geoms of an object namespace */
+  void getNamespaceDistanceBodies(const CollisionNamespace *cn, std::vector<DistanceBody> &bodies) const;
+
+  /** \brief Get the geoms of all the object namespaces, grouped by namespace */
+  void getObjectDistanceBodies(std::vector<DistanceBody> &bodies) const;
+
+  /** \brief Compute the signed distance between two bodies. Returns
+      false without computing anything if the bounding boxes show the
+      distance is at least \e bound */
+  bool computeBodyDistance(const DistanceBody &b1, const DistanceBody &b2, double bound, DistanceResult &result) const;
+
   /** \brief Internal function for collision detection */
   void testCollision(CollisionData *data) const;
 
@@ -447,6 +556,7 @@ protected:
   void createODERobotModel();	
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::Shape *shape, double scale, double padding);
   dGeomID createODEGeom(dSpaceID space, ODEStorage &storage, const shapes::StaticShape *shape);
+  ODEStorage::Element* createODEMeshData(const shapes::Mesh *mesh, double padding) const;
   void updateGeom(dGeomID geom, const tf::Transform &pose) const;	
 
   void addAttachedBody(LinkGeom* lg, const planning_models::KinematicModel::AttachedBodyModel* attm,
@@ -457,11 +567,24 @@ protected:
   void setAttachedBodiesLinkPadding();
   void revertAttachedBodiesLinkPadding();
 
+  /** \brief Make the padded geoms for \e shapes with the given padding
+      active, reusing a cached variant if one exists. The previously
+      active geoms are moved to the front of \e variants and the least
+      recently used variants beyond MAX_PADDED_VARIANTS are destroyed */
+  void swapPaddedGeoms(std::vector<dGeomID>& padded_geom, double& active_padding,
+                       std::list<PaddedGeomVariant>& variants,
+                       const std::vector<const shapes::Shape*>& shapes,
+                       double padding, const std::string& name, BodyType type);
+
   void freeMemory(void);	
 	
   ModelInfo model_geom_;
   std::map<std::string, CollisionNamespace*> coll_namespaces_;
 
+  /** \brief The trimesh data that is currently in use, so that
+      geoms for identical meshes can share it */
+  std::map<MeshDataKey, boost::weak_ptr<ODEStorage::Element> > mesh_data_;
+
   std::map<dGeomID, std::pair<std::string, BodyType> > geom_lookup_map_;
   std::map<std::string, dSpaceID> dspace_lookup_map_;
 
@@ -0,0 +1,298 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "collision_space/convex_distance.h"
+#include <limits>
+#include <cmath>
+#include <algorithm>
+
+namespace collision_space
+{
+
+static const unsigned int GJK_MAX_ITERATIONS = 64;
+
+/** \brief A vertex of the simplex in the Minkowski difference, along with the support points that generated it */
+struct SimplexVertex
+{
+  tf::Vector3 w;
+  tf::Vector3 a;
+  tf::Vector3 b;
+};
+
+/** \brief Compute the barycentric coordinates of the point closest to
+    the origin on the affine hull of the selected simplex vertices.
+    Returns false if the vertices are affinely dependent. */
+static bool solveAffineProjection(const SimplexVertex *simplex, const unsigned int *idx, unsigned int k, double *lambda)
+{
+  if (k == 1)
+  {
+    lambda[0] = 1.0;
+    return true;
+  }
+  
+  const tf::Vector3 &p0 = simplex[idx[0]].w;
+  const unsigned int m = k - 1;
+  tf::Vector3 e[3];
+  for (unsigned int i = 0 ; i < m ; ++i)
+    e[i] = simplex[idx[i + 1]].w - p0;
+
+  // normal equations of min |p0 + sum mu_i e_i|^2
+  double g[3][4];
+  double scale = 0.0;
+  for (unsigned int i = 0 ; i < m ; ++i)
+  {
+    for (unsigned int j = 0 ; j < m ; ++j)
+      g[i][j] = e[i].dot(e[j]);
+    g[i][m] = -e[i].dot(p0);
+    scale = std::max(scale, g[i][i]);
+  }
+  if (scale <= 0.0)
+    return false;
+  
+  // gaussian elimination with partial pivoting
+  for (unsigned int c = 0 ; c < m ; ++c)
+  {
+    unsigned int p = c;
+    for (unsigned int r = c + 1 ; r < m ; ++r)
+      if (fabs(g[r][c]) > fabs(g[p][c]))
+        p = r;
+    if (fabs(g[p][c]) < 1e-12 * scale)
+      return false;
+    if (p != c)
+      for (unsigned int j = 0 ; j <= m ; ++j)
+        std::swap(g[p][j], g[c][j]);
+    for (unsigned int r = c + 1 ; r < m ; ++r)
+    {
+      double f = g[r][c] / g[c][c];
+      for (unsigned int j = c ; j <= m ; ++j)
+        g[r][j] -= f * g[c][j];
+    }
+  }
+
+  double mu[3];
+  for (int r = m - 1 ; r >= 0 ; --r)
+  {
+    double s = g[r][m];
+    for (unsigned int j = r + 1 ; j < m ; ++j)
+      s -= g[r][j] * mu[j];
+    mu[r] = s / g[r][r];
+  }
+
+  lambda[0] = 1.0;
+  for (unsigned int i = 0 ; i < m ; ++i)
+  {
+    lambda[i + 1] = mu[i];
+    lambda[0] -= mu[i];
+  }
+  return true;
+}
+
+/** \brief Find the point closest to the origin on the convex hull of
+    the simplex. Every face of the simplex is tried; the closest point
+    is the one of minimum norm among the faces whose projection falls
+    inside them. The simplex is reduced to the vertices of that face
+    and \e lambda receives their barycentric coordinates. */
+static tf::Vector3 reduceSimplex(SimplexVertex *simplex, unsigned int &n, double *lambda)
+{
+  double best_norm = std::numeric_limits<double>::infinity();
+  unsigned int best_idx[4] = {0, 0, 0, 0};
+  double best_lambda[4] = {1.0, 0.0, 0.0, 0.0};
+  unsigned int best_k = 1;
+  tf::Vector3 best_v = simplex[0].w;
+  
+  for (unsigned int mask = 1 ; mask < (1u << n) ; ++mask)
+  {
+    unsigned int idx[4];
+    unsigned int k = 0;
+    for (unsigned int i = 0 ; i < n ; ++i)
+      if (mask & (1u << i))
+        idx[k++] = i;
+    
+    double l[4];
+    if (!solveAffineProjection(simplex, idx, k, l))
+      continue;
+    
+    bool inside = true;
+    for (unsigned int j = 0 ; j < k && inside ; ++j)
+      if (l[j] < 0.0)
+        inside = false;
+    if (!inside)
+      continue;
+    
+    tf::Vector3 v(0.0, 0.0, 0.0);
+    for (unsigned int j = 0 ; j < k ; ++j)
+      v += l[j] * simplex[idx[j]].w;
+    double norm = v.length2();
+    if (norm < best_norm)
+    {
+      best_norm = norm;
+      best_v = v;
+      best_k = k;
+      for (unsigned int j = 0 ; j < k ; ++j)
+      {
+        best_idx[j] = idx[j];
+        best_lambda[j] = l[j];
+      }
+    }
+  }
+  
+  SimplexVertex reduced[4];
+  for (unsigned int j = 0 ; j < best_k ; ++j)
+  {
+    reduced[j] = simplex[best_idx[j]];
+    lambda[j] = best_lambda[j];
+  }
+  for (unsigned int j = 0 ; j < best_k ; ++j)
+    simplex[j] = reduced[j];
+  n = best_k;
+  
+  return best_v;
+}
+
+}
+
+tf::Vector3 collision_space::ConvexBody::support(const tf::Vector3 &dir) const
+{
+  const tf::Matrix3x3 &basis = pose.getBasis();
+  // direction in the body frame
+  tf::Vector3 d = basis.transpose() * dir;
+  tf::Vector3 s(0.0, 0.0, 0.0);
+  
+  switch (type)
+  {
+  case SPHERE:
+    {
+      double n = d.length();
+      if (n > 0.0)
+        s = d * (dims[0] / n);
+    }
+    break;
+  case BOX:
+    s.setValue(d.x() >= 0.0 ? dims[0] : -dims[0],
+               d.y() >= 0.0 ? dims[1] : -dims[1],
+               d.z() >= 0.0 ? dims[2] : -dims[2]);
+    break;
+  case CYLINDER:
+    {
+      double n = sqrt(d.x() * d.x() + d.y() * d.y());
+      double z = d.z() >= 0.0 ? dims[1] : -dims[1];
+      if (n > 0.0)
+        s.setValue(d.x() * dims[0] / n, d.y() * dims[0] / n, z);
+      else
+        s.setValue(0.0, 0.0, z);
+    }
+    break;
+  case POINTS:
+    {
+      double best = -std::numeric_limits<double>::infinity();
+      for (unsigned int i = 0 ; i < vertex_count ; ++i)
+      {
+        const double *v = vertices + i * 3;
+        double p = v[0] * d.x() + v[1] * d.y() + v[2] * d.z();
+        if (p > best)
+        {
+          best = p;
+          s.setValue(v[0], v[1], v[2]);
+        }
+      }
+    }
+    break;
+  }
+  
+  return pose * s;
+}
+
+double collision_space::computeConvexDistance(const ConvexBody &a, const ConvexBody &b,
+                                              tf::Vector3 &point_a, tf::Vector3 &point_b,
+                                              double tolerance)
+{
+  SimplexVertex simplex[4];
+  double lambda[4] = {1.0, 0.0, 0.0, 0.0};
+  unsigned int n = 1;
+  
+  tf::Vector3 v = a.pose.getOrigin() - b.pose.getOrigin();
+  if (v.length2() < std::numeric_limits<double>::epsilon())
+    v.setValue(1.0, 0.0, 0.0);
+  simplex[0].a = a.support(-v);
+  simplex[0].b = b.support(v);
+  simplex[0].w = simplex[0].a - simplex[0].b;
+  v = simplex[0].w;
+  
+  bool overlap = false;
+  for (unsigned int iter = 0 ; iter < GJK_MAX_ITERATIONS ; ++iter)
+  {
+    double vv = v.length2();
+    if (vv <= tolerance * tolerance)
+    {
+      overlap = true;
+      break;
+    }
+    
+    SimplexVertex s;
+    s.a = a.support(-v);
+    s.b = b.support(v);
+    s.w = s.a - s.b;
+    
+    // v.w / |v| is a lower bound on the distance, so this bounds the error by the tolerance
+    if (vv - v.dot(s.w) <= tolerance * sqrt(vv))
+      break;
+    
+    bool repeated = false;
+    for (unsigned int i = 0 ; i < n && !repeated ; ++i)
+      if ((simplex[i].w - s.w).length2() <= std::numeric_limits<double>::epsilon() * vv)
+        repeated = true;
+    if (repeated)
+      break;
+    
+    simplex[n++] = s;
+    v = reduceSimplex(simplex, n, lambda);
+
+    // a full simplex is only kept if it encloses the origin
+    if (n == 4)
+    {
+      overlap = true;
+      break;
+    }
+  }
+  
+  point_a.setValue(0.0, 0.0, 0.0);
+  point_b.setValue(0.0, 0.0, 0.0);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    point_a += lambda[i] * simplex[i].a;
+    point_b += lambda[i] * simplex[i].b;
+  }
+  
+  return overlap ? 0.0 : v.length();
+}
@@ -36,11 +36,13 @@
 
 #include "collision_space/environmentODE.h"
 #include <geometric_shapes/shape_operations.h>
+#include <geometric_shapes/mesh_cache.h>
 #include <ros/console.h>
 #include <cassert>
 #include <cstdio>
 #include <cmath>
 #include <algorithm>
+#include <limits>
 #include <map>
 
 #include <boost/thread.hpp>
@@ -204,6 +206,7 @@ void collision_space::EnvironmentModelODE::createODERobotModel()
     dGeomID padd_g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, padd);
     assert(padd_g);
     lg->padded_geom.push_back(padd_g);
+    lg->padding = padd;
     geom_lookup_map_[padd_g] = std::pair<std::string, BodyType>(link->getName(), LINK);
     const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = link->getAttachedBodyModels();
     for (unsigned int j = 0 ; j < attached_bodies.size() ; ++j) {
@@ -262,64 +265,35 @@ dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODES
     {
       const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
       if (mesh->vertexCount > 0 && mesh->triangleCount > 0)
-      {		
-        // copy indices for ODE
-        int icount = mesh->triangleCount * 3;
-        dTriIndex *indices = new dTriIndex[icount];
-        for (int i = 0 ; i < icount ; ++i)
-          indices[i] = mesh->triangles[i];
-		
-        // copt vertices for ODE
-        double *vertices = new double[mesh->vertexCount* 3];
-        double sx = 0.0, sy = 0.0, sz = 0.0;
-        for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
+      {
+        // identical meshes with the same padding share their trimesh data
+        MeshDataKey key;
+        key.hash = shapes::mesh_cache::hash(mesh->vertices, mesh->vertexCount * 3 * sizeof(double));
+        key.hash = shapes::mesh_cache::hash(mesh->triangles, mesh->triangleCount * 3 * sizeof(unsigned int), key.hash);
+        key.vertex_count = mesh->vertexCount;
+        key.triangle_count = mesh->triangleCount;
+        key.padding = padding;
+        ODEStorage::ElementPtr e = mesh_data_[key].lock();
+        if (e && !e->builtFrom(mesh))
         {
-          unsigned int i3 = i * 3;
-          vertices[i3] = mesh->vertices[i3];
-          vertices[i3 + 1] = mesh->vertices[i3 + 1];
-          vertices[i3 + 2] = mesh->vertices[i3 + 2];
-          sx += vertices[i3];
-          sy += vertices[i3 + 1];
-          sz += vertices[i3 + 2];
+          // a different mesh with the same hash; give it data of its own
+          ROS_DEBUG("Mesh hash collision, not sharing trimesh data");
+          e.reset(createODEMeshData(mesh, padding));
         }
-        // the center of the mesh
-        sx /= (double)mesh->vertexCount;
-        sy /= (double)mesh->vertexCount;
-        sz /= (double)mesh->vertexCount;
-
-        // scale the mesh
-        for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
+        else if (!e)
         {
-          unsigned int i3 = i * 3;
-		    
-          // vector from center to the vertex
-          double dx = vertices[i3] - sx;
-          double dy = vertices[i3 + 1] - sy;
-          double dz = vertices[i3 + 2] - sz;
-		    
-          // length of vector
-          //double norm = sqrt(dx * dx + dy * dy + dz * dz);
-		    
-          double ndx = ((dx > 0) ? dx+padding : dx-padding);
-          double ndy = ((dy > 0) ? dy+padding : dy-padding);
-          double ndz = ((dz > 0) ? dz+padding : dz-padding);
-
-          // the new distance of the vertex from the center
-          //double fact = scale + padding/norm;
-          vertices[i3] = sx + ndx; //dx * fact;
-          vertices[i3 + 1] = sy + ndy; //dy * fact;
-          vertices[i3 + 2] = sz + ndz; //dz * fact;		    
+          e.reset(createODEMeshData(mesh, padding));
+          
+          // forget the data no geom uses anymore
+          for (std::map<MeshDataKey, boost::weak_ptr<ODEStorage::Element> >::iterator it = mesh_data_.begin() ; it != mesh_data_.end() ; )
+            if (it->second.expired())
+              mesh_data_.erase(it++);
+            else
+              ++it;
+          mesh_data_[key] = e;
         }
-		
-        dTriMeshDataID data = dGeomTriMeshDataCreate();
-        dGeomTriMeshDataBuildDouble(data, vertices, sizeof(double) * 3, mesh->vertexCount, indices, icount, sizeof(dTriIndex) * 3);
-        g = dCreateTriMesh(space, data, NULL, NULL, NULL);
-        ODEStorage::Element& e = storage.meshes[g];
-        e.vertices = vertices;
-        e.indices = indices;
-        e.data = data;
-        e.n_vertices = mesh->vertexCount;
-        e.n_indices = icount;
+        g = dCreateTriMesh(space, e->data, NULL, NULL, NULL);
+        storage.meshes[g] = e;
       }
     }
 	
@@ -329,6 +303,68 @@ dGeomID collision_space::EnvironmentModelODE::createODEGeom(dSpaceID space, ODES
   return g;
 }
 
+collision_space::EnvironmentModelODE::ODEStorage::Element* collision_space::EnvironmentModelODE::createODEMeshData(const shapes::Mesh *mesh, double padding) const
+{
+  ODEStorage::Element *e = new ODEStorage::Element();
+  
+  // copy indices for ODE
+  int icount = mesh->triangleCount * 3;
+  e->indices = new dTriIndex[icount];
+  for (int i = 0 ; i < icount ; ++i)
+    e->indices[i] = mesh->triangles[i];
+		
+  // keep the source vertices to tell meshes with the same hash apart
+  e->source_vertices.assign(mesh->vertices, mesh->vertices + mesh->vertexCount * 3);
+
+  // copt vertices for ODE
+  double *vertices = e->vertices = new double[mesh->vertexCount* 3];
+  double sx = 0.0, sy = 0.0, sz = 0.0;
+  for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
+  {
+    unsigned int i3 = i * 3;
+    vertices[i3] = mesh->vertices[i3];
+    vertices[i3 + 1] = mesh->vertices[i3 + 1];
+    vertices[i3 + 2] = mesh->vertices[i3 + 2];
+    sx += vertices[i3];
+    sy += vertices[i3 + 1];
+    sz += vertices[i3 + 2];
+  }
+  // the center of the mesh
+  sx /= (double)mesh->vertexCount;
+  sy /= (double)mesh->vertexCount;
+  sz /= (double)mesh->vertexCount;
+
+  // scale the mesh
+  for (unsigned int i = 0 ; i < mesh->vertexCount ; ++i)
+  {
+    unsigned int i3 = i * 3;
+		    
+    // vector from center to the vertex
+    double dx = vertices[i3] - sx;
+    double dy = vertices[i3 + 1] - sy;
+    double dz = vertices[i3 + 2] - sz;
+		    
+    // length of vector
+    //double norm = sqrt(dx * dx + dy * dy + dz * dz);
+		    
+    double ndx = ((dx > 0) ? dx+padding : dx-padding);
+    double ndy = ((dy > 0) ? dy+padding : dy-padding);
+    double ndz = ((dz > 0) ? dz+padding : dz-padding);
+
+    // the new distance of the vertex from the center
+    //double fact = scale + padding/norm;
+    vertices[i3] = sx + ndx; //dx * fact;
+    vertices[i3 + 1] = sy + ndy; //dy * fact;
+    vertices[i3 + 2] = sz + ndz; //dz * fact;		    
+  }
+		
+  e->data = dGeomTriMeshDataCreate();
+  dGeomTriMeshDataBuildDouble(e->data, vertices, sizeof(double) * 3, mesh->vertexCount, e->indices, icount, sizeof(dTriIndex) * 3);
+  e->n_vertices = mesh->vertexCount;
+  e->n_indices = icount;
+  return e;
+}
+
 void collision_space::EnvironmentModelODE::updateGeom(dGeomID geom,  const tf::Transform &pose) const
 {
   tf::Vector3 pos = pose.getOrigin();
@@ -366,6 +402,12 @@ void collision_space::EnvironmentModelODE::updateAttachedBodies(const std::map<s
       for(unsigned int k = 0; k < lg->att_bodies[j]->padded_geom.size(); k++) {
         geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
       }
+      const std::list<PaddedGeomVariant>& variants = lg->att_bodies[j]->padded_variants;
+      for(std::list<PaddedGeomVariant>::const_iterator it = variants.begin(); it != variants.end(); it++) {
+        for(unsigned int k = 0; k < it->geoms.size(); k++) {
+          geom_lookup_map_.erase(it->geoms[k]);
+        }
+      }
     }
     lg->deleteAttachedBodies();
 
@@ -390,6 +432,7 @@ void collision_space::EnvironmentModelODE::addAttachedBody(LinkGeom* lg,
 
   AttGeom* attg = new AttGeom(model_geom_.storage);
   attg->att = attm;
+  attg->padding = padd;
 
   if(!default_collision_matrix_.addEntry(attm->getName(), false)) {
     ROS_WARN_STREAM("Must already have an entry in allowed collision matrix for " << attm->getName());
@@ -435,15 +478,10 @@ void collision_space::EnvironmentModelODE::setAttachedBodiesLinkPadding() {
         new_padd = altered_link_padding_map_.find("attached")->second;
       }
       if(new_padd != -1.0) {
-        for(unsigned int k = 0; k < attached_bodies[j]->getShapes().size(); k++) {
-          geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
-          dGeomDestroy(lg->att_bodies[j]->padded_geom[k]);
-          model_geom_.storage.remove(lg->att_bodies[j]->padded_geom[k]);
-          dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
-          assert(padd_ga);
-          lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
-        }
+        AttGeom *attg = lg->att_bodies[j];
+        std::vector<const shapes::Shape*> shapes(attached_bodies[j]->getShapes().begin(), attached_bodies[j]->getShapes().end());
+        swapPaddedGeoms(attg->padded_geom, attg->padding, attg->padded_variants, shapes,
+                        new_padd, attached_bodies[j]->getName(), ATTACHED);
       }
     }
   }
@@ -456,21 +494,20 @@ void collision_space::EnvironmentModelODE::revertAttachedBodiesLinkPadding() {
     const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_bodies = lg->link->getAttachedBodyModels();
     for (unsigned int j = 0 ; j < attached_bodies.size(); ++j) {
       double new_padd = -1.0;
-      if(altered_link_padding_map_.find(attached_bodies[j]->getName()) != altered_link_padding_map_.end()) {
-        new_padd = default_link_padding_map_.find(attached_bodies[j]->getName())->second;
-      } else if (altered_link_padding_map_.find("attached") != altered_link_padding_map_.end()) {
-        new_padd = default_link_padding_map_.find("attached")->second;
+      if(altered_link_padding_map_.find(attached_bodies[j]->getName()) != altered_link_padding_map_.end() ||
+         altered_link_padding_map_.find("attached") != altered_link_padding_map_.end()) {
+        new_padd = default_robot_padding_;
+        if(default_link_padding_map_.find(attached_bodies[j]->getName()) != default_link_padding_map_.end()) {
+          new_padd = default_link_padding_map_.find(attached_bodies[j]->getName())->second;
+        } else if (default_link_padding_map_.find("attached") != default_link_padding_map_.end()) {
+          new_padd = default_link_padding_map_.find("attached")->second;
+        }
       }
       if(new_padd != -1.0) {
-        for(unsigned int k = 0; k < attached_bodies[j]->getShapes().size(); k++) {
-          geom_lookup_map_.erase(lg->att_bodies[j]->padded_geom[k]);
-          dGeomDestroy(lg->att_bodies[j]->padded_geom[k]);
-          model_geom_.storage.remove(lg->att_bodies[j]->padded_geom[k]);
-          dGeomID padd_ga = createODEGeom(model_geom_.env_space, model_geom_.storage, attached_bodies[j]->getShapes()[k], robot_scale_, new_padd);
-          assert(padd_ga);
-          lg->att_bodies[j]->padded_geom[k] = padd_ga;
-          geom_lookup_map_[padd_ga] = std::pair<std::string, BodyType>(attached_bodies[j]->getName(), ATTACHED);
-        }
+        AttGeom *attg = lg->att_bodies[j];
+        std::vector<const shapes::Shape*> shapes(attached_bodies[j]->getShapes().begin(), attached_bodies[j]->getShapes().end());
+        swapPaddedGeoms(attg->padded_geom, attg->padding, attg->padded_variants, shapes,
+                        new_padd, attached_bodies[j]->getName(), ATTACHED);
       }
     }
   }
@@ -515,19 +552,11 @@ void collision_space::EnvironmentModelODE::setAlteredLinkPadding(const std::map<
         continue;
       }
       ROS_DEBUG_STREAM("Setting padding for link " << lg->link->getName() << " from " 
-                       << default_link_padding_map_[lg->link->getName()] 
+                       << lg->padding
                        << " to " << new_padding);
-      //otherwise we clear out the data associated with the old one
-      for (unsigned int j = 0 ; j < lg->padded_geom.size() ; ++j) {
-        geom_lookup_map_.erase(lg->padded_geom[j]);
-        dGeomDestroy(lg->padded_geom[j]);
-        model_geom_.storage.remove(lg->padded_geom[j]);
-      }
-      lg->padded_geom.clear();
-      dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, new_padding);
-      assert(g);
-      lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      swapPaddedGeoms(lg->padded_geom, lg->padding, lg->padded_variants,
+                      std::vector<const shapes::Shape*>(1, link->getLinkShape()),
+                      new_padding, link->getName(), LINK);
     }
   }
   //this does all the work
@@ -540,26 +569,20 @@ void collision_space::EnvironmentModelODE::revertAlteredLinkPadding() {
     LinkGeom *lg = model_geom_.link_geom[i];
 
     if(altered_link_padding_map_.find(lg->link->getName()) != altered_link_padding_map_.end()) {
-      double old_padding = default_link_padding_map_.find(lg->link->getName())->second;
+      double old_padding = default_robot_padding_;
+      if(default_link_padding_map_.find(lg->link->getName()) != default_link_padding_map_.end()) {
+        old_padding = default_link_padding_map_.find(lg->link->getName())->second;
+      }
       const planning_models::KinematicModel::LinkModel *link = lg->link;
       if (!link || !link->getLinkShape()) {
         ROS_WARN_STREAM("Can't get kinematic model for link " << link->getName() << " to revert to old padding");
         continue;
       }
-      //otherwise we clear out the data associated with the old one
-      for (unsigned int j = 0 ; j < lg->padded_geom.size() ; ++j) {
-        geom_lookup_map_.erase(lg->padded_geom[j]);
-        dGeomDestroy(lg->padded_geom[j]);
-        model_geom_.storage.remove(lg->padded_geom[j]);
-      }
       ROS_DEBUG_STREAM("Reverting padding for link " << lg->link->getName() << " from " << altered_link_padding_map_[lg->link->getName()]
                       << " to " << old_padding);
-      lg->padded_geom.clear();
-      dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, link->getLinkShape(), robot_scale_, old_padding);
-      assert(g);
-      dGeomSetData(g, reinterpret_cast<void*>(lg));
-      lg->padded_geom.push_back(g);
-      geom_lookup_map_[g] = std::pair<std::string, BodyType>(link->getName(), LINK);
+      swapPaddedGeoms(lg->padded_geom, lg->padding, lg->padded_variants,
+                      std::vector<const shapes::Shape*>(1, link->getLinkShape()),
+                      old_padding, link->getName(), LINK);
     }
   }
   revertAttachedBodiesLinkPadding();
@@ -568,6 +591,68 @@ void collision_space::EnvironmentModelODE::revertAlteredLinkPadding() {
   collision_space::EnvironmentModel::revertAlteredLinkPadding();
 } 
 
+void collision_space::EnvironmentModelODE::swapPaddedGeoms(std::vector<dGeomID>& padded_geom, double& active_padding,
+                                                           std::list<PaddedGeomVariant>& variants,
+                                                           const std::vector<const shapes::Shape*>& shapes,
+                                                           double padding, const std::string& name, BodyType type)
+{
+  if(padding == active_padding && padded_geom.size() == shapes.size()) {
+    return;
+  }
+
+  //the active geoms become the most recently used variant; they stay
+  //in the lookup map so that restoring them later needs no changes there
+  variants.push_front(PaddedGeomVariant());
+  variants.front().padding = active_padding;
+  variants.front().geoms.swap(padded_geom);
+  const std::vector<dGeomID>& old_geoms = variants.front().geoms;
+  for(unsigned int i = 0; i < old_geoms.size(); i++) {
+    dSpaceRemove(model_geom_.env_space, old_geoms[i]);
+  }
+
+  std::list<PaddedGeomVariant>::iterator it = variants.begin();
+  for(++it; it != variants.end(); ++it) {
+    if(it->padding == padding && it->geoms.size() == shapes.size()) {
+      break;
+    }
+  }
+  if(it != variants.end()) {
+    padded_geom.swap(it->geoms);
+    variants.erase(it);
+    for(unsigned int i = 0; i < padded_geom.size(); i++) {
+      dSpaceAdd(model_geom_.env_space, padded_geom[i]);
+    }
+  } else {
+    padded_geom.reserve(shapes.size());
+    for(unsigned int i = 0; i < shapes.size(); i++) {
+      dGeomID g = createODEGeom(model_geom_.env_space, model_geom_.storage, shapes[i], robot_scale_, padding);
+      assert(g);
+      padded_geom.push_back(g);
+      geom_lookup_map_[g] = std::pair<std::string, BodyType>(name, type);
+    }
+  }
+  active_padding = padding;
+
+  //carry over the current pose so the swap is transparent until the next update
+  for(unsigned int i = 0; i < padded_geom.size() && i < old_geoms.size(); i++) {
+    const dReal *pos = dGeomGetPosition(old_geoms[i]);
+    dGeomSetPosition(padded_geom[i], pos[0], pos[1], pos[2]);
+    dQuaternion q;
+    dGeomGetQuaternion(old_geoms[i], q);
+    dGeomSetQuaternion(padded_geom[i], q);
+  }
+
+  while(variants.size() > MAX_PADDED_VARIANTS) {
+    std::vector<dGeomID>& geoms = variants.back().geoms;
+    for(unsigned int i = 0; i < geoms.size(); i++) {
+      geom_lookup_map_.erase(geoms[i]);
+      dGeomDestroy(geoms[i]);
+      model_geom_.storage.remove(geoms[i]);
+    }
+    variants.pop_back();
+  }
+}
+
 bool collision_space::EnvironmentModelODE::ODECollide2::empty(void) const
 {
   return geoms_x.empty();
@@ -1078,6 +1163,330 @@ bool collision_space::EnvironmentModelODE::getAllObjectEnvironmentCollisionConta
   return cdata.collides;
 }
 
+static bool isDistanceRequired(const collision_space::EnvironmentModel::AllowedCollisionMatrix &acm,
+                               const std::string &name1, const std::string &name2)
+{
+  bool allowed;
+  if (!acm.getAllowedCollision(name1, name2, allowed)) {
+    ROS_DEBUG_STREAM("No entry in allowed collision matrix for " << name1 << " and " << name2);
+    return false;
+  }
+  return !allowed;
+}
+
+static double getClearanceBound(const std::map<std::string, collision_space::EnvironmentModel::DistanceResult> &clearances,
+                                const std::string &name, double max_distance)
+{
+  std::map<std::string, collision_space::EnvironmentModel::DistanceResult>::const_iterator it = clearances.find(name);
+  if (it == clearances.end())
+    return max_distance;
+  return std::min(max_distance, it->second.distance);
+}
+
+static void swapDistanceBodies(collision_space::EnvironmentModel::DistanceResult &result)
+{
+  std::swap(result.point_1, result.point_2);
+  std::swap(result.body_name_1, result.body_name_2);
+  std::swap(result.body_type_1, result.body_type_2);
+}
+
+bool collision_space::EnvironmentModelODE::getDistanceBody(dGeomID geom, const ODEStorage &storage, const std::string &name, BodyType type, DistanceBody &body) const
+{
+  body.geom = geom;
+  body.name = name;
+  body.type = type;
+  body.plane = false;
+
+  int geom_class = dGeomGetClass(geom);
+  if (geom_class == dPlaneClass) {
+    body.plane = true;
+    dGeomPlaneGetParams(geom, body.plane_params);
+    return true;
+  }
+
+  dGeomGetAABB(geom, body.aabb);
+  const dReal *pos = dGeomGetPosition(geom);
+  const dReal *rot = dGeomGetRotation(geom);
+  body.convex.pose.setOrigin(tf::Vector3(pos[0], pos[1], pos[2]));
+  body.convex.pose.setBasis(tf::Matrix3x3(rot[0], rot[1], rot[2],
+                                          rot[4], rot[5], rot[6],
+                                          rot[8], rot[9], rot[10]));
+  switch (geom_class)
+  {
+  case dSphereClass:
+    body.convex.type = ConvexBody::SPHERE;
+    body.convex.dims[0] = dGeomSphereGetRadius(geom);
+    break;
+  case dBoxClass:
+    {
+      dVector3 lengths;
+      dGeomBoxGetLengths(geom, lengths);
+      body.convex.type = ConvexBody::BOX;
+      body.convex.dims[0] = lengths[0] / 2.0;
+      body.convex.dims[1] = lengths[1] / 2.0;
+      body.convex.dims[2] = lengths[2] / 2.0;
+    }
+    break;
+  case dCylinderClass:
+    {
+      dReal radius, length;
+      dGeomCylinderGetParams(geom, &radius, &length);
+      body.convex.type = ConvexBody::CYLINDER;
+      body.convex.dims[0] = radius;
+      body.convex.dims[1] = length / 2.0;
+    }
+    break;
+  case dTriMeshClass:
+    {
+      std::map<dGeomID, ODEStorage::ElementPtr>::const_iterator it = storage.meshes.find(geom);
+      if (it == storage.meshes.end()) {
+        ROS_WARN_STREAM("No mesh data stored for a geom of " << name);
+        return false;
+      }
+      body.convex.type = ConvexBody::POINTS;
+      body.convex.vertices = it->second->vertices;
+      body.convex.vertex_count = it->second->n_vertices;
+    }
+    break;
+  default:
+    ROS_DEBUG_STREAM("Geom class " << geom_class << " of " << name << " is not supported for distance queries");
+    return false;
+  }
+  return true;
+}
+
+void collision_space::EnvironmentModelODE::getRobotDistanceBodies(std::vector<DistanceBody> &bodies, bool padded) const
+{
+  bodies.clear();
+  for (unsigned int i = 0 ; i < model_geom_.link_geom.size() ; ++i) {
+    const LinkGeom *lg = model_geom_.link_geom[i];
+    const std::vector<dGeomID> &geoms = padded ? lg->padded_geom : lg->geom;
+    for (unsigned int j = 0 ; j < geoms.size() ; ++j) {
+      bodies.resize(bodies.size() + 1);
+      if (!getDistanceBody(geoms[j], model_geom_.storage, lg->link->getName(), LINK, bodies.back()))
+        bodies.pop_back();
+    }
+    for (unsigned int j = 0 ; j < lg->att_bodies.size() ; ++j) {
+      const AttGeom *ag = lg->att_bodies[j];
+      const std::vector<dGeomID> &att_geoms = padded ? ag->padded_geom : ag->geom;
+      for (unsigned int k = 0 ; k < att_geoms.size() ; ++k) {
+        bodies.resize(bodies.size() + 1);
+        if (!getDistanceBody(att_geoms[k], model_geom_.storage, ag->att->getName(), ATTACHED, bodies.back()))
+          bodies.pop_back();
+      }
+    }
+  }
+}
+
+void collision_space::EnvironmentModelODE::getNamespaceDistanceBodies(const CollisionNamespace *cn, std::vector<DistanceBody> &bodies) const
+{
+  int n = dSpaceGetNumGeoms(cn->space);
+  for (int i = 0 ; i < n ; ++i) {
+    bodies.resize(bodies.size() + 1);
+    if (!getDistanceBody(dSpaceGetGeom(cn->space, i), cn->storage, cn->name, OBJECT, bodies.back()))
+      bodies.pop_back();
+  }
+}
+
+void collision_space::EnvironmentModelODE::getObjectDistanceBodies(std::vector<DistanceBody> &bodies) const
+{
+  bodies.clear();
+  for (std::map<std::string, CollisionNamespace*>::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() ; ++it)
+    getNamespaceDistanceBodies(it->second, bodies);
+}
+
+bool collision_space::EnvironmentModelODE::computeBodyDistance(const DistanceBody &b1, const DistanceBody &b2, double bound, DistanceResult &result) const
+{
+  if (b1.plane && b2.plane)
+    return false;
+
+  result.body_name_1 = b1.name;
+  result.body_type_1 = b1.type;
+  result.body_name_2 = b2.name;
+  result.body_type_2 = b2.type;
+
+  // planes are half-spaces; the closest point of the body is its support point against the normal
+  if (b1.plane || b2.plane) {
+    const DistanceBody &p = b1.plane ? b1 : b2;
+    const DistanceBody &o = b1.plane ? b2 : b1;
+    tf::Vector3 normal(p.plane_params[0], p.plane_params[1], p.plane_params[2]);
+    tf::Vector3 closest = o.convex.support(-normal);
+    result.distance = normal.dot(closest) - p.plane_params[3];
+    tf::Vector3 on_plane = closest - normal * result.distance;
+    result.point_1 = b1.plane ? on_plane : closest;
+    result.point_2 = b1.plane ? closest : on_plane;
+    return true;
+  }
+
+  // the distance between the bounding boxes is a lower bound on the distance between the bodies
+  double lower_bound = 0.0;
+  for (unsigned int i = 0 ; i < 3 ; ++i) {
+    double gap = std::max(b1.aabb[2 * i] - b2.aabb[2 * i + 1], b2.aabb[2 * i] - b1.aabb[2 * i + 1]);
+    if (gap > 0.0)
+      lower_bound += gap * gap;
+  }
+  if (lower_bound > 0.0 && sqrt(lower_bound) >= bound)
+    return false;
+
+  result.distance = computeConvexDistance(b1.convex, b2.convex, result.point_1, result.point_2);
+  if (result.distance > 0.0)
+    return true;
+
+  // the bodies overlap; ODE's contacts give the penetration depth
+  dContactGeom contacts[MAX_ODE_CONTACTS];
+  int num_contacts = dCollide(b1.geom, b2.geom, MAX_ODE_CONTACTS, contacts, sizeof(dContactGeom));
+  for (int i = 0 ; i < num_contacts ; ++i) {
+    if (-contacts[i].depth < result.distance) {
+      result.distance = -contacts[i].depth;
+      result.point_1 = result.point_2 = tf::Vector3(contacts[i].pos[0], contacts[i].pos[1], contacts[i].pos[2]);
+    }
+  }
+  return true;
+}
+
+bool collision_space::EnvironmentModelODE::getClearance(DistanceResult &result, double max_distance, bool include_self) const
+{
+  checkThreadInit();
+  const AllowedCollisionMatrix &acm = getCurrentAllowedCollisionMatrix();
+  double best = max_distance;
+  bool found = false;
+  DistanceResult current;
+
+  std::vector<DistanceBody> robot;
+  std::vector<DistanceBody> objects;
+  getRobotDistanceBodies(robot, true);
+  getObjectDistanceBodies(objects);
+
+  for (unsigned int i = 0 ; i < robot.size() ; ++i) {
+    //objects are grouped by namespace, so the matrix only needs to be consulted when the namespace changes
+    const std::string *last_name = NULL;
+    bool required = false;
+    for (unsigned int j = 0 ; j < objects.size() ; ++j) {
+      if (!last_name || *last_name != objects[j].name) {
+        last_name = &objects[j].name;
+        required = isDistanceRequired(acm, objects[j].name, robot[i].name);
+      }
+      if (!required || !computeBodyDistance(robot[i], objects[j], best, current) || current.distance >= best)
+        continue;
+      best = current.distance;
+      result = current;
+      found = true;
+      if (best <= 0.0)
+        return true;
+    }
+  }
+
+  if (!include_self)
+    return found;
+
+  getRobotDistanceBodies(robot, false);
+  for (unsigned int i = 0 ; i < robot.size() ; ++i) {
+    for (unsigned int j = i + 1 ; j < robot.size() ; ++j) {
+      if (robot[i].name == robot[j].name || !isDistanceRequired(acm, robot[i].name, robot[j].name))
+        continue;
+      if (!computeBodyDistance(robot[i], robot[j], best, current) || current.distance >= best)
+        continue;
+      best = current.distance;
+      result = current;
+      found = true;
+      if (best <= 0.0)
+        return true;
+    }
+  }
+  return found;
+}
+
+void collision_space::EnvironmentModelODE::getLinkClearances(std::map<std::string, DistanceResult> &clearances, double max_distance, bool include_self) const
+{
+  clearances.clear();
+  checkThreadInit();
+  const AllowedCollisionMatrix &acm = getCurrentAllowedCollisionMatrix();
+  DistanceResult current;
+
+  std::vector<DistanceBody> robot;
+  std::vector<DistanceBody> objects;
+  getRobotDistanceBodies(robot, true);
+  getObjectDistanceBodies(objects);
+
+  for (unsigned int i = 0 ; i < robot.size() ; ++i) {
+    double best = getClearanceBound(clearances, robot[i].name, max_distance);
+    const std::string *last_name = NULL;
+    bool required = false;
+    for (unsigned int j = 0 ; j < objects.size() ; ++j) {
+      if (!last_name || *last_name != objects[j].name) {
+        last_name = &objects[j].name;
+        required = isDistanceRequired(acm, objects[j].name, robot[i].name);
+      }
+      if (!required || !computeBodyDistance(robot[i], objects[j], best, current) || current.distance >= best)
+        continue;
+      best = current.distance;
+      clearances[robot[i].name] = current;
+    }
+  }
+
+  if (!include_self)
+    return;
+
+  getRobotDistanceBodies(robot, false);
+  for (unsigned int i = 0 ; i < robot.size() ; ++i) {
+    for (unsigned int j = i + 1 ; j < robot.size() ; ++j) {
+      if (robot[i].name == robot[j].name || !isDistanceRequired(acm, robot[i].name, robot[j].name))
+        continue;
+      double best_i = getClearanceBound(clearances, robot[i].name, max_distance);
+      double best_j = getClearanceBound(clearances, robot[j].name, max_distance);
+      if (!computeBodyDistance(robot[i], robot[j], std::max(best_i, best_j), current))
+        continue;
+      if (current.distance < best_i)
+        clearances[robot[i].name] = current;
+      if (current.distance < best_j) {
+        swapDistanceBodies(current);
+        clearances[robot[j].name] = current;
+      }
+    }
+  }
+}
+
+bool collision_space::EnvironmentModelODE::getPairDistance(const std::string &name1, const std::string &name2, DistanceResult &result) const
+{
+  checkThreadInit();
+  std::map<std::string, CollisionNamespace*>::const_iterator it1 = coll_namespaces_.find(name1);
+  std::map<std::string, CollisionNamespace*>::const_iterator it2 = coll_namespaces_.find(name2);
+
+  //objects are checked against padded robot bodies, the robot against itself unpadded
+  std::vector<DistanceBody> robot;
+  if (it1 == coll_namespaces_.end() || it2 == coll_namespaces_.end())
+    getRobotDistanceBodies(robot, it1 != coll_namespaces_.end() || it2 != coll_namespaces_.end());
+
+  std::vector<DistanceBody> bodies1;
+  std::vector<DistanceBody> bodies2;
+  if (it1 != coll_namespaces_.end())
+    getNamespaceDistanceBodies(it1->second, bodies1);
+  if (it2 != coll_namespaces_.end())
+    getNamespaceDistanceBodies(it2->second, bodies2);
+  for (unsigned int i = 0 ; i < robot.size() ; ++i) {
+    if (it1 == coll_namespaces_.end() && robot[i].name == name1)
+      bodies1.push_back(robot[i]);
+    if (it2 == coll_namespaces_.end() && robot[i].name == name2)
+      bodies2.push_back(robot[i]);
+  }
+  if (bodies1.empty() || bodies2.empty()) {
+    ROS_WARN_STREAM("No geometry to compute the distance between " << name1 << " and " << name2);
+    return false;
+  }
+
+  double best = std::numeric_limits<double>::infinity();
+  DistanceResult current;
+  for (unsigned int i = 0 ; i < bodies1.size() ; ++i) {
+    for (unsigned int j = 0 ; j < bodies2.size() ; ++j) {
+      if (!computeBodyDistance(bodies1[i], bodies2[j], best, current) || current.distance >= best)
+        continue;
+      best = current.distance;
+      result = current;
+    }
+  }
+  return best < std::numeric_limits<double>::infinity();
+}
+
 void collision_space::EnvironmentModelODE::testObjectEnvironmentCollision(CollisionData *cdata, const std::string& object_name) const {
   /* check collision with other ode bodies until done*/
   for (std::map<std::string, CollisionNamespace*>::const_iterator it = coll_namespaces_.begin() ; it != coll_namespaces_.end() && !cdata->done ; ++it) {
@@ -1377,27 +1786,11 @@ dGeomID collision_space::EnvironmentModelODE::copyGeom(dSpaceID space, ODEStorag
     break;
   case dTriMeshClass:
     {
-      dTriMeshDataID tdata = dGeomTriMeshGetData(geom);
-      dTriMeshDataID cdata = dGeomTriMeshDataCreate();
-      for(std::map<dGeomID, ODEStorage::Element>::const_iterator it = sourceStorage.meshes.begin();
-          it != sourceStorage.meshes.end();
-          it++) {
-        if (it->second.data == tdata)
-        {
-          ODEStorage::Element& e = storage.meshes[geom];
-          e.n_vertices = it->second.n_vertices;
-          e.n_indices = it->second.n_indices;
-          e.indices = new dTriIndex[e.n_indices];
-          for (int j = 0 ; j < e.n_indices ; ++j)
-            e.indices[j] = it->second.indices[j];
-          e.vertices = new double[e.n_vertices];
-          for (int j = 0 ; j < e.n_vertices ; ++j)
-            e.vertices[j] = e.vertices[j];
-          dGeomTriMeshDataBuildDouble(cdata, e.vertices, sizeof(double) * 3, e.n_vertices, e.indices, e.n_indices, sizeof(dTriIndex) * 3);
-          e.data = cdata;
-          break;
-        }
-        ng = dCreateTriMesh(space, cdata, NULL, NULL, NULL);
+      // the copy shares the trimesh data of the original
+      std::map<dGeomID, ODEStorage::ElementPtr>::const_iterator it = sourceStorage.meshes.find(geom);
+      if (it != sourceStorage.meshes.end()) {
+        ng = dCreateTriMesh(space, it->second->data, NULL, NULL, NULL);
+        storage.meshes[ng] = it->second;
       }
     }
     break;
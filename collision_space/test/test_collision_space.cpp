@@ -41,6 +41,7 @@
 #include <ctype.h>
 #include <ros/package.h>
 #include <collision_space/environmentODE.h>
+#include <geometric_shapes/shape_operations.h>
 #include <boost/thread.hpp>
 
 //urdf location relative to the planning_models path
@@ -455,6 +456,85 @@ TEST_F(TestCollisionSpace, TestStaticObjects)
 
 }
 
+TEST_F(TestCollisionSpace, TestDistance)
+{
+  std::vector<std::string> links;
+  kinematic_model_->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+  
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space_->setRobotModel(kinematic_model_, acm, link_padding_map);  
+  
+  {
+    planning_models::KinematicState state(kinematic_model_);
+    state.setKinematicStateToDefault();
+    
+    coll_space_->updateRobotModel(&state);
+  }
+
+  collision_space::EnvironmentModel::DistanceResult result;
+
+  //nothing in the environment
+  EXPECT_FALSE(coll_space_->getClearance(result, 10.0, false));
+
+  shapes::Sphere* sphere1 = new shapes::Sphere();
+  sphere1->radius = .2;
+
+  tf::Transform pose;
+  pose.setIdentity();
+  pose.setOrigin(tf::Vector3(5.0, 0.0, 0.0));
+  coll_space_->addObject("obj1", sphere1, pose);
+
+  //too far away for the threshold
+  EXPECT_FALSE(coll_space_->getClearance(result, 1.0, false));
+
+  ASSERT_TRUE(coll_space_->getClearance(result, 10.0, false));
+  EXPECT_GT(result.distance, 0.0);
+  EXPECT_LT(result.distance, 5.0);
+  EXPECT_EQ(result.body_name_2, "obj1");
+  EXPECT_EQ(result.body_type_2, collision_space::EnvironmentModel::OBJECT);
+  EXPECT_NEAR(result.point_1.distance(result.point_2), result.distance, 1e-4);
+  //the witness point lies on the sphere
+  EXPECT_NEAR(result.point_2.distance(pose.getOrigin()), .2, 1e-4);
+
+  //the global minimum is the minimum over the links
+  std::map<std::string, collision_space::EnvironmentModel::DistanceResult> clearances;
+  coll_space_->getLinkClearances(clearances, 10.0, false);
+  ASSERT_TRUE(clearances.find(result.body_name_1) != clearances.end());
+  for(std::map<std::string, collision_space::EnvironmentModel::DistanceResult>::iterator it = clearances.begin();
+      it != clearances.end();
+      it++) {
+    EXPECT_GE(it->second.distance, result.distance - 1e-9);
+  }
+  EXPECT_NEAR(clearances[result.body_name_1].distance, result.distance, 1e-9);
+
+  collision_space::EnvironmentModel::DistanceResult pair_result;
+  ASSERT_TRUE(coll_space_->getPairDistance(result.body_name_1, "obj1", pair_result));
+  EXPECT_NEAR(pair_result.distance, result.distance, 1e-9);
+  EXPECT_FALSE(coll_space_->getPairDistance("no_such_body", "obj1", pair_result));
+
+  //allowing the collision removes the pair from the query
+  acm = coll_space_->getDefaultAllowedCollisionMatrix();
+  ASSERT_TRUE(acm.changeEntry(result.body_name_1, "obj1", true));
+  coll_space_->setAlteredCollisionMatrix(acm);
+  collision_space::EnvironmentModel::DistanceResult allowed_result;
+  if(coll_space_->getClearance(allowed_result, 10.0, false)) {
+    EXPECT_GE(allowed_result.distance, result.distance);
+    EXPECT_NE(allowed_result.body_name_1, result.body_name_1);
+  }
+  coll_space_->revertAlteredCollisionMatrix();
+
+  //in collision the distance is a penetration depth
+  coll_space_->clearObjects("obj1");
+  shapes::Sphere* sphere2 = new shapes::Sphere();
+  sphere2->radius = .2;
+  pose.setOrigin(tf::Vector3(0.0, 0.0, 0.0));
+  coll_space_->addObject("obj1", sphere2, pose);
+  ASSERT_TRUE(coll_space_->isEnvironmentCollision());
+  ASSERT_TRUE(coll_space_->getClearance(result, 10.0, false));
+  EXPECT_LE(result.distance, 0.0);
+}
+
 TEST_F(TestCollisionSpace, TestAllowedContacts)
 {
   std::vector<std::string> links;
@@ -561,6 +641,117 @@ TEST_F(TestCollisionSpace, TestAllowedContacts)
   coll_space_->clearAllowedContacts();
 }
 
+static shapes::Mesh* createCubeMesh(double size)
+{
+  std::vector<tf::Vector3> vertices;
+  for(unsigned int i = 0; i < 8; i++) {
+    vertices.push_back(tf::Vector3(i & 1 ? size / 2.0 : -size / 2.0,
+                                   i & 2 ? size / 2.0 : -size / 2.0,
+                                   i & 4 ? size / 2.0 : -size / 2.0));
+  }
+  unsigned int t[] = { 0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+                       0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+                       0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5 };
+  std::vector<unsigned int> triangles(t, t + 36);
+  return shapes::createMeshFromVertices(vertices, triangles);
+}
+
+TEST_F(TestCollisionSpace, TestSharedMeshObjects)
+{
+  std::vector<std::string> links;
+  kinematic_model_->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+  
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space_->setRobotModel(kinematic_model_, acm, link_padding_map);  
+  
+  {
+    planning_models::KinematicState state(kinematic_model_);
+    state.setKinematicStateToDefault();
+    
+    coll_space_->updateRobotModel(&state);
+  }
+
+  //identical meshes share their trimesh data
+  tf::Transform pose;
+  pose.setIdentity();
+  coll_space_->addObject("obj1", createCubeMesh(.2), pose);
+  ASSERT_TRUE(coll_space_->isEnvironmentCollision());
+
+  pose.setOrigin(tf::Vector3(5.0, 0.0, 0.0));
+  coll_space_->addObject("obj2", createCubeMesh(.2), pose);
+  pose.setOrigin(tf::Vector3(5.05, 0.0, 0.0));
+  coll_space_->addObject("obj3", createCubeMesh(.2), pose);
+  EXPECT_FALSE(coll_space_->isObjectObjectCollision("obj1", "obj2"));
+  EXPECT_TRUE(coll_space_->isObjectObjectCollision("obj2", "obj3"));
+
+  //the data outlives the objects that are removed
+  coll_space_->clearObjects("obj1");
+  EXPECT_FALSE(coll_space_->isEnvironmentCollision());
+  EXPECT_TRUE(coll_space_->isObjectObjectCollision("obj2", "obj3"));
+
+  //and is shared with clones
+  collision_space::EnvironmentModel* clone = coll_space_->clone();
+  coll_space_->clearObjects("obj2");
+  EXPECT_TRUE(clone->isObjectObjectCollision("obj2", "obj3"));
+  delete clone;
+}
+
+TEST_F(TestCollisionSpace, TestAlteredLinkPadding)
+{
+  std::vector<std::string> links;
+  kinematic_model_->getLinkModelNames(links);
+  std::map<std::string, double> link_padding_map;
+  
+  collision_space::EnvironmentModel::AllowedCollisionMatrix acm(links, false);
+  coll_space_->setRobotModel(kinematic_model_, acm, link_padding_map);  
+  
+  {
+    planning_models::KinematicState state(kinematic_model_);
+    state.setKinematicStateToDefault();
+    
+    coll_space_->updateRobotModel(&state);
+  }
+
+  shapes::Sphere* sphere = new shapes::Sphere();
+  sphere->radius = .05;
+  tf::Transform pose;
+  pose.setIdentity();
+  pose.setOrigin(tf::Vector3(-1.2, 0.0, 0.1));
+  coll_space_->addObject("obj1", sphere, pose);
+  ASSERT_FALSE(coll_space_->isEnvironmentCollision());
+
+  std::map<std::string, double> large_padding;
+  large_padding["base_link"] = 1.0;
+  std::map<std::string, double> small_padding;
+  small_padding["base_link"] = .5;
+
+  //switching back and forth between paddings reuses the padded geoms,
+  //which must behave the same as freshly created ones
+  for(unsigned int i = 0; i < 3; i++) {
+    coll_space_->setAlteredLinkPadding(large_padding);
+    EXPECT_TRUE(coll_space_->isEnvironmentCollision());
+    coll_space_->revertAlteredLinkPadding();
+    EXPECT_FALSE(coll_space_->isEnvironmentCollision());
+    coll_space_->setAlteredLinkPadding(small_padding);
+    EXPECT_FALSE(coll_space_->isEnvironmentCollision());
+    coll_space_->revertAlteredLinkPadding();
+  }
+
+  //more paddings than are cached
+  for(unsigned int i = 0; i < 6; i++) {
+    std::map<std::string, double> padding;
+    padding["base_link"] = .4 + i * .05;
+    coll_space_->setAlteredLinkPadding(padding);
+    EXPECT_FALSE(coll_space_->isEnvironmentCollision());
+    coll_space_->revertAlteredLinkPadding();
+  }
+  EXPECT_FALSE(coll_space_->isEnvironmentCollision());
+  coll_space_->setAlteredLinkPadding(large_padding);
+  EXPECT_TRUE(coll_space_->isEnvironmentCollision());
+  coll_space_->revertAlteredLinkPadding();
+}
+
 TEST_F(TestCollisionSpace, TestThreading)
 {
   boost::thread thread1(boost::bind(&TestCollisionSpace::spinThread, this));
@@ -51,13 +51,17 @@ public:
 	Trajectory(const std::list<Eigen::VectorXd> &path, const Eigen::VectorXd &maxVelocity, const Eigen::VectorXd &maxAcceleration, double minWayPointSeparation = 0.0);
 	Eigen::VectorXd getPosition(double time) const;
 	Eigen::VectorXd getVelocity(double time) const;
+	Eigen::VectorXd getAcceleration(double time) const;
 	double getDuration() const;
 private:
+	unsigned int getSegment(double &t) const;
+
 	std::vector<Eigen::VectorXd> path;
 	std::vector<Eigen::VectorXd> velocities;
 	std::vector<Eigen::VectorXd> accelerations;
 	std::vector<double> durations;
 	std::vector<double> blendDurations;
+	std::vector<double> segmentEndTimes;
 	double duration;
 };
 
@@ -43,6 +43,8 @@
 #include <spline_smoother/cubic_trajectory.h>
 #include <planning_environment/models/collision_models_interface.h>
 #include <planning_environment/models/model_utils.h>
+#include <constraint_aware_spline_smoother/segment_validity_cache.h>
+#include <boost/bind.hpp>
 #include <arm_navigation_msgs/RobotState.h>
 #include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
 #include <trajectory_msgs/JointTrajectoryPoint.h>
@@ -105,6 +107,13 @@ private:
 
   void refineTrajectory(T &trajectory) const;
 
+  /**
+   * \brief Check the goal constraints against the last point of a trajectory only
+   */
+  bool isGoalValid(const trajectory_msgs::JointTrajectory &trajectory,
+                   const arm_navigation_msgs::Constraints &goal_constraints,
+                   arm_navigation_msgs::ArmNavigationErrorCodes &error_code) const;
+
 };
 
 template <typename T>
@@ -176,7 +185,11 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   arm_navigation_msgs::RobotState robot_state;
   spline_smoother::CubicTrajectory trajectory_solver;
   spline_smoother::SplineTrajectory spline, shortcut_spline;
-  arm_navigation_msgs::JointTrajectoryWithLimits shortcut, discretized_trajectory;
+  arm_navigation_msgs::JointTrajectoryWithLimits shortcut;
+  SegmentValidityCache validity_cache;
+  SegmentDiscretizer discretize = boost::bind(&CubicSplineShortCutter<T>::discretizeAndAppendSegment,this,
+                                              _1,discretization,_2,ros::Duration(0.0),true);
+  const std::vector<std::string> &joint_names = trajectory_in.request.trajectory.joint_names;
 
   trajectory_out.request = trajectory_in.request;
 
@@ -203,9 +216,6 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   shortcut.limits = trajectory_in.request.limits;
   shortcut.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
 
-  discretized_trajectory.limits = trajectory_in.request.limits;
-  discretized_trajectory.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
-
   ros::Time start_time = ros::Time::now();
   ros::Duration timeout = trajectory_in.request.allowed_time;
 
@@ -233,19 +243,13 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
     ROS_DEBUG_STREAM("Originally sampled trajectory ok");
   }
   
-  T test_traj = trajectory_out;
-
-  discretizeTrajectory(spline,discretization,test_traj.request.trajectory);
-
-  if(!collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                          test_traj.request.trajectory,
-                                                          trajectory_in.request.goal_constraints,
-                                                          trajectory_in.request.path_constraints,
-                                                          trajectory_out.response.error_code,
-                                                          trajectory_error_codes,
-                                                          false)) {
+  // validating the discretized original segment by segment also seeds the cache with every segment
+  // the shortcutter will leave untouched
+  validity_cache.setWaypoints(trajectory_out.request.trajectory.points.size());
+  if(!isSplineValid(spline,discretize,joint_names,trajectory_in.request.path_constraints,
+                    collision_models_interface_,&validity_cache,trajectory_out.response.error_code)) {
     ROS_WARN_STREAM("Original discretized trajectory invalid with error code " << trajectory_out.response.error_code.val);
-    trajectory_out.request = test_traj.request;
+    discretizeTrajectory(spline,discretization,trajectory_out.request.trajectory);
     return false;
   } else {
     ROS_DEBUG_STREAM("Originally discretized trajectory ok");
@@ -279,22 +283,22 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
     
     if(!trajectory_solver.parameterize(shortcut.trajectory,trajectory_in.request.limits,shortcut_spline))
       return false;
-    discretizeTrajectory(shortcut_spline,discretization,discretized_trajectory.trajectory);
-    ROS_DEBUG("Succeeded in sampling trajectory with size: %d",(int)discretized_trajectory.trajectory.points.size());
-
-    arm_navigation_msgs::Constraints empty_goal_constraints;
-
-    if(collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                           discretized_trajectory.trajectory,
-                                                           empty_goal_constraints,
-                                                           trajectory_in.request.path_constraints,
-                                                           error_code,
-                                                           trajectory_error_codes,
-                                                           false))
+    double shortcut_time;
+    spline_smoother::getTotalTime(shortcut_spline,shortcut_time);
+    ros::Duration shortcut_duration(shortcut_time);
+    // a shortcut that does not save time is never used, so don't spend a collision check on it
+    if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
+      continue;
+
+    // a shortcut is a new segment, so there is nothing to look up
+    if(isSplineValid(shortcut_spline,discretize,joint_names,trajectory_in.request.path_constraints,
+                     collision_models_interface_,NULL,error_code))
     {
-      ros::Duration shortcut_duration = discretized_trajectory.trajectory.points.back().time_from_start - discretized_trajectory.trajectory.points.front().time_from_start;
-      if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
+      int trim_start, trim_end;
+      if(!findTrajectoryPointsInInterval(trajectory_out.request.trajectory,segment_start_time,segment_end_time,trim_start,trim_end))
         continue;
+      unsigned int num_kept = trajectory_out.request.trajectory.points.size() - 
+        (std::min((unsigned int) trim_end,(unsigned int) trajectory_out.request.trajectory.points.size()) - trim_start);
       if(!trimTrajectory(trajectory_out.request.trajectory,segment_start_time,segment_end_time))
         continue;
       ROS_DEBUG_STREAM("Trimmed trajectory has " << trajectory_out.request.trajectory.points.size() << " points");
@@ -310,6 +314,8 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
       addToTrajectory(trajectory_out.request.trajectory,
                       shortcut.trajectory.points[1],
                       shortcut_duration-ros::Duration(segment_end_time-segment_start_time));
+      // the trimmed waypoints are replaced by the shortcut endpoints, the others keep their segments
+      validity_cache.replaceWaypoints(trim_start,trim_end,trajectory_out.request.trajectory.points.size()-num_kept);
       spline.segments.clear();
       if(!trajectory_solver.parameterize(trajectory_out.request.trajectory,trajectory_in.request.limits,spline)) {
         trajectory_out.response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_TRAJECTORY;
@@ -334,48 +340,27 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   {
     trajectory_out.request.trajectory.points[i].accelerations.clear();
   }
-  if(!collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                          trajectory_out.request.trajectory,
-                                                          trajectory_in.request.goal_constraints,
-                                                          trajectory_in.request.path_constraints,
-                                                          trajectory_out.response.error_code,
-                                                          trajectory_error_codes,
-                                                          false)) {
-    ROS_INFO_STREAM("Before refine trajectory invalid with error code " << trajectory_out.response.error_code.val);
-  } else {
-    ROS_DEBUG_STREAM("Before refine trajectory ok");
-  }
 
   printTrajectory(trajectory_out.request.trajectory);
+  std::vector<trajectory_msgs::JointTrajectoryPoint> unrefined_points = trajectory_out.request.trajectory.points;
   refineTrajectory(trajectory_out);
-  
-  if(!collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                          trajectory_out.request.trajectory,
-                                                          trajectory_in.request.goal_constraints,
-                                                          trajectory_in.request.path_constraints,
-                                                          trajectory_out.response.error_code,
-                                                          trajectory_error_codes,
-                                                          false)) {
-    ROS_INFO_STREAM("Before waypoints trajectory invalid with error code " << trajectory_out.response.error_code.val);
-  } else {
-    ROS_DEBUG_STREAM("Before waypoints trajectory ok");
+  for(unsigned int i=0; i < unrefined_points.size(); i++)
+  {
+    if(unrefined_points[i].velocities != trajectory_out.request.trajectory.points[i].velocities)
+      validity_cache.changeWaypoint(i);
   }
 
   if(!trajectory_solver.parameterize(trajectory_out.request.trajectory,trajectory_in.request.limits,spline))
     return false;
   if(!getWaypoints(spline,trajectory_out.request.trajectory))
     return false;
-  if(!collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                          trajectory_out.request.trajectory,
-                                                          trajectory_in.request.goal_constraints,
-                                                          trajectory_in.request.path_constraints,
-                                                          error_code,
-                                                          trajectory_error_codes,
-                                                          false)) {
-    ROS_INFO_STREAM("Before discretize trajectory invalid with error code " << error_code.val);
-  } else {
-    ROS_DEBUG_STREAM("Before discretize trajectory ok");
-  }
+
+  // refinement only changes the velocities at a few waypoints, so only the segments adjacent to those 
+  // and the segments next to accepted shortcuts miss the cache here
+  bool final_spline_valid = isSplineValid(spline,discretize,joint_names,trajectory_in.request.path_constraints,
+                                          collision_models_interface_,&validity_cache,trajectory_out.response.error_code);
+  ROS_DEBUG("Segment validity cache: %u segments, %u hits, %u misses",
+            validity_cache.size(),validity_cache.getNumHits(),validity_cache.getNumMisses());
   discretizeTrajectory(spline,discretization,trajectory_out.request.trajectory);
 
   trajectory_out.request.limits = trajectory_in.request.limits;
@@ -385,15 +370,9 @@ bool CubicSplineShortCutter<T>::smooth(const T& trajectory_in,
   ROS_DEBUG("Final trajectory has %d points and %f total time",(int)trajectory_out.request.trajectory.points.size(),
             trajectory_out.request.trajectory.points.back().time_from_start.toSec());
   
-  if(!collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                          trajectory_out.request.trajectory,
-                                                          trajectory_in.request.goal_constraints,
-                                                          trajectory_in.request.path_constraints,
-                                                          trajectory_out.response.error_code,
-                                                          trajectory_error_codes,
-                                                          false)) {
-    ROS_INFO_STREAM("Final trajectory invalid with error code " << error_code.val);
-    ROS_INFO_STREAM("Trajectory error codes size is " << trajectory_error_codes.size());
+  if(!final_spline_valid ||
+     !isGoalValid(trajectory_out.request.trajectory,trajectory_in.request.goal_constraints,trajectory_out.response.error_code)) {
+    ROS_INFO_STREAM("Final trajectory invalid with error code " << trajectory_out.response.error_code.val);
     return false;
   } else {
     ROS_DEBUG_STREAM("Final trajectory ok");
@@ -431,6 +410,27 @@ void CubicSplineShortCutter<T>::refineTrajectory(T &trajectory) const
   }
 }
 
+template <typename T>
+bool CubicSplineShortCutter<T>::isGoalValid(const trajectory_msgs::JointTrajectory &trajectory,
+                                            const arm_navigation_msgs::Constraints &goal_constraints,
+                                            arm_navigation_msgs::ArmNavigationErrorCodes &error_code) const
+{
+  if(trajectory.points.empty())
+    return true;
+  arm_navigation_msgs::Constraints empty_path_constraints;
+  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+  trajectory_msgs::JointTrajectory goal_trajectory;
+  goal_trajectory.joint_names = trajectory.joint_names;
+  goal_trajectory.points.push_back(trajectory.points.back());
+  return collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
+                                                             goal_trajectory,
+                                                             goal_constraints,
+                                                             empty_path_constraints,
+                                                             error_code,
+                                                             trajectory_error_codes,
+                                                             false);
+}
+
 template <typename T>
 void CubicSplineShortCutter<T>::printTrajectory(const trajectory_msgs::JointTrajectory &trajectory) const
 {
@@ -55,16 +55,32 @@ public:
   /// \brief Configures the filter
   virtual bool configure();
 
-  /// \brief Calculates a smooth trajectory by iteratively incrementing the time between
+  /// \brief Calculates a smooth trajectory by incrementing the time between
   /// points that exceed the velocity or acceleration bounds.
+  ///
+  /// By default the time intervals are computed with alternating forward and backward sweeps
+  /// (see applyAccelerationConstraintsForwardBackward). Setting the iterative_time_scaling
+  /// parameter selects the original iterative scheme instead.
   virtual bool smooth(const T& trajectory_in, T& trajectory_out) const;
 
 private:
   int			max_iterations_;					/// @brief maximum number of iterations to find solution
   double	max_time_change_per_it_;	/// @brief maximum allowed time change per iteration in seconds
+  bool		iterative_time_scaling_;	/// @brief use the iterative scheme instead of the forward-backward passes
 
   void applyVelocityConstraints(T& trajectory, std::vector<double> &time_diff) const;
   void applyAccelerationConstraints(const T& trajectory, std::vector<double> & time_diff) const;
+
+  /// \brief Enforces the acceleration limits with alternating forward and backward sweeps.
+  ///
+  /// At each violating point a sweep either grows the interval ahead of it to the smallest value
+  /// (a root of a quadratic) that satisfies the limits of all joints, or scales both intervals
+  /// around it by sqrt(|a|/a_max), whichever adds less time. Scaling both intervals can disturb
+  /// points already visited, so the sweeps repeat until nothing changes, for at most a small fixed
+  /// number of pairs (they settle within two or three in practice). A final backward sweep that
+  /// only grows the interval before each point then guarantees a feasible result. Each sweep costs
+  /// O(num_points*num_joints), so the whole step is linear in the number of points.
+  void applyAccelerationConstraintsForwardBackward(const T& trajectory, std::vector<double> & time_diff) const;
   double findT1( const double d1, const double d2, double t1, const double t2, const double a_max) const;
   double findT2( const double d1, const double d2, const double t1, double t2, const double a_max) const;
   void printStats(const T& trajectory) const;
@@ -43,6 +43,8 @@
 #include <spline_smoother/linear_trajectory.h>
 #include <planning_environment/models/collision_models_interface.h>
 #include <planning_environment/models/model_utils.h>
+#include <constraint_aware_spline_smoother/segment_validity_cache.h>
+#include <boost/bind.hpp>
 #include <arm_navigation_msgs/RobotState.h>
 #include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
 #include <trajectory_msgs/JointTrajectoryPoint.h>
@@ -171,11 +173,12 @@ bool LinearSplineShortCutter<T>::smooth(const T& trajectory_in,
   }
 
   arm_navigation_msgs::ArmNavigationErrorCodes error_code;
-  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
   arm_navigation_msgs::RobotState robot_state;
   spline_smoother::LinearTrajectory trajectory_solver;
   spline_smoother::SplineTrajectory spline, shortcut_spline;
-  arm_navigation_msgs::JointTrajectoryWithLimits shortcut, discretized_trajectory;
+  arm_navigation_msgs::JointTrajectoryWithLimits shortcut;
+  SegmentDiscretizer discretize = boost::bind(&LinearSplineShortCutter<T>::discretizeAndAppendSegment,this,
+                                              _1,discretization,_2,ros::Duration(0.0),true);
 
   trajectory_out = trajectory_in;
 
@@ -190,9 +193,6 @@ bool LinearSplineShortCutter<T>::smooth(const T& trajectory_in,
   shortcut.limits = trajectory_in.request.limits;
   shortcut.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
 
-  discretized_trajectory.limits = trajectory_in.request.limits;
-  discretized_trajectory.trajectory.joint_names = trajectory_in.request.trajectory.joint_names;
-
   ros::Time start_time = ros::Time::now();
   ros::Duration timeout = trajectory_in.request.allowed_time;
 
@@ -226,22 +226,16 @@ bool LinearSplineShortCutter<T>::smooth(const T& trajectory_in,
     
     if(!trajectory_solver.parameterize(shortcut.trajectory,trajectory_in.request.limits,shortcut_spline))
       return false;
-    discretizeTrajectory(shortcut_spline,discretization,discretized_trajectory.trajectory);
-    ROS_DEBUG("Succeeded in sampling trajectory with size: %d",(int)discretized_trajectory.trajectory.points.size());
-
-    arm_navigation_msgs::Constraints empty_goal_constraints;
-
-    if(collision_models_interface_->isJointTrajectoryValid(*collision_models_interface_->getPlanningSceneState(),
-                                                           discretized_trajectory.trajectory,
-                                                           empty_goal_constraints,
-                                                           trajectory_in.request.path_constraints,
-                                                           error_code,
-                                                           trajectory_error_codes,
-                                                           false))
+    double shortcut_time;
+    spline_smoother::getTotalTime(shortcut_spline,shortcut_time);
+    ros::Duration shortcut_duration(shortcut_time);
+    // a shortcut that does not save time is never used, so don't spend a collision check on it
+    if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
+      continue;
+
+    if(isSplineValid(shortcut_spline,discretize,trajectory_in.request.trajectory.joint_names,
+                     trajectory_in.request.path_constraints,collision_models_interface_,NULL,error_code))
     {
-     ros::Duration shortcut_duration = discretized_trajectory.trajectory.points.back().time_from_start - discretized_trajectory.trajectory.points.front().time_from_start;
-      if(segment_end_time-segment_start_time <= shortcut_duration.toSec())
-        continue;
       if(!trimTrajectory(trajectory_out.request.trajectory,segment_start_time,segment_end_time))
         continue;
       ROS_DEBUG("Trimmed trajectory has %u points",(unsigned int) trajectory_out.request.trajectory.points.size());
@@ -53,14 +53,18 @@ template <typename T>
 class ParabolicLinearBlendSmoother : public spline_smoother::SplineSmoother<T>
 {
 public:
-  ParabolicLinearBlendSmoother(){};
+  ParabolicLinearBlendSmoother();
   ~ParabolicLinearBlendSmoother(){};
 
   /// \brief Configures the filter
-  virtual bool configure() { return true; }
+  virtual bool configure();
 
   /// \brief Calculates a smooth trajectory based on parabolic blends
   virtual bool smooth(const T& trajectory_in, T& trajectory_out) const;
+
+private:
+  double discretization_;           /// @brief time between output trajectory points in seconds
+  double min_waypoint_separation_;  /// @brief waypoints closer than this (in joint space) are merged
 };
 
 }
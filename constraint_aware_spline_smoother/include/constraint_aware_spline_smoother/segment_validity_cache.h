@@ -0,0 +1,208 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef SEGMENT_VALIDITY_CACHE_H_
+#define SEGMENT_VALIDITY_CACHE_H_
+
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <string>
+#include <boost/function.hpp>
+#include <ros/ros.h>
+#include <spline_smoother/SplineTrajectory.h>
+#include <spline_smoother/SplineTrajectorySegment.h>
+#include <trajectory_msgs/JointTrajectory.h>
+#include <arm_navigation_msgs/ArmNavigationErrorCodes.h>
+#include <arm_navigation_msgs/Constraints.h>
+#include <planning_environment/models/collision_models_interface.h>
+
+namespace constraint_aware_spline_smoother
+{
+
+/**
+ * \brief Remembers the result of validating the segments between the waypoints of a trajectory
+ *
+ * A cubic spline segment only depends on the positions and velocities of its two waypoints, so
+ * a segment between two waypoints that have not changed since it was checked is still valid after
+ * the trajectory is re-parameterized. Every waypoint carries an id that is replaced whenever the
+ * waypoint is added or modified, and segments are keyed on the ids of their waypoints. Keying on
+ * the ids rather than the segment coefficients keeps lookups exact even though re-parameterizing
+ * and resampling a trajectory perturbs the coefficients of untouched segments. A cache is only
+ * valid for a single planning scene and discretization.
+ */
+class SegmentValidityCache
+{
+public:
+  SegmentValidityCache() : next_id_(0), hits_(0), misses_(0) {}
+
+  /**
+   * \brief Give new ids to all waypoints of a trajectory with the given number of waypoints
+   */
+  void setWaypoints(unsigned int num_waypoints)
+  {
+    waypoint_ids_.resize(num_waypoints);
+    for(unsigned int i=0; i < num_waypoints; i++)
+      waypoint_ids_[i] = next_id_++;
+  }
+
+  /**
+   * \brief Replace the waypoints in [first,last) with num_inserted new waypoints
+   */
+  void replaceWaypoints(unsigned int first, unsigned int last, unsigned int num_inserted)
+  {
+    last = std::min(last,(unsigned int) waypoint_ids_.size());
+    waypoint_ids_.erase(waypoint_ids_.begin()+first,waypoint_ids_.begin()+last);
+    for(unsigned int i=0; i < num_inserted; i++)
+      waypoint_ids_.insert(waypoint_ids_.begin()+first+i,next_id_++);
+  }
+
+  /**
+   * \brief Mark a waypoint as modified, invalidating the segments on either side of it
+   */
+  void changeWaypoint(unsigned int index)
+  {
+    waypoint_ids_[index] = next_id_++;
+  }
+
+  unsigned int getNumWaypoints() const { return waypoint_ids_.size(); }
+
+  /**
+   * \brief Look up the validation result of the segment that starts at a waypoint
+   * \return true if the segment has been checked before
+   * \param error_code Filled in with the stored result if the segment was found
+   */
+  bool lookup(unsigned int segment, arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+  {
+    std::map<std::pair<unsigned int, unsigned int>, int>::const_iterator it = cache_.find(makeKey(segment));
+    if(it == cache_.end())
+    {
+      misses_++;
+      return false;
+    }
+    hits_++;
+    error_code.val = it->second;
+    return true;
+  }
+
+  /**
+   * \brief Store the validation result of the segment that starts at a waypoint
+   */
+  void insert(unsigned int segment, const arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+  {
+    cache_[makeKey(segment)] = error_code.val;
+  }
+
+  void clear()
+  {
+    cache_.clear();
+    waypoint_ids_.clear();
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+  unsigned int size() const { return cache_.size(); }
+  unsigned int getNumHits() const { return hits_; }
+  unsigned int getNumMisses() const { return misses_; }
+
+private:
+  std::pair<unsigned int, unsigned int> makeKey(unsigned int segment) const
+  {
+    return std::make_pair(waypoint_ids_[segment],waypoint_ids_[segment+1]);
+  }
+
+  std::vector<unsigned int> waypoint_ids_;
+  unsigned int next_id_;
+  std::map<std::pair<unsigned int, unsigned int>, int> cache_;
+  unsigned int hits_, misses_;
+};
+
+/// \brief Appends the discretization of a spline segment to a joint trajectory
+typedef boost::function<void(const spline_smoother::SplineTrajectorySegment&,
+                             trajectory_msgs::JointTrajectory&)> SegmentDiscretizer;
+
+/**
+ * \brief Check a spline segment by segment, stopping at the first invalid segment
+ * \return true if every segment satisfies the path constraints and is collision free
+ * \param discretize Discretizes a single segment, starting at time zero
+ * \param cache If given, its waypoints must match the spline; only segments that are not in the cache are checked
+ * \param error_code Filled in with the error code of the first invalid segment
+ */
+inline bool isSplineValid(const spline_smoother::SplineTrajectory &spline,
+                          const SegmentDiscretizer &discretize,
+                          const std::vector<std::string> &joint_names,
+                          const arm_navigation_msgs::Constraints &path_constraints,
+                          planning_environment::CollisionModelsInterface *collision_models_interface,
+                          SegmentValidityCache *cache,
+                          arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+{
+  arm_navigation_msgs::Constraints empty_goal_constraints;
+  std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+  trajectory_msgs::JointTrajectory segment_trajectory;
+  segment_trajectory.joint_names = joint_names;
+  error_code.val = error_code.SUCCESS;
+  if(cache && cache->getNumWaypoints() != spline.segments.size()+1)
+  {
+    ROS_WARN("Segment validity cache has %u waypoints for a spline with %u segments, not using it",
+             cache->getNumWaypoints(),(unsigned int) spline.segments.size());
+    cache = NULL;
+  }
+  for(unsigned int i=0; i < spline.segments.size(); i++)
+  {
+    if(cache && cache->lookup(i,error_code))
+    {
+      if(error_code.val != error_code.SUCCESS)
+        return false;
+      continue;
+    }
+    segment_trajectory.points.clear();
+    discretize(spline.segments[i],segment_trajectory);
+    collision_models_interface->isJointTrajectoryValid(*collision_models_interface->getPlanningSceneState(),
+                                                       segment_trajectory,
+                                                       empty_goal_constraints,
+                                                       path_constraints,
+                                                       error_code,
+                                                       trajectory_error_codes,
+                                                       false);
+    if(cache)
+      cache->insert(i,error_code);
+    if(error_code.val != error_code.SUCCESS)
+      return false;
+  }
+  return true;
+}
+}
+
+#endif
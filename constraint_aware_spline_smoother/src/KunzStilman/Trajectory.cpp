@@ -37,6 +37,7 @@
  */
 
 #include "constraint_aware_spline_smoother/KunzStilman/Trajectory.h"
+#include <algorithm>
 
 using namespace std;
 using namespace Eigen;
@@ -97,13 +98,22 @@ Trajectory::Trajectory(const list<VectorXd> &_path, const VectorXd &maxVelocity,
 		blendDurations.resize(path.size());
 	}
 
+	// all waypoints were within the separation of the start, keep the goal so the path still reaches it
+	if(path.size() < 2) {
+		path.push_back(_path.back());
+		velocities.resize(1);
+		accelerations.resize(2);
+		durations.resize(1);
+		blendDurations.resize(2);
+	}
+
 	// calculate time between waypoints and initial velocities of linear segments
 	for(unsigned int i = 0; i < path.size() - 1; i++) {
 		durations[i] = 0.0;
 		for(int j = 0; j < path[i].size(); j++) {
 			durations[i] = max(durations[i], abs(path[i+1][j] - path[i][j]) / maxVelocity[j]);
 		}
-		velocities[i] = (path[i+1] - path[i]) / durations[i];
+		velocities[i] = (durations[i] > 0.0) ? VectorXd((path[i+1] - path[i]) / durations[i]) : VectorXd::Zero(path[i].size());
 	}
 
 	int numBlendsSlowedDown = numeric_limits<int>::max();
@@ -118,8 +128,14 @@ Trajectory::Trajectory(const list<VectorXd> &_path, const VectorXd &maxVelocity,
 			blendDurations[i] = 0.0;
 			for(int j = 0; j < path[i].size(); j++) {
 				blendDurations[i] = max(blendDurations[i], abs(nextVelocity[j] - previousVelocity[j]) / maxAcceleration[j]);
+			}
+			// there is no blend where the velocity does not change
+			if(blendDurations[i] > 0.0) {
 				accelerations[i] = (nextVelocity - previousVelocity) / blendDurations[i];
 			}
+			else {
+				accelerations[i] = VectorXd::Zero(path[i].size());
+			}
 
       // calculate slow down factor such that the blend phase replaces at most half of the neighboring linear segments
 			const double eps = 0.000001;
@@ -145,6 +161,24 @@ Trajectory::Trajectory(const list<VectorXd> &_path, const VectorXd &maxVelocity,
 		duration += durations[i];
 	}
 	duration += 0.5 * blendDurations.front() + 0.5 * blendDurations.back();
+
+	// cumulative end times of the linear segments, used to look up segments by binary search
+	segmentEndTimes.resize(durations.size());
+	double t = 0.0;
+	for(unsigned int i = 0; i < durations.size(); i++) {
+		t += durations[i];
+		segmentEndTimes[i] = t;
+	}
+}
+
+
+unsigned int Trajectory::getSegment(double &t) const {
+	vector<double>::const_iterator it = lower_bound(segmentEndTimes.begin(), segmentEndTimes.end(), t);
+	const unsigned int i = it - segmentEndTimes.begin();
+	if(i > 0) {
+		t -= segmentEndTimes[i-1];
+	}
+	return i;
 }
 
 
@@ -159,11 +193,7 @@ VectorXd Trajectory::getPosition(double time) const {
 	else {
 		t -= 0.5 * blendDurations[0];
 	}
-  unsigned int i = 0;
-	while(i < path.size() - 1 && t > durations[i]) {
-		t -= durations[i];
-		i++;
-	}
+	const unsigned int i = getSegment(t);
   if(i == path.size() - 1) {
 		t = 0.5 * blendDurations.back() - t;
 		return path.back() + 0.5 * t * t * accelerations.back();
@@ -197,11 +227,7 @@ VectorXd Trajectory::getVelocity(double time) const {
 	else {
 		t -= 0.5 * blendDurations[0];
 	}
-  unsigned int i = 0;
-	while(i < path.size() - 1 && t > durations[i]) {
-		t -= durations[i];
-		i++;
-	}
+	const unsigned int i = getSegment(t);
   if(i == path.size() - 1) {
 		t = 0.5 * blendDurations.back() - t;
 		return - t * accelerations.back();
@@ -224,6 +250,37 @@ VectorXd Trajectory::getVelocity(double time) const {
 }
 
 
+VectorXd Trajectory::getAcceleration(double time) const {
+  if(time > duration) {
+		return VectorXd::Zero(path.back().size());
+	}
+	double t = time;
+	if(t <= 0.5 * blendDurations[0]) {
+		return accelerations[0];
+	}
+	else {
+		t -= 0.5 * blendDurations[0];
+	}
+	const unsigned int i = getSegment(t);
+  if(i == path.size() - 1) {
+		return accelerations.back();
+	}
+
+	double switchingTime1 = 0.5 * blendDurations[i];
+	double switchingTime2 = durations[i] - 0.5 * blendDurations[i+1];
+
+  if(t < switchingTime1) {
+		return accelerations[i];
+	}
+	else if(t > switchingTime2) {
+		return accelerations[i+1];
+	}
+	else {
+		return VectorXd::Zero(path[i].size());
+	}
+}
+
+
 double Trajectory::getDuration() const {
   return duration;
 }
@@ -37,18 +37,24 @@
 #include <constraint_aware_spline_smoother/iterative_smoother.h>
 #include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
 #include <arm_navigation_msgs/JointLimits.h>
+#include <algorithm>
+#include <cmath>
 
 using namespace constraint_aware_spline_smoother;
 
 const double DEFAULT_VEL_MAX=1.0;
 const double DEFAULT_ACCEL_MAX=1.0;
 const double ROUNDING_THRESHOLD = 0.01;
+// The forward-backward sweeps settle within three pairs on random and adversarial trajectories;
+// the final one-sided sweep keeps the result feasible if they are cut off
+const int MAX_SWEEP_PAIRS = 4;
 
 
 template <typename T>
 IterativeParabolicSmoother<T>::IterativeParabolicSmoother()
 : max_iterations_(100),
-  max_time_change_per_it_(0.01)
+  max_time_change_per_it_(0.01),
+  iterative_time_scaling_(false)
 {}
 
 template <typename T>
@@ -72,6 +78,9 @@ bool IterativeParabolicSmoother<T>::configure()
   }
   ROS_DEBUG("Using a max_time_change_per_it value of %f",max_time_change_per_it_);
 
+  spline_smoother::SplineSmoother<T>::getParam("iterative_time_scaling", iterative_time_scaling_);
+  ROS_DEBUG("Using %s time scaling",iterative_time_scaling_ ? "iterative" : "forward-backward");
+
  return true;
 }
 
@@ -399,6 +408,184 @@ void IterativeParabolicSmoother<T>::applyAccelerationConstraints(const T& trajec
   } while(num_updates > 0 && iteration < max_iterations_);
 }
 
+// Returns the larger root of c2*x^2 + c1*x + c0 (c2 > 0), or 0 if the quadratic has no real roots,
+// i.e. the smallest x beyond which the quadratic is non-negative.
+static double largerRoot(const double c2, const double c1, const double c0)
+{
+  const double disc = c1*c1 - 4.0*c2*c0;
+  if(disc < 0.0)
+    return 0.0;
+  return (-c1 + sqrt(disc)) / (2.0*c2);
+}
+
+// Smallest dt2 >= dt2_min such that the parabolic acceleration 2*(dq2/dt2 - dq1/dt1)/(dt1+dt2)
+// stays within a_max. Writing v1 = dq1/dt1, the two sides of |a| <= a_max are the quadratics
+//   (a_max/2)*dt2^2 + (a_max/2*dt1 + v1)*dt2 - dq2 >= 0
+//   (a_max/2)*dt2^2 + (a_max/2*dt1 - v1)*dt2 + dq2 >= 0
+// each of which holds below its smaller root and past its larger root.
+static double minFeasibleInterval(const double dq1, const double dt1, const double dq2, const double dt2_min, const double a_max)
+{
+  const double v1 = (dt1 > 0.0) ? dq1/dt1 : 0.0;
+  const double c2 = 0.5*a_max;
+  const double c1_upper = 0.5*a_max*dt1 + v1;
+  const double c1_lower = 0.5*a_max*dt1 - v1;
+  double dt2 = dt2_min;
+  // moving past the larger root of one quadratic can only violate the other one once
+  for (int k=0; k<2; ++k)
+  {
+    if( c2*dt2*dt2 + c1_upper*dt2 - dq2 < 0.0 )
+      dt2 = std::max(dt2, largerRoot(c2, c1_upper, -dq2));
+    if( c2*dt2*dt2 + c1_lower*dt2 + dq2 < 0.0 )
+      dt2 = std::max(dt2, largerRoot(c2, c1_lower, dq2));
+  }
+  return dt2;
+}
+
+// Largest ratio of acceleration to acceleration limit over all joints at a waypoint
+static double accelerationRatio(const double* dq1, const double* dq2, const double dt1, const double dt2,
+                                const double* a_max, const unsigned int num_joints)
+{
+  if(dt1 <= 0.0 || dt2 <= 0.0)
+    return 0.0;
+  const double inv_dt1 = 1.0/dt1;
+  const double inv_dt2 = 1.0/dt2;
+  const double scale = 2.0/(dt1+dt2);
+  double ratio = 0.0;
+  for (unsigned int j=0; j<num_joints; ++j)
+  {
+    ratio = std::max(ratio, std::abs(scale*(dq2[j]*inv_dt2 - dq1[j]*inv_dt1))/a_max[j]);
+  }
+  return ratio;
+}
+
+// Smallest dt2 >= dt2_min for which all joints are within their acceleration limits. Growing dt2 for
+// one joint can move another joint into its infeasible band, but every change puts dt2 past a larger
+// root, so this terminates after at most 2*num_joints changes.
+static double minFeasibleInterval(const double* dq1, const double dt1, const double* dq2, const double dt2_min,
+                                  const double* a_max, const unsigned int num_joints)
+{
+  double dt2 = dt2_min;
+  bool changed = true;
+  while(changed)
+  {
+    changed = false;
+    for (unsigned int j=0; j<num_joints; ++j)
+    {
+      const double dt = minFeasibleInterval(dq1[j], dt1, dq2[j], dt2, a_max[j]);
+      if(dt > dt2)
+      {
+        dt2 = dt;
+        changed = true;
+      }
+    }
+  }
+  return dt2;
+}
+
+template <typename T>
+void IterativeParabolicSmoother<T>::applyAccelerationConstraintsForwardBackward(const T& trajectory, std::vector<double> & time_diff) const
+{
+  const unsigned int num_points = trajectory.request.trajectory.points.size();
+  const unsigned int num_joints = trajectory.request.trajectory.joint_names.size();
+  if(num_points < 2)
+    return;
+  const unsigned int num_segments = num_points-1;
+  const double ratio_tolerance = 1.0 + 1e-9;
+
+  // Segment displacements stored per segment, so that all joints of a segment are contiguous.
+  // Reversing time maps (dq1,dt1,dq2,dt2) at a waypoint to (-dq2,dt2,-dq1,dt1) without changing the
+  // acceleration, so the backward sweep solves the forward problem on the negated displacements.
+  std::vector<double> a_max(num_joints, DEFAULT_ACCEL_MAX);
+  std::vector<double> dq(num_segments*num_joints);
+  std::vector<double> neg_dq(num_segments*num_joints);
+  for (unsigned int j=0; j<num_joints; ++j)
+  {
+    if( trajectory.request.limits[j].has_acceleration_limits )
+    {
+      a_max[j] = trajectory.request.limits[j].max_acceleration;
+    }
+  }
+  for (unsigned int i=0; i<num_segments; ++i)
+  {
+    const std::vector<double>& q1 = trajectory.request.trajectory.points[i].positions;
+    const std::vector<double>& q2 = trajectory.request.trajectory.points[i+1].positions;
+    double* dq_i = &dq[i*num_joints];
+    double* neg_dq_i = &neg_dq[i*num_joints];
+    for (unsigned int j=0; j<num_joints; ++j)
+    {
+      dq_i[j] = q2[j] - q1[j];
+      neg_dq_i[j] = -dq_i[j];
+    }
+  }
+
+  // First and last points accelerate from and decelerate to rest: |a| = 2*|dq|/dt^2
+  for (unsigned int j=0; j<num_joints; ++j)
+  {
+    time_diff[0] = std::max(time_diff[0], sqrt(2.0*std::abs(dq[j])/a_max[j]));
+    time_diff[num_segments-1] = std::max(time_diff[num_segments-1],
+                                         sqrt(2.0*std::abs(dq[(num_segments-1)*num_joints+j])/a_max[j]));
+  }
+
+  // Alternate forward and backward sweeps. At a violating waypoint either the interval ahead of
+  // the sweep is grown to the smallest feasible value, or both intervals are stretched by
+  // sqrt(ratio) (accelerations scale with 1/k^2), whichever adds less time. Stretching both
+  // intervals can disturb the waypoint behind the sweep, which the next sweep picks up.
+  int iteration = 0;
+  bool changed = true;
+  while(changed && iteration < MAX_SWEEP_PAIRS)
+  {
+    changed = false;
+    iteration++;
+    for( int count=0; count<2; count++)
+    {
+      const bool backwards = (count == 1);
+      for (unsigned int n=1; n<num_segments; ++n)
+      {
+        const unsigned int i = backwards ? num_segments-n : n;
+        double& dt1 = time_diff[i-1];
+        double& dt2 = time_diff[i];
+        const double ratio = accelerationRatio(&dq[(i-1)*num_joints], &dq[i*num_joints], dt1, dt2, &a_max[0], num_joints);
+        if(ratio <= ratio_tolerance)
+          continue;
+        changed = true;
+        const double k = sqrt(ratio);
+        if(!backwards)
+        {
+          const double one_sided = minFeasibleInterval(&dq[(i-1)*num_joints], dt1, &dq[i*num_joints], dt2, &a_max[0], num_joints);
+          if(one_sided - dt2 <= (k-1.0)*(dt1+dt2))
+          {
+            dt2 = one_sided;
+            continue;
+          }
+        }
+        else
+        {
+          const double one_sided = minFeasibleInterval(&neg_dq[i*num_joints], dt2, &neg_dq[(i-1)*num_joints], dt1, &a_max[0], num_joints);
+          if(one_sided - dt1 <= (k-1.0)*(dt1+dt2))
+          {
+            dt1 = one_sided;
+            continue;
+          }
+        }
+        dt1 *= k;
+        dt2 *= k;
+      }
+    }
+  }
+  ROS_DEBUG("applyAccelerationConstraintsForwardBackward: %d sweeps", iteration);
+
+  // Final backward sweep that only grows the interval before each waypoint. Waypoint i depends only
+  // on intervals i-1 and i, and this sweep only modifies intervals before i, so every waypoint stays
+  // feasible once visited. This guarantees a feasible result even if the sweeps above were cut off.
+  if(changed)
+  {
+    for (unsigned int i=num_segments-1; i>0; --i)
+    {
+      time_diff[i-1] = minFeasibleInterval(&neg_dq[i*num_joints], time_diff[i], &neg_dq[(i-1)*num_joints], time_diff[i-1], &a_max[0], num_joints);
+    }
+  }
+}
+
 template <typename T>
 bool IterativeParabolicSmoother<T>::smooth(const T& trajectory_in,
                                    T& trajectory_out) const
@@ -409,7 +596,10 @@ bool IterativeParabolicSmoother<T>::smooth(const T& trajectory_in,
   std::vector<double> time_diff(num_points,0.0);	// the time difference between adjacent points
 
   applyVelocityConstraints(trajectory_out, time_diff);
-  applyAccelerationConstraints(trajectory_out, time_diff);
+  if(iterative_time_scaling_)
+    applyAccelerationConstraints(trajectory_out, time_diff);
+  else
+    applyAccelerationConstraintsForwardBackward(trajectory_out, time_diff);
 
   ROS_DEBUG("Velocity & Acceleration-Constrained Trajectory");
   updateTrajectory(trajectory_out, time_diff);
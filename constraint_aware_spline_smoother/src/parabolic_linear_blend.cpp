@@ -39,23 +39,66 @@
 #include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
 #include <arm_navigation_msgs/JointLimits.h>
 #include <Eigen/Core>
+#include <algorithm>
 
 using namespace constraint_aware_spline_smoother;
 
 const double	DEFAULT_VEL_MAX=1.0;
 const double	DEFAULT_ACCEL_MAX=1.0;
 const double	ROUNDING_THRESHOLD = 0.01;
-const int			NUM_OUTPUT_POINTS = 100;	// TODO - make this a parameter
 
 
+template <typename T>
+ParabolicLinearBlendSmoother<T>::ParabolicLinearBlendSmoother()
+: discretization_(0.01),
+  min_waypoint_separation_(0.03)
+{}
+
+template <typename T>
+bool ParabolicLinearBlendSmoother<T>::configure()
+{
+  if (!spline_smoother::SplineSmoother<T>::getParam("discretization", discretization_))
+  {
+    ROS_WARN("Spline smoother, \"%s\", params has no attribute discretization.",
+            spline_smoother::SplineSmoother<T>::getName().c_str());
+  }
+  if (discretization_ <= 0.0)
+  {
+    ROS_ERROR("Spline smoother, \"%s\", discretization must be positive, got %f",
+              spline_smoother::SplineSmoother<T>::getName().c_str(), discretization_);
+    return false;
+  }
+  ROS_DEBUG("Using a discretization value of %f",discretization_);
+
+  if (!spline_smoother::SplineSmoother<T>::getParam("min_waypoint_separation", min_waypoint_separation_))
+  {
+    ROS_DEBUG("Spline smoother, \"%s\", params has no attribute min_waypoint_separation.",
+            spline_smoother::SplineSmoother<T>::getName().c_str());
+  }
+  ROS_DEBUG("Using a min_waypoint_separation value of %f",min_waypoint_separation_);
+
+  return true;
+}
+
 template <typename T>
 bool ParabolicLinearBlendSmoother<T>::smooth(const T& trajectory_in,
                                    T& trajectory_out) const
 {
+  ros::WallTime start_time = ros::WallTime::now();
+
+  trajectory_out = trajectory_in;
+  if(trajectory_in.request.trajectory.points.size() < 2)
+    return true;
+  if(trajectory_in.request.limits.size() != trajectory_in.request.trajectory.joint_names.size())
+  {
+    ROS_ERROR("Number of joint limits (%d) does not match number of joints (%d)",
+              (int) trajectory_in.request.limits.size(), (int) trajectory_in.request.trajectory.joint_names.size());
+    return false;
+  }
+
   std::list<Eigen::VectorXd> path;
   Eigen::VectorXd vmax;	// velocity
   Eigen::VectorXd amax;	// acceleration
-  double smin = 0.03;		// minimum waypoint separation
 
   // Convert to expected form
   vmax.resize(trajectory_in.request.limits.size());
@@ -92,42 +135,45 @@ bool ParabolicLinearBlendSmoother<T>::smooth(const T& trajectory_in,
     {
       point[j]=trajectory_in.request.trajectory.points[i].positions[j];
     }
-    std::vector<double> positions=trajectory_in.request.trajectory.points[i].positions;
     path.push_back(point);
   }
 
-  ParabolicBlend::Trajectory blend_trajectory(path,vmax,amax,smin);
+  ParabolicBlend::Trajectory blend_trajectory(path,vmax,amax,min_waypoint_separation_);
 
   // Convert back
-  trajectory_out = trajectory_in;
   unsigned int num_joints = trajectory_in.request.trajectory.joint_names.size();
-  unsigned int num_points = NUM_OUTPUT_POINTS;
   double duration = blend_trajectory.getDuration();
-  double discretization = duration / num_points;
+  // always emit the start and the goal, even when the motion is shorter than one step
+  unsigned int num_points = std::max((unsigned int)(duration/discretization_ + 0.5) + 1, 2u);
+  double discretization = (num_points > 1) ? duration/(num_points-1) : 0.0;
 
-  // add on the new trjectory points
-  trajectory_out.request.trajectory.points.clear();
-  for (unsigned int i=0; i<=num_points; ++i)
+  // add on the new trajectory points
+  trajectory_out.request.trajectory.points.resize(num_points);
+  for (unsigned int i=0; i<num_points; ++i)
   {
-   double time_from_start = discretization * i;
-    if(i==0) time_from_start=0.0;	//safety check.
+    double time_from_start = discretization * i;
+    if(i==num_points-1) time_from_start=duration;	//safety check.
 
     Eigen::VectorXd positions = blend_trajectory.getPosition( time_from_start );
     Eigen::VectorXd velocities = blend_trajectory.getVelocity( time_from_start );
+    Eigen::VectorXd accelerations = blend_trajectory.getAcceleration( time_from_start );
 
-    trajectory_msgs::JointTrajectoryPoint point;
+    trajectory_msgs::JointTrajectoryPoint& point = trajectory_out.request.trajectory.points[i];
     point.time_from_start = ros::Duration(time_from_start);
     point.positions.resize(num_joints);
     point.velocities.resize(num_joints);
+    point.accelerations.resize(num_joints);
     for (unsigned int j=0; j<num_joints; ++j)
     {
       point.positions[j] = positions[j];
       point.velocities[j] = velocities[j];
+      point.accelerations[j] = accelerations[j];
     }
-
-    trajectory_out.request.trajectory.points.push_back(point);	// TODO - can make this faster by initializing the size
   }
 
+  ROS_INFO("Trajectory filter took %f seconds for %d input points, output %d points with duration %f",
+            (ros::WallTime::now() - start_time).toSec(), (int) trajectory_in.request.trajectory.points.size(),
+            (int) num_points, duration);
   return true;
 }
 
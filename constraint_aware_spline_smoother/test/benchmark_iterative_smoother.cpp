@@ -0,0 +1,160 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2011, Willow Garage, Inc.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of the Willow Garage nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+// Compares the iterative and the forward-backward time scaling of the
+// IterativeParabolicSmoother on random dense trajectories.
+// Usage: benchmark_iterative_smoother [num_trajectories] [num_points]
+
+#include <ros/ros.h>
+#include <constraint_aware_spline_smoother/iterative_smoother.h>
+#include <arm_navigation_msgs/FilterJointTrajectoryWithConstraints.h>
+#include <cstdlib>
+#include <cmath>
+
+typedef arm_navigation_msgs::FilterJointTrajectoryWithConstraints FilterType;
+
+static const unsigned int NUM_JOINTS = 7;
+
+static double gen_rand(double min, double max)
+{
+  return ((double)rand() / RAND_MAX)*(max-min) + min;
+}
+
+// Sum of sines per joint plus a little noise, similar to a densely interpolated plan
+static void generateTrajectory(unsigned int num_points, FilterType& trajectory)
+{
+  trajectory.request.trajectory.joint_names.resize(NUM_JOINTS);
+  trajectory.request.limits.resize(NUM_JOINTS);
+  trajectory.request.trajectory.points.resize(num_points);
+
+  std::vector<double> amplitude(NUM_JOINTS), frequency(NUM_JOINTS);
+  for (unsigned int j=0; j<NUM_JOINTS; ++j)
+  {
+    char name[32];
+    sprintf(name, "joint_%d", j);
+    trajectory.request.trajectory.joint_names[j] = name;
+    trajectory.request.limits[j].joint_name = name;
+    trajectory.request.limits[j].has_velocity_limits = true;
+    trajectory.request.limits[j].max_velocity = gen_rand(0.5, 2.0);
+    trajectory.request.limits[j].has_acceleration_limits = true;
+    trajectory.request.limits[j].max_acceleration = gen_rand(1.0, 4.0);
+    amplitude[j] = gen_rand(-1.0, 1.0);
+    frequency[j] = gen_rand(0.5, 3.0);
+  }
+
+  for (unsigned int i=0; i<num_points; ++i)
+  {
+    const double s = (double)i/(num_points-1);
+    trajectory.request.trajectory.points[i].positions.resize(NUM_JOINTS);
+    for (unsigned int j=0; j<NUM_JOINTS; ++j)
+    {
+      trajectory.request.trajectory.points[i].positions[j] = amplitude[j]*sin(2.0*M_PI*frequency[j]*s) + gen_rand(-1e-4, 1e-4);
+    }
+  }
+}
+
+static bool configureSmoother(constraint_aware_spline_smoother::IterativeParabolicSmoother<FilterType>& smoother,
+                              bool iterative)
+{
+  XmlRpc::XmlRpcValue config;
+  config["name"] = iterative ? "iterative" : "forward_backward";
+  config["type"] = "IterativeParabolicSmootherFilterJointTrajectoryWithConstraints";
+  config["params"]["max_iterations"] = 100;
+  config["params"]["max_time_change_per_it"] = 0.01;
+  config["params"]["iterative_time_scaling"] = iterative;
+  return smoother.configure(config);
+}
+
+// Largest ratio of acceleration to acceleration limit along the smoothed trajectory
+static double maxAccelerationRatio(const FilterType& trajectory)
+{
+  double ratio = 0.0;
+  for (unsigned int i=0; i<trajectory.request.trajectory.points.size(); ++i)
+  {
+    for (unsigned int j=0; j<NUM_JOINTS; ++j)
+    {
+      ratio = std::max(ratio, fabs(trajectory.request.trajectory.points[i].accelerations[j]) / 
+                       trajectory.request.limits[j].max_acceleration);
+    }
+  }
+  return ratio;
+}
+
+int main(int argc, char** argv)
+{
+  int num_trajectories = 20;
+  int num_points = 1000;
+  if(argc > 1)
+    num_trajectories = atoi(argv[1]);
+  if(argc > 2)
+    num_points = atoi(argv[2]);
+  srand(1);
+
+  constraint_aware_spline_smoother::IterativeParabolicSmoother<FilterType> smoothers[2];
+  const char* names[2] = {"forward-backward", "iterative"};
+  for (int k=0; k<2; ++k)
+  {
+    if(!configureSmoother(smoothers[k], k == 1))
+    {
+      ROS_ERROR("Could not configure %s smoother", names[k]);
+      return 1;
+    }
+  }
+
+  double total_time[2] = {0.0, 0.0};
+  double total_duration[2] = {0.0, 0.0};
+  double worst_ratio[2] = {0.0, 0.0};
+  for (int n=0; n<num_trajectories; ++n)
+  {
+    FilterType trajectory_in;
+    generateTrajectory(num_points, trajectory_in);
+    for (int k=0; k<2; ++k)
+    {
+      FilterType trajectory_out;
+      ros::WallTime start = ros::WallTime::now();
+      smoothers[k].smooth(trajectory_in, trajectory_out);
+      total_time[k] += (ros::WallTime::now() - start).toSec();
+      total_duration[k] += trajectory_out.request.trajectory.points.back().time_from_start.toSec();
+      worst_ratio[k] = std::max(worst_ratio[k], maxAccelerationRatio(trajectory_out));
+    }
+  }
+
+  printf("%d trajectories, %d points, %d joints\n", num_trajectories, num_points, NUM_JOINTS);
+  for (int k=0; k<2; ++k)
+  {
+    printf("%-17s: %8.3f ms per trajectory, mean trajectory duration %8.3f s, max |a|/a_max %.4f\n",
+           names[k], 1000.0*total_time[k]/num_trajectories, total_duration[k]/num_trajectories, worst_ratio[k]);
+  }
+  return 0;
+}
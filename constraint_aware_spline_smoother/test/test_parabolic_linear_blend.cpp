@@ -0,0 +1,115 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <gtest/gtest.h>
+#include <constraint_aware_spline_smoother/KunzStilman/Trajectory.h>
+#include <cmath>
+
+static Eigen::VectorXd makeWaypoint(double first, double second)
+{
+  Eigen::VectorXd waypoint(2);
+  waypoint[0] = first;
+  waypoint[1] = second;
+  return waypoint;
+}
+
+static void expectFinite(const ParabolicBlend::Trajectory &trajectory)
+{
+  ASSERT_FALSE(std::isnan(trajectory.getDuration()));
+  for(unsigned int i=0; i <= 20; i++)
+  {
+    double time = trajectory.getDuration()*i/20.0;
+    Eigen::VectorXd position = trajectory.getPosition(time);
+    Eigen::VectorXd velocity = trajectory.getVelocity(time);
+    Eigen::VectorXd acceleration = trajectory.getAcceleration(time);
+    for(int j=0; j < position.size(); j++)
+    {
+      EXPECT_FALSE(std::isnan(position[j]));
+      EXPECT_FALSE(std::isnan(velocity[j]));
+      EXPECT_FALSE(std::isnan(acceleration[j]));
+    }
+  }
+}
+
+TEST(TestParabolicLinearBlend, CollapsedPathKeepsStartAndGoal)
+{
+  // every waypoint is within the default separation of the start
+  std::list<Eigen::VectorXd> path;
+  path.push_back(makeWaypoint(0.0,0.0));
+  path.push_back(makeWaypoint(0.01,0.0));
+  path.push_back(makeWaypoint(0.02,0.01));
+  Eigen::VectorXd limits = Eigen::VectorXd::Ones(2);
+  ParabolicBlend::Trajectory trajectory(path,limits,limits,0.03);
+  expectFinite(trajectory);
+  Eigen::VectorXd start = trajectory.getPosition(0.0);
+  Eigen::VectorXd goal = trajectory.getPosition(trajectory.getDuration());
+  EXPECT_NEAR(start[0],0.0,1e-9);
+  EXPECT_NEAR(start[1],0.0,1e-9);
+  EXPECT_NEAR(goal[0],0.02,1e-9);
+  EXPECT_NEAR(goal[1],0.01,1e-9);
+  EXPECT_NEAR(trajectory.getVelocity(0.0).norm(),0.0,1e-9);
+  EXPECT_NEAR(trajectory.getVelocity(trajectory.getDuration()).norm(),0.0,1e-9);
+}
+
+TEST(TestParabolicLinearBlend, IdenticalStartAndGoal)
+{
+  std::list<Eigen::VectorXd> path;
+  path.push_back(makeWaypoint(0.5,0.5));
+  path.push_back(makeWaypoint(0.5,0.5));
+  Eigen::VectorXd limits = Eigen::VectorXd::Ones(2);
+  ParabolicBlend::Trajectory trajectory(path,limits,limits,0.0);
+  expectFinite(trajectory);
+  EXPECT_EQ(trajectory.getDuration(),0.0);
+}
+
+TEST(TestParabolicLinearBlend, InteriorWaypointWithoutVelocityChange)
+{
+  // the middle waypoint lies on a straight line at constant speed, so it has no blend
+  std::list<Eigen::VectorXd> path;
+  path.push_back(makeWaypoint(0.0,0.0));
+  path.push_back(makeWaypoint(1.0,1.0));
+  path.push_back(makeWaypoint(2.0,2.0));
+  Eigen::VectorXd limits = Eigen::VectorXd::Ones(2);
+  ParabolicBlend::Trajectory trajectory(path,limits,limits,0.0);
+  expectFinite(trajectory);
+  Eigen::VectorXd goal = trajectory.getPosition(trajectory.getDuration());
+  EXPECT_NEAR(goal[0],2.0,1e-9);
+  EXPECT_NEAR(goal[1],2.0,1e-9);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -43,6 +43,7 @@
 // #include <BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h>
 // #include <BulletCollision/CollisionShapes/btTriangleMesh.h>
 #include <vector>
+#include <cstddef>
 
 /**
    This set of classes allows quickly detecting whether a given point
@@ -156,6 +157,25 @@ struct BoundingCylinder
 	
     /** \brief Check is a point is inside the body */
     virtual bool containsPoint(const tf::Vector3 &p, bool verbose = false) const = 0;	
+
+    /** \brief Check which of \e n points are inside the body. The
+        points are given as separate arrays of x, y and z
+        coordinates. For every point inside the body, the
+        corresponding entry of \e inside is set to 1; other entries
+        are left unchanged, so the results for several bodies can be
+        accumulated in the same array. */
+    virtual void containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const;
+
+    /** \brief Same as above, for single precision coordinates */
+    virtual void containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const;
+
+    /** \brief Intersect \e n rays that share the same origin with the
+        body. Ray directions are given as separate arrays of x, y and z
+        components and do not need to be normalized. For every ray,
+        \e depth receives the smallest t > 0 for which origin + t * dir
+        is on the surface of the body, or a negative value if the ray
+        does not intersect the body. */
+    virtual void intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const;
 	
     /** \brief Compute the volume of the body. This method includes
         changes induced by scaling and padding */
@@ -204,11 +224,17 @@ public:
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
+  virtual void containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const;
+  virtual void containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const;
+  virtual void intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const;
 
 protected:
 	
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
+
+  template <typename T>
+  void containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const;
 	
   tf::Vector3 m_center;
   double    m_radius;	
@@ -240,11 +266,17 @@ public:
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
+  virtual void containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const;
+  virtual void containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const;
+  virtual void intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const;
 
 protected:
 	
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
+
+  template <typename T>
+  void containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const;
 	
   tf::Vector3 m_center;
   tf::Vector3 m_normalH;
@@ -286,11 +318,17 @@ public:
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
+  virtual void containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const;
+  virtual void containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const;
+  virtual void intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const;
 
 protected:
 	
   virtual void useDimensions(const shapes::Shape *shape); // (x, y, z) = (length, width, height)	    
   virtual void updateInternalData(void);
+
+  template <typename T>
+  void containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const;
 	
   tf::Vector3 m_center;
   tf::Vector3 m_normalL;
@@ -371,11 +409,13 @@ public:
   ConvexMesh(void) : Body()
   {	    
     m_type = shapes::MESH;
+    m_bvhScale = -1.0;
   }
 	
   ConvexMesh(const shapes::Shape *shape) : Body()
   {	  
     m_type = shapes::MESH;
+    m_bvhScale = -1.0;
     setDimensions(shape);
   }
 	
@@ -389,6 +429,9 @@ public:
   virtual void computeBoundingSphere(BoundingSphere &sphere) const;
   virtual void computeBoundingCylinder(BoundingCylinder &cylinder) const;
   virtual bool intersectsRay(const tf::Vector3& origin, const tf::Vector3 &dir, std::vector<tf::Vector3> *intersections = NULL, unsigned int count = 0) const;
+  virtual void containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const;
+  virtual void containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const;
+  virtual void intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const;
 
   const std::vector<unsigned int>& getTriangles() const {
     return m_triangles;
@@ -406,14 +449,36 @@ protected:
 	
   virtual void useDimensions(const shapes::Shape *shape);
   virtual void updateInternalData(void);
+
+  template <typename T>
+  void containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const;
+	
+  /** \brief A node of the bounding volume hierarchy over the
+      triangles of the hull. The first child of an inner node
+      follows it; \e start is the index of the second child. For
+      leaves, \e start and \e count select a range of
+      m_bvhTriangles */
+  struct BVHNode
+  {
+    tf::Vector3  min;
+    tf::Vector3  max;
+    unsigned int start;
+    unsigned int count;
+  };
 	
   unsigned int countVerticesBehindPlane(const tf::tfVector4& planeNormal) const;
   bool isPointInsidePlanes(const tf::Vector3& point) const;
+  void updateScaledVertices(void);
+  unsigned int buildBVH(unsigned int begin, unsigned int end, const std::vector<tf::Vector3> &centroids);
 	
   std::vector<tf::tfVector4>    m_planes;
   std::vector<tf::Vector3>    m_vertices;
   std::vector<tf::Vector3>    m_scaledVertices;
   std::vector<unsigned int> m_triangles;
+  std::vector<BVHNode>      m_bvh;
+  std::vector<unsigned int> m_bvhTriangles;
+  double                    m_bvhScale;   // scale and padding the scaled vertices
+  double                    m_bvhPadding; // and the BVH were last computed for
   tf::Transform               m_iPose;
 	
   tf::Vector3                 m_center;
@@ -46,7 +46,9 @@ namespace bodies {
 
 /**
    This function sets the mask for the transforms to false if they
-   are inside any body in any body vector, and otherwise sets them to true
+   are inside any body in any body vector, and otherwise sets them to true.
+   The poses are bucketed in a uniform grid, so each body is only tested
+   against the poses near its bounding sphere
  */
 
 void maskPosesInsideBodyVectors(const std::vector<tf::Transform>& poses,
@@ -0,0 +1,148 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef GEOMETRIC_SHAPES_MESH_CACHE_
+#define GEOMETRIC_SHAPES_MESH_CACHE_
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+namespace shapes
+{
+
+/** \brief A persistent, content-addressed cache for the results of
+    expensive mesh processing (loading meshes through assimp,
+    computing convex hulls).  Entries are stored as binary files
+    named by a hash of their inputs, so every process that loads the
+    same mesh can reuse the work of the first one.
+
+    The cache lives in $ROS_HOME/geometric_shapes_cache (or
+    ~/.ros/geometric_shapes_cache).  The directory can be changed with
+    the GEOMETRIC_SHAPES_CACHE_DIR environment variable; setting that
+    variable to an empty string disables the cache.
+
+    Only results derived from meshes loaded from resources are cached;
+    meshes built at runtime (e.g. collision objects received over a
+    topic) never touch the disk. */
+namespace mesh_cache
+{
+
+/** \brief Hash a block of bytes (64 bit FNV-1a), chaining from \e seed */
+uint64_t hash(const void *data, std::size_t size, uint64_t seed = 14695981039346656037ULL);
+
+/** \brief Whether cache entries will be read and written */
+bool enabled(void);
+
+/** \brief Record that the mesh whose vertices hash to \e key was
+    loaded from a resource, so results computed from it may be cached */
+void addResourceMesh(uint64_t key);
+
+/** \brief Whether addResourceMesh() was called with \e key in this process */
+bool isResourceMesh(uint64_t key);
+
+/** \brief The directory the cache entries are stored in; empty if the cache is disabled */
+std::string getDirectory(void);
+
+/** \brief A read-only, memory-mapped view of a cache entry. Data is
+    read sequentially from the beginning of the entry */
+class Entry
+{
+public:
+  
+  Entry(void);
+  
+  ~Entry(void);
+
+  /** \brief Map the entry of type \e kind with key \e key. Returns
+      false if there is no such entry or it was written by an
+      incompatible version */
+  bool open(const std::string &kind, uint64_t key);
+  
+  /** \brief Copy the next \e size bytes of the entry into \e dest. Returns false if the entry is too short */
+  bool read(void *dest, std::size_t size);
+
+  template<typename T>
+  bool read(T &value)
+  {
+    return read(&value, sizeof(T));
+  }
+
+  /** \brief Whether all the data in the entry has been read */
+  bool atEnd(void) const
+  {
+    return offset_ == size_;
+  }
+  
+  void close(void);
+  
+private:
+
+  Entry(const Entry&);
+  Entry& operator=(const Entry&);
+  
+  char        *data_;
+  std::size_t  size_;
+  std::size_t  offset_;
+};
+
+/** \brief Accumulates the data for a cache entry and stores it
+    atomically, so concurrent readers never see a partial entry */
+class EntryWriter
+{
+public:
+
+  void write(const void *data, std::size_t size)
+  {
+    buffer_.append(static_cast<const char*>(data), size);
+  }
+
+  template<typename T>
+  void write(const T &value)
+  {
+    write(&value, sizeof(T));
+  }
+  
+  /** \brief Store the accumulated data as the entry of type \e kind with key \e key */
+  bool commit(const std::string &kind, uint64_t key) const;
+  
+private:
+  
+  std::string buffer_;
+};
+
+}
+}
+
+#endif
@@ -35,6 +35,7 @@
 /** \author Ioan Sucan */
 
 #include "geometric_shapes/bodies.h"
+#include "geometric_shapes/mesh_cache.h"
 
 #include <ros/console.h>
 
@@ -65,6 +66,84 @@ extern "C"
 #include <iostream>
 #include <cmath>
 
+namespace
+{
+
+/* convex hulls are stored as: vertex count, plane count, triangle
+   index count, followed by the vertices (x,y,z), the planes (a,b,c,d)
+   and the triangle indices */
+static const std::string CONVEX_HULL_CACHE_KIND = "hull";
+
+bool loadCachedConvexHull(uint64_t key, std::vector<tf::Vector3> &vertices,
+                          std::vector<tf::tfVector4> &planes, std::vector<unsigned int> &triangles)
+{
+  shapes::mesh_cache::Entry entry;
+  if (!entry.open(CONVEX_HULL_CACHE_KIND, key))
+    return false;
+  
+  uint32_t nv, np, nt;
+  if (!entry.read(nv) || !entry.read(np) || !entry.read(nt))
+    return false;
+
+  std::vector<tf::Vector3> v(nv);
+  std::vector<tf::tfVector4> p(np);
+  std::vector<unsigned int> t(nt);
+  double d[4];
+  for (uint32_t i = 0 ; i < nv ; ++i)
+  {
+    if (!entry.read(d, 3 * sizeof(double)))
+      return false;
+    v[i].setValue(d[0], d[1], d[2]);
+  }
+  for (uint32_t i = 0 ; i < np ; ++i)
+  {
+    if (!entry.read(d, 4 * sizeof(double)))
+      return false;
+    p[i] = tf::tfVector4(d[0], d[1], d[2], d[3]);
+  }
+  for (uint32_t i = 0 ; i < nt ; ++i)
+  {
+    uint32_t index;
+    if (!entry.read(index) || index >= nv)
+      return false;
+    t[i] = index;
+  }
+  if (!entry.atEnd())
+    return false;
+  
+  vertices.swap(v);
+  planes.swap(p);
+  triangles.swap(t);
+  return true;
+}
+
+void storeCachedConvexHull(uint64_t key, const std::vector<tf::Vector3> &vertices,
+                           const std::vector<tf::tfVector4> &planes, const std::vector<unsigned int> &triangles)
+{
+  if (!shapes::mesh_cache::enabled())
+    return;
+  
+  shapes::mesh_cache::EntryWriter writer;
+  writer.write((uint32_t)vertices.size());
+  writer.write((uint32_t)planes.size());
+  writer.write((uint32_t)triangles.size());
+  for (unsigned int i = 0 ; i < vertices.size() ; ++i)
+  {
+    double d[3] = { vertices[i].x(), vertices[i].y(), vertices[i].z() };
+    writer.write(d, sizeof(d));
+  }
+  for (unsigned int i = 0 ; i < planes.size() ; ++i)
+  {
+    double d[4] = { planes[i].getX(), planes[i].getY(), planes[i].getZ(), planes[i].getW() };
+    writer.write(d, sizeof(d));
+  }
+  for (unsigned int i = 0 ; i < triangles.size() ; ++i)
+    writer.write((uint32_t)triangles[i]);
+  writer.commit(CONVEX_HULL_CACHE_KIND, key);
+}
+
+}
+
 bodies::Body* bodies::createBodyFromShape(const shapes::Shape *shape)
 {
   Body *body = NULL;
@@ -135,6 +214,59 @@ static inline double distanceSQR(const tf::Vector3& p, const tf::Vector3& origin
   double d = dir.dot(a);
   return a.length2() - d * d;
 }
+
+/** \brief Restrict the interval [t_near, t_far] of ray parameters to
+    those for which o + t * d lies within [-h, h]. This is written
+    without branches, so that it can be used in vectorized loops */
+static inline void clipToSlab(double o, double d, double h, double &t_near, double &t_far)
+{
+  const double inv = 1.0 / d;
+  const double t1 = (-h - o) * inv;
+  const double t2 = (h - o) * inv;
+  const double lo = t1 < t2 ? t1 : t2;
+  const double hi = t1 < t2 ? t2 : t1;
+  t_near = lo > t_near ? lo : t_near;
+  t_far = hi < t_far ? hi : t_far;
+}
+
+static inline double coordinate(const tf::Vector3 &v, int axis)
+{
+  return axis == 0 ? v.x() : (axis == 1 ? v.y() : v.z());
+}
+
+/** \brief Check if the ray origin + t * dir, t >= 0, intersects an
+    axis-aligned box */
+static inline bool rayIntersectsBox(const tf::Vector3 &origin, const tf::Vector3 &dir, const tf::Vector3 &min, const tf::Vector3 &max)
+{
+  double t_near = 0.0;
+  double t_far = INFINITY;
+  for (int i = 0 ; i < 3 ; ++i)
+  {
+    const double o = coordinate(origin, i);
+    const double d = coordinate(dir, i);
+    const double lo = coordinate(min, i);
+    const double hi = coordinate(max, i);
+    if (fabs(d) < ZERO)
+    {
+      if (o < lo || o > hi)
+        return false;
+    }
+    else
+    {
+      double t1 = (lo - o) / d;
+      double t2 = (hi - o) / d;
+      if (t1 > t2)
+        std::swap(t1, t2);
+      if (t1 > t_near)
+        t_near = t1;
+      if (t2 < t_far)
+        t_far = t2;
+      if (t_near > t_far)
+        return false;
+    }
+  }
+  return true;
+}
     
 namespace detail
 {
@@ -156,14 +288,103 @@ struct interscOrder
     return a.time < b.time;
   }
 };
+
+// order triangles by the coordinate of their centroid along an axis
+struct centroidOrder
+{
+  centroidOrder(const std::vector<tf::Vector3> &_centroids, int _axis) : centroids(_centroids), axis(_axis) {}
+  
+  bool operator()(unsigned int a, unsigned int b) const
+  {
+    return coordinate(centroids[a], axis) < coordinate(centroids[b], axis);
+  }
+  
+  const std::vector<tf::Vector3> &centroids;
+  int                             axis;
+};
 }
 }
 
+void bodies::Body::containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const
+{
+  for (std::size_t i = 0 ; i < n ; ++i)
+    if (containsPoint(tf::Vector3(x[i], y[i], z[i])))
+      inside[i] = 1;
+}
+
+void bodies::Body::containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const
+{
+  for (std::size_t i = 0 ; i < n ; ++i)
+    if (containsPoint(tf::Vector3(x[i], y[i], z[i])))
+      inside[i] = 1;
+}
+
+void bodies::Body::intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const
+{
+  std::vector<tf::Vector3> intersections;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    depth[i] = -1.0;
+    tf::Vector3 dir(dx[i], dy[i], dz[i]);
+    double len = dir.length();
+    if (len < ZERO)
+      continue;
+    intersections.clear();
+    if (intersectsRay(origin, dir / len, &intersections, 1) && !intersections.empty())
+      depth[i] = (intersections[0] - origin).length() / len;
+  }
+}
+
 bool bodies::Sphere::containsPoint(const tf::Vector3 &p, bool verbose) const 
 {
   return (m_center - p).length2() < m_radius2;
 }
 
+template <typename T>
+void bodies::Sphere::containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const
+{
+  const double cx = m_center.x();
+  const double cy = m_center.y();
+  const double cz = m_center.z();
+  const double r2 = m_radius2;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double vx = cx - x[i];
+    const double vy = cy - y[i];
+    const double vz = cz - z[i];
+    inside[i] |= (unsigned char)(vx * vx + vy * vy + vz * vz < r2);
+  }
+}
+
+void bodies::Sphere::containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
+void bodies::Sphere::containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
+void bodies::Sphere::intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const
+{
+  const tf::Vector3 oc(origin - m_center);
+  const double ox = oc.x();
+  const double oy = oc.y();
+  const double oz = oc.z();
+  const double c = oc.length2() - m_radius2;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double a = dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i];
+    const double b = ox * dx[i] + oy * dy[i] + oz * dz[i];
+    const double disc = b * b - a * c;
+    const double s = sqrt(disc > 0.0 ? disc : 0.0);
+    const double t1 = (-b - s) / a;
+    const double t2 = (-b + s) / a;
+    depth[i] = disc >= 0.0 && t2 > 0.0 ? (t1 > 0.0 ? t1 : t2) : -1.0;
+  }
+}
+
 void bodies::Sphere::useDimensions(const shapes::Shape *shape) // radius
 {
   m_radius = static_cast<const shapes::Sphere*>(shape)->radius;
@@ -271,6 +492,37 @@ bool bodies::Cylinder::containsPoint(const tf::Vector3 &p, bool verbose) const
   }		
 }
 
+template <typename T>
+void bodies::Cylinder::containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const
+{
+  const double cx = m_center.x(), cy = m_center.y(), cz = m_center.z();
+  const double hx = m_normalH.x(), hy = m_normalH.y(), hz = m_normalH.z();
+  const double b1x = m_normalB1.x(), b1y = m_normalB1.y(), b1z = m_normalB1.z();
+  const double b2x = m_normalB2.x(), b2y = m_normalB2.y(), b2z = m_normalB2.z();
+  const double l2 = m_length2;
+  const double r2 = m_radius2;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double vx = x[i] - cx;
+    const double vy = y[i] - cy;
+    const double vz = z[i] - cz;
+    const double pH = vx * hx + vy * hy + vz * hz;
+    const double pB1 = vx * b1x + vy * b1y + vz * b1z;
+    const double pB2 = vx * b2x + vy * b2y + vz * b2z;
+    inside[i] |= (unsigned char)((fabs(pH) <= l2) & (pB2 * pB2 < r2 - pB1 * pB1));
+  }
+}
+
+void bodies::Cylinder::containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
+void bodies::Cylinder::containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
 void bodies::Cylinder::useDimensions(const shapes::Shape *shape) // (length, radius)
 {
   m_length = static_cast<const shapes::Cylinder*>(shape)->length;
@@ -314,6 +566,45 @@ void bodies::Cylinder::computeBoundingCylinder(BoundingCylinder &cylinder) const
   cylinder.length = m_scale*m_length+m_padding;
 }
 
+void bodies::Cylinder::intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const
+{
+  const tf::Vector3 oc(origin - m_center);
+  const double oH = oc.dot(m_normalH);
+  const double oB1 = oc.dot(m_normalB1);
+  const double oB2 = oc.dot(m_normalB2);
+  const double c = oB1 * oB1 + oB2 * oB2 - m_radius2;
+  const double hx = m_normalH.x(), hy = m_normalH.y(), hz = m_normalH.z();
+  const double b1x = m_normalB1.x(), b1y = m_normalB1.y(), b1z = m_normalB1.z();
+  const double b2x = m_normalB2.x(), b2y = m_normalB2.y(), b2z = m_normalB2.z();
+  const double l2 = m_length2;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double dH = dx[i] * hx + dy[i] * hy + dz[i] * hz;
+    const double dB1 = dx[i] * b1x + dy[i] * b1y + dz[i] * b1z;
+    const double dB2 = dx[i] * b2x + dy[i] * b2y + dz[i] * b2z;
+    
+    // the caps of the cylinder
+    double t_near = -INFINITY;
+    double t_far = INFINITY;
+    clipToSlab(oH, dH, l2, t_near, t_far);
+    
+    // the infinite cylinder; rays parallel to the axis are either
+    // always or never within the radius
+    const double a = dB1 * dB1 + dB2 * dB2;
+    const double b = oB1 * dB1 + oB2 * dB2;
+    const double disc = b * b - a * c;
+    const double s = sqrt(disc > 0.0 ? disc : 0.0);
+    const bool parallel = !(a > 0.0);
+    const double t1 = parallel ? -INFINITY : (-b - s) / a;
+    const double t2 = parallel ? INFINITY : (-b + s) / a;
+    const bool valid = parallel ? c <= 0.0 : disc >= 0.0;
+    t_near = t1 > t_near ? t1 : t_near;
+    t_far = t2 < t_far ? t2 : t_far;
+    
+    depth[i] = valid && t_near <= t_far && t_far > 0.0 ? (t_near > 0.0 ? t_near : t_far) : -1.0;
+  }
+}
+
 bool bodies::Cylinder::intersectsRay(const tf::Vector3& origin, const tf::Vector3& dir, std::vector<tf::Vector3> *intersections, unsigned int count) const
 {
   if (distanceSQR(m_center, origin, dir) > m_radiusBSqr) return false;
@@ -440,6 +731,36 @@ bool bodies::Box::containsPoint(const tf::Vector3 &p, bool verbose) const
   return true;
 }
 
+template <typename T>
+void bodies::Box::containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const
+{
+  const double cx = m_center.x(), cy = m_center.y(), cz = m_center.z();
+  const double lx = m_normalL.x(), ly = m_normalL.y(), lz = m_normalL.z();
+  const double wx = m_normalW.x(), wy = m_normalW.y(), wz = m_normalW.z();
+  const double hx = m_normalH.x(), hy = m_normalH.y(), hz = m_normalH.z();
+  const double l2 = m_length2, w2 = m_width2, h2 = m_height2;
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double vx = x[i] - cx;
+    const double vy = y[i] - cy;
+    const double vz = z[i] - cz;
+    const double pL = vx * lx + vy * ly + vz * lz;
+    const double pW = vx * wx + vy * wy + vz * wz;
+    const double pH = vx * hx + vy * hy + vz * hz;
+    inside[i] |= (unsigned char)((fabs(pL) <= l2) & (fabs(pW) <= w2) & (fabs(pH) <= h2));
+  }
+}
+
+void bodies::Box::containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
+void bodies::Box::containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
 void bodies::Box::useDimensions(const shapes::Shape *shape) // (x, y, z) = (length, width, height)
 {
   const double *size = static_cast<const shapes::Box*>(shape)->size;
@@ -508,6 +829,26 @@ void bodies::Box::computeBoundingCylinder(BoundingCylinder &cylinder) const
   //cylinder.radius = sqrt(2*(max_rad*max_rad));
 }
 
+void bodies::Box::intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const
+{
+  const tf::Vector3 oc(origin - m_center);
+  const double oL = oc.dot(m_normalL);
+  const double oW = oc.dot(m_normalW);
+  const double oH = oc.dot(m_normalH);
+  const double lx = m_normalL.x(), ly = m_normalL.y(), lz = m_normalL.z();
+  const double wx = m_normalW.x(), wy = m_normalW.y(), wz = m_normalW.z();
+  const double hx = m_normalH.x(), hy = m_normalH.y(), hz = m_normalH.z();
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    double t_near = -INFINITY;
+    double t_far = INFINITY;
+    clipToSlab(oL, dx[i] * lx + dy[i] * ly + dz[i] * lz, m_length2, t_near, t_far);
+    clipToSlab(oW, dx[i] * wx + dy[i] * wy + dz[i] * wz, m_width2, t_near, t_far);
+    clipToSlab(oH, dx[i] * hx + dy[i] * hy + dz[i] * hz, m_height2, t_near, t_far);
+    depth[i] = t_near <= t_far && t_far > 0.0 ? (t_near > 0.0 ? t_near : t_far) : -1.0;
+  }
+}
+
 bool bodies::Box::intersectsRay(const tf::Vector3& origin, const tf::Vector3& dir, std::vector<tf::Vector3> *intersections, unsigned int count) const
 {  
   if (distanceSQR(m_center, origin, dir) > m_radius2) return false;
@@ -781,6 +1122,63 @@ bool bodies::ConvexMesh::containsPoint(const tf::Vector3 &p, bool verbose) const
     return false;
 }
 
+template <typename T>
+void bodies::ConvexMesh::containsPointsT(const T *x, const T *y, const T *z, std::size_t n, unsigned char *inside) const
+{
+  if (n == 0)
+    return;
+  
+  // the bounding box discards most points; only the remaining ones
+  // are transformed to the frame of the mesh and tested against the
+  // planes of the hull
+  std::vector<unsigned char> candidate(n, 0);
+  m_boundingBox.containsPoints(x, y, z, n, &candidate[0]);
+  
+  std::vector<std::size_t> index;
+  std::vector<double> px, py, pz;
+  for (std::size_t i = 0 ; i < n ; ++i)
+    if (candidate[i] && !inside[i])
+    {
+      tf::Vector3 ip(m_iPose * tf::Vector3(x[i], y[i], z[i]));
+      ip = m_meshCenter + (ip - m_meshCenter) * m_scale;
+      index.push_back(i);
+      px.push_back(ip.x());
+      py.push_back(ip.y());
+      pz.push_back(ip.z());
+    }
+  
+  const std::size_t nc = index.size();
+  if (nc == 0)
+    return;
+  
+  std::vector<unsigned char> outside(nc, 0);
+  const double padding = m_padding;
+  const unsigned int numplanes = m_planes.size();
+  for (unsigned int j = 0 ; j < numplanes ; ++j)
+  {
+    const double a = m_planes[j].getX();
+    const double b = m_planes[j].getY();
+    const double c = m_planes[j].getZ();
+    const double d = m_planes[j].getW();
+    for (std::size_t k = 0 ; k < nc ; ++k)
+      outside[k] |= (unsigned char)(a * px[k] + b * py[k] + c * pz[k] + d - padding - 1e-6 > 0.0);
+  }
+  
+  for (std::size_t k = 0 ; k < nc ; ++k)
+    if (!outside[k])
+      inside[index[k]] = 1;
+}
+
+void bodies::ConvexMesh::containsPoints(const double *x, const double *y, const double *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
+void bodies::ConvexMesh::containsPoints(const float *x, const float *y, const float *z, std::size_t n, unsigned char *inside) const
+{
+  containsPointsT(x, y, z, n, inside);
+}
+
 void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
 {  
   const shapes::Mesh *mesh = static_cast<const shapes::Mesh*>(shape);
@@ -816,6 +1214,7 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   m_planes.clear();
   m_triangles.clear();
   m_vertices.clear();
+  m_bvhScale = -1.0;
   m_meshRadiusB = 0.0;
   m_meshCenter.setValue(tfScalar(0), tfScalar(0), tfScalar(0));
 
@@ -854,14 +1253,8 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   }
 
 
-  /* compute convex hull */
-  coordT *points = (coordT *)calloc(mesh->vertexCount*3, sizeof(coordT));
   for(unsigned int i = 0; i < mesh->vertexCount ; ++i)
   {
-    points[3*i+0] = (coordT) mesh->vertices[3*i+0];
-    points[3*i+1] = (coordT) mesh->vertices[3*i+1];
-    points[3*i+2] = (coordT) mesh->vertices[3*i+2];
-
     double dista = mesh->vertices[3 * i + off1]-pose1;
     double distb = mesh->vertices[3 * i + off2]-pose2;
     double dist = sqrt(((dista*dista)+(distb*distb)));
@@ -872,68 +1265,95 @@ void bodies::ConvexMesh::useDimensions(const shapes::Shape *shape)
   m_boundingCylinder.radius = maxdist;
   m_boundingCylinder.length = cyl_length;
 
-  FILE* null = fopen ("/dev/null","w");
+  /* the hull only depends on the vertices, so it can be reused from an
+     earlier run; only meshes loaded from resources are cached, so that
+     objects created at runtime do not fill up the cache */
+  uint64_t hull_key = 0;
+  bool use_cache = shapes::mesh_cache::enabled();
+  if (use_cache)
+  {
+    hull_key = shapes::mesh_cache::hash(mesh->vertices, mesh->vertexCount * 3 * sizeof(double));
+    use_cache = shapes::mesh_cache::isResourceMesh(hull_key);
+  }
+  if (!use_cache || !loadCachedConvexHull(hull_key, m_vertices, m_planes, m_triangles))
+  {
+    /* compute convex hull */
+    coordT *points = (coordT *)calloc(mesh->vertexCount*3, sizeof(coordT));
+    for(unsigned int i = 0; i < mesh->vertexCount ; ++i)
+    {
+      points[3*i+0] = (coordT) mesh->vertices[3*i+0];
+      points[3*i+1] = (coordT) mesh->vertices[3*i+1];
+      points[3*i+2] = (coordT) mesh->vertices[3*i+2];
+    }
 
-  char flags[] = "qhull Tv";
-  int exitcode = qh_new_qhull(3, mesh->vertexCount, points, true, flags, null, null);
+    FILE* null = fopen ("/dev/null","w");
 
-  if (exitcode != 0)
-  {
+    char flags[] = "qhull Tv";
+    int exitcode = qh_new_qhull(3, mesh->vertexCount, points, true, flags, null, null);
+
+    if (exitcode != 0)
+    {
       ROS_WARN("Convex hull creation failed");
-    qh_freeqhull (!qh_ALL);
-    int curlong, totlong;
-    qh_memfreeshort (&curlong, &totlong);
-    return;
-  }
+      qh_freeqhull (!qh_ALL);
+      int curlong, totlong;
+      qh_memfreeshort (&curlong, &totlong);
+      return;
+    }
 
-  int num_facets = qh num_facets;
+    int num_facets = qh num_facets;
 
-  int num_vertices = qh num_vertices;
-  m_vertices.reserve(num_vertices);
-  tf::Vector3 sum(0, 0, 0);
+    int num_vertices = qh num_vertices;
+    m_vertices.reserve(num_vertices);
 
-  //necessary for FORALLvertices
-  std::map<unsigned int, unsigned int> qhull_vertex_table;
-  vertexT * vertex;
-  FORALLvertices
-  {
-    tf::Vector3 vert(vertex->point[0],
-                         vertex->point[1],
-                         vertex->point[2]);
-    qhull_vertex_table[vertex->id] = m_vertices.size();
-    sum = sum + vert;
-    m_vertices.push_back(vert);
+    //necessary for FORALLvertices
+    std::map<unsigned int, unsigned int> qhull_vertex_table;
+    vertexT * vertex;
+    FORALLvertices
+    {
+      tf::Vector3 vert(vertex->point[0],
+                       vertex->point[1],
+                       vertex->point[2]);
+      qhull_vertex_table[vertex->id] = m_vertices.size();
+      m_vertices.push_back(vert);
+    }
+
+    m_triangles.reserve(num_facets);
+
+    //neccessary for qhull macro
+    facetT * facet;
+    FORALLfacets
+    {
+      tf::tfVector4 planeEquation(facet->normal[0], facet->normal[1], facet->normal[2], facet->offset);
+      m_planes.push_back(planeEquation);
+
+      // Needed by FOREACHvertex_i_
+      int vertex_n, vertex_i;
+      FOREACHvertex_i_ ((*facet).vertices)
+      {
+        m_triangles.push_back(qhull_vertex_table[vertex->id]);
+      }
+    }
+    qh_freeqhull(!qh_ALL);
+    int curlong, totlong;
+    qh_memfreeshort (&curlong, &totlong);
+
+    if (use_cache)
+      storeCachedConvexHull(hull_key, m_vertices, m_planes, m_triangles);
   }
 
-  m_meshCenter = sum / (double)(num_vertices);
+  tf::Vector3 sum(0, 0, 0);
+  for (unsigned int j = 0 ; j < m_vertices.size() ; ++j)
+    sum = sum + m_vertices[j];
+  
+  m_meshCenter = sum / (double)(m_vertices.size());
   for (unsigned int j = 0 ; j < m_vertices.size() ; ++j)
   {
-      double dist = m_vertices[j].distance2(m_meshCenter);
+    double dist = m_vertices[j].distance2(m_meshCenter);
     if (dist > m_radiusB)
       m_radiusB = dist;
   }
 
   m_radiusB = sqrt(m_radiusB);
-  m_triangles.reserve(num_facets);
-
-  //neccessary for qhull macro
-  facetT * facet;
-  FORALLfacets
-  {
-    tf::tfVector4 planeEquation(facet->normal[0], facet->normal[1], facet->normal[2], facet->offset);
-    m_planes.push_back(planeEquation);
-
-    // Needed by FOREACHvertex_i_
-    int vertex_n, vertex_i;
-    FOREACHvertex_i_ ((*facet).vertices)
-    {
-      m_triangles.push_back(qhull_vertex_table[vertex->id]);
-    }
-
-  }
-  qh_freeqhull(!qh_ALL);
-  int curlong, totlong;
-  qh_memfreeshort (&curlong, &totlong);
 
 
 
@@ -1031,6 +1451,14 @@ void bodies::ConvexMesh::updateInternalData(void)
   m_radiusB = m_meshRadiusB * m_scale + m_padding;
   m_radiusBSqr = m_radiusB * m_radiusB;
 
+  // the scaled vertices are in the frame of the mesh, so they only
+  // change with the scale and the padding, not with the pose
+  if (m_bvhScale != m_scale || m_bvhPadding != m_padding)
+    updateScaledVertices();
+}
+
+void bodies::ConvexMesh::updateScaledVertices(void)
+{
   m_scaledVertices.resize(m_vertices.size());
   for (unsigned int i = 0 ; i < m_vertices.size() ; ++i)
   {
@@ -1038,6 +1466,65 @@ void bodies::ConvexMesh::updateInternalData(void)
     tfScalar l = v.length();
     m_scaledVertices[i] = m_meshCenter + v * (m_scale + (l > ZERO ? m_padding / l : 0.0));
   }
+  
+  const unsigned int nt = m_triangles.size() / 3;
+  std::vector<tf::Vector3> centroids(nt);
+  m_bvhTriangles.resize(nt);
+  for (unsigned int i = 0 ; i < nt ; ++i)
+  {
+    centroids[i] = (m_scaledVertices[m_triangles[3 * i]] + m_scaledVertices[m_triangles[3 * i + 1]] + m_scaledVertices[m_triangles[3 * i + 2]]) / 3.0;
+    m_bvhTriangles[i] = i;
+  }
+  m_bvh.clear();
+  if (nt > 0)
+  {
+    m_bvh.reserve(2 * nt);
+    buildBVH(0, nt, centroids);
+  }
+  
+  m_bvhScale = m_scale;
+  m_bvhPadding = m_padding;
+}
+
+unsigned int bodies::ConvexMesh::buildBVH(unsigned int begin, unsigned int end, const std::vector<tf::Vector3> &centroids)
+{
+  const unsigned int index = m_bvh.size();
+  m_bvh.push_back(BVHNode());
+  
+  tf::Vector3 lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+  tf::Vector3 clo(lo), chi(hi);
+  for (unsigned int i = begin ; i < end ; ++i)
+  {
+    const unsigned int t = m_bvhTriangles[i];
+    for (unsigned int k = 0 ; k < 3 ; ++k)
+    {
+      lo.setMin(m_scaledVertices[m_triangles[3 * t + k]]);
+      hi.setMax(m_scaledVertices[m_triangles[3 * t + k]]);
+    }
+    clo.setMin(centroids[t]);
+    chi.setMax(centroids[t]);
+  }
+  m_bvh[index].min = lo;
+  m_bvh[index].max = hi;
+  
+  if (end - begin <= 4)
+  {
+    m_bvh[index].start = begin;
+    m_bvh[index].count = end - begin;
+    return index;
+  }
+  
+  // split at the median centroid along the longest axis
+  tf::Vector3 extent(chi - clo);
+  int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+  unsigned int mid = (begin + end) / 2;
+  std::nth_element(m_bvhTriangles.begin() + begin, m_bvhTriangles.begin() + mid, m_bvhTriangles.begin() + end,
+                   detail::centroidOrder(centroids, axis));
+  buildBVH(begin, mid, centroids);
+  unsigned int second = buildBVH(mid, end, centroids);
+  m_bvh[index].start = second;
+  m_bvh[index].count = 0;
+  return index;
 }
 
 void bodies::ConvexMesh::computeBoundingSphere(BoundingSphere &sphere) const
@@ -1095,10 +1582,76 @@ double bodies::ConvexMesh::computeVolume(void) const
   return fabs(volume)/6.0;
 }
 
+void bodies::ConvexMesh::intersectsRays(const tf::Vector3 &origin, const double *dx, const double *dy, const double *dz, std::size_t n, double *depth) const
+{
+  if (n == 0)
+    return;
+  
+  // discard the rays that miss the bounding sphere
+  const tf::Vector3 oc(origin - m_center);
+  const double ox = oc.x(), oy = oc.y(), oz = oc.z();
+  const double c = oc.length2() - m_radiusBSqr;
+  std::vector<unsigned char> candidate(n);
+  for (std::size_t i = 0 ; i < n ; ++i)
+  {
+    const double a = dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i];
+    const double b = ox * dx[i] + oy * dy[i] + oz * dz[i];
+    const double disc = b * b - a * c;
+    candidate[i] = (unsigned char)((disc >= 0.0) & (sqrt(disc > 0.0 ? disc : 0.0) > b));
+    depth[i] = -1.0;
+  }
+  
+  // the remaining rays are clipped by the planes of the hull, in
+  // the frame of the mesh; the hull is convex, so the ray is inside
+  // it for one interval [t_near, t_far] at most
+  const tf::Vector3 o(m_meshCenter + (m_iPose * origin - m_meshCenter) * m_scale);
+  const tf::Matrix3x3 &basis = m_iPose.getBasis();
+  std::vector<std::size_t> index;
+  std::vector<double> rx, ry, rz;
+  for (std::size_t i = 0 ; i < n ; ++i)
+    if (candidate[i])
+    {
+      tf::Vector3 dr(basis * tf::Vector3(dx[i], dy[i], dz[i]) * m_scale);
+      index.push_back(i);
+      rx.push_back(dr.x());
+      ry.push_back(dr.y());
+      rz.push_back(dr.z());
+    }
+  
+  const std::size_t nc = index.size();
+  if (nc == 0)
+    return;
+  
+  std::vector<double> t_near(nc, -INFINITY);
+  std::vector<double> t_far(nc, INFINITY);
+  std::vector<unsigned char> miss(nc, 0);
+  const unsigned int numplanes = m_planes.size();
+  for (unsigned int j = 0 ; j < numplanes ; ++j)
+  {
+    const double a = m_planes[j].getX();
+    const double b = m_planes[j].getY();
+    const double c = m_planes[j].getZ();
+    const double dist = m_planes[j].dot(o) + m_planes[j].getW() - m_padding - 1e-6;
+    for (std::size_t k = 0 ; k < nc ; ++k)
+    {
+      const double den = a * rx[k] + b * ry[k] + c * rz[k];
+      const double t = -dist / den;
+      t_near[k] = den < 0.0 && t > t_near[k] ? t : t_near[k];
+      t_far[k] = den > 0.0 && t < t_far[k] ? t : t_far[k];
+      miss[k] |= (unsigned char)((den == 0.0) & (dist > 0.0));
+    }
+  }
+  
+  for (std::size_t k = 0 ; k < nc ; ++k)
+    if (!miss[k] && t_near[k] <= t_far[k] && t_far[k] > 0.0)
+      depth[index[k]] = t_near[k] > 0.0 ? t_near[k] : t_far[k];
+}
+
 bool bodies::ConvexMesh::intersectsRay(const tf::Vector3& origin, const tf::Vector3& dir, std::vector<tf::Vector3> *intersections, unsigned int count) const
 {
   if (distanceSQR(m_center, origin, dir) > m_radiusBSqr) return false;
   if (!m_boundingBox.intersectsRay(origin, dir)) return false;
+  if (m_bvh.empty()) return false;
     
   // transform the ray into the coordinate frame of the mesh
   tf::Vector3 orig(m_iPose * origin);
@@ -1107,63 +1660,65 @@ bool bodies::ConvexMesh::intersectsRay(const tf::Vector3& origin, const tf::Vect
   std::vector<detail::intersc> ipts;
     
   bool result = false;
-    
-  // for each triangle 
-  const unsigned int nt = m_triangles.size() / 3;
-  for (unsigned int i = 0 ; i < nt ; ++i)
+  
+  // walk the BVH; only the triangles in the leaves the ray reaches are
+  // tested. The tree is balanced, so its depth is logarithmic in the
+  // number of triangles
+  unsigned int stack[64];
+  unsigned int top = 0;
+  stack[top++] = 0;
+  while (top > 0)
   {
-    tfScalar tmp = m_planes[i].dot(dr);
-    if (fabs(tmp) > ZERO)
+    const unsigned int index = stack[--top];
+    const BVHNode &node = m_bvh[index];
+    if (!rayIntersectsBox(orig, dr, node.min, node.max))
+      continue;
+    
+    if (node.count == 0)
+    {
+      stack[top++] = index + 1;
+      stack[top++] = node.start;
+      continue;
+    }
+    
+    for (unsigned int i = node.start ; i < node.start + node.count ; ++i)
     {
-      double t = -(m_planes[i].dot(orig) + m_planes[i].getW()) / tmp;
-      if (t > 0.0)
+      const unsigned int i3 = 3 * m_bvhTriangles[i];
+      const tf::Vector3 &a = m_scaledVertices[m_triangles[i3 + 0]];
+      const tf::Vector3 &b = m_scaledVertices[m_triangles[i3 + 1]];
+      const tf::Vector3 &c = m_scaledVertices[m_triangles[i3 + 2]];
+      
+      // intersection of the ray with the triangle, in barycentric
+      // coordinates (u, v)
+      tf::Vector3 ab(b - a);
+      tf::Vector3 ac(c - a);
+      tf::Vector3 p(dr.cross(ac));
+      double det = ab.dot(p);
+      if (fabs(det) < ZERO)
+        continue;
+      
+      tf::Vector3 ao(orig - a);
+      double u = ao.dot(p) / det;
+      if (u < 0.0 || u > 1.0)
+        continue;
+      
+      tf::Vector3 q(ao.cross(ab));
+      double v = dr.dot(q) / det;
+      if (v < 0.0 || u + v > 1.0)
+        continue;
+      
+      double t = ac.dot(q) / det;
+      if (t <= 0.0)
+        continue;
+      
+      result = true;
+      if (intersections)
       {
-        const int i3 = 3 * i;
-        const int v1 = m_triangles[i3 + 0];
-        const int v2 = m_triangles[i3 + 1];
-        const int v3 = m_triangles[i3 + 2];
-		
-        const tf::Vector3 &a = m_scaledVertices[v1];
-        const tf::Vector3 &b = m_scaledVertices[v2];
-        const tf::Vector3 &c = m_scaledVertices[v3];
-		
-        tf::Vector3 cb(c - b);
-        tf::Vector3 ab(a - b);
-		
-        // intersection of the plane defined by the triangle and the ray
-        tf::Vector3 P(orig + dr * t);
-		
-        // check if it is inside the triangle
-        tf::Vector3 pb(P - b);
-        tf::Vector3 c1(cb.cross(pb));
-        tf::Vector3 c2(cb.cross(ab));
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
-        tf::Vector3 ca(c - a);
-        tf::Vector3 pa(P - a);
-        tf::Vector3 ba(-ab);
-		
-        c1 = ca.cross(pa);
-        c2 = ca.cross(ba);
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
-        c1 = ba.cross(pa);
-        c2 = ba.cross(ca);
-		
-        if (c1.dot(c2) < 0.0)
-          continue;
-		
-        result = true;
-        if (intersections)
-        {
-          detail::intersc ip(origin + dir * t, t);
-          ipts.push_back(ip);
-        }
-        else
-          break;
+        detail::intersc ip(origin + dir * t, t);
+        ipts.push_back(ip);
       }
+      else
+        return result;
     }
   }
 
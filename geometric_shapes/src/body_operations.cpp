@@ -35,32 +35,152 @@
 /** \author Ioan Sucan, E. Gil Jones */
 
 #include <geometric_shapes/body_operations.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// the range of grid cells overlapped by the bounding sphere of a body
+struct CellRange
+{
+  const bodies::Body *body;
+  int x0, x1, y0, y1, z0, z1;
+};
+
+inline int cellCoordinate(double v, double lo, double cell_size, int count)
+{
+  double c = floor((v - lo) / cell_size);
+  if (c < 0.0)
+    return 0;
+  if (c >= count)
+    return count - 1;
+  return (int)c;
+}
+
+}
 
 void bodies::maskPosesInsideBodyVectors(const std::vector<tf::Transform>& poses,
                                         const std::vector<bodies::BodyVector*>& bvs,
                                         std::vector<bool>& mask,
                                         bool use_padded) {
-  mask.resize(poses.size(), false);
-  for(unsigned int i = 0; i < poses.size(); i++) {
-    bool inside = false;
-    tf::Vector3 pt = poses[i].getOrigin();
-    for(unsigned int j = 0; !inside && j < bvs.size(); j++) {
-      for(unsigned int k = 0;!inside && k < bvs[j]->getSize(); k++) {
-        if(!use_padded) {
-          if(bvs[j]->getBoundingSphere(k).center.distance2(pt) < bvs[j]->getBoundingSphereRadiusSquared(k)) {
-            if(bvs[j]->getBody(k)->containsPoint(pt)) {
-              inside = true;
-            }
-          }
-        } else {
-          if(bvs[j]->getPaddedBoundingSphere(k).center.distance2(pt) < bvs[j]->getPaddedBoundingSphereRadiusSquared(k)) {
-            if(bvs[j]->getPaddedBody(k)->containsPoint(pt)) {
-              inside = true;
-            }
-          }
+  const std::size_t np = poses.size();
+  mask.resize(np, false);
+  if(np == 0) {
+    return;
+  }
+
+  std::vector<const bodies::Body*> objects;
+  std::vector<bodies::BoundingSphere> spheres;
+  double radius_sum = 0.0;
+  for(unsigned int j = 0; j < bvs.size(); j++) {
+    for(unsigned int k = 0; k < bvs[j]->getSize(); k++) {
+      objects.push_back(use_padded ? bvs[j]->getPaddedBody(k) : bvs[j]->getBody(k));
+      spheres.push_back(use_padded ? bvs[j]->getPaddedBoundingSphere(k) : bvs[j]->getBoundingSphere(k));
+      radius_sum += spheres.back().radius;
+    }
+  }
+  if(objects.empty()) {
+    std::fill(mask.begin(), mask.end(), true);
+    return;
+  }
+
+  // the poses are bucketed in a uniform grid with cells about the
+  // size of the objects, so every object is only tested against the
+  // poses in the cells its bounding sphere overlaps
+  tf::Vector3 lo = poses[0].getOrigin();
+  tf::Vector3 hi = lo;
+  for(std::size_t i = 1; i < np; i++) {
+    const tf::Vector3& pt = poses[i].getOrigin();
+    lo.setValue(std::min(lo.x(), pt.x()), std::min(lo.y(), pt.y()), std::min(lo.z(), pt.z()));
+    hi.setValue(std::max(hi.x(), pt.x()), std::max(hi.y(), pt.y()), std::max(hi.z(), pt.z()));
+  }
+  double cell_size = 2.0 * radius_sum / objects.size();
+  if(cell_size <= 0.0) {
+    cell_size = 1.0;
+  }
+  int nx, ny, nz;
+  while(true) {
+    nx = (int)floor((hi.x() - lo.x()) / cell_size) + 1;
+    ny = (int)floor((hi.y() - lo.y()) / cell_size) + 1;
+    nz = (int)floor((hi.z() - lo.z()) / cell_size) + 1;
+    // do not use many more cells than there are poses
+    if((double)nx * ny * nz <= 4.0 * np + 64.0) {
+      break;
+    }
+    cell_size *= 2.0;
+  }
+  const std::size_t ncells = (std::size_t)nx * ny * nz;
+
+  // sort the poses by cell, ordered by (z, y, x), so that the poses in
+  // a run of cells along x are contiguous and can be tested in one batch
+  std::vector<std::size_t> cell_of(np);
+  std::vector<std::size_t> start(ncells + 1, 0);
+  for(std::size_t i = 0; i < np; i++) {
+    const tf::Vector3& pt = poses[i].getOrigin();
+    std::size_t c = ((std::size_t)cellCoordinate(pt.z(), lo.z(), cell_size, nz) * ny +
+                     cellCoordinate(pt.y(), lo.y(), cell_size, ny)) * nx +
+      cellCoordinate(pt.x(), lo.x(), cell_size, nx);
+    cell_of[i] = c;
+    start[c + 1]++;
+  }
+  for(std::size_t c = 0; c < ncells; c++) {
+    start[c + 1] += start[c];
+  }
+  std::vector<std::size_t> next(start.begin(), start.end() - 1);
+  std::vector<std::size_t> order(np);
+  std::vector<double> x(np), y(np), z(np);
+  for(std::size_t i = 0; i < np; i++) {
+    std::size_t k = next[cell_of[i]]++;
+    const tf::Vector3& pt = poses[i].getOrigin();
+    order[k] = i;
+    x[k] = pt.x();
+    y[k] = pt.y();
+    z[k] = pt.z();
+  }
+
+  std::vector<CellRange> ranges;
+  for(unsigned int b = 0; b < objects.size(); b++) {
+    const tf::Vector3& c = spheres[b].center;
+    const double r = spheres[b].radius;
+    if(c.x() + r < lo.x() || c.x() - r > hi.x() ||
+       c.y() + r < lo.y() || c.y() - r > hi.y() ||
+       c.z() + r < lo.z() || c.z() - r > hi.z()) {
+      continue;
+    }
+    CellRange range;
+    range.body = objects[b];
+    range.x0 = cellCoordinate(c.x() - r, lo.x(), cell_size, nx);
+    range.x1 = cellCoordinate(c.x() + r, lo.x(), cell_size, nx);
+    range.y0 = cellCoordinate(c.y() - r, lo.y(), cell_size, ny);
+    range.y1 = cellCoordinate(c.y() + r, lo.y(), cell_size, ny);
+    range.z0 = cellCoordinate(c.z() - r, lo.z(), cell_size, nz);
+    range.z1 = cellCoordinate(c.z() + r, lo.z(), cell_size, nz);
+    ranges.push_back(range);
+  }
+
+  // the layers of the grid along z hold disjoint sets of poses, so
+  // they can be processed in parallel
+  std::vector<unsigned char> inside(np, 0);
+#pragma omp parallel for schedule(dynamic)
+  for(int cz = 0; cz < nz; cz++) {
+    for(unsigned int b = 0; b < ranges.size(); b++) {
+      const CellRange& range = ranges[b];
+      if(cz < range.z0 || cz > range.z1) {
+        continue;
+      }
+      for(int cy = range.y0; cy <= range.y1; cy++) {
+        std::size_t row = ((std::size_t)cz * ny + cy) * nx;
+        std::size_t first = start[row + range.x0];
+        std::size_t last = start[row + range.x1 + 1];
+        if(last > first) {
+          range.body->containsPoints(&x[first], &y[first], &z[first], last - first, &inside[first]);
         }
       }
     }
-    mask[i] = !inside;
+  }
+
+  for(std::size_t k = 0; k < np; k++) {
+    mask[order[k]] = !inside[k];
   }
 }
@@ -0,0 +1,254 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include "geometric_shapes/mesh_cache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <set>
+
+#include <ros/console.h>
+
+namespace shapes
+{
+namespace mesh_cache
+{
+
+namespace
+{
+
+// bump this whenever the layout of any cached entry changes
+static const uint32_t CACHE_FORMAT_VERSION = 1;
+static const char CACHE_MAGIC[4] = { 'G', 'S', 'M', 'C' };
+
+// vertex hashes of the meshes loaded from resources by this process
+static std::set<uint64_t> resource_meshes;
+static pthread_mutex_t resource_meshes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct EntryHeader
+{
+  char     magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint64_t size;
+};
+
+bool makeDirectories(const std::string &path)
+{
+  for (std::size_t pos = path.find('/', 1) ; ; pos = path.find('/', pos + 1))
+  {
+    std::string sub = path.substr(0, pos);
+    if (mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (pos == std::string::npos)
+      break;
+  }
+  return true;
+}
+
+std::string entryFilename(const std::string &dir, const std::string &kind, uint64_t key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+  return dir + "/" + kind + "-" + name + ".bin";
+}
+
+}
+
+uint64_t hash(const void *data, std::size_t size, uint64_t seed)
+{
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  uint64_t h = seed;
+  for (std::size_t i = 0 ; i < size ; ++i)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+std::string getDirectory(void)
+{
+  const char *dir = getenv("GEOMETRIC_SHAPES_CACHE_DIR");
+  if (dir)
+    return std::string(dir);
+  
+  std::string ros_home;
+  const char *rh = getenv("ROS_HOME");
+  if (rh && rh[0])
+    ros_home = rh;
+  else
+  {
+    const char *home = getenv("HOME");
+    if (!home || !home[0])
+      return std::string();
+    ros_home = std::string(home) + "/.ros";
+  }
+  return ros_home + "/geometric_shapes_cache";
+}
+
+bool enabled(void)
+{
+  return !getDirectory().empty();
+}
+
+void addResourceMesh(uint64_t key)
+{
+  pthread_mutex_lock(&resource_meshes_lock);
+  resource_meshes.insert(key);
+  pthread_mutex_unlock(&resource_meshes_lock);
+}
+
+bool isResourceMesh(uint64_t key)
+{
+  pthread_mutex_lock(&resource_meshes_lock);
+  bool found = resource_meshes.find(key) != resource_meshes.end();
+  pthread_mutex_unlock(&resource_meshes_lock);
+  return found;
+}
+
+Entry::Entry(void) : data_(NULL), size_(0), offset_(0)
+{
+}
+
+Entry::~Entry(void)
+{
+  close();
+}
+
+void Entry::close(void)
+{
+  if (data_)
+    munmap(data_, size_);
+  data_ = NULL;
+  size_ = offset_ = 0;
+}
+
+bool Entry::open(const std::string &kind, uint64_t key)
+{
+  close();
+  if (!enabled())
+    return false;
+  
+  std::string filename = entryFilename(getDirectory(), kind, key);
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(EntryHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+  
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED)
+    return false;
+  
+  data_ = static_cast<char*>(mapped);
+  size_ = st.st_size;
+  
+  EntryHeader header;
+  if (!read(header) || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header.version != CACHE_FORMAT_VERSION || header.key != key || header.size != size_ - sizeof(EntryHeader))
+  {
+    ROS_DEBUG("Ignoring stale mesh cache entry '%s'", filename.c_str());
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool Entry::read(void *dest, std::size_t size)
+{
+  if (!data_ || size > size_ - offset_)
+    return false;
+  memcpy(dest, data_ + offset_, size);
+  offset_ += size;
+  return true;
+}
+
+bool EntryWriter::commit(const std::string &kind, uint64_t key) const
+{
+  if (!enabled())
+    return false;
+  
+  std::string dir = getDirectory();
+  if (!makeDirectories(dir))
+  {
+    ROS_DEBUG("Unable to create mesh cache directory '%s'", dir.c_str());
+    return false;
+  }
+  
+  EntryHeader header;
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_FORMAT_VERSION;
+  header.key = key;
+  header.size = buffer_.size();
+  
+  // write to a file unique to this writer and rename it into place
+  std::string filename = entryFilename(dir, kind, key);
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%d.%p.tmp", (int)getpid(), (const void*)this);
+  std::string tmp_filename = filename + suffix;
+  
+  FILE *f = fopen(tmp_filename.c_str(), "wb");
+  if (!f)
+    return false;
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (ok && !buffer_.empty())
+    ok = fwrite(buffer_.data(), buffer_.size(), 1, f) == 1;
+  ok = (fclose(f) == 0) && ok;
+  
+  if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0)
+  {
+    ROS_DEBUG("Unable to write mesh cache entry '%s'", filename.c_str());
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+}
+}
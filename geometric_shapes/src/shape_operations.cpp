@@ -35,6 +35,7 @@
 /** \author Ioan Sucan */
 
 #include "geometric_shapes/shape_operations.h"
+#include "geometric_shapes/mesh_cache.h"
 
 #include <cstdio>
 #include <cmath>
@@ -276,6 +277,54 @@ shapes::Mesh* createMeshFromVertices(const std::vector<tf::Vector3> &source)
   return mesh;
 }
 
+namespace
+{
+
+/* meshes are stored as: vertex count, triangle count, followed by
+   the vertices, triangle indices and normals as laid out in Mesh */
+static const std::string MESH_CACHE_KIND = "mesh";
+
+shapes::Mesh* loadCachedMesh(uint64_t key)
+{
+  mesh_cache::Entry entry;
+  if (!entry.open(MESH_CACHE_KIND, key))
+    return NULL;
+
+  uint32_t nv, nt;
+  if (!entry.read(nv) || !entry.read(nt))
+    return NULL;
+  
+  shapes::Mesh *mesh = new shapes::Mesh(nv, nt);
+  if (!entry.read(mesh->vertices, nv * 3 * sizeof(double)) ||
+      !entry.read(mesh->triangles, nt * 3 * sizeof(unsigned int)) ||
+      !entry.read(mesh->normals, nt * 3 * sizeof(double)) ||
+      !entry.atEnd())
+  {
+    delete mesh;
+    return NULL;
+  }
+  for (unsigned int i = 0 ; i < nt * 3 ; ++i)
+    if (mesh->triangles[i] >= nv)
+    {
+      delete mesh;
+      return NULL;
+    }
+  return mesh;
+}
+
+void storeCachedMesh(uint64_t key, const shapes::Mesh *mesh)
+{
+  mesh_cache::EntryWriter writer;
+  writer.write((uint32_t)mesh->vertexCount);
+  writer.write((uint32_t)mesh->triangleCount);
+  writer.write(mesh->vertices, mesh->vertexCount * 3 * sizeof(double));
+  writer.write(mesh->triangles, mesh->triangleCount * 3 * sizeof(unsigned int));
+  writer.write(mesh->normals, mesh->triangleCount * 3 * sizeof(double));
+  writer.commit(MESH_CACHE_KIND, key);
+}
+
+}
+
 shapes::Mesh* createMeshFromFilename(const std::string& filename, const tf::Vector3* scale) {
   resource_retriever::Retriever retriever;
   resource_retriever::MemoryResource res;
@@ -290,6 +339,30 @@ shapes::Mesh* createMeshFromFilename(const std::string& filename, const tf::Vect
     ROS_WARN("Retrieved empty mesh for resource '%s'", filename.c_str());
     return NULL;
   } 
+
+  tf::Vector3 ts(1.0, 1.0, 1.0);
+  if(scale != NULL) {
+    ts = (*scale);
+  }
+
+  // meshes are cached by content (plus the format hint and scale), so
+  // every process loading the same resource shares one entry
+  bool use_cache = mesh_cache::enabled();
+  uint64_t cache_key = 0;
+  if (use_cache) {
+    double sc[3] = { ts.x(), ts.y(), ts.z() };
+    std::size_t dot = filename.find_last_of(".");
+    std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot);
+    cache_key = mesh_cache::hash(res.data.get(), res.size);
+    cache_key = mesh_cache::hash(extension.c_str(), extension.size(), cache_key);
+    cache_key = mesh_cache::hash(sc, sizeof(sc), cache_key);
+    shapes::Mesh *cached = loadCachedMesh(cache_key);
+    if (cached) {
+      ROS_DEBUG_STREAM("Loaded mesh " << filename << " from cache");
+      mesh_cache::addResourceMesh(mesh_cache::hash(cached->vertices, cached->vertexCount * 3 * sizeof(double)));
+      return cached;
+    }
+  }
   
   // Create an instance of the Importer class
   Assimp::Importer importer;
@@ -344,11 +417,12 @@ shapes::Mesh* createMeshFromFilename(const std::string& filename, const tf::Vect
     return NULL;
   }
   aiMatrix4x4 transform = node->mTransformation;
-  tf::Vector3 ts(1.0, 1.0, 1.0);
-  if(scale != NULL) {
-    ts = (*scale);
+  shapes::Mesh *mesh = shapes::createMeshFromAsset(scene->mMeshes[node->mMeshes[0]], transform, ts);
+  if (mesh && use_cache) {
+    storeCachedMesh(cache_key, mesh);
+    mesh_cache::addResourceMesh(mesh_cache::hash(mesh->vertices, mesh->vertexCount * 3 * sizeof(double)));
   }
-  return(shapes::createMeshFromAsset(scene->mMeshes[node->mMeshes[0]], transform, ts));
+  return mesh;
 }
 
 shapes::Mesh* createMeshFromAsset(const aiMesh* a, const aiMatrix4x4& transform, const tf::Vector3& scale)
@@ -0,0 +1,158 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/* Compares the batch point containment and ray intersection calls of
+   the bodies against calling the single point versions in a loop.
+   Usage: bench_point_inclusion [point count] [repetitions] */
+
+#include <geometric_shapes/bodies.h>
+#include <geometric_shapes/shape_operations.h>
+#include <ros/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+static double uniform(double lo, double hi)
+{
+  return lo + (hi - lo) * rand() / (double)RAND_MAX;
+}
+
+static void benchmark(const char *name, const bodies::Body *body, unsigned int n, unsigned int reps)
+{
+  std::vector<double> x(n), y(n), z(n);
+  std::vector<float> fx(n), fy(n), fz(n);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    fx[i] = x[i] = uniform(-1.5, 1.5);
+    fy[i] = y[i] = uniform(-1.5, 1.5);
+    fz[i] = z[i] = uniform(-1.5, 1.5);
+  }
+  std::vector<unsigned char> inside(n);
+  unsigned int count = 0;
+  
+  ros::WallTime start = ros::WallTime::now();
+  for (unsigned int r = 0 ; r < reps ; ++r)
+    for (unsigned int i = 0 ; i < n ; ++i)
+      if (body->containsPoint(tf::Vector3(x[i], y[i], z[i])))
+        count++;
+  double scalar = (ros::WallTime::now() - start).toSec();
+
+  start = ros::WallTime::now();
+  for (unsigned int r = 0 ; r < reps ; ++r)
+  {
+    std::fill(inside.begin(), inside.end(), 0);
+    body->containsPoints(&x[0], &y[0], &z[0], n, &inside[0]);
+  }
+  double batch = (ros::WallTime::now() - start).toSec();
+  
+  start = ros::WallTime::now();
+  for (unsigned int r = 0 ; r < reps ; ++r)
+  {
+    std::fill(inside.begin(), inside.end(), 0);
+    body->containsPoints(&fx[0], &fy[0], &fz[0], n, &inside[0]);
+  }
+  double batchf = (ros::WallTime::now() - start).toSec();
+
+  // rays from a fixed origin towards every point
+  const tf::Vector3 origin(2.5, 1.0, -0.7);
+  std::vector<double> dx(n), dy(n), dz(n), depth(n);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    dx[i] = x[i] - origin.x();
+    dy[i] = y[i] - origin.y();
+    dz[i] = z[i] - origin.z();
+  }
+  std::vector<tf::Vector3> intersections;
+  start = ros::WallTime::now();
+  for (unsigned int r = 0 ; r < reps ; ++r)
+    for (unsigned int i = 0 ; i < n ; ++i)
+    {
+      tf::Vector3 dir(dx[i], dy[i], dz[i]);
+      intersections.clear();
+      if (body->intersectsRay(origin, dir.normalized(), &intersections, 1))
+        count++;
+    }
+  double rscalar = (ros::WallTime::now() - start).toSec();
+  
+  start = ros::WallTime::now();
+  for (unsigned int r = 0 ; r < reps ; ++r)
+    body->intersectsRays(origin, &dx[0], &dy[0], &dz[0], n, &depth[0]);
+  double rbatch = (ros::WallTime::now() - start).toSec();
+
+  const double mpts = (double)n * reps / 1e6;
+  printf("%-10s containment: scalar %7.1f, batch %7.1f, batch (float) %7.1f Mpts/s | rays: scalar %7.1f, batch %7.1f Mrays/s\n",
+         name, mpts / scalar, mpts / batch, mpts / batchf, mpts / rscalar, mpts / rbatch);
+  
+  // keep the scalar loops from being optimized away
+  if (count == 0)
+    printf("  (no points inside)\n");
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int n = argc > 1 ? atoi(argv[1]) : 100000;
+  unsigned int reps = argc > 2 ? atoi(argv[2]) : 20;
+  srand(0);
+  
+  tf::Transform pose(tf::Quaternion(tf::Vector3(0.3, 1.0, 0.2), 0.7), tf::Vector3(0.2, -0.1, 0.3));
+  
+  shapes::Sphere sphere(0.8);
+  shapes::Box box(1.2, 0.6, 0.9);
+  shapes::Cylinder cylinder(0.5, 1.4);
+  
+  // a convex mesh with a few hundred facets, similar to robot links
+  std::vector<tf::Vector3> vertices;
+  for (unsigned int i = 0 ; i < 200 ; ++i)
+  {
+    tf::Vector3 v(uniform(-1.0, 1.0), uniform(-1.0, 1.0), uniform(-1.0, 1.0));
+    v.normalize();
+    vertices.push_back(tf::Vector3(v.x() * 0.9, v.y() * 0.5, v.z() * 0.6));
+  }
+  shapes::Mesh *mesh = shapes::createMeshFromVertices(vertices, std::vector<unsigned int>());
+  
+  const char *names[4] = { "sphere", "box", "cylinder", "mesh" };
+  shapes::Shape *shapes[4] = { &sphere, &box, &cylinder, mesh };
+  for (unsigned int k = 0 ; k < 4 ; ++k)
+  {
+    bodies::Body *body = bodies::createBodyFromShape(shapes[k]);
+    body->setPose(pose);
+    body->setPadding(0.02);
+    benchmark(names[k], body, n, reps);
+    delete body;
+  }
+  delete mesh;
+  
+  return 0;
+}
@@ -35,7 +35,14 @@
 /** \Author Ioan Sucan */
 
 #include <geometric_shapes/bodies.h>
+#include <geometric_shapes/body_operations.h>
+#include <geometric_shapes/shape_operations.h>
+#include <geometric_shapes/mesh_cache.h>
 #include <gtest/gtest.h>
+#include <cstdlib>
+#include <cstdio>
+#include <ftw.h>
+#include <algorithm>
 
 TEST(SpherePointContainment, SimpleInside)
 {
@@ -231,8 +238,276 @@ TEST(CylinderPointContainment, CylinderPadding)
   EXPECT_TRUE(bsphere.radius > 2.0);
 }
 
+TEST(ConvexMeshPointContainment, CachedHull)
+{
+  ASSERT_TRUE(shapes::mesh_cache::enabled());
+
+  // a tetrahedron with an extra point inside, which is not on the hull
+  std::vector<tf::Vector3> vertices;
+  vertices.push_back(tf::Vector3(0, 0, 0));
+  vertices.push_back(tf::Vector3(1, 0, 0));
+  vertices.push_back(tf::Vector3(0, 1, 0));
+  vertices.push_back(tf::Vector3(0, 0, 1));
+  vertices.push_back(tf::Vector3(0.1, 0.1, 0.1));
+  std::vector<unsigned int> triangles;
+  unsigned int t[] = { 0, 2, 1,  0, 1, 3,  0, 3, 2,  1, 2, 3,  0, 1, 4 };
+  triangles.insert(triangles.end(), t, t + 15);
+  shapes::Mesh *mesh = shapes::createMeshFromVertices(vertices, triangles);
+  uint64_t key = shapes::mesh_cache::hash(mesh->vertices, mesh->vertexCount * 3 * sizeof(double));
+
+  // meshes that were not loaded from a resource are not cached
+  bodies::ConvexMesh uncached(mesh);
+  shapes::mesh_cache::Entry entry;
+  EXPECT_FALSE(entry.open("hull", key));
+
+  // the first body computes the hull, the second one reads it back
+  shapes::mesh_cache::addResourceMesh(key);
+  bodies::ConvexMesh computed(mesh);
+  EXPECT_TRUE(entry.open("hull", key));
+  bodies::ConvexMesh cached(mesh);
+  EXPECT_EQ(4u, computed.getVertices().size());
+  ASSERT_EQ(computed.getVertices().size(), cached.getVertices().size());
+  ASSERT_EQ(computed.getTriangles().size(), cached.getTriangles().size());
+  for (unsigned int i = 0 ; i < computed.getVertices().size() ; ++i)
+    EXPECT_TRUE(computed.getVertices()[i] == cached.getVertices()[i]);
+  EXPECT_TRUE(computed.getTriangles() == cached.getTriangles());
+
+  EXPECT_TRUE(cached.containsPoint(0.2, 0.2, 0.2));
+  EXPECT_FALSE(cached.containsPoint(0.5, 0.5, 0.5));
+  EXPECT_EQ(computed.computeVolume(), cached.computeVolume());
+
+  EXPECT_TRUE(uncached.getTriangles() == cached.getTriangles());
+
+  delete mesh;
+}
+
+TEST(BatchPointContainment, MatchesScalar)
+{
+  shapes::Sphere sphere(0.8);
+  shapes::Box box(1.2, 0.6, 0.9);
+  shapes::Cylinder cylinder(0.5, 1.4);
+  std::vector<tf::Vector3> vertices;
+  vertices.push_back(tf::Vector3(-0.5, -0.5, -0.5));
+  vertices.push_back(tf::Vector3(1.5, 0, 0));
+  vertices.push_back(tf::Vector3(0, 1.5, 0));
+  vertices.push_back(tf::Vector3(0, 0, 1.5));
+  std::vector<unsigned int> triangles;
+  unsigned int t[] = { 0, 2, 1,  0, 1, 3,  0, 3, 2,  1, 2, 3 };
+  triangles.insert(triangles.end(), t, t + 12);
+  shapes::Mesh *mesh = shapes::createMeshFromVertices(vertices, triangles);
+  shapes::Shape *shapes[4] = { &sphere, &box, &cylinder, mesh };
+
+  const unsigned int n = 10000;
+  std::vector<double> x(n), y(n), z(n);
+  std::vector<float> fx(n), fy(n), fz(n);
+  srand(1);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    fx[i] = x[i] = 3.0 * rand() / (double)RAND_MAX - 1.5;
+    fy[i] = y[i] = 3.0 * rand() / (double)RAND_MAX - 1.5;
+    fz[i] = z[i] = 3.0 * rand() / (double)RAND_MAX - 1.5;
+  }
+  
+  tf::Transform pose(tf::Quaternion(tf::Vector3(0.3, 1.0, 0.2), 0.7), tf::Vector3(0.2, -0.1, 0.3));
+  for (unsigned int k = 0 ; k < 4 ; ++k)
+  {
+    bodies::Body *body = bodies::createBodyFromShape(shapes[k]);
+    body->setPose(pose);
+    body->setPadding(0.05);
+    
+    std::vector<unsigned char> inside(n, 0), finside(n, 0);
+    body->containsPoints(&x[0], &y[0], &z[0], n, &inside[0]);
+    body->containsPoints(&fx[0], &fy[0], &fz[0], n, &finside[0]);
+    unsigned int count = 0;
+    for (unsigned int i = 0 ; i < n ; ++i)
+    {
+      bool contains = body->containsPoint(x[i], y[i], z[i]);
+      EXPECT_EQ(contains, inside[i] != 0);
+      EXPECT_EQ(body->containsPoint(fx[i], fy[i], fz[i]), finside[i] != 0);
+      if (contains)
+        count++;
+    }
+    EXPECT_GT(count, 0u);
+    
+    // points already marked as inside are left untouched
+    std::fill(inside.begin(), inside.end(), 1);
+    body->containsPoints(&x[0], &y[0], &z[0], n, &inside[0]);
+    EXPECT_EQ(n, (unsigned int)std::count(inside.begin(), inside.end(), 1));
+    delete body;
+  }
+  delete mesh;
+}
+
+TEST(BatchRayIntersection, MatchesScalar)
+{
+  shapes::Sphere sphere(0.8);
+  shapes::Box box(1.2, 0.6, 0.9);
+  shapes::Cylinder cylinder(0.5, 1.4);
+  shapes::Shape *shapes[3] = { &sphere, &box, &cylinder };
+
+  const unsigned int n = 10000;
+  const tf::Vector3 origin(2.5, 1.0, -0.7);
+  std::vector<double> dx(n), dy(n), dz(n);
+  srand(2);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    // directions towards points around the body, of varying length
+    tf::Vector3 target(2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0);
+    tf::Vector3 dir((target - origin) * (0.5 + rand() / (double)RAND_MAX));
+    dx[i] = dir.x();
+    dy[i] = dir.y();
+    dz[i] = dir.z();
+  }
+  
+  tf::Transform pose(tf::Quaternion(tf::Vector3(0.3, 1.0, 0.2), 0.7), tf::Vector3(0.2, -0.1, 0.3));
+  for (unsigned int k = 0 ; k < 3 ; ++k)
+  {
+    bodies::Body *body = bodies::createBodyFromShape(shapes[k]);
+    body->setPose(pose);
+    
+    std::vector<double> depth(n);
+    body->intersectsRays(origin, &dx[0], &dy[0], &dz[0], n, &depth[0]);
+    unsigned int hits = 0;
+    for (unsigned int i = 0 ; i < n ; ++i)
+    {
+      tf::Vector3 dir(dx[i], dy[i], dz[i]);
+      std::vector<tf::Vector3> intersections;
+      bool intersects = body->intersectsRay(origin, dir / dir.length(), &intersections, 1);
+      ASSERT_EQ(intersects, depth[i] > 0.0);
+      if (intersects)
+      {
+        EXPECT_NEAR(0.0, (origin + dir * depth[i] - intersections[0]).length(), 1e-9);
+        hits++;
+      }
+    }
+    EXPECT_GT(hits, 0u);
+    delete body;
+  }
+}
+
+TEST(ConvexMeshRayIntersection, MatchesPlanes)
+{
+  // a hull with a few hundred facets
+  srand(4);
+  std::vector<tf::Vector3> vertices;
+  for (unsigned int i = 0 ; i < 200 ; ++i)
+  {
+    tf::Vector3 v(2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0);
+    v.normalize();
+    vertices.push_back(tf::Vector3(v.x() * 0.9, v.y() * 0.5, v.z() * 0.6));
+  }
+  shapes::Mesh *mesh = shapes::createMeshFromVertices(vertices, std::vector<unsigned int>());
+  bodies::ConvexMesh body(mesh);
+  body.setPose(tf::Transform(tf::Quaternion(tf::Vector3(0.3, 1.0, 0.2), 0.7), tf::Vector3(0.2, -0.1, 0.3)));
+  EXPECT_GT(body.getTriangles().size(), 300u);
+
+  // the triangles found through the BVH must agree with clipping the
+  // rays by the planes of the hull
+  const unsigned int n = 2000;
+  const tf::Vector3 origin(2.5, 1.0, -0.7);
+  std::vector<double> dx(n), dy(n), dz(n), depth(n);
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    tf::Vector3 target(2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0, 2.0 * rand() / (double)RAND_MAX - 1.0);
+    tf::Vector3 dir((target - origin).normalized());
+    dx[i] = dir.x();
+    dy[i] = dir.y();
+    dz[i] = dir.z();
+  }
+  body.intersectsRays(origin, &dx[0], &dy[0], &dz[0], n, &depth[0]);
+
+  unsigned int hits = 0, mismatches = 0;
+  for (unsigned int i = 0 ; i < n ; ++i)
+  {
+    tf::Vector3 dir(dx[i], dy[i], dz[i]);
+    std::vector<tf::Vector3> intersections;
+    bool intersects = body.intersectsRay(origin, dir, &intersections, 2);
+    EXPECT_EQ(intersects, body.intersectsRay(origin, dir));
+    if (intersects != (depth[i] > 0.0))
+      mismatches++;
+    else if (intersects)
+    {
+      hits++;
+      EXPECT_NEAR(0.0, (origin + dir * depth[i] - intersections[0]).length(), 1e-4);
+    }
+  }
+  // rays grazing an edge may be decided differently by the two methods
+  EXPECT_LE(mismatches, n / 100);
+  EXPECT_GT(hits, 0u);
+  delete mesh;
+}
+
+TEST(MaskPosesInsideBodyVectors, MatchesBruteForce)
+{
+  srand(3);
+  std::vector<bodies::BodyVector*> bvs;
+  for (unsigned int j = 0 ; j < 3 ; ++j)
+  {
+    std::vector<shapes::Shape*> shapes;
+    std::vector<tf::Transform> poses;
+    for (unsigned int k = 0 ; k < 20 ; ++k)
+    {
+      double size = 0.05 + 0.3 * rand() / (double)RAND_MAX;
+      if (k % 3 == 0)
+        shapes.push_back(new shapes::Sphere(size));
+      else if (k % 3 == 1)
+        shapes.push_back(new shapes::Box(size, 2.0 * size, size));
+      else
+        shapes.push_back(new shapes::Cylinder(size, 3.0 * size));
+      tf::Transform pose(tf::Quaternion(tf::Vector3(rand(), rand(), rand() + 1.0), rand() / (double)RAND_MAX),
+                         tf::Vector3(4.0 * rand() / (double)RAND_MAX - 2.0, 4.0 * rand() / (double)RAND_MAX - 2.0, 2.0 * rand() / (double)RAND_MAX));
+      poses.push_back(pose);
+    }
+    bvs.push_back(new bodies::BodyVector(shapes, poses, 0.02));
+    for (unsigned int k = 0 ; k < shapes.size() ; ++k)
+      delete shapes[k];
+  }
+
+  // poses on a voxel grid, as in a collision map
+  std::vector<tf::Transform> poses;
+  for (double px = -2.5 ; px < 2.5 ; px += 0.1)
+    for (double py = -2.5 ; py < 2.5 ; py += 0.1)
+      for (double pz = -0.5 ; pz < 2.5 ; pz += 0.1)
+        poses.push_back(tf::Transform(tf::Quaternion(0, 0, 0, 1), tf::Vector3(px, py, pz)));
+
+  for (int padded = 0 ; padded < 2 ; ++padded)
+  {
+    std::vector<bool> mask;
+    bodies::maskPosesInsideBodyVectors(poses, bvs, mask, padded);
+    ASSERT_EQ(poses.size(), mask.size());
+    unsigned int masked = 0;
+    for (unsigned int i = 0 ; i < poses.size() ; ++i)
+    {
+      bool inside = false;
+      for (unsigned int j = 0 ; !inside && j < bvs.size() ; ++j)
+        for (unsigned int k = 0 ; !inside && k < bvs[j]->getSize() ; ++k)
+          inside = (padded ? bvs[j]->getPaddedBody(k) : bvs[j]->getBody(k))->containsPoint(poses[i].getOrigin());
+      EXPECT_EQ(!inside, mask[i]);
+      if (inside)
+        masked++;
+    }
+    EXPECT_GT(masked, 0u);
+  }
+
+  for (unsigned int j = 0 ; j < bvs.size() ; ++j)
+    delete bvs[j];
+}
+
+static int removeCacheEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+  return remove(path);
+}
+
 int main(int argc, char **argv)
 { 
     testing::InitGoogleTest(&argc, argv);
-    return RUN_ALL_TESTS();
+
+    // keep the tests out of the user's mesh cache
+    char dir[] = "/tmp/geometric_shapes_cacheXXXXXX";
+    if (!mkdtemp(dir))
+      return 1;
+    setenv("GEOMETRIC_SHAPES_CACHE_DIR", dir, 1);
+    int result = RUN_ALL_TESTS();
+    nftw(dir, removeCacheEntry, 16, FTW_DEPTH | FTW_PHYS);
+    return result;
 }
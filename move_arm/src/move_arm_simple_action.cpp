@@ -70,18 +70,33 @@
 
 #include <planning_environment/models/collision_models.h>
 #include <planning_environment/models/model_utils.h>
+#include <planning_environment/util/latency_statistics.h>
 #include <arm_navigation_msgs/SetPlanningSceneDiff.h>
 
 #include <arm_navigation_msgs/GetRobotState.h>
+#include <arm_navigation_msgs/CollisionMap.h>
+#include <arm_navigation_msgs/CollisionObject.h>
+#include <geometry_msgs/PointStamped.h>
+#include <geometry_msgs/QuaternionStamped.h>
 
 #include <actionlib/client/simple_action_client.h>
 #include <actionlib/client/simple_client_goal_state.h>
 
 #include <std_msgs/Bool.h>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+
 #include <valarray>
+#include <deque>
+#include <set>
+#include <limits>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 
 typedef actionlib::ActionClient<control_msgs::FollowJointTrajectoryAction> JointExecutorActionClient;
 
@@ -95,6 +110,14 @@ enum MoveArmState {
   MONITOR
 };
 
+/// Events that wake up the move arm state machine
+enum MoveArmEvent {
+  STATE_CHANGED,
+  CONTROLLER_DONE,
+  PREEMPT_REQUESTED,
+  SCENE_CHANGED
+};
+
 enum ControllerStatus {
   QUEUED,
   ACTIVE,
@@ -130,6 +153,48 @@ static const std::string DISPLAY_JOINT_GOAL_PUB_TOPIC  = "display_joint_goal";
 static const std::string SET_PLANNING_SCENE_DIFF_NAME = "/environment_server/set_planning_scene_diff";
 static const double MIN_TRAJECTORY_MONITORING_FREQUENCY = 1.0;
 static const double MAX_TRAJECTORY_MONITORING_FREQUENCY = 100.0;
+static const double VOXEL_KEY_RESOLUTION = 1e-3;
+
+/// Axis aligned box, used to find the parts of a trajectory that are close to a change in the scene
+struct BoundingBox
+{
+  BoundingBox() : min_(std::numeric_limits<double>::max(),std::numeric_limits<double>::max(),std::numeric_limits<double>::max()),
+                  max_(-std::numeric_limits<double>::max(),-std::numeric_limits<double>::max(),-std::numeric_limits<double>::max())
+  {
+  }
+
+  void add(const tf::Vector3 &center, const double &radius)
+  {
+    min_.setMin(center - tf::Vector3(radius,radius,radius));
+    max_.setMax(center + tf::Vector3(radius,radius,radius));
+  }
+
+  void add(const BoundingBox &box)
+  {
+    min_.setMin(box.min_);
+    max_.setMax(box.max_);
+  }
+
+  bool intersects(const BoundingBox &box) const
+  {
+    return min_.x() <= box.max_.x() && max_.x() >= box.min_.x() &&
+      min_.y() <= box.max_.y() && max_.y() >= box.min_.y() &&
+      min_.z() <= box.max_.z() && max_.z() >= box.min_.z();
+  }
+
+  tf::Vector3 min_, max_;
+};
+
+/// Bounding sphere of a collision body, in the frame of the body
+typedef struct{
+  std::string link_name;
+  int attached_body_index; ///-1 for the collision body of the link itself
+  unsigned int shape_index;
+  tf::Vector3 center;
+  double radius;
+} LinkBoundingSphere;
+
+typedef boost::tuple<long,long,long> VoxelKey;
   
 class MoveArm
 {
@@ -144,6 +209,10 @@ public:
     private_handle_.param<double>("ik_allowed_time",ik_allowed_time_, 2.0);
 
     private_handle_.param<bool>("publish_stats",publish_stats_, true);
+    private_handle_.param<bool>("pipeline_execution",pipeline_execution_, false);
+    private_handle_.param<int>("validation_chunk_size",validation_chunk_size_, 20);
+    private_handle_.param<double>("scene_monitor_padding",scene_monitor_padding_, 0.05);
+    validation_chunk_size_ = std::max(validation_chunk_size_, 2);
 
     planning_scene_state_ = NULL;
 
@@ -151,6 +220,10 @@ public:
 
     num_planning_attempts_ = 0;
     state_ = PLANNING;
+    stage_start_time_ = ros::WallTime::now();
+    filter_in_progress_ = false;
+    filter_service_ok_ = false;
+    num_validated_points_ = 0;
 
     ik_client_ = root_handle_.serviceClient<kinematics_msgs::GetConstraintAwarePositionIK>(ARM_IK_NAME);
     allowed_contact_regions_publisher_ = root_handle_.advertise<visualization_msgs::MarkerArray>("allowed_contact_regions_array", 128);
@@ -167,11 +240,16 @@ public:
     ros::service::waitForService(TRAJECTORY_FILTER);
 
     action_server_.reset(new actionlib::SimpleActionServer<arm_navigation_msgs::MoveArmAction>(root_handle_, "move_" + group_name, boost::bind(&MoveArm::execute, this, _1), false));
+    action_server_->registerPreemptCallback(boost::bind(&MoveArm::preemptCallback, this));
     action_server_->start();
 
+    collision_map_subscriber_ = root_handle_.subscribe("collision_map_occ", 1, &MoveArm::collisionMapCallback, this);
+    collision_object_subscriber_ = root_handle_.subscribe("collision_object", 1024, &MoveArm::collisionObjectCallback, this);
+
     display_path_publisher_ = root_handle_.advertise<arm_navigation_msgs::DisplayTrajectory>(DISPLAY_PATH_PUB_TOPIC, 1, true);
     display_joint_goal_publisher_ = root_handle_.advertise<arm_navigation_msgs::DisplayTrajectory>(DISPLAY_JOINT_GOAL_PUB_TOPIC, 1, true);
     stats_publisher_ = private_handle_.advertise<arm_navigation_msgs::MoveArmStatistics>("statistics",1,true);
+    planning_environment::LatencyStatistics::getInstance().initialize(private_handle_);
   }	
   virtual ~MoveArm()
   {
@@ -198,6 +276,7 @@ public:
     }
     group_joint_names_ = joint_model_group->getJointModelNames();
     group_link_names_ = joint_model_group->getGroupLinkNames();
+    updated_link_names_ = joint_model_group->getUpdatedLinkModelNames();
     return true;
   }
 	
@@ -299,7 +378,11 @@ private:
     request.ik_request.ik_link_name = link_name;
     request.timeout = ros::Duration(ik_allowed_time_);
     request.constraints = original_request_.motion_plan_request.goal_constraints;
-    if (ik_client_.call(request, response))
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_calls");
+    planning_environment::ScopedLatencyTimer ik_timer("ik");
+    bool ik_service_ok = ik_client_.call(request, response);
+    ik_timer.stop();
+    if (ik_service_ok)
     {
       move_arm_action_result_.error_code = response.error_code;
       if(response.error_code.val != response.error_code.SUCCESS)
@@ -330,18 +413,17 @@ private:
   ///
   /// Trajectory Filtering
   ///
-  bool filterTrajectory(const trajectory_msgs::JointTrajectory &trajectory_in, 
-                        trajectory_msgs::JointTrajectory &trajectory_out)
+  /**
+   * @brief Fill in the request for the trajectory filter. 
+   * @return false if the trajectory does not need to be filtered, req.trajectory is the result in that case
+   */
+  bool fillFilterRequest(const trajectory_msgs::JointTrajectory &trajectory_in,
+                         arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request &req)
   {
-    arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request  req;
-    arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response res;
     fillTrajectoryMsg(trajectory_in, req.trajectory);
 
     if(trajectory_filter_allowed_time_ == 0.0)
-    {
-      trajectory_out = req.trajectory;
-      return true;
-    }
+      return false;
     resetToStartState(planning_scene_state_);
     planning_environment::convertKinematicStateToRobotState(*planning_scene_state_,
                                                             ros::Time::now(),
@@ -351,8 +433,22 @@ private:
     req.path_constraints = original_request_.motion_plan_request.path_constraints;
     req.goal_constraints = original_request_.motion_plan_request.goal_constraints;
     req.allowed_time = ros::Duration(trajectory_filter_allowed_time_);
+    return true;
+  }
+
+  /**
+   * @brief Call the trajectory filter service. This does not touch the planning scene state 
+   * and can run in parallel with trajectory validation.
+   */
+  bool callTrajectoryFilter(arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request &req,
+                            trajectory_msgs::JointTrajectory &trajectory_out)
+  {
+    arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Response res;
     ros::Time smoothing_time = ros::Time::now();
-    if(filter_trajectory_client_.call(req,res))
+    planning_environment::ScopedLatencyTimer filter_timer("trajectory_filter");
+    bool filter_service_ok = filter_trajectory_client_.call(req,res);
+    filter_timer.stop();
+    if(filter_service_ok)
     {
       move_arm_stats_.trajectory_duration = (res.trajectory.points.back().time_from_start-res.trajectory.points.front().time_from_start).toSec();
       move_arm_stats_.smoothing_time = (ros::Time::now()-smoothing_time).toSec();
@@ -366,6 +462,93 @@ private:
     }
   }
 
+  bool filterTrajectory(const trajectory_msgs::JointTrajectory &trajectory_in, 
+                        trajectory_msgs::JointTrajectory &trajectory_out)
+  {
+    arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request req;
+    if(!fillFilterRequest(trajectory_in, req))
+    {
+      trajectory_out = req.trajectory;
+      return true;
+    }
+    return callTrajectoryFilter(req, trajectory_out);
+  }
+
+  /**
+   * @brief Start filtering a trajectory in the background. The result is picked up by finishFilterTrajectory()
+   */
+  void startFilterTrajectory(const trajectory_msgs::JointTrajectory &trajectory_in)
+  {
+    discardFilterTrajectory();
+    filter_in_progress_ = true;
+    if(!fillFilterRequest(trajectory_in, filter_request_))
+    {
+      filtered_trajectory_ = filter_request_.trajectory;
+      filter_service_ok_ = true;
+      return;
+    }
+    filter_thread_.reset(new boost::thread(boost::bind(&MoveArm::filterTrajectoryThread, this)));
+  }
+
+  void filterTrajectoryThread()
+  {
+    filter_service_ok_ = callTrajectoryFilter(filter_request_, filtered_trajectory_);
+  }
+
+  bool finishFilterTrajectory(trajectory_msgs::JointTrajectory &trajectory_out)
+  {
+    if(filter_thread_)
+    {
+      filter_thread_->join();
+      filter_thread_.reset();
+    }
+    filter_in_progress_ = false;
+    trajectory_out = filtered_trajectory_;
+    return filter_service_ok_;
+  }
+
+  void discardFilterTrajectory()
+  {
+    trajectory_msgs::JointTrajectory discarded_trajectory;
+    if(filter_in_progress_)
+      finishFilterTrajectory(discarded_trajectory);
+  }
+
+  /**
+   * @brief Check the points [start, end) of a trajectory. The goal constraints are only checked if 
+   * the chunk contains the last point of the trajectory.
+   */
+  bool isTrajectoryChunkValid(const trajectory_msgs::JointTrajectory &trajectory,
+                              const unsigned int &start,
+                              const unsigned int &end,
+                              arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+  {
+    trajectory_msgs::JointTrajectory chunk;
+    chunk.header = trajectory.header;
+    chunk.joint_names = trajectory.joint_names;
+    chunk.points.insert(chunk.points.end(), trajectory.points.begin()+start, trajectory.points.begin()+end);
+    arm_navigation_msgs::Constraints empty_goal_constraints;
+    std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
+    resetToStartState(planning_scene_state_);
+    if(collision_models_->isJointTrajectoryValid(*planning_scene_state_,
+                                                 chunk,
+                                                 end == trajectory.points.size() ? original_request_.motion_plan_request.goal_constraints : empty_goal_constraints,
+                                                 original_request_.motion_plan_request.path_constraints,
+                                                 error_code,
+                                                 traj_error_codes,
+                                                 false))
+      return true;
+    // the first point of a chunk is only the start state for the first chunk
+    if(start > 0)
+    {
+      if(error_code.val == error_code.START_STATE_IN_COLLISION)
+        error_code.val = error_code.COLLISION_CONSTRAINTS_VIOLATED;
+      else if(error_code.val == error_code.START_STATE_VIOLATES_PATH_CONSTRAINTS)
+        error_code.val = error_code.PATH_CONSTRAINTS_VIOLATED;
+    }
+    return false;
+  }
+
   ///
   /// End Trajectory Filtering
   ///
@@ -597,7 +780,10 @@ private:
     move_arm_stats_.planner_service_name = move_arm_parameters_.planner_service_name;
     ROS_DEBUG("Issuing request for motion plan");		    
     // call the planner and decide whether to use the path
-    if (planning_client.call(req, res))
+    planning_environment::ScopedLatencyTimer planning_timer("planning");
+    bool planning_service_ok = planning_client.call(req, res);
+    planning_timer.stop();
+    if (planning_service_ok)
     {
       if (res.trajectory.joint_trajectory.points.empty())
       {
@@ -679,9 +865,9 @@ private:
 		  goal.trajectory.points[i].velocities[5],
 		  goal.trajectory.points[i].velocities[6]);
 		  }*/
+    controller_status_ = QUEUED;
     controller_goal_handle_ = controller_action_client_->sendGoal(goal,boost::bind(&MoveArm::controllerTransitionCallback, this, _1));
 
-    controller_status_ = QUEUED;
     //    printTrajectory(goal.trajectory);
     return true;
   }
@@ -715,12 +901,14 @@ private:
 	    ROS_INFO("Trajectory controller status came back as failed");
 	    controller_status_ = FAILED;
 	    controller_goal_handle_.reset();
+	    pushEvent(CONTROLLER_DONE);
 	    return;
 	  }
         case actionlib::TerminalState::SUCCEEDED:
 	  {
 	    controller_goal_handle_.reset();
 	    controller_status_ = SUCCESS;	  
+	    pushEvent(CONTROLLER_DONE);
 	    return;
 	  }
         default:
@@ -833,6 +1021,310 @@ private:
   /// End Control
   ///
 
+  ///
+  /// Execution monitoring
+  ///
+  void collisionMapCallback(const arm_navigation_msgs::CollisionMapConstPtr &collision_map)
+  {
+    if(!action_server_->isActive())
+      return;
+    {
+      boost::mutex::scoped_lock lock(scene_change_lock_);
+      pending_collision_map_ = collision_map;
+    }
+    pushEvent(SCENE_CHANGED);
+  }
+
+  void collisionObjectCallback(const arm_navigation_msgs::CollisionObjectConstPtr &collision_object)
+  {
+    if(!action_server_->isActive())
+      return;
+    {
+      boost::mutex::scoped_lock lock(scene_change_lock_);
+      pending_collision_objects_.push_back(collision_object);
+    }
+    pushEvent(SCENE_CHANGED);
+  }
+
+  static VoxelKey getVoxelKey(const geometry_msgs::Point &point)
+  {
+    return VoxelKey(lround(point.x/VOXEL_KEY_RESOLUTION),
+                    lround(point.y/VOXEL_KEY_RESOLUTION),
+                    lround(point.z/VOXEL_KEY_RESOLUTION));
+  }
+
+  /**
+   * @brief Start tracking scene changes against the planning scene that was just set. 
+   * Changes that arrive from now on are applied while the trajectory is executed.
+   */
+  void resetSceneMonitor()
+  {
+    {
+      boost::mutex::scoped_lock lock(scene_change_lock_);
+      pending_collision_map_.reset();
+      pending_collision_objects_.clear();
+    }
+    monitored_voxels_.clear();
+    arm_navigation_msgs::CollisionMap collision_map;
+    collision_models_->getLastCollisionMap(collision_map);
+    for(unsigned int i=0; i < collision_map.boxes.size(); i++)
+      monitored_voxels_.insert(getVoxelKey(collision_map.boxes[i].center));
+    waypoint_bounding_boxes_.clear();
+  }
+
+  void addLinkBoundingSphere(const std::string &link_name,
+                             const int &attached_body_index,
+                             const unsigned int &shape_index,
+                             const shapes::Shape *shape)
+  {
+    if(shape == NULL)
+      return;
+    bodies::Body* body = bodies::createBodyFromShape(shape);
+    if(body == NULL)
+      return;
+    bodies::BoundingSphere sphere;
+    body->computeBoundingSphere(sphere);
+    delete body;
+    LinkBoundingSphere link_sphere;
+    link_sphere.link_name = link_name;
+    link_sphere.attached_body_index = attached_body_index;
+    link_sphere.shape_index = shape_index;
+    link_sphere.center = sphere.center;
+    link_sphere.radius = sphere.radius;
+    link_bounding_spheres_.push_back(link_sphere);
+  }
+
+  /**
+   * @brief For every waypoint of the current trajectory, compute the box swept by the moving links (and 
+   * the objects attached to them) on the way to the next waypoint. The swept volume is approximated 
+   * by the union of the boxes around the bounding spheres of the bodies at both waypoints.
+   */
+  void computeWaypointBoundingBoxes()
+  {
+    resetToStartState(planning_scene_state_);
+    link_bounding_spheres_.clear();
+    for(unsigned int i=0; i < updated_link_names_.size(); i++)
+    {
+      const planning_models::KinematicState::LinkState* link_state = planning_scene_state_->getLinkState(updated_link_names_[i]);
+      if(link_state == NULL)
+        continue;
+      addLinkBoundingSphere(updated_link_names_[i], -1, 0, link_state->getLinkModel()->getLinkShape());
+      for(unsigned int j=0; j < link_state->getAttachedBodyStateVector().size(); j++)
+      {
+        const std::vector<shapes::Shape*> &shapes = link_state->getAttachedBodyStateVector()[j]->getAttachedBodyModel()->getShapes();
+        for(unsigned int k=0; k < shapes.size(); k++)
+          addLinkBoundingSphere(updated_link_names_[i], j, k, shapes[k]);
+      }
+    }
+
+    std::vector<BoundingBox> point_boxes(current_trajectory_.points.size());
+    std::map<std::string, double> joint_values;
+    for(unsigned int i=0; i < current_trajectory_.points.size(); i++)
+    {
+      for(unsigned int j=0; j < current_trajectory_.joint_names.size(); j++)
+        joint_values[current_trajectory_.joint_names[j]] = current_trajectory_.points[i].positions[j];
+      planning_scene_state_->setKinematicState(joint_values);
+      for(unsigned int j=0; j < link_bounding_spheres_.size(); j++)
+      {
+        const LinkBoundingSphere &sphere = link_bounding_spheres_[j];
+        const planning_models::KinematicState::LinkState* link_state = planning_scene_state_->getLinkState(sphere.link_name);
+        const tf::Transform &pose = sphere.attached_body_index < 0 ? link_state->getGlobalCollisionBodyTransform() :
+          link_state->getAttachedBodyStateVector()[sphere.attached_body_index]->getGlobalCollisionBodyTransforms()[sphere.shape_index];
+        point_boxes[i].add(pose*sphere.center, sphere.radius+scene_monitor_padding_);
+      }
+    }
+    waypoint_bounding_boxes_ = point_boxes;
+    for(unsigned int i=0; i+1 < point_boxes.size(); i++)
+      waypoint_bounding_boxes_[i].add(point_boxes[i+1]);
+  }
+
+  /**
+   * @brief Put a new collision map into the collision space. Only voxels that were not in the 
+   * previous map are reported as changes, voxels that disappeared cannot invalidate the trajectory.
+   */
+  void applyCollisionMap(const arm_navigation_msgs::CollisionMap &collision_map_in,
+                         std::vector<BoundingBox> &changes)
+  {
+    arm_navigation_msgs::CollisionMap collision_map = collision_map_in;
+    if(collision_map.header.frame_id != collision_models_->getWorldFrameId())
+    {
+      for(unsigned int i=0; i < collision_map.boxes.size(); i++)
+      {
+        arm_navigation_msgs::OrientedBoundingBox &box = collision_map.boxes[i];
+        geometry_msgs::PointStamped center;
+        if(!collision_models_->convertPointGivenWorldTransform(*planning_scene_state_,
+                                                               collision_models_->getWorldFrameId(),
+                                                               collision_map.header,
+                                                               box.center,
+                                                               center))
+        {
+          ROS_WARN("Can't transform collision map from frame %s, ignoring it",collision_map.header.frame_id.c_str());
+          return;
+        }
+        box.center = center.point;
+        tf::Vector3 axis(box.axis.x, box.axis.y, box.axis.z);
+        tf::Quaternion rotation = axis.length2() > 0.0 ? tf::Quaternion(axis, box.angle) : tf::Quaternion::getIdentity();
+        geometry_msgs::Quaternion rotation_msg;
+        geometry_msgs::QuaternionStamped world_rotation;
+        tf::quaternionTFToMsg(rotation, rotation_msg);
+        if(collision_models_->convertQuaternionGivenWorldTransform(*planning_scene_state_,
+                                                                   collision_models_->getWorldFrameId(),
+                                                                   collision_map.header,
+                                                                   rotation_msg,
+                                                                   world_rotation))
+        {
+          tf::quaternionMsgToTF(world_rotation.quaternion, rotation);
+          axis = rotation.getAxis();
+          box.axis.x = axis.x();
+          box.axis.y = axis.y();
+          box.axis.z = axis.z();
+          box.angle = rotation.getAngle();
+        }
+      }
+      collision_map.header.frame_id = collision_models_->getWorldFrameId();
+    }
+
+    std::set<VoxelKey> voxels;
+    for(unsigned int i=0; i < collision_map.boxes.size(); i++)
+    {
+      const arm_navigation_msgs::OrientedBoundingBox &box = collision_map.boxes[i];
+      VoxelKey key = getVoxelKey(box.center);
+      voxels.insert(key);
+      if(monitored_voxels_.find(key) != monitored_voxels_.end())
+        continue;
+      BoundingBox change;
+      change.add(tf::Vector3(box.center.x, box.center.y, box.center.z),
+                 0.5*sqrt(box.extents.x*box.extents.x+box.extents.y*box.extents.y+box.extents.z*box.extents.z));
+      changes.push_back(change);
+    }
+    monitored_voxels_.swap(voxels);
+    collision_models_->setCollisionMap(collision_map, true);
+  }
+
+  /**
+   * @brief Apply a collision object update to the collision space. Only added objects are reported as changes.
+   */
+  void applyCollisionObject(const arm_navigation_msgs::CollisionObject &collision_object_in,
+                            std::vector<BoundingBox> &changes)
+  {
+    arm_navigation_msgs::CollisionObject collision_object = collision_object_in;
+    if(collision_object.operation.operation == arm_navigation_msgs::CollisionObjectOperation::REMOVE)
+    {
+      if(collision_object.id == "all")
+        collision_models_->deleteAllStaticObjects();
+      else
+        collision_models_->deleteStaticObject(collision_object.id);
+      return;
+    }
+    if(collision_object.operation.operation != arm_navigation_msgs::CollisionObjectOperation::ADD)
+    {
+      ROS_DEBUG("Ignoring attach/detach operation on object %s during execution",collision_object.id.c_str());
+      return;
+    }
+    if(!collision_models_->convertCollisionObjectToNewWorldFrame(*planning_scene_state_, collision_object))
+    {
+      ROS_WARN("Can't transform collision object %s, ignoring it",collision_object.id.c_str());
+      return;
+    }
+    if(!collision_models_->addStaticObject(collision_object))
+      return;
+    for(unsigned int i=0; i < collision_object.shapes.size() && i < collision_object.poses.size(); i++)
+    {
+      shapes::Shape *shape = planning_environment::constructObject(collision_object.shapes[i]);
+      if(shape == NULL)
+        continue;
+      bodies::Body *body = bodies::createBodyFromShape(shape);
+      delete shape;
+      if(body == NULL)
+        continue;
+      tf::Transform pose;
+      tf::poseMsgToTF(collision_object.poses[i], pose);
+      body->setPose(pose);
+      bodies::BoundingSphere sphere;
+      body->computeBoundingSphere(sphere);
+      delete body;
+      BoundingBox change;
+      change.add(sphere.center, sphere.radius);
+      changes.push_back(change);
+    }
+  }
+
+  /**
+   * @brief Apply the scene changes received since the last call and re-check the waypoints that are 
+   * still to be executed, but only those whose swept box intersects one of the changes.
+   * @return false if one of these waypoints is now in collision
+   */
+  bool checkSceneChanges(arm_navigation_msgs::ArmNavigationErrorCodes &error_code)
+  {
+    arm_navigation_msgs::CollisionMapConstPtr collision_map;
+    std::vector<arm_navigation_msgs::CollisionObjectConstPtr> collision_objects;
+    {
+      boost::mutex::scoped_lock lock(scene_change_lock_);
+      collision_map.swap(pending_collision_map_);
+      collision_objects.swap(pending_collision_objects_);
+    }
+    if(!collision_map && collision_objects.empty())
+      return true;
+
+    planning_environment::ScopedLatencyTimer scene_check_timer("move_arm_scene_check");
+    // the changes are transformed and self-filtered using the current state, not a waypoint 
+    // left over from an earlier check
+    resetToStartState(planning_scene_state_);
+    std::vector<BoundingBox> changes;
+    if(collision_map)
+      applyCollisionMap(*collision_map, changes);
+    for(unsigned int i=0; i < collision_objects.size(); i++)
+      applyCollisionObject(*collision_objects[i], changes);
+    if(changes.empty() || current_trajectory_.points.empty())
+      return true;
+
+    if(waypoint_bounding_boxes_.size() != current_trajectory_.points.size())
+      computeWaypointBoundingBoxes();
+    BoundingBox all_changes;
+    for(unsigned int i=0; i < changes.size(); i++)
+      all_changes.add(changes[i]);
+
+    // start at the segment that is being executed right now
+    ros::Duration time_from_start = ros::Time::now() - current_trajectory_.header.stamp;
+    unsigned int first_waypoint = 0;
+    while(first_waypoint+1 < current_trajectory_.points.size() && 
+          current_trajectory_.points[first_waypoint+1].time_from_start < time_from_start)
+      first_waypoint++;
+
+    std::map<std::string, double> joint_values;
+    unsigned int num_checked = 0;
+    for(unsigned int i=first_waypoint; i < current_trajectory_.points.size(); i++)
+    {
+      if(!waypoint_bounding_boxes_[i].intersects(all_changes))
+        continue;
+      bool affected = false;
+      for(unsigned int j=0; j < changes.size() && !affected; j++)
+        affected = waypoint_bounding_boxes_[i].intersects(changes[j]);
+      if(!affected)
+        continue;
+      num_checked++;
+      for(unsigned int j=0; j < current_trajectory_.joint_names.size(); j++)
+        joint_values[current_trajectory_.joint_names[j]] = current_trajectory_.points[i].positions[j];
+      planning_scene_state_->setKinematicState(joint_values);
+      if(collision_models_->isKinematicStateInCollision(*planning_scene_state_))
+      {
+        ROS_WARN("Waypoint %u of the executing trajectory is in collision after a scene change", i);
+        collision_models_->getAllCollisionsForState(*planning_scene_state_, move_arm_action_result_.contacts);
+        error_code.val = error_code.COLLISION_CONSTRAINTS_VIOLATED;
+        planning_environment::LatencyStatistics::getInstance().incrementCounter("move_arm_scene_check_waypoints", num_checked);
+        return false;
+      }
+    }
+    ROS_DEBUG("Scene changed, re-checked %u of %u remaining waypoints", num_checked, 
+              (unsigned int) current_trajectory_.points.size()-first_waypoint);
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("move_arm_scene_check_waypoints", num_checked);
+    return true;
+  }
+
+  ///
+  /// End Execution monitoring
+  ///
+
   ///
   /// State machine
   ///
@@ -841,8 +1333,81 @@ private:
     num_planning_attempts_ = 0;
     current_trajectory_.points.clear();
     current_trajectory_.joint_names.clear();
+    discardFilterTrajectory();
+    num_validated_points_ = 0;
+    recordStageLatency();
     state_ = PLANNING;    
   }
+
+  /**
+   * @brief Transition to a new state. The transition is queued as an event so that the 
+   * next state is run right away instead of on the next cycle.
+   */
+  void setState(const MoveArmState &state)
+  {
+    recordStageLatency();
+    state_ = state;
+    pushEvent(STATE_CHANGED);
+  }
+
+  void recordStageLatency()
+  {
+    ros::WallTime now = ros::WallTime::now();
+    switch(state_)
+    {
+    case PLANNING:
+      planning_environment::LatencyStatistics::getInstance().addSample("move_arm_planning_stage", (now-stage_start_time_).toSec());
+      break;
+    case START_CONTROL:
+      planning_environment::LatencyStatistics::getInstance().addSample("move_arm_start_control_stage", (now-stage_start_time_).toSec());
+      break;
+    case MONITOR:
+      planning_environment::LatencyStatistics::getInstance().addSample("move_arm_monitor_stage", (now-stage_start_time_).toSec());
+      break;
+    default:
+      break;
+    }
+    stage_start_time_ = now;
+  }
+
+  void pushEvent(const MoveArmEvent &event)
+  {
+    {
+      boost::mutex::scoped_lock lock(event_lock_);
+      events_.push_back(event);
+    }
+    event_condition_.notify_all();
+  }
+
+  /**
+   * @brief Wait until an event is queued or the timeout expires. 
+   * @return false if no event arrived before the timeout
+   */
+  bool waitForEvent(MoveArmEvent &event, const ros::WallDuration &timeout)
+  {
+    boost::mutex::scoped_lock lock(event_lock_);
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::microseconds(timeout.toNSec()/1000);
+    while(events_.empty())
+      if(!event_condition_.timed_wait(lock, deadline))
+        break;
+    if(events_.empty())
+      return false;
+    event = events_.front();
+    events_.pop_front();
+    return true;
+  }
+
+  void clearEvents()
+  {
+    boost::mutex::scoped_lock lock(event_lock_);
+    events_.clear();
+  }
+
+  void preemptCallback()
+  {
+    pushEvent(PREEMPT_REQUESTED);
+  }
+
   bool executeCycle(arm_navigation_msgs::GetMotionPlan::Request &req)
   {
     arm_navigation_msgs::GetMotionPlan::Response res;
@@ -879,6 +1444,9 @@ private:
           std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
           move_arm_stats_.planning_time = (ros::Time::now()-planning_time).toSec();
           ROS_DEBUG("createPlan succeeded");
+          // filter the raw plan while it is being validated
+          if(pipeline_execution_)
+            startFilterTrajectory(res.trajectory.joint_trajectory);
           resetToStartState(planning_scene_state_);
           if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
                                                         res.trajectory.joint_trajectory, 
@@ -897,6 +1465,7 @@ private:
             } else if (error_code.val == error_code.GOAL_CONSTRAINTS_VIOLATED) {
               ROS_WARN("Planner trajectory doesn't reach goal");
             }
+            discardFilterTrajectory();
 	    num_planning_attempts_++;
 	    if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
             {
@@ -905,6 +1474,7 @@ private:
               action_server_->setAborted(move_arm_action_result_);
               return true;
             }
+            pushEvent(STATE_CHANGED);
           }
           else{
             ROS_DEBUG("Trajectory validity check was successful");
@@ -912,7 +1482,7 @@ private:
 	    current_trajectory_ = res.trajectory.joint_trajectory;
 	    visualizePlan(current_trajectory_);
 	    //          printTrajectory(current_trajectory_);
-	    state_ = START_CONTROL;
+	    setState(START_CONTROL);
 	    ROS_DEBUG("Done planning. Transitioning to control");
 	  }
         }
@@ -928,6 +1498,7 @@ private:
             action_server_->setAborted(move_arm_action_result_);
             return true;
           }
+          pushEvent(STATE_CHANGED);
         }
         else
         {
@@ -942,18 +1513,20 @@ private:
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Filtering Trajectory");
         trajectory_msgs::JointTrajectory filtered_trajectory;
-        if(filterTrajectory(current_trajectory_, filtered_trajectory))
+        bool filter_ok;
+        if(filter_in_progress_)
+          filter_ok = finishFilterTrajectory(filtered_trajectory);
+        else
+          filter_ok = filterTrajectory(current_trajectory_, filtered_trajectory);
+        if(filter_ok)
         {
           arm_navigation_msgs::ArmNavigationErrorCodes error_code;
-          std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> traj_error_codes;
-          resetToStartState(planning_scene_state_);
-          if(!collision_models_->isJointTrajectoryValid(*planning_scene_state_,
-                                                        filtered_trajectory,
-                                                        original_request_.motion_plan_request.goal_constraints,
-                                                        original_request_.motion_plan_request.path_constraints,
-                                                        error_code,
-                                                        traj_error_codes,
-                                                        false))
+          // In pipelined mode only the first chunk is validated before the trajectory is sent, 
+          // the rest is validated while the controller is executing it
+          num_validated_points_ = filtered_trajectory.points.size();
+          if(pipeline_execution_)
+            num_validated_points_ = std::min(num_validated_points_, (unsigned int) validation_chunk_size_);
+          if(!isTrajectoryChunkValid(filtered_trajectory, 0, num_validated_points_, error_code))
           {
             if(error_code.val == error_code.COLLISION_CONSTRAINTS_VIOLATED) {
               ROS_WARN("Filtered trajectory collides");
@@ -965,7 +1538,7 @@ private:
               ROS_WARN("Filtered trajectory doesn't reach goal");
             }
             ROS_ERROR("Move arm will abort this goal.  Will replan");
-            state_ = PLANNING;
+            setState(PLANNING);
 	    num_planning_attempts_++;	    
 	    if(num_planning_attempts_ > req.motion_plan_request.num_planning_attempts)
             {
@@ -991,9 +1564,11 @@ private:
         }
         ROS_DEBUG("Sending trajectory");
         move_arm_stats_.time_to_execution = (ros::Time::now() - ros::Time(move_arm_stats_.time_to_execution)).toSec();
+        planning_environment::LatencyStatistics::getInstance().addSample("time_to_execution", move_arm_stats_.time_to_execution);
         if(sendTrajectory(current_trajectory_))
         {
-          state_ = MONITOR;
+          waypoint_bounding_boxes_.clear();
+          setState(MONITOR);
         }
         else
         {
@@ -1010,10 +1585,42 @@ private:
         move_arm_action_feedback_.time_to_completion = current_trajectory_.points.back().time_from_start;
         action_server_->publishFeedback(move_arm_action_feedback_);
         ROS_DEBUG("Start to monitor");
+        arm_navigation_msgs::ArmNavigationErrorCodes scene_error_code;
+        if(!move_arm_parameters_.disable_collision_monitoring && !checkSceneChanges(scene_error_code))
+        {
+          ROS_WARN("Stopping the controller since the rest of the trajectory is no longer valid");
+          stopTrajectory();
+          move_arm_action_result_.error_code = scene_error_code;
+          resetStateMachine();
+          action_server_->setAborted(move_arm_action_result_);
+          return true;
+        }
+        if(num_validated_points_ < current_trajectory_.points.size())
+        {
+          // chunks overlap by one point so that the transition between them is checked as well
+          unsigned int start = num_validated_points_ - 1;
+          unsigned int end = std::min(start + validation_chunk_size_, (unsigned int) current_trajectory_.points.size());
+          arm_navigation_msgs::ArmNavigationErrorCodes chunk_error_code;
+          if(!isTrajectoryChunkValid(current_trajectory_, start, end, chunk_error_code))
+          {
+            ROS_WARN("Points %u to %u of the executing trajectory are invalid (%s), stopping the controller",
+                     start, end, arm_navigation_msgs::armNavigationErrorCodeToString(chunk_error_code).c_str());
+            stopTrajectory();
+            move_arm_action_result_.error_code = chunk_error_code;
+            resetStateMachine();
+            action_server_->setAborted(move_arm_action_result_);
+            return true;
+          }
+          num_validated_points_ = end;
+          // keep validating right away, the controller is running on the validated prefix
+          if(num_validated_points_ < current_trajectory_.points.size())
+            pushEvent(STATE_CHANGED);
+        }
         arm_navigation_msgs::ArmNavigationErrorCodes controller_error_code;
         if(isControllerDone(controller_error_code))
         {
           move_arm_stats_.time_to_result = (ros::Time::now()-ros::Time(move_arm_stats_.time_to_result)).toSec();
+          planning_environment::LatencyStatistics::getInstance().addSample("time_to_result", move_arm_stats_.time_to_result);
 
           arm_navigation_msgs::RobotState empty_state;
           arm_navigation_msgs::ArmNavigationErrorCodes state_error_code;
@@ -1094,8 +1701,13 @@ private:
                                                             collision_models_->getWorldFrameId(),
                                                             req.motion_plan_request.start_state);
     original_request_ = req;
+    resetSceneMonitor();
 
-    ros::Rate move_arm_rate(move_arm_frequency_);
+    // The state machine runs whenever an event is queued. Without events (while the 
+    // trajectory is being executed) it still runs at move_arm_frequency_ to publish feedback.
+    ros::WallDuration max_event_wait(1.0/move_arm_frequency_);
+    clearEvents();
+    stage_start_time_ = ros::WallTime::now();
     move_arm_action_result_.contacts.clear();
     move_arm_action_result_.error_code.val = 0;
     move_arm_stats_.time_to_execution = ros::Time::now().toSec();
@@ -1108,6 +1720,7 @@ private:
         move_arm_stats_.preempted = true;
         if(publish_stats_)
           publishStats();
+        planning_environment::LatencyStatistics::getInstance().finishRequest();
         move_arm_stats_.time_to_execution = ros::Time::now().toSec();
         move_arm_stats_.time_to_result = ros::Time::now().toSec();
         if(action_server_->isNewGoalAvailable())
@@ -1134,8 +1747,12 @@ private:
                                                                   collision_models_->getWorldFrameId(),
                                                                   req.motion_plan_request.start_state);
           original_request_ = req;
+          resetSceneMonitor();
 
+          discardFilterTrajectory();
+          recordStageLatency();
           state_ = PLANNING;
+          clearEvents();
         }
         else               //if we've been preempted explicitly we need to shut things down
         {
@@ -1154,17 +1771,22 @@ private:
       bool done = executeCycle(req);
 
 
+      ros::WallDuration t_diff = ros::WallTime::now() - start;
+      planning_environment::LatencyStatistics::getInstance().addSample("move_arm_cycle", t_diff.toSec());
+
       if(done)
       {
         if(publish_stats_)
           publishStats();
+        planning_environment::LatencyStatistics::getInstance().finishRequest();
         return;
       }
 
-      ros::WallDuration t_diff = ros::WallTime::now() - start;
       ROS_DEBUG("Full control cycle time: %.9f\n", t_diff.toSec());
 
-      move_arm_rate.sleep();
+      MoveArmEvent event;
+      if(waitForEvent(event, max_event_wait))
+        ROS_DEBUG("Move arm woken up by event %d", event);
     }	    
     //if the node is killed then we'll abort and return
     ROS_INFO("Node was killed, aborting");
@@ -1181,7 +1803,10 @@ private:
     planning_scene_req.planning_scene_diff = planning_diff;
     planning_scene_req.operations = operations;
 
-    if(!set_planning_scene_diff_client_.call(planning_scene_req, planning_scene_res)) {
+    planning_environment::ScopedLatencyTimer scene_timer("get_planning_scene_diff");
+    bool scene_service_ok = set_planning_scene_diff_client_.call(planning_scene_req, planning_scene_res);
+    scene_timer.stop();
+    if(!scene_service_ok) {
       ROS_WARN("Can't get planning scene");
       return false;
     }
@@ -1388,12 +2013,39 @@ private:
   tf::TransformListener *tf_;
   MoveArmState state_;
   double move_arm_frequency_;      	
+  ros::WallTime stage_start_time_;
+
+  boost::mutex event_lock_;
+  boost::condition_variable event_condition_;
+  std::deque<MoveArmEvent> events_;
   trajectory_msgs::JointTrajectory current_trajectory_;
 
   int num_planning_attempts_;
 
+  bool pipeline_execution_;
+  int validation_chunk_size_;
+  unsigned int num_validated_points_;
+
+  // Background filtering of the raw plan in pipelined mode
+  bool filter_in_progress_;
+  bool filter_service_ok_;
+  boost::shared_ptr<boost::thread> filter_thread_;
+  arm_navigation_msgs::FilterJointTrajectoryWithConstraints::Request filter_request_;
+  trajectory_msgs::JointTrajectory filtered_trajectory_;
+
+  // Scene changes received during execution
+  ros::Subscriber collision_map_subscriber_, collision_object_subscriber_;
+  boost::mutex scene_change_lock_;
+  arm_navigation_msgs::CollisionMapConstPtr pending_collision_map_;
+  std::vector<arm_navigation_msgs::CollisionObjectConstPtr> pending_collision_objects_;
+  std::set<VoxelKey> monitored_voxels_;
+  std::vector<LinkBoundingSphere> link_bounding_spheres_;
+  std::vector<BoundingBox> waypoint_bounding_boxes_; ///box swept by the robot from each waypoint to the next
+  double scene_monitor_padding_;
+
   std::vector<std::string> group_joint_names_;
   std::vector<std::string> group_link_names_;
+  std::vector<std::string> updated_link_names_;
   std::vector<std::string> all_link_names_;
   arm_navigation_msgs::MoveArmResult move_arm_action_result_;
   arm_navigation_msgs::MoveArmFeedback move_arm_action_feedback_;
@@ -53,6 +53,7 @@
 #include <ompl_ros_interface/ompl_ros_planner_config.h>
 
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+#include <ompl_ros_interface/ik/ompl_ros_ik_sampling_pool.h>
 
 // Kinematics
 #include <pluginlib/class_loader.h>
@@ -103,7 +104,8 @@ public:
                           const unsigned int &max_sample_count = 100);
 
   /**
-   * @brief Sample a goal in the goal sampleable region
+   * @brief Sample a goal in the goal sampleable region. Solutions found by the background 
+   * IK workers are returned first, a serial IK call is made once they run out.
    * @param state - The state to be sampled and filled in
    */
   virtual void sampleGoal(ompl::base::State *state) const;
@@ -133,6 +135,8 @@ private:
   ompl_ros_interface::RobotStateToOmplStateMapping robot_state_to_ompl_state_mapping_;
   const planning_environment::CollisionModelsInterface* collision_models_interface_;
 
+  mutable ompl_ros_interface::OmplRosIKSamplingPool ik_sampling_pool_;
+
 };
 
 }
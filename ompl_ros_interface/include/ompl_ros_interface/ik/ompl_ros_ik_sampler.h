@@ -53,6 +53,7 @@
 #include <ompl_ros_interface/ompl_ros_projection_evaluator.h>
 #include <ompl_ros_interface/ompl_ros_planner_config.h>
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+#include <ompl_ros_interface/ik/ompl_ros_ik_sampling_pool.h>
 
 // Kinematics
 #include <pluginlib/class_loader.h>
@@ -89,7 +90,8 @@ public:
                   const planning_environment::CollisionModelsInterface *cmi);
 
   /**
-   * @brief Configure the kinematics solver when a request is received
+   * @brief Configure the kinematics solver when a request is received. If the sampler was configured 
+   * with ik_sampling_threads > 0, this also starts the background workers that solve IK for the goal poses.
    * @param request - The motion planning request
    * @param response - The response to the motion planning request. Use this to fill in any error codes
    * @param max_sample_count - The maximum number of samples that the IK should generate
@@ -112,6 +114,11 @@ public:
    */
   bool sampleGoals(const ompl::base::GoalLazySamples *gls, ompl::base::State *state);
 
+  /**
+   * @brief Stop the background workers. Calls to sampleGoals() that are waiting for a solution return false.
+   */
+  void stopSampling();
+
 private:
 
   std::vector<geometry_msgs::PoseStamped> ik_poses_;
@@ -129,6 +136,8 @@ private:
   ompl_ros_interface::RobotStateToOmplStateMapping robot_state_to_ompl_state_mapping_;
   const planning_environment::CollisionModelsInterface *collision_models_interface_;
 
+  ompl_ros_interface::OmplRosIKSamplingPool ik_sampling_pool_;
+
 };
 
 }
@@ -0,0 +1,159 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_IK_SAMPLING_POOL_H_
+#define OMPL_ROS_IK_SAMPLING_POOL_H_
+
+// OMPL
+#include <ompl/base/StateSpace.h>
+#include <ompl/base/ScopedState.h>
+#include <ompl/base/State.h>
+
+// Boost
+#include <boost/thread.hpp>
+#include <deque>
+
+// OMPL ROS Interface
+#include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+
+// Kinematics
+#include <pluginlib/class_loader.h>
+#include <kinematics_base/kinematics_base.h>
+
+#include <planning_environment/util/latency_statistics.h>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosIKSamplingPool
+ * @brief A pool of worker threads that keep solving IK for a set of goal poses in the background
+ * while the planner is searching. Each worker owns its own instance of the kinematics solver. 
+ * Solutions that are closer than a minimum joint space distance to a solution that was already 
+ * found are discarded, the rest are queued for the goal sampler to consume. A worker gives up 
+ * after a bounded number of IK calls in a row that do not produce a new solution, e.g. for 
+ * unreachable poses, and sampling stops once all workers have given up.
+ */
+class OmplRosIKSamplingPool
+{
+public:
+
+  OmplRosIKSamplingPool();
+  
+  ~OmplRosIKSamplingPool();
+
+  /**
+   * @brief Initialize the pool
+   * @param state_space - The state space that the planner is operating on
+   * @param kinematics_solver_name - The name of the kinematics plugin to load for every worker
+   * @param group_name - The name of the group that the solvers are operating on
+   * @param base_name - The root link of the kinematic chain
+   * @param tip_name - The tip link of the kinematic chain
+   * @param num_threads - The number of worker threads (0 disables the pool)
+   * @param min_distance - Solutions closer than this (in joint space) to an existing solution are discarded
+   */
+  bool initialize(const ompl::base::StateSpacePtr &state_space,
+                  const std::string &kinematics_solver_name,
+                  const std::string &group_name,
+                  const std::string &base_name,
+                  const std::string &tip_name,
+                  const unsigned int &num_threads,
+                  const double &min_distance);
+
+  /**
+   * @brief Discard the solutions of the previous request and start sampling for a new set of poses. 
+   * The poses must be expressed in the base frame of the kinematics solver.
+   * @param ik_poses - The goal poses for the end effector
+   * @param max_solutions - The workers stop once this many distinct solutions have been found
+   */
+  void start(const std::vector<geometry_msgs::PoseStamped> &ik_poses,
+             const unsigned int &max_solutions);
+
+  /**
+   * @brief Stop the workers and drop any solutions that have not been consumed. 
+   * Consumers blocked in waitForSolution() return false.
+   */
+  void stop();
+
+  /**
+   * @brief Block until a new solution is available
+   * @param state - The solution
+   * @return false if sampling stopped (or all workers gave up) and no more solutions are queued
+   */
+  bool waitForSolution(ompl::base::State *state);
+
+  /**
+   * @brief Get the number of worker threads
+   */
+  unsigned int getNumThreads() const
+  {
+    return kinematics_solvers_.size();
+  }
+
+  /**
+   * @brief Get the number of distinct solutions found for the current request
+   */
+  unsigned int getNumSolutions() const;
+
+private:
+
+  void sample(const unsigned int &worker,
+              const planning_environment::LatencyStatistics::RequestCountersPtr &counters);
+
+  bool addSolution(const ompl::base::State *state);
+
+  void clear();
+
+  ompl::base::StateSpacePtr state_space_;
+  pluginlib::ClassLoader<kinematics::KinematicsBase> kinematics_loader_;
+  std::vector<kinematics::KinematicsBase*> kinematics_solvers_;
+
+  arm_navigation_msgs::RobotState seed_state_;
+  ompl_ros_interface::OmplStateToRobotStateMapping ompl_state_to_robot_state_mapping_;
+  ompl_ros_interface::RobotStateToOmplStateMapping robot_state_to_ompl_state_mapping_;
+
+  std::vector<geometry_msgs::PoseStamped> ik_poses_;
+  unsigned int max_solutions_;
+  double min_distance_;
+
+  std::vector<ompl::base::State*> solutions_; ///all the distinct solutions found for this request
+  std::deque<ompl::base::State*> queue_; ///solutions that have not been consumed yet
+
+  mutable boost::mutex lock_;
+  boost::condition_variable solution_available_;
+  std::vector<boost::shared_ptr<boost::thread> > workers_;
+  unsigned int num_active_workers_; ///workers that have not given up yet
+  volatile bool running_;
+};
+}
+#endif //OMPL_ROS_IK_SAMPLING_POOL_H_
@@ -48,10 +48,15 @@
 #include <ompl_ros_interface/planners/ompl_ros_rpy_ik_task_space_planner.h>
 #include <ompl_ros_interface/planners/ompl_ros_joint_planner.h>
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+#include <ompl_ros_interface/ompl_ros_plan_library.h>
 
 // Diagnostics Message
 #include <ompl_ros_interface/OmplPlannerDiagnostics.h>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/scoped_ptr.hpp>
+
 namespace ompl_ros_interface
 {
   /**
@@ -76,8 +81,28 @@ public:
   boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& getPlanner(const std::string &group_name, 
                                                                           const std::string &planner_config_name);
 
+  /**
+     @brief The number of requests that can be planned for concurrently
+   */
+  unsigned int getNumPlanningContexts() const
+  {
+    return planning_contexts_.size();
+  }
+
 private:
 
+  /**
+     @brief A copy of the planning scene together with an instance of every configured 
+     planning group that plans against it. A context serves one request at a time.
+  */
+  struct PlanningContext
+  {
+    planning_environment::CollisionModelsInterface *collision_models_interface;
+    std::map<std::string,boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> > planner_map;
+    /// The scene last set into collision_models_interface
+    boost::shared_ptr<const arm_navigation_msgs::PlanningScene> planning_scene;
+  };
+
  /**
     @brief Planning - choose the correct planner and then call it
     with the request.
@@ -94,15 +119,81 @@ private:
   bool initialize(const std::string &param_server_prefix);
   
   bool initializePlanningMap(const std::string &param_server_prefix,
-                             const std::vector<std::string> &group_names);
+                             const std::vector<std::string> &group_names,
+                             PlanningContext &context);
   
   bool initializePlanningInstance(const std::string &param_server_prefix,
                                   const std::string &group_name,
-                                  const std::string &planner_config_name);    
+                                  const std::string &planner_config_name,
+                                  PlanningContext &context);    
+
+  bool initializePortfolio(const std::string &param_server_prefix,
+                           const std::string &group_name,
+                           const std::string &planner_config_name,
+                           PlanningContext &context);
+
+  /**
+     @brief Race the member planners of a portfolio, one per acquired context. The first 
+     successful member wins and the others are terminated. If there are fewer contexts than 
+     members, the members are raced in rounds until one of them finds a solution.
+     @param winner Set to the planner configuration of the member whose plan was returned
+  */
+  void computePortfolioPlan(const std::vector<std::string> &members,
+                            const std::vector<unsigned int> &context_indices,
+                            arm_navigation_msgs::GetMotionPlan::Request &request,
+                            arm_navigation_msgs::GetMotionPlan::Response &response,
+                            std::string &winner);
+
+  /**
+     @brief Block until num planning contexts are free and take them all at once. Requests 
+     are served in arrival order.
+  */
+  void acquirePlanningContexts(unsigned int num, 
+                               std::vector<unsigned int> &indices);
+
+  void releasePlanningContexts(const std::vector<unsigned int> &indices);
+
+  /**
+     @brief Publish a newly synced planning scene to the planning contexts
+  */
+  void setPlanningSceneCallback(const arm_navigation_msgs::PlanningScene &scene);
+
+  /**
+     @brief Set the latest published planning scene into an acquired context if it does not have it yet
+  */
+  void updatePlanningScene(PlanningContext &context);
+
+  /**
+     @brief The planning contexts. With a single context it plans directly against 
+     collision_models_interface_, otherwise every context owns its own copy of the scene.
+  */
+  std::vector<PlanningContext> planning_contexts_;
+  std::vector<unsigned int> free_planning_contexts_;
+  /// Requests are served in the order of their tickets
+  unsigned int next_ticket_, serving_ticket_;
+  boost::mutex planning_contexts_mutex_;
+  boost::condition_variable planning_context_available_;
+
+  /**
+     @brief The latest synced planning scene. A new scene replaces the pointer without waiting for 
+     requests in flight, which keep planning against the scene they started with. Every context 
+     picks up the latest scene when it starts its next request, so contexts that sit idle never 
+     rebuild their scene.
+  */
+  boost::shared_ptr<const arm_navigation_msgs::PlanningScene> planning_scene_;
+  boost::mutex planning_scene_mutex_;
+
+  /**
+     @brief Map from portfolio name[group name] to the names of its member planner configurations
+  */
+  std::map<std::string,std::vector<std::string> > portfolio_map_;
+
   /**
-     @brief Map from planner name[group name] to an instance of ompl_ros_interface::OmplPlanningGroup
+     @brief Previous solutions shared by all planning groups, NULL if the plan library is disabled. 
+     It is loaded from plan_library_filename_ on startup and saved back on shutdown.
   */
-  std::map<std::string,boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> > planner_map_;
+  boost::scoped_ptr<ompl_ros_interface::OmplRosPlanLibrary> plan_library_;
+  std::string plan_library_filename_;
 
   // ROS interface 
   boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> empty_ptr;
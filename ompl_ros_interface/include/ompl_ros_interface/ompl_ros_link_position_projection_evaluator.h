@@ -0,0 +1,120 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_LINK_POSITION_PROJECTION_EVALUATOR_
+#define OMPL_ROS_LINK_POSITION_PROJECTION_EVALUATOR_
+
+#include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+#include <ompl_ros_interface/helpers/ompl_ros_exception.h>
+
+#include <ompl/base/ProjectionEvaluator.h>
+
+#include <planning_models/kinematic_model.h>
+#include <planning_models/kinematic_state.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace ompl_ros_interface
+{
+
+/**
+ * @class OmplRosLinkPositionProjectionEvaluator
+ * @brief A projection evaluator that projects the joint state of a group onto the 
+ * cartesian position of one of its links. Only the transforms of the links between the 
+ * first joint of the group and the projected link are recomputed for every state, and the 
+ * most recent projections are cached. The cell sizes are estimated from the projections 
+ * of uniformly sampled states.
+*/
+class OmplRosLinkPositionProjectionEvaluator : public ompl::base::ProjectionEvaluator
+{
+public:
+  /**
+   * @brief Default constructor
+   * @param state_space - The state space of the group, as created by jointGroupToOmplStateSpacePtr
+   * @param kinematic_model - The kinematic model the group belongs to
+   * @param group_name - The name of the joint group 
+   * @param link_name - The link whose position is used as the projection
+   * @param num_cells - The number of grid cells along every axis of the sampled workspace
+   */  
+  OmplRosLinkPositionProjectionEvaluator(const ompl::base::StateSpacePtr &state_space, 
+                                         const planning_models::KinematicModel *kinematic_model,
+                                         const std::string &group_name,
+                                         const std::string &link_name,
+                                         unsigned int num_cells = 20);
+
+  ~OmplRosLinkPositionProjectionEvaluator();
+	
+  /**
+   * @brief Get the dimension of the state used by this projection evaluator
+   */
+  virtual unsigned int getDimension(void) const;
+	
+  /**
+   * @brief Carry out the projection
+   */
+  virtual void project(const ompl::base::State *state, 
+                       ompl::base::EuclideanProjection &projection) const;
+
+private:
+
+  struct CachedProjection
+  {
+    CachedProjection() : key(NULL), state(NULL) {}
+    const ompl::base::State *key;
+    ompl::base::State *state;
+    double position[3];
+  };
+
+  void estimateCellSizes(unsigned int num_cells);
+
+  boost::scoped_ptr<planning_models::KinematicState> kinematic_state_;
+  planning_models::KinematicState::JointStateGroup *joint_state_group_;
+  const planning_models::KinematicState::LinkState *link_state_;
+
+  /** 
+      @brief The links whose transforms change with the state of the group, from the root towards link_state_ 
+  */
+  std::vector<planning_models::KinematicState::LinkState*> link_chain_;
+  ompl_ros_interface::OmplStateToKinematicStateMapping ompl_state_to_kinematic_state_mapping_;
+
+  /**
+     @brief Direct mapped cache of projections, indexed by the address of the projected state
+  */
+  mutable std::vector<CachedProjection> cache_;
+  mutable boost::mutex mutex_;
+};
+}
+
+#endif
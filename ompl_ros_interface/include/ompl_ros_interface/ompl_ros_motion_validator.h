@@ -0,0 +1,85 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_MOTION_VALIDATOR_
+#define OMPL_ROS_MOTION_VALIDATOR_
+
+#include <ompl/base/MotionValidator.h>
+#include <ompl/base/SpaceInformation.h>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosMotionValidator
+ * @brief Checks motions at the resolution of the state space, like the default ompl motion validator, 
+ * but coarse to fine: the end state first, then the middle of the motion and then recursively the 
+ * middle of each half, stopping at the first invalid state. Colliding motions are usually rejected
+ * after a few checks, and states that were checked before are answered by the validity cache of 
+ * the state validity checker.
+ */
+class OmplRosMotionValidator : public ompl::base::MotionValidator
+{
+public:
+  OmplRosMotionValidator(ompl::base::SpaceInformation *si) : 
+    ompl::base::MotionValidator(si)
+  {
+  }
+
+  OmplRosMotionValidator(const ompl::base::SpaceInformationPtr &si) : 
+    ompl::base::MotionValidator(si)
+  {
+  }
+
+  virtual ~OmplRosMotionValidator()
+  {
+  }
+
+  /**
+   * @brief Check the motion from s1 to s2 by bisection. s1 is assumed to be valid.
+   */
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2) const;
+
+  /**
+   * @brief Check the motion from s1 to s2 from the start on, so that the last valid state is known.
+   * s1 is assumed to be valid.
+   * @param last_valid Set to the last valid state (if the state is not NULL) and its position along the 
+   * motion, if the motion is invalid
+   */
+  virtual bool checkMotion(const ompl::base::State *s1, 
+                           const ompl::base::State *s2, 
+                           std::pair<ompl::base::State*, double> &last_valid) const;
+};
+}
+#endif
@@ -0,0 +1,185 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_PLAN_LIBRARY_H_
+#define OMPL_ROS_PLAN_LIBRARY_H_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <arm_navigation_msgs/PlanningScene.h>
+
+// OMPL
+#include <ompl/base/StateSpace.h>
+#include <ompl/datastructures/NearestNeighborsGNAT.h>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosPlanLibrary
+ * @brief A library of previously computed solution paths. Paths are stored per group as 
+ * sequences of states of the group's planning state space and are looked up by the distance 
+ * between their start and goal states and the start and goal of a new request. The library 
+ * can be saved to a binary file; a loaded file is memory mapped and its paths are used in place.
+ */
+class OmplRosPlanLibrary
+{
+public:
+
+  typedef std::vector<double> Waypoint;
+  typedef std::vector<Waypoint> Path;
+
+  /**
+     @param max_candidates The maximum number of paths returned by a single lookup
+     @param max_distance Paths whose start and goal are further away than this 
+     (sum of the squared distances, square rooted) are never returned
+     @param duplicate_distance A new path this close to a stored path for the same scene is not added
+  */
+  OmplRosPlanLibrary(unsigned int max_candidates = 3, 
+                     double max_distance = 1.0,
+                     double duplicate_distance = 0.01);
+  ~OmplRosPlanLibrary();
+
+  /**
+     @brief Add the paths in a library file. The file is mapped into memory and stays mapped 
+     for the lifetime of this object.
+  */
+  bool load(const std::string &filename);
+
+  /**
+     @brief Write all paths to a library file. The file is written to a temporary 
+     file first and then renamed, so a mapped copy of a previous version stays valid.
+  */
+  bool save(const std::string &filename) const;
+
+  /**
+     @brief Add a path for a group. Paths with less than two waypoints are ignored.
+     @return False if the path was not added because it duplicates a stored path
+  */
+  bool addPath(const std::string &group_name,
+               const boost::uint64_t &scene_signature,
+               const Path &path);
+
+  /**
+     @brief Find the stored paths of a group whose start and goal are closest to the given ones.
+     Paths recorded in a scene with the given signature come first, otherwise paths are sorted by distance.
+  */
+  void getNearestPaths(const std::string &group_name,
+                       const Waypoint &start,
+                       const Waypoint &goal,
+                       const boost::uint64_t &scene_signature,
+                       std::vector<Path> &paths) const;
+
+  /**
+     @brief The number of stored paths
+  */
+  unsigned int size() const;
+
+  /**
+     @brief A coarse signature of the obstacles in a planning scene. Scenes with the same 
+     collision objects and attached objects share a signature wherever these objects are.
+  */
+  static boost::uint64_t computeSceneSignature(const arm_navigation_msgs::PlanningScene &planning_scene);
+
+  /**
+     @brief Get the real values that make up an ompl state
+  */
+  static void stateToWaypoint(const ompl::base::StateSpacePtr &state_space,
+                              const ompl::base::State *state,
+                              Waypoint &waypoint);
+
+  /**
+     @brief Set an ompl state from its real values
+  */
+  static bool waypointToState(const ompl::base::StateSpacePtr &state_space,
+                              const Waypoint &waypoint,
+                              ompl::base::State *state);
+
+private:
+
+  /**
+     @brief A stored path. The waypoints either point into a mapped library file 
+     or into storage.
+  */
+  struct Entry
+  {
+    boost::uint64_t scene_signature;
+    unsigned int num_waypoints;
+    unsigned int dimension;
+    const double *waypoints;
+    std::vector<double> storage;
+
+    const double* start() const
+    {
+      return waypoints;
+    }
+    const double* goal() const
+    {
+      return waypoints + (num_waypoints-1)*dimension;
+    }
+  };
+  typedef boost::shared_ptr<Entry> EntryPtr;
+
+  struct GroupLibrary
+  {
+    unsigned int dimension;
+    std::vector<EntryPtr> entries;
+    boost::shared_ptr<ompl::NearestNeighborsGNAT<Entry*> > nearest_neighbors;
+  };
+
+  static double distance(const Entry* a, const Entry* b);
+
+  GroupLibrary* getGroupLibrary(const std::string &group_name, 
+                                unsigned int dimension);
+
+  void addEntry(const std::string &group_name,
+                const EntryPtr &entry);
+
+  void unmap();
+
+  std::map<std::string, GroupLibrary> groups_;
+  unsigned int max_candidates_;
+  double max_distance_, duplicate_distance_;
+  mutable boost::mutex mutex_;
+
+  void *mapped_file_;
+  size_t mapped_size_;
+};
+}
+#endif //OMPL_ROS_PLAN_LIBRARY_H_
@@ -52,8 +52,11 @@
 
 // OMPL ROS Interface
 #include <ompl_ros_interface/ompl_ros_state_validity_checker.h>
+#include <ompl_ros_interface/ompl_ros_motion_validator.h>
 #include <ompl_ros_interface/ompl_ros_projection_evaluator.h>
+#include <ompl_ros_interface/ompl_ros_link_position_projection_evaluator.h>
 #include <ompl_ros_interface/ompl_ros_planner_config.h>
+#include <ompl_ros_interface/ompl_ros_plan_library.h>
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
 
 // OMPL
@@ -80,7 +83,7 @@ namespace ompl_ros_interface
   {
   public:
     
-    OmplRosPlanningGroup(){}
+    OmplRosPlanningGroup() : terminate_(false), plan_library_(NULL) {}
     
     /**
        @brief Initialize the planning group from the param server
@@ -118,6 +121,30 @@ namespace ompl_ros_interface
     bool computePlan(arm_navigation_msgs::GetMotionPlan::Request &request, 
                      arm_navigation_msgs::GetMotionPlan::Response &response);
 
+    /*
+      @brief Ask a computePlan call running in another thread to stop planning as soon as possible.
+      The request stays terminated until clearTermination is called.
+     */
+    void terminate()
+    {
+      terminate_ = true;
+    }
+
+    void clearTermination()
+    {
+      terminate_ = false;
+    }
+
+    /*
+      @brief Set the library of previous solutions. Before planning from scratch, computePlan 
+      tries to repair the nearest stored paths and it adds new solutions to the library.
+      The library may be shared between planning groups.
+     */
+    void setPlanLibrary(ompl_ros_interface::OmplRosPlanLibrary *plan_library)
+    {
+      plan_library_ = plan_library;
+    }
+
     /**
        @brief The underlying planner to be used for planning
      */
@@ -186,6 +213,12 @@ namespace ompl_ros_interface
      */
     virtual arm_navigation_msgs::RobotTrajectory getSolutionPath() = 0;
 
+    /**
+      @brief Stop any goal sampling that was started in the background for the current request. 
+      This is called when a request is finished.
+     */
+    virtual void stopGoalSampling(){}
+
   protected:
     ros::NodeHandle node_handle_;
     bool omplPathGeometricToRobotTrajectory(const ompl::geometric::PathGeometric &path, 
@@ -202,6 +235,31 @@ namespace ompl_ros_interface
 
     ompl::base::PlannerPtr ompl_planner_;
 
+    volatile bool terminate_;
+
+    bool shouldTerminate(const ros::WallTime &deadline) const;
+
+    ompl_ros_interface::OmplRosPlanLibrary *plan_library_;
+    double plan_library_repair_fraction_;
+
+    /**
+       @brief Try to solve the current problem by repairing the nearest paths in the plan library.
+       On success the repaired path is set as the solution path of the planner.
+       @param repaired Set to true if any segment of the library path had to be replanned
+    */
+    bool computePlanFromLibrary(const ros::WallTime &deadline,
+                                bool &repaired);
+
+    /**
+       @brief Check every segment of a path and replan the segments that are invalid
+    */
+    bool repairPath(const ompl::geometric::PathGeometric &path,
+                    const ros::WallTime &deadline,
+                    ompl::geometric::PathGeometric &repaired_path,
+                    bool &repaired);
+
+    void addSolutionToLibrary();
+
     bool initializeProjectionEvaluator();
 
     bool initializePhysicalGroup();
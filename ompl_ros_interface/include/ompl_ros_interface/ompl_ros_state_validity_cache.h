@@ -0,0 +1,137 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef OMPL_ROS_STATE_VALIDITY_CACHE_
+#define OMPL_ROS_STATE_VALIDITY_CACHE_
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <ompl/base/StateSpace.h>
+#include <ompl/base/State.h>
+
+namespace ompl_ros_interface
+{
+/**
+ * @class OmplRosStateValidityCache
+ * @brief Remembers the validity of states within one planning request. States are 
+ * identified by their values rounded to a fixed resolution, so states that differ by 
+ * less than the resolution share their result. Lookups and insertions may come from 
+ * several threads, e.g. goal sampling threads running alongside the planner.
+ */
+class OmplRosStateValidityCache
+{
+public:
+  /**
+   * @param state_space The state space of the cached states
+   * @param resolution The resolution the state values are rounded to, the cache is disabled if it is not positive
+   * @param max_size The cache is cleared when it holds more states than this
+   */
+  OmplRosStateValidityCache(const ompl::base::StateSpacePtr &state_space,
+                            double resolution = 1e-5,
+                            unsigned int max_size = 100000);
+
+  /**
+   * @brief Look up the validity of a state
+   * @return False if the state has not been checked yet
+   */
+  bool lookup(const ompl::base::State *state, bool &valid);
+
+  /**
+   * @brief Store the validity of a state
+   */
+  void insert(const ompl::base::State *state, bool valid);
+
+  /**
+   * @brief Forget all states and reset the hit and miss counts
+   */
+  void clear();
+
+  void setResolution(double resolution)
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    resolution_ = resolution;
+    results_.clear();
+    num_hits_ = 0;
+    num_misses_ = 0;
+  }
+
+  void setMaxSize(unsigned int max_size)
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    max_size_ = max_size;
+  }
+
+  bool isEnabled() const
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    return resolution_ > 0.0;
+  }
+
+  unsigned int size() const
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    return results_.size();
+  }
+
+  unsigned int getNumHits() const
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    return num_hits_;
+  }
+
+  unsigned int getNumMisses() const
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    return num_misses_;
+  }
+
+private:
+
+  typedef std::vector<boost::int64_t> Key;
+
+  void computeKey(const ompl::base::State *state, double resolution, Key &key) const;
+
+  ompl::base::StateSpacePtr state_space_;
+  double resolution_;
+  unsigned int max_size_;
+  boost::unordered_map<Key, bool, boost::hash<Key> > results_;
+  unsigned int num_hits_, num_misses_;
+  mutable boost::mutex lock_;
+};
+}
+#endif
@@ -42,6 +42,7 @@
 #include <arm_navigation_msgs/GetMotionPlan.h>
 
 #include <ompl_ros_interface/helpers/ompl_ros_conversions.h>
+#include <ompl_ros_interface/ompl_ros_state_validity_cache.h>
 
 #include <ompl/base/StateValidityChecker.h>
 #include <ompl/base/State.h>
@@ -64,12 +65,31 @@ public:
   OmplRosStateValidityChecker(ompl::base::SpaceInformation *si, 
                               planning_environment::CollisionModelsInterface *cmi) :
     ompl::base::StateValidityChecker(si), 
-    collision_models_interface_(cmi)
+    collision_models_interface_(cmi),
+    validity_cache_(si->getStateSpace())
   {
   }
   
-  /** @brief Callback function used to determine whether a state is valid or not */
-  virtual bool 	isValid  (const ompl::base::State *ompl_state) const = 0;	
+  /** @brief Callback function used to determine whether a state is valid or not. 
+      Results are cached until the next call to configureOnRequest. */
+  virtual bool 	isValid  (const ompl::base::State *ompl_state) const;	
+
+  /** @brief The cache of isValid results for the current request */
+  const OmplRosStateValidityCache& getValidityCache() const
+  {
+    return validity_cache_;
+  }
+
+  /** 
+      @brief Configure the validity cache
+      @param resolution The resolution that state values are rounded to, the cache is disabled if it is not positive
+      @param max_size The maximum number of cached states
+  */
+  void setValidityCacheParameters(double resolution, unsigned int max_size)
+  {
+    validity_cache_.setResolution(resolution);
+    validity_cache_.setMaxSize(max_size);
+  }
 
   /** \brief Used by the ROS space information to print information */
   void printSettings(std::ostream &out) const;
@@ -101,6 +121,12 @@ public:
   virtual bool isStateValid(const ompl::base::State *ompl_state) = 0;
 
 protected:	
+
+  /** @brief Check a state without consulting the cache. This function must be implemented by every derived class. */
+  virtual bool checkState(const ompl::base::State *ompl_state) const = 0;
+
+  mutable OmplRosStateValidityCache validity_cache_;
+
   planning_models::KinematicState::JointStateGroup *joint_state_group_;
   planning_environment::CollisionModelsInterface* collision_models_interface_;
   planning_models::KinematicState *kinematic_state_;
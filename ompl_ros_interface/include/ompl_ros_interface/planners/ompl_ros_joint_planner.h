@@ -93,6 +93,11 @@ namespace ompl_ros_interface
      */
     virtual arm_navigation_msgs::RobotTrajectory getSolutionPath();
 
+    /**
+      @brief Stop the IK sampling threads
+     */
+    virtual void stopGoalSampling();
+
   private:
 
     //Mappings in between ompl state and robot state, these are used for efficiency
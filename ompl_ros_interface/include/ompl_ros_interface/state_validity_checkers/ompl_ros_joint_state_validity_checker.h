@@ -63,12 +63,6 @@ public:
   }
   ~OmplRosJointStateValidityChecker(){}
 	
-  /**
-   * @brief The callback function used by the planners to determine if a state is valid
-   * @param ompl_state The state that needs to be checked
-   */
-  virtual bool 	isValid  (const ompl::base::State *ompl_state) const;	
-
   /**
    * @brief A non-const version of isValid designed to fill in the last error code 
    * @param ompl_state The state that needs to be checked
@@ -76,6 +70,12 @@ public:
   virtual bool isStateValid(const ompl::base::State *ompl_state);
 	
 protected:	
+  /**
+   * @brief Check a state, called by isValid for states that are not in the validity cache
+   * @param ompl_state The state that needs to be checked
+   */
+  virtual bool checkState(const ompl::base::State *ompl_state) const;
+
   ompl_ros_interface::OmplStateToKinematicStateMapping ompl_state_to_kinematic_state_mapping_;    
 
   //a cached pose that will be multiplied to every input pose
@@ -63,12 +63,6 @@ public:
   }
   ~OmplRosTaskSpaceValidityChecker(){}
 	
-  /**
-   * @brief The callback function used by the planners to determine if a state is valid
-   * @param ompl_state The state that needs to be checked
-   */
-  virtual bool 	isValid  (const ompl::base::State *ompl_state) const;	
-
   /*
     @brief A non-const version of isValid designed to fill in the last error code 
     @param ompl_state The state that needs to be checked
@@ -103,6 +97,11 @@ public:
                                   const arm_navigation_msgs::GetMotionPlan::Request &request);
 
 protected:	
+  /**
+   * @brief Check a state, called by isValid for states that are not in the validity cache
+   * @param ompl_state The state that needs to be checked
+   */
+  virtual bool checkState(const ompl::base::State *ompl_state) const;
 
   arm_navigation_msgs::RobotState robot_state_msg_;
   std::string parent_frame_;
@@ -35,6 +35,8 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/ik/ompl_ros_ik_goal_sampleable_region.h>
+#include <planning_environment/util/latency_statistics.h>
+#include <algorithm>
 
 namespace ompl_ros_interface
 {
@@ -60,7 +62,6 @@ bool OmplRosIKSampleableRegion::initialize(const ompl::base::StateSpacePtr &stat
   try
   {
     kinematics_solver_ = kinematics_loader_.createClassInstance(kinematics_solver_name);
-    return false;
   }
   catch(pluginlib::PluginlibException& ex)    //handle the class failing to load
   {
@@ -99,12 +100,27 @@ bool OmplRosIKSampleableRegion::initialize(const ompl::base::StateSpacePtr &stat
     return false;
   if(!ompl_ros_interface::getOmplStateToRobotStateMapping(scoped_state_,seed_state_,ompl_state_to_robot_state_mapping_))
     return false;
+
+  int num_threads;
+  double min_distance;
+  node_handle.param(group_name_+"/ik_sampling_threads",num_threads,2);
+  node_handle.param(group_name_+"/ik_sampling_min_distance",min_distance,0.05);
+  if(!ik_sampling_pool_.initialize(state_space_,
+                                   kinematics_solver_name,
+                                   group_name,
+                                   base_name,
+                                   tip_name,
+                                   std::max(num_threads,0),
+                                   min_distance))
+    ROS_WARN("Could not start IK sampling threads for group %s, goals will be sampled serially",group_name.c_str());
+  return true;
 }  
 
 bool OmplRosIKSampleableRegion::configureOnRequest(const arm_navigation_msgs::GetMotionPlan::Request &request,
                                                    arm_navigation_msgs::GetMotionPlan::Response &response,
                                                    const unsigned int &max_sample_count)
 {
+  ik_sampling_pool_.stop();
   max_sample_count_ = max_sample_count;
   ik_poses_.clear();
   arm_navigation_msgs::Constraints goal_constraints = request.motion_plan_request.goal_constraints;
@@ -135,6 +151,7 @@ bool OmplRosIKSampleableRegion::configureOnRequest(const arm_navigation_msgs::Ge
       return false;
     }
   }
+  ik_sampling_pool_.start(ik_poses_,max_sample_count_);
   return true;
 }
 
@@ -146,6 +163,8 @@ unsigned int OmplRosIKSampleableRegion::maxSampleCount(void) const
 void OmplRosIKSampleableRegion::sampleGoal(ompl::base::State *state) const
 
 {
+  if(ik_sampling_pool_.getNumThreads() > 0 && ik_sampling_pool_.waitForSolution(state))
+    return;
   std::vector<arm_navigation_msgs::RobotState> sampled_states_vector;
   sampleGoals(1,sampled_states_vector);
   if(!sampled_states_vector.empty())
@@ -172,10 +191,14 @@ void OmplRosIKSampleableRegion::sampleGoals(const unsigned int &number_goals,
                                               ompl_state_to_robot_state_mapping_,
                                               seed_state);    
     int error_code;
-    if(kinematics_solver_->getPositionIK(ik_poses_[ik_poses_counter].pose,
-                                         seed_state.joint_state.position,
-                                         solution_state.joint_state.position,
-					 error_code))
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_calls");
+    planning_environment::ScopedLatencyTimer ik_timer("ik");
+    bool ik_found = kinematics_solver_->getPositionIK(ik_poses_[ik_poses_counter].pose,
+                                                      seed_state.joint_state.position,
+                                                      solution_state.joint_state.position,
+                                                      error_code);
+    ik_timer.stop();
+    if(ik_found)
     {
       sampled_states_vector.push_back(solution_state);
       ik_poses_counter++;
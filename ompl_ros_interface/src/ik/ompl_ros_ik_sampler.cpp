@@ -35,6 +35,8 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/ik/ompl_ros_ik_sampler.h>
+#include <planning_environment/util/latency_statistics.h>
+#include <algorithm>
 
 namespace ompl_ros_interface
 {
@@ -93,6 +95,19 @@ bool OmplRosIKSampler::initialize(const ompl::base::StateSpacePtr &state_space,
     return false;
   }
   ROS_DEBUG("Initialized solver %s",kinematics_solver_name.c_str());
+
+  int num_threads;
+  double min_distance;
+  node_handle.param(group_name_+"/ik_sampling_threads",num_threads,2);
+  node_handle.param(group_name_+"/ik_sampling_min_distance",min_distance,0.05);
+  if(!ik_sampling_pool_.initialize(state_space_,
+                                   kinematics_solver_name,
+                                   group_name,
+                                   base_name,
+                                   tip_name,
+                                   std::max(num_threads,0),
+                                   min_distance))
+    ROS_WARN("Could not start IK sampling threads for group %s, goals will be sampled serially",group_name.c_str());
   scoped_state_.reset(new ompl::base::ScopedState<ompl::base::CompoundStateSpace>(state_space_));
   seed_state_.joint_state.name = kinematics_solver_->getJointNames();
   seed_state_.joint_state.position.resize(kinematics_solver_->getJointNames().size());
@@ -123,6 +138,7 @@ bool OmplRosIKSampler::configureOnRequest(const arm_navigation_msgs::GetMotionPl
                                           arm_navigation_msgs::GetMotionPlan::Response &response,
                                           const unsigned int &max_sample_count)
 {
+  ik_sampling_pool_.stop();
   ik_poses_counter_ = 0;
   max_sample_count_ = max_sample_count;
   num_samples_ = 0;
@@ -158,6 +174,7 @@ bool OmplRosIKSampler::configureOnRequest(const arm_navigation_msgs::GetMotionPl
       return false;
     }
   }
+  ik_sampling_pool_.start(ik_poses_,max_sample_count_);
   return true;
 }
 
@@ -174,10 +191,14 @@ bool OmplRosIKSampler::sampleGoal(const ompl::base::GoalLazySamples *gls, ompl::
                                             ompl_state_to_robot_state_mapping_,
                                             seed_state);    
   int error_code;
-  if(kinematics_solver_->getPositionIK(ik_poses_[ik_poses_counter_].pose,
-                                       seed_state.joint_state.position,
-                                       solution_state.joint_state.position,
-				       error_code))
+  planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_calls");
+  planning_environment::ScopedLatencyTimer ik_timer("ik");
+  bool ik_found = kinematics_solver_->getPositionIK(ik_poses_[ik_poses_counter_].pose,
+                                                    seed_state.joint_state.position,
+                                                    solution_state.joint_state.position,
+                                                    error_code);
+  ik_timer.stop();
+  if(ik_found)
   {
     // arm_navigation_msgs::printJointState(solution_state.joint_state);
     ompl_ros_interface::robotStateToOmplState(solution_state,
@@ -192,6 +213,10 @@ bool OmplRosIKSampler::sampleGoal(const ompl::base::GoalLazySamples *gls, ompl::
 
 bool OmplRosIKSampler::sampleGoals(const ompl::base::GoalLazySamples *gls, ompl::base::State *state)
 {
+  // The workers stop by themselves once max_sample_count_ distinct solutions have been found
+  if(ik_sampling_pool_.getNumThreads() > 0)
+    return ik_sampling_pool_.waitForSolution(state);
+
   bool continue_sampling = sampleGoal(gls,state);
   if(continue_sampling)
     num_samples_++;
@@ -203,4 +228,9 @@ bool OmplRosIKSampler::sampleGoals(const ompl::base::GoalLazySamples *gls, ompl:
     return true;
 }
 
+void OmplRosIKSampler::stopSampling()
+{
+  ik_sampling_pool_.stop();
+}
+
 }
@@ -0,0 +1,258 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ik/ompl_ros_ik_sampling_pool.h>
+#include <planning_environment/util/latency_statistics.h>
+
+namespace ompl_ros_interface
+{
+// A worker gives up after this many IK calls per goal pose in a row without a new solution
+const unsigned int MAX_CONSECUTIVE_FAILURES_PER_POSE = 100;
+
+OmplRosIKSamplingPool::OmplRosIKSamplingPool(): kinematics_loader_("kinematics_base","kinematics::KinematicsBase"),
+                                                max_solutions_(0),
+                                                min_distance_(0.0),
+                                                num_active_workers_(0),
+                                                running_(false)
+{
+}
+
+OmplRosIKSamplingPool::~OmplRosIKSamplingPool()
+{
+  stop();
+  clear();
+  for(unsigned int i=0; i < kinematics_solvers_.size(); i++)
+    delete kinematics_solvers_[i];
+}
+
+bool OmplRosIKSamplingPool::initialize(const ompl::base::StateSpacePtr &state_space,
+                                       const std::string &kinematics_solver_name,
+                                       const std::string &group_name,
+                                       const std::string &base_name,
+                                       const std::string &tip_name,
+                                       const unsigned int &num_threads,
+                                       const double &min_distance)
+{
+  state_space_ = state_space;
+  min_distance_ = min_distance;
+
+  // The kinematics plugins are not thread safe, every worker gets its own instance
+  for(unsigned int i=0; i < num_threads; i++)
+  {
+    kinematics::KinematicsBase* kinematics_solver;
+    try
+    {
+      kinematics_solver = kinematics_loader_.createClassInstance(kinematics_solver_name);
+    }
+    catch(pluginlib::PluginlibException& ex)
+    {
+      ROS_ERROR("The plugin failed to load. Error: %s", ex.what());
+      break;
+    }
+    kinematics_solvers_.push_back(kinematics_solver);
+    if(!kinematics_solver->initialize(group_name,
+                                      base_name,
+                                      tip_name,
+                                      .01))
+    {
+      ROS_ERROR("Could not initialize kinematics solver for group %s",group_name.c_str());
+      break;
+    }
+  }
+
+  ompl::base::ScopedState<ompl::base::CompoundStateSpace> scoped_state(state_space_);
+  if(kinematics_solvers_.size() == num_threads && num_threads > 0)
+  {
+    seed_state_.joint_state.name = kinematics_solvers_[0]->getJointNames();
+    seed_state_.joint_state.position.resize(kinematics_solvers_[0]->getJointNames().size());
+    if(ompl_ros_interface::getRobotStateToOmplStateMapping(seed_state_,scoped_state,robot_state_to_ompl_state_mapping_) &&
+       ompl_ros_interface::getOmplStateToRobotStateMapping(scoped_state,seed_state_,ompl_state_to_robot_state_mapping_))
+    {
+      ROS_DEBUG("Initialized %d IK sampling threads for group %s",num_threads,group_name.c_str());
+      return true;
+    }
+    ROS_ERROR("Could not get mapping between robot state and ompl state");
+  }
+
+  for(unsigned int i=0; i < kinematics_solvers_.size(); i++)
+    delete kinematics_solvers_[i];
+  kinematics_solvers_.clear();
+  return num_threads == 0;
+}
+
+void OmplRosIKSamplingPool::start(const std::vector<geometry_msgs::PoseStamped> &ik_poses,
+                                  const unsigned int &max_solutions)
+{
+  stop();
+  clear();
+  if(kinematics_solvers_.empty() || ik_poses.empty())
+    return;
+  ik_poses_ = ik_poses;
+  max_solutions_ = max_solutions;
+  running_ = true;
+  num_active_workers_ = kinematics_solvers_.size();
+  // The workers count into the counters of the request that started them
+  planning_environment::LatencyStatistics::RequestCountersPtr counters = planning_environment::LatencyStatistics::getInstance().getRequestCounters();
+  for(unsigned int i=0; i < kinematics_solvers_.size(); i++)
+    workers_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(&OmplRosIKSamplingPool::sample,this,i,counters))));
+}
+
+void OmplRosIKSamplingPool::stop()
+{
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    running_ = false;
+    queue_.clear();
+  }
+  solution_available_.notify_all();
+  for(unsigned int i=0; i < workers_.size(); i++)
+    workers_[i]->join();
+  workers_.clear();
+}
+
+void OmplRosIKSamplingPool::clear()
+{
+  boost::mutex::scoped_lock lock(lock_);
+  queue_.clear();
+  for(unsigned int i=0; i < solutions_.size(); i++)
+    state_space_->freeState(solutions_[i]);
+  solutions_.clear();
+}
+
+unsigned int OmplRosIKSamplingPool::getNumSolutions() const
+{
+  boost::mutex::scoped_lock lock(lock_);
+  return solutions_.size();
+}
+
+bool OmplRosIKSamplingPool::waitForSolution(ompl::base::State *state)
+{
+  boost::mutex::scoped_lock lock(lock_);
+  while(queue_.empty() && running_)
+    solution_available_.wait(lock);
+  if(queue_.empty())
+    return false;
+  state_space_->copyState(state,queue_.front());
+  queue_.pop_front();
+  return true;
+}
+
+void OmplRosIKSamplingPool::sample(const unsigned int &worker,
+                                   const planning_environment::LatencyStatistics::RequestCountersPtr &counters)
+{
+  planning_environment::LatencyStatistics::getInstance().setRequestCounters(counters);
+  kinematics::KinematicsBase* kinematics_solver = kinematics_solvers_[worker];
+  ompl::base::StateSamplerPtr sampler = state_space_->allocStateSampler();
+  ompl::base::ScopedState<ompl::base::CompoundStateSpace> seed(state_space_), solution(state_space_);
+  arm_navigation_msgs::RobotState seed_state, solution_state;
+  seed_state = seed_state_;
+  solution_state = seed_state_;
+
+  // Every worker walks through the poses from a different offset so that all of them are covered concurrently
+  unsigned int ik_poses_counter = worker % ik_poses_.size();
+  // Unreachable poses or an exhausted set of distinct solutions would otherwise keep the worker 
+  // busy calling IK until the request finishes
+  unsigned int max_consecutive_failures = MAX_CONSECUTIVE_FAILURES_PER_POSE*ik_poses_.size();
+  unsigned int consecutive_failures = 0;
+  while(running_ && consecutive_failures < max_consecutive_failures)
+  {
+    //sample a seed at random
+    sampler->sampleUniform(seed.get());
+    ompl_ros_interface::omplStateToRobotState(seed,
+                                              ompl_state_to_robot_state_mapping_,
+                                              seed_state);
+    int error_code;
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_calls");
+    planning_environment::ScopedLatencyTimer ik_timer("ik");
+    bool ik_found = kinematics_solver->getPositionIK(ik_poses_[ik_poses_counter].pose,
+                                                     seed_state.joint_state.position,
+                                                     solution_state.joint_state.position,
+                                                     error_code);
+    ik_timer.stop();
+    ik_poses_counter = (ik_poses_counter+1)%ik_poses_.size();
+    if(!ik_found)
+    {
+      consecutive_failures++;
+      continue;
+    }
+    ompl_ros_interface::robotStateToOmplState(solution_state,
+                                              robot_state_to_ompl_state_mapping_,
+                                              solution.get());
+    if(addSolution(solution.get()))
+      consecutive_failures = 0;
+    else
+      consecutive_failures++;
+  }
+  if(consecutive_failures >= max_consecutive_failures)
+  {
+    ROS_DEBUG("IK sampling worker %u found no new solution in %u attempts, stopping",worker,consecutive_failures);
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_workers_gave_up");
+  }
+  planning_environment::LatencyStatistics::getInstance().flushCounters();
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    // once the last worker gives up, consumers get the queued solutions and then stop waiting
+    num_active_workers_--;
+    if(num_active_workers_ == 0)
+      running_ = false;
+  }
+  solution_available_.notify_all();
+}
+
+bool OmplRosIKSamplingPool::addSolution(const ompl::base::State *state)
+{
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    if(!running_)
+      return false;
+    for(unsigned int i=0; i < solutions_.size(); i++)
+    {
+      if(state_space_->distance(solutions_[i],state) < min_distance_)
+      {
+        planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_duplicate_solutions");
+        return false;
+      }
+    }
+    ompl::base::State *copy = state_space_->allocState();
+    state_space_->copyState(copy,state);
+    solutions_.push_back(copy);
+    queue_.push_back(copy);
+    if(solutions_.size() >= max_solutions_)
+      running_ = false;
+  }
+  solution_available_.notify_all();
+  return true;
+}
+
+}
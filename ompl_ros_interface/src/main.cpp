@@ -40,7 +40,11 @@ int main(int argc, char **argv)
 { 
   ros::init(argc, argv, "ompl_planning");
 
-  ros::AsyncSpinner spinner(1); 
+  // one thread per planning context plus one so planning scene syncs are not starved; 
+  // a single context keeps planning and scene syncs serialized on one thread
+  int num_planning_contexts;
+  ros::NodeHandle("~").param("num_planning_contexts", num_planning_contexts, 1);
+  ros::AsyncSpinner spinner(num_planning_contexts > 1 ? num_planning_contexts+1 : 1); 
   spinner.start();
 
   ompl_ros_interface::OmplRos ompl_ros;
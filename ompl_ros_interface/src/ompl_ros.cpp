@@ -35,18 +35,66 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/ompl_ros.h>
+#include <planning_environment/util/latency_statistics.h>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
 
 namespace ompl_ros_interface
 {
 
-  OmplRos::OmplRos(void): node_handle_("~")
+  OmplRos::OmplRos(void): next_ticket_(0), serving_ticket_(0), node_handle_("~")
 {
   collision_models_interface_ = new planning_environment::CollisionModelsInterface("robot_description");
+
+  int num_planning_contexts;
+  node_handle_.param("num_planning_contexts", num_planning_contexts, 1);
+  if(num_planning_contexts < 1)
+  {
+    ROS_WARN("num_planning_contexts must be at least 1");
+    num_planning_contexts = 1;
+  }
+  planning_contexts_.resize(num_planning_contexts);
+  if(num_planning_contexts == 1)
+    planning_contexts_[0].collision_models_interface = collision_models_interface_;
+  else
+  {
+    // collision_models_interface_ only receives scenes from the environment server, 
+    // the contexts plan against their own copies
+    ROS_INFO("Planning with %d concurrent planning contexts",num_planning_contexts);
+    for(unsigned int i=0; i < planning_contexts_.size(); i++)
+      planning_contexts_[i].collision_models_interface = new planning_environment::CollisionModelsInterface("robot_description",false,false);
+    collision_models_interface_->addSetPlanningSceneCallback(boost::bind(&OmplRos::setPlanningSceneCallback, this, _1));
+  }
+  for(unsigned int i=0; i < planning_contexts_.size(); i++)
+    free_planning_contexts_.push_back(i);
+
+  bool use_plan_library;
+  node_handle_.param("plan_library/enabled", use_plan_library, false);
+  if(use_plan_library)
+  {
+    int max_candidates;
+    double max_distance, duplicate_distance;
+    node_handle_.param("plan_library/max_candidates", max_candidates, 3);
+    node_handle_.param("plan_library/max_distance", max_distance, 1.0);
+    node_handle_.param("plan_library/duplicate_distance", duplicate_distance, 0.01);
+    node_handle_.param<std::string>("plan_library/filename", plan_library_filename_, "");
+    plan_library_.reset(new ompl_ros_interface::OmplRosPlanLibrary(std::max(max_candidates,1),max_distance,duplicate_distance));
+    if(!plan_library_filename_.empty())
+      plan_library_->load(plan_library_filename_);
+  }
 }
 
 /** Free the memory */
 OmplRos::~OmplRos(void)
 {
+  if(plan_library_ && !plan_library_filename_.empty())
+    plan_library_->save(plan_library_filename_);
+  for(unsigned int i=0; i < planning_contexts_.size(); i++)
+  {
+    planning_contexts_[i].planner_map.clear();
+    if(planning_contexts_[i].collision_models_interface != collision_models_interface_)
+      delete planning_contexts_[i].collision_models_interface;
+  }
   delete collision_models_interface_;
 }
 
@@ -56,6 +104,7 @@ void OmplRos::run(void)
     return;
   if (collision_models_interface_->loadedModels())
   {
+    planning_environment::LatencyStatistics::getInstance().initialize(node_handle_);
     plan_path_service_ = node_handle_.advertiseService("plan_kinematic_path", &OmplRos::computePlan, this);
     node_handle_.param<bool>("publish_diagnostics", publish_diagnostics_,false);
     if(publish_diagnostics_)
@@ -73,10 +122,13 @@ bool OmplRos::initialize(const std::string &param_server_prefix)
     ROS_ERROR("Could not find groups for planning under %s",param_server_prefix.c_str());
     return false;
   }
-  if(!initializePlanningMap(param_server_prefix,group_names))
+  for(unsigned int i=0; i < planning_contexts_.size(); i++)
   {
-    ROS_ERROR("Could not initialize planning groups from the param server");
-    return false;
+    if(!initializePlanningMap(param_server_prefix,group_names,planning_contexts_[i]))
+    {
+      ROS_ERROR("Could not initialize planning groups from the param server");
+      return false;
+    }
   }
 
   if(!node_handle_.hasParam("default_planner_config"))
@@ -89,7 +141,8 @@ bool OmplRos::initialize(const std::string &param_server_prefix)
   for(unsigned int i=0; i < group_names.size(); i++)
   {
     std::string location = default_planner_config_ + "[" + group_names[i] + "]";
-    if(planner_map_.find(location) == planner_map_.end())
+    if(planning_contexts_[0].planner_map.find(location) == planning_contexts_[0].planner_map.end() &&
+       portfolio_map_.find(location) == portfolio_map_.end())
     {
       ROS_ERROR("The default planner configuration %s has not been defined for group %s. The default planner must be configured for every group in your ompl_planning.yaml file", default_planner_config_.c_str(), group_names[i].c_str());
       return false;
@@ -127,7 +180,8 @@ bool OmplRos::getGroupNamesFromParamServer(const std::string &param_server_prefi
 };
 
 bool OmplRos::initializePlanningMap(const std::string &param_server_prefix,
-                                    const std::vector<std::string> &group_names)
+                                    const std::vector<std::string> &group_names,
+                                    PlanningContext &context)
 {
   for(unsigned int i=0; i < group_names.size(); i++)
   {
@@ -146,7 +200,7 @@ bool OmplRos::initializePlanningMap(const std::string &param_server_prefix,
         return false;
       }
       std::string planner_config = static_cast<std::string>(planner_list[j]);
-      if(!initializePlanningInstance(param_server_prefix,group_names[i],planner_config))
+      if(!initializePlanningInstance(param_server_prefix,group_names[i],planner_config,context))
       {
         ROS_ERROR("Could not add planner for group %s and planner_config %s",group_names[i].c_str(),planner_config.c_str());
         return false;
@@ -162,15 +216,21 @@ bool OmplRos::initializePlanningMap(const std::string &param_server_prefix,
 
 bool OmplRos::initializePlanningInstance(const std::string &param_server_prefix,
                                          const std::string &group_name,
-                                         const std::string &planner_config_name)
+                                         const std::string &planner_config_name,
+                                         PlanningContext &context)
 {
   std::string location = planner_config_name+"["+group_name+"]";
-  if (planner_map_.find(location) != planner_map_.end())
+  if (context.planner_map.find(location) != context.planner_map.end())
   {
     ROS_WARN("Re-definition of '%s'", location.c_str());
     return true;
   }
 
+  std::string config_type;
+  node_handle_.param<std::string>(param_server_prefix+"/planner_configs/"+planner_config_name+"/type",config_type,"");
+  if(config_type == "portfolio")
+    return initializePortfolio(param_server_prefix,group_name,planner_config_name,context);
+
   if(!node_handle_.hasParam(param_server_prefix+"/"+group_name+"/planner_type"))
   {
     ROS_ERROR_STREAM("Planner type not defined for group " << group_name << " param name " << param_server_prefix+"/"+group_name+"/planner_type");
@@ -183,25 +243,27 @@ bool OmplRos::initializePlanningInstance(const std::string &param_server_prefix,
   {
     boost::shared_ptr<ompl_ros_interface::OmplRosJointPlanner> new_planner;
     new_planner.reset(new ompl_ros_interface::OmplRosJointPlanner());
-    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,collision_models_interface_))
+    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,context.collision_models_interface))
     {
       new_planner.reset();
       ROS_ERROR("Could not configure planner for group %s with config %s",group_name.c_str(),planner_config_name.c_str());
       return false;
     }
-    planner_map_[location] = new_planner;
+    new_planner->setPlanLibrary(plan_library_.get());
+    context.planner_map[location] = new_planner;
   }
   else if(planner_type == "RPYIKTaskSpacePlanner")
   {
     boost::shared_ptr<ompl_ros_interface::OmplRosRPYIKTaskSpacePlanner> new_planner;
     new_planner.reset(new ompl_ros_interface::OmplRosRPYIKTaskSpacePlanner());
-    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,collision_models_interface_))
+    if(!new_planner->initialize(ros::NodeHandle(param_server_prefix),group_name,planner_config_name,context.collision_models_interface))
     {
       new_planner.reset();
       ROS_ERROR("Could not configure planner for group %s with config %s",group_name.c_str(),planner_config_name.c_str());
       return false;
     }
-    planner_map_[location] = new_planner;
+    new_planner->setPlanLibrary(plan_library_.get());
+    context.planner_map[location] = new_planner;
   }
   else
   {
@@ -225,7 +287,9 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
   else
     planner_id = request.motion_plan_request.planner_id; 
   location = planner_id + "[" +request.motion_plan_request.group_name + "]";
-  if(planner_map_.find(location) == planner_map_.end())
+  std::map<std::string,std::vector<std::string> >::const_iterator portfolio = portfolio_map_.find(location);
+  bool is_portfolio = (portfolio != portfolio_map_.end());
+  if(!is_portfolio && planning_contexts_[0].planner_map.find(location) == planning_contexts_[0].planner_map.end())
   {
     ROS_ERROR("Could not find requested planner %s", location.c_str());
     response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::INVALID_PLANNER_ID;
@@ -235,7 +299,22 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
   {
     ROS_DEBUG("Using planner config %s",location.c_str());
   }
-  planner_map_[location]->computePlan(request,response);
+  std::vector<unsigned int> context_indices;
+  if(is_portfolio)
+    acquirePlanningContexts(std::min(portfolio->second.size(),planning_contexts_.size()),context_indices);
+  else
+    acquirePlanningContexts(1,context_indices);
+  for(unsigned int i=0; i < context_indices.size(); i++)
+    updatePlanningScene(planning_contexts_[context_indices[i]]);
+  PlanningContext &context = planning_contexts_[context_indices[0]];
+  planning_environment::ScopedLatencyTimer plan_timer("compute_plan");
+  std::string winner = location;
+  if(is_portfolio)
+    computePortfolioPlan(portfolio->second,context_indices,request,response,winner);
+  else
+    context.planner_map[location]->computePlan(request,response);
+  plan_timer.stop();
+  planning_environment::LatencyStatistics::getInstance().finishRequest();
   if(publish_diagnostics_)
   {
     ompl_ros_interface::OmplPlannerDiagnostics msg;
@@ -244,17 +323,18 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
       std::string filename = "planning_failure_";
       std::string str = boost::lexical_cast<std::string>(ros::Time::now().toSec());
       filename += str;
-      collision_models_interface_->writePlanningSceneBag(filename,
-                                                         collision_models_interface_->getLastPlanningScene());
-      collision_models_interface_->appendMotionPlanRequestToPlanningSceneBag(filename,
-                                                                             "motion_plan_request",
-                                                                             request.motion_plan_request);
+      context.collision_models_interface->writePlanningSceneBag(filename,
+                                                                context.collision_models_interface->getLastPlanningScene());
+      context.collision_models_interface->appendMotionPlanRequestToPlanningSceneBag(filename,
+                                                                                    "motion_plan_request",
+                                                                                    request.motion_plan_request);
     }
     else
       msg.summary = "Planning Succeeded";
 
     msg.group = request.motion_plan_request.group_name;
     msg.planner = planner_id;
+    msg.winning_planner = winner;
     msg.result =  arm_navigation_msgs::armNavigationErrorCodeToString(response.error_code);
     if(response.error_code.val == arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS)
     {
@@ -265,14 +345,192 @@ bool OmplRos::computePlan(arm_navigation_msgs::GetMotionPlan::Request &request,
     }
     diagnostic_publisher_.publish(msg);
   }
+  releasePlanningContexts(context_indices);
   return true;
 };
 
+/**
+   @brief Shared state of the members of one portfolio race
+*/
+struct PortfolioRace
+{
+  PortfolioRace() : winner(-1) {}
+  boost::mutex mutex;
+  int winner;
+  std::vector<boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup> > racers;
+};
+
+static void runPortfolioMember(PortfolioRace &race,
+                               unsigned int index,
+                               arm_navigation_msgs::GetMotionPlan::Request &request,
+                               arm_navigation_msgs::GetMotionPlan::Response &response,
+                               const planning_environment::LatencyStatistics::RequestCountersPtr &counters)
+{
+  planning_environment::LatencyStatistics::getInstance().setRequestCounters(counters);
+  race.racers[index]->computePlan(request,response);
+  planning_environment::LatencyStatistics::getInstance().flushCounters();
+  if(response.error_code.val != arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS)
+    return;
+  boost::mutex::scoped_lock lock(race.mutex);
+  if(race.winner >= 0)
+    return;
+  race.winner = index;
+  for(unsigned int i=0; i < race.racers.size(); i++)
+    if(i != index)
+      race.racers[i]->terminate();
+}
+
+void OmplRos::computePortfolioPlan(const std::vector<std::string> &members,
+                                   const std::vector<unsigned int> &context_indices,
+                                   arm_navigation_msgs::GetMotionPlan::Request &request,
+                                   arm_navigation_msgs::GetMotionPlan::Response &response,
+                                   std::string &winner)
+{
+  // the racers count into the counters of this request
+  planning_environment::LatencyStatistics::RequestCountersPtr counters = planning_environment::LatencyStatistics::getInstance().getRequestCounters();
+  
+  // With fewer contexts than members the members are raced in rounds of one per context. A round 
+  // only starts if no member of the previous rounds found a solution.
+  for(unsigned int first=0; first < members.size(); first += context_indices.size())
+  {
+    unsigned int num_racers = std::min(context_indices.size(),members.size()-first);
+    PortfolioRace race;
+    // every racer modifies its request while planning, so each gets its own copy
+    std::vector<arm_navigation_msgs::GetMotionPlan::Request> requests(num_racers,request);
+    std::vector<arm_navigation_msgs::GetMotionPlan::Response> responses(num_racers);
+    for(unsigned int i=0; i < num_racers; i++)
+    {
+      race.racers.push_back(planning_contexts_[context_indices[i]].planner_map[members[first+i]]);
+      race.racers.back()->clearTermination();
+    }
+
+    boost::thread_group threads;
+    for(unsigned int i=0; i < num_racers; i++)
+      threads.create_thread(boost::bind(&runPortfolioMember,boost::ref(race),i,boost::ref(requests[i]),boost::ref(responses[i]),counters));
+    threads.join_all();
+
+    for(unsigned int i=0; i < num_racers; i++)
+      race.racers[i]->clearTermination();
+
+    if(race.winner >= 0)
+    {
+      winner = members[first+race.winner];
+      ROS_DEBUG("Portfolio won by %s in %f seconds",winner.c_str(),responses[race.winner].planning_time.toSec());
+      response = responses[race.winner];
+      return;
+    }
+    response = responses[0];
+  }
+  ROS_ERROR("No planner in the portfolio found a solution");
+}
+
+bool OmplRos::initializePortfolio(const std::string &param_server_prefix,
+                                  const std::string &group_name,
+                                  const std::string &planner_config_name,
+                                  PlanningContext &context)
+{
+  std::string location = planner_config_name+"["+group_name+"]";
+  XmlRpc::XmlRpcValue member_list;
+  if(!node_handle_.getParam(param_server_prefix+"/planner_configs/"+planner_config_name+"/planners", member_list) ||
+     member_list.getType() != XmlRpc::XmlRpcValue::TypeArray ||
+     member_list.size() == 0)
+  {
+    ROS_ERROR("Portfolio %s must define a non-empty list of planners",planner_config_name.c_str());
+    return false;
+  }
+  std::vector<std::string> members;
+  for(int32_t i = 0; i < member_list.size(); ++i)
+  {
+    if(member_list[i].getType() != XmlRpc::XmlRpcValue::TypeString)
+    {
+      ROS_ERROR("Planner names must be of type string");
+      return false;
+    }
+    std::string member = static_cast<std::string>(member_list[i]);
+    std::string member_type;
+    node_handle_.param<std::string>(param_server_prefix+"/planner_configs/"+member+"/type",member_type,"");
+    if(member_type == "portfolio")
+    {
+      ROS_ERROR("Portfolio %s cannot contain another portfolio %s",planner_config_name.c_str(),member.c_str());
+      return false;
+    }
+    if(!initializePlanningInstance(param_server_prefix,group_name,member,context))
+      return false;
+    members.push_back(member+"["+group_name+"]");
+  }
+  if(members.size() > planning_contexts_.size())
+    ROS_WARN("Portfolio %s has %u planners but there are only %u planning contexts. They will be raced %u at a time, "
+             "each round taking up to the allowed planning time. Set num_planning_contexts to %u to race them all at once.",
+             location.c_str(),(unsigned int)members.size(),(unsigned int)planning_contexts_.size(),
+             (unsigned int)planning_contexts_.size(),(unsigned int)members.size());
+  portfolio_map_[location] = members;
+  return true;
+}
+
+void OmplRos::acquirePlanningContexts(unsigned int num,
+                                      std::vector<unsigned int> &indices)
+{
+  ros::WallTime start = ros::WallTime::now();
+  boost::mutex::scoped_lock lock(planning_contexts_mutex_);
+  // Requests take their contexts in arrival order. Otherwise a portfolio request waiting for 
+  // several contexts could be starved by single context requests grabbing each released one.
+  unsigned int ticket = next_ticket_++;
+  // number of requests waiting for contexts, including this one
+  unsigned int queue_depth = (ticket != serving_ticket_ || free_planning_contexts_.size() < num) ? next_ticket_-serving_ticket_ : 0;
+  planning_environment::LatencyStatistics::getInstance().addSample("planning_queue_depth",queue_depth);
+  if(queue_depth > 0)
+    ROS_DEBUG("Not enough free planning contexts, %u requests waiting",queue_depth);
+  while(ticket != serving_ticket_ || free_planning_contexts_.size() < num)
+    planning_context_available_.wait(lock);
+  serving_ticket_++;
+  indices.clear();
+  for(unsigned int i=0; i < num; i++)
+  {
+    indices.push_back(free_planning_contexts_.back());
+    free_planning_contexts_.pop_back();
+  }
+  // the next request in line may be able to take the contexts that are left
+  planning_context_available_.notify_all();
+  planning_environment::LatencyStatistics::getInstance().addSample("planning_context_wait",(ros::WallTime::now()-start).toSec());
+}
+
+void OmplRos::releasePlanningContexts(const std::vector<unsigned int> &indices)
+{
+  {
+    boost::mutex::scoped_lock lock(planning_contexts_mutex_);
+    free_planning_contexts_.insert(free_planning_contexts_.end(),indices.begin(),indices.end());
+  }
+  // a portfolio request may be waiting for more than one context
+  planning_context_available_.notify_all();
+}
+
+void OmplRos::setPlanningSceneCallback(const arm_navigation_msgs::PlanningScene &scene)
+{
+  boost::shared_ptr<const arm_navigation_msgs::PlanningScene> planning_scene(new arm_navigation_msgs::PlanningScene(scene));
+  boost::mutex::scoped_lock lock(planning_scene_mutex_);
+  planning_scene_.swap(planning_scene);
+}
+
+void OmplRos::updatePlanningScene(PlanningContext &context)
+{
+  boost::shared_ptr<const arm_navigation_msgs::PlanningScene> planning_scene;
+  {
+    boost::mutex::scoped_lock lock(planning_scene_mutex_);
+    planning_scene = planning_scene_;
+  }
+  if(!planning_scene || planning_scene == context.planning_scene)
+    return;
+  planning_environment::ScopedLatencyTimer scene_timer("planning_scene_update");
+  if(!context.collision_models_interface->setPlanningSceneWithCallbacks(*planning_scene))
+    ROS_WARN("Could not set planning scene for planning context");
+  context.planning_scene = planning_scene;
+}
+
 boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& OmplRos::getPlanner(const std::string &group_name,
                                                                                  const std::string &planner_config_name)
 {
   std::string location = planner_config_name + "[" + group_name + "]";
-  if(planner_map_.find(location) == planner_map_.end())
+  if(planning_contexts_[0].planner_map.find(location) == planning_contexts_[0].planner_map.end())
   {
     ROS_ERROR("Could not find requested planner %s", location.c_str());
     return empty_ptr;
@@ -280,7 +538,7 @@ boost::shared_ptr<ompl_ros_interface::OmplRosPlanningGroup>& OmplRos::getPlanner
   else
   {
     ROS_DEBUG("Using planner config %s",location.c_str());
-    return planner_map_[location];
+    return planning_contexts_[0].planner_map[location];
   }
 };
 
@@ -0,0 +1,164 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_link_position_projection_evaluator.h>
+#include <algorithm>
+#include <limits>
+
+namespace ompl_ros_interface
+{
+
+static const unsigned int PROJECTION_CACHE_SIZE = 1024;
+static const unsigned int CELL_SIZE_SAMPLES = 1000;
+
+OmplRosLinkPositionProjectionEvaluator::OmplRosLinkPositionProjectionEvaluator(const ompl::base::StateSpacePtr &state_space,
+                                                                               const planning_models::KinematicModel *kinematic_model,
+                                                                               const std::string &group_name,
+                                                                               const std::string &link_name,
+                                                                               unsigned int num_cells) : 
+  ompl::base::ProjectionEvaluator(state_space.get()),
+  cache_(PROJECTION_CACHE_SIZE)
+{
+  kinematic_state_.reset(new planning_models::KinematicState(kinematic_model));
+  kinematic_state_->setKinematicStateToDefault();
+  joint_state_group_ = kinematic_state_->getJointStateGroup(group_name);
+  if(!joint_state_group_)
+  {
+    ROS_ERROR("Could not find group %s for the link position projection evaluator",group_name.c_str());
+    throw new OMPLROSException();
+  }
+  planning_models::KinematicState::LinkState *link_state = kinematic_state_->getLinkState(link_name);
+  if(!link_state)
+  {
+    ROS_ERROR("Could not find link %s for the link position projection evaluator",link_name.c_str());
+    throw new OMPLROSException();
+  }
+  link_state_ = link_state;
+
+  // Walk up from the link to the root, the chain starts at the last link moved by a joint of the group
+  std::vector<planning_models::KinematicState::LinkState*> ancestors;
+  unsigned int chain_length = 0;
+  while(link_state)
+  {
+    ancestors.push_back(link_state);
+    if(link_state->getParentJointState() && joint_state_group_->hasJointState(link_state->getParentJointState()->getName()))
+      chain_length = ancestors.size();
+    link_state = link_state->getParentLinkState() ? kinematic_state_->getLinkState(link_state->getParentLinkState()->getName()) : NULL;
+  }
+  if(chain_length == 0)
+  {
+    ROS_ERROR("Link %s is not moved by any joint in group %s",link_name.c_str(),group_name.c_str());
+    throw new OMPLROSException();
+  }
+  link_chain_.assign(ancestors.rend()-chain_length,ancestors.rend());
+
+  ompl::base::ScopedState<ompl::base::CompoundStateSpace> ompl_scoped_state(state_space);
+  if(!ompl_ros_interface::getOmplStateToJointStateGroupMapping(ompl_scoped_state,
+                                                              joint_state_group_,
+                                                              ompl_state_to_kinematic_state_mapping_))
+  {
+    ROS_ERROR("Could not map the planning state space onto group %s",group_name.c_str());
+    throw new OMPLROSException();
+  }
+  // the links above the chain never move
+  kinematic_state_->updateKinematicLinks();
+  estimateCellSizes(num_cells);
+  ROS_DEBUG("Projecting group %s onto the position of %s, chain of %u links, cell sizes %f %f %f",
+            group_name.c_str(),link_name.c_str(),(unsigned int) link_chain_.size(),cellSizes_[0],cellSizes_[1],cellSizes_[2]);
+};
+
+OmplRosLinkPositionProjectionEvaluator::~OmplRosLinkPositionProjectionEvaluator()
+{
+  for(unsigned int i=0; i < cache_.size(); i++)
+    if(cache_[i].state)
+      space_->freeState(cache_[i].state);
+}
+
+void OmplRosLinkPositionProjectionEvaluator::estimateCellSizes(unsigned int num_cells)
+{
+  std::vector<double> low(3,std::numeric_limits<double>::max()), high(3,-std::numeric_limits<double>::max());
+  ompl::base::StateSamplerPtr sampler = space_->allocStateSampler();
+  ompl::base::State *state = space_->allocState();
+  ompl::base::EuclideanProjection projection(3);
+  for(unsigned int i=0; i < CELL_SIZE_SAMPLES; i++)
+  {
+    sampler->sampleUniform(state);
+    project(state,projection);
+    for(unsigned int j=0; j < 3; j++)
+    {
+      low[j] = std::min(low[j],projection[j]);
+      high[j] = std::max(high[j],projection[j]);
+    }
+  }
+  space_->freeState(state);
+  // the sampled states are forgotten, their memory is about to be reused
+  for(unsigned int i=0; i < cache_.size(); i++)
+    cache_[i].key = NULL;
+
+  cellSizes_.resize(3);
+  for(unsigned int j=0; j < 3; j++)
+    cellSizes_[j] = std::max((high[j]-low[j])/std::max(num_cells,1u),1e-3);
+}
+
+unsigned int OmplRosLinkPositionProjectionEvaluator::getDimension(void) const
+{
+  return 3;
+};
+
+void OmplRosLinkPositionProjectionEvaluator::project(const ompl::base::State *state, 
+                                                     ompl::base::EuclideanProjection &projection) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  // planners project the same state repeatedly, a state at the same address is only a hit if its values are unchanged
+  CachedProjection &cached = cache_[(reinterpret_cast<size_t>(state) / sizeof(void*)) % cache_.size()];
+  if(cached.key != state || !space_->equalStates(cached.state,state))
+  {
+    ompl_ros_interface::omplStateToKinematicStateGroup(state,ompl_state_to_kinematic_state_mapping_,joint_state_group_);
+    for(unsigned int i=0; i < link_chain_.size(); i++)
+      link_chain_[i]->computeTransform();
+    const tf::Vector3 &position = link_state_->getGlobalLinkTransform().getOrigin();
+    if(!cached.state)
+      cached.state = space_->allocState();
+    space_->copyState(cached.state,state);
+    cached.key = state;
+    cached.position[0] = position.x();
+    cached.position[1] = position.y();
+    cached.position[2] = position.z();
+  }
+  projection[0] = cached.position[0];
+  projection[1] = cached.position[1];
+  projection[2] = cached.position[2];
+};
+
+}
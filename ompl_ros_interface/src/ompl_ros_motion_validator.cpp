@@ -0,0 +1,111 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_motion_validator.h>
+#include <planning_environment/util/latency_statistics.h>
+#include <queue>
+
+namespace ompl_ros_interface
+{
+
+bool OmplRosMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                         const ompl::base::State *s2) const
+{
+  planning_environment::LatencyStatistics::getInstance().incrementCounter("motion_validations");
+  if(!si_->isValid(s2))
+    return false;
+
+  const ompl::base::StateSpacePtr &state_space = si_->getStateSpace();
+  unsigned int num_segments = state_space->validSegmentCount(s1,s2);
+  if(num_segments < 2)
+    return true;
+
+  // ranges of intermediate states that still have to be checked, 
+  // breadth first so that the checked states are spread evenly along the motion
+  std::queue<std::pair<unsigned int, unsigned int> > ranges;
+  ranges.push(std::make_pair(1u,num_segments-1));
+  ompl::base::State *test = si_->allocState();
+  bool valid = true;
+  while(!ranges.empty())
+  {
+    std::pair<unsigned int, unsigned int> range = ranges.front();
+    ranges.pop();
+    unsigned int middle = (range.first+range.second)/2;
+    state_space->interpolate(s1,s2,(double) middle/(double) num_segments,test);
+    if(!si_->isValid(test))
+    {
+      valid = false;
+      break;
+    }
+    if(range.first < middle)
+      ranges.push(std::make_pair(range.first,middle-1));
+    if(middle < range.second)
+      ranges.push(std::make_pair(middle+1,range.second));
+  }
+  si_->freeState(test);
+  return valid;
+}
+
+bool OmplRosMotionValidator::checkMotion(const ompl::base::State *s1, 
+                                         const ompl::base::State *s2, 
+                                         std::pair<ompl::base::State*, double> &last_valid) const
+{
+  planning_environment::LatencyStatistics::getInstance().incrementCounter("motion_validations");
+  const ompl::base::StateSpacePtr &state_space = si_->getStateSpace();
+  unsigned int num_segments = state_space->validSegmentCount(s1,s2);
+  ompl::base::State *test = si_->allocState();
+  for(unsigned int i=1; i < num_segments; i++)
+  {
+    state_space->interpolate(s1,s2,(double) i/(double) num_segments,test);
+    if(!si_->isValid(test))
+    {
+      last_valid.second = (double) (i-1)/(double) num_segments;
+      if(last_valid.first)
+        state_space->interpolate(s1,s2,last_valid.second,last_valid.first);
+      si_->freeState(test);
+      return false;
+    }
+  }
+  si_->freeState(test);
+  if(!si_->isValid(s2))
+  {
+    last_valid.second = (double) (num_segments-1)/(double) num_segments;
+    if(last_valid.first)
+      state_space->interpolate(s1,s2,last_valid.second,last_valid.first);
+    return false;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,413 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_plan_library.h>
+#include <ros/console.h>
+
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ompl_ros_interface
+{
+
+/*
+  Library file layout, in native byte order. Every record is a multiple of 8 bytes 
+  long so that the waypoints can be read in place from the mapped file.
+
+  header:  char magic[8], uint32 version, uint32 num_groups
+  group:   uint32 name_length, uint32 dimension, uint32 num_entries, uint32 reserved, 
+           name (padded to a multiple of 8 bytes)
+  entry:   uint32 num_waypoints, uint32 reserved, uint64 scene_signature,
+           double waypoints[num_waypoints*dimension]
+*/
+static const char PLAN_LIBRARY_MAGIC[8] = {'O','M','P','L','L','I','B','\0'};
+static const boost::uint32_t PLAN_LIBRARY_VERSION = 1;
+
+static size_t paddedLength(size_t length)
+{
+  return (length + 7) & ~static_cast<size_t>(7);
+}
+
+OmplRosPlanLibrary::OmplRosPlanLibrary(unsigned int max_candidates,
+                                       double max_distance,
+                                       double duplicate_distance) :
+  max_candidates_(max_candidates),
+  max_distance_(max_distance),
+  duplicate_distance_(duplicate_distance),
+  mapped_file_(NULL),
+  mapped_size_(0)
+{
+}
+
+OmplRosPlanLibrary::~OmplRosPlanLibrary()
+{
+  groups_.clear();
+  unmap();
+}
+
+void OmplRosPlanLibrary::unmap()
+{
+  if(mapped_file_ != NULL)
+    munmap(mapped_file_,mapped_size_);
+  mapped_file_ = NULL;
+  mapped_size_ = 0;
+}
+
+bool OmplRosPlanLibrary::load(const std::string &filename)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  if(mapped_file_ != NULL)
+  {
+    ROS_ERROR("A plan library file has already been loaded");
+    return false;
+  }
+  int fd = open(filename.c_str(),O_RDONLY);
+  if(fd < 0)
+  {
+    ROS_WARN("Could not open plan library %s",filename.c_str());
+    return false;
+  }
+  struct stat file_stat;
+  if(fstat(fd,&file_stat) != 0 || file_stat.st_size < 16)
+  {
+    ROS_ERROR("Plan library %s is empty or unreadable",filename.c_str());
+    close(fd);
+    return false;
+  }
+  mapped_size_ = file_stat.st_size;
+  mapped_file_ = mmap(NULL,mapped_size_,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if(mapped_file_ == MAP_FAILED)
+  {
+    ROS_ERROR("Could not map plan library %s",filename.c_str());
+    mapped_file_ = NULL;
+    mapped_size_ = 0;
+    return false;
+  }
+
+  const char *data = static_cast<const char*>(mapped_file_);
+  const char *end = data + mapped_size_;
+  boost::uint32_t version, num_groups;
+  memcpy(&version,data+8,4);
+  memcpy(&num_groups,data+12,4);
+  if(memcmp(data,PLAN_LIBRARY_MAGIC,8) != 0 || version != PLAN_LIBRARY_VERSION)
+  {
+    ROS_ERROR("%s is not a plan library of version %u",filename.c_str(),PLAN_LIBRARY_VERSION);
+    unmap();
+    return false;
+  }
+  data += 16;
+
+  // Entries are only added once the whole file has been checked
+  std::vector<std::pair<std::string,EntryPtr> > entries;
+  for(boost::uint32_t i=0; i < num_groups; i++)
+  {
+    boost::uint32_t group_header[4];
+    if(end - data < 16)
+      break;
+    memcpy(group_header,data,16);
+    data += 16;
+    size_t name_length = paddedLength(group_header[0]);
+    if(static_cast<size_t>(end - data) < name_length || group_header[1] == 0)
+      break;
+    std::string group_name(data,group_header[0]);
+    data += name_length;
+    for(boost::uint32_t j=0; j < group_header[2]; j++)
+    {
+      boost::uint32_t num_waypoints;
+      if(end - data < 16)
+        break;
+      memcpy(&num_waypoints,data,4);
+      size_t waypoints_size = static_cast<size_t>(num_waypoints)*group_header[1]*sizeof(double);
+      if(num_waypoints < 2 || static_cast<size_t>(end - data - 16) < waypoints_size)
+        break;
+      EntryPtr entry(new Entry());
+      memcpy(&entry->scene_signature,data+8,8);
+      entry->num_waypoints = num_waypoints;
+      entry->dimension = group_header[1];
+      entry->waypoints = reinterpret_cast<const double*>(data+16);
+      entries.push_back(std::make_pair(group_name,entry));
+      data += 16 + waypoints_size;
+    }
+  }
+  if(data != end)
+  {
+    ROS_ERROR("Plan library %s is truncated or corrupt",filename.c_str());
+    unmap();
+    return false;
+  }
+  for(unsigned int i=0; i < entries.size(); i++)
+    addEntry(entries[i].first,entries[i].second);
+  ROS_INFO("Loaded %u paths from plan library %s",(unsigned int) entries.size(),filename.c_str());
+  return true;
+}
+
+bool OmplRosPlanLibrary::save(const std::string &filename) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  std::string temporary_filename = filename + ".tmp";
+  std::ofstream file(temporary_filename.c_str(),std::ios::binary | std::ios::trunc);
+  if(!file.good())
+  {
+    ROS_ERROR("Could not open %s for writing",temporary_filename.c_str());
+    return false;
+  }
+  const char padding[8] = {0,0,0,0,0,0,0,0};
+  boost::uint32_t header[2] = {PLAN_LIBRARY_VERSION,static_cast<boost::uint32_t>(groups_.size())};
+  file.write(PLAN_LIBRARY_MAGIC,8);
+  file.write(reinterpret_cast<const char*>(header),8);
+  unsigned int num_entries = 0;
+  for(std::map<std::string,GroupLibrary>::const_iterator it = groups_.begin(); it != groups_.end(); ++it)
+  {
+    boost::uint32_t group_header[4] = {static_cast<boost::uint32_t>(it->first.size()),
+                                       it->second.dimension,
+                                       static_cast<boost::uint32_t>(it->second.entries.size()),
+                                       0};
+    file.write(reinterpret_cast<const char*>(group_header),16);
+    file.write(it->first.c_str(),it->first.size());
+    file.write(padding,paddedLength(it->first.size())-it->first.size());
+    for(unsigned int i=0; i < it->second.entries.size(); i++)
+    {
+      const Entry &entry = *(it->second.entries[i]);
+      boost::uint32_t entry_header[2] = {entry.num_waypoints,0};
+      file.write(reinterpret_cast<const char*>(entry_header),8);
+      file.write(reinterpret_cast<const char*>(&entry.scene_signature),8);
+      file.write(reinterpret_cast<const char*>(entry.waypoints),entry.num_waypoints*entry.dimension*sizeof(double));
+      num_entries++;
+    }
+  }
+  file.close();
+  if(file.fail() || rename(temporary_filename.c_str(),filename.c_str()) != 0)
+  {
+    ROS_ERROR("Could not write plan library %s",filename.c_str());
+    return false;
+  }
+  ROS_DEBUG("Saved %u paths to plan library %s",num_entries,filename.c_str());
+  return true;
+}
+
+bool OmplRosPlanLibrary::addPath(const std::string &group_name,
+                                 const boost::uint64_t &scene_signature,
+                                 const Path &path)
+{
+  if(path.size() < 2 || path[0].empty())
+    return false;
+  EntryPtr entry(new Entry());
+  entry->scene_signature = scene_signature;
+  entry->num_waypoints = path.size();
+  entry->dimension = path[0].size();
+  entry->storage.reserve(entry->num_waypoints*entry->dimension);
+  for(unsigned int i=0; i < path.size(); i++)
+  {
+    if(path[i].size() != entry->dimension)
+    {
+      ROS_ERROR("Waypoints of a library path must all have the same dimension");
+      return false;
+    }
+    entry->storage.insert(entry->storage.end(),path[i].begin(),path[i].end());
+  }
+  entry->waypoints = &(entry->storage[0]);
+
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<std::string,GroupLibrary>::iterator group = groups_.find(group_name);
+  if(group != groups_.end() && group->second.nearest_neighbors->size() > 0)
+  {
+    std::vector<Entry*> nearest;
+    group->second.nearest_neighbors->nearestK(entry.get(),1,nearest);
+    if(!nearest.empty() && 
+       nearest[0]->scene_signature == scene_signature &&
+       distance(nearest[0],entry.get()) < duplicate_distance_)
+      return false;
+  }
+  addEntry(group_name,entry);
+  return true;
+}
+
+void OmplRosPlanLibrary::addEntry(const std::string &group_name,
+                                  const EntryPtr &entry)
+{
+  GroupLibrary *group = getGroupLibrary(group_name,entry->dimension);
+  if(!group)
+    return;
+  group->entries.push_back(entry);
+  group->nearest_neighbors->add(entry.get());
+}
+
+OmplRosPlanLibrary::GroupLibrary* OmplRosPlanLibrary::getGroupLibrary(const std::string &group_name,
+                                                                      unsigned int dimension)
+{
+  std::map<std::string,GroupLibrary>::iterator it = groups_.find(group_name);
+  if(it == groups_.end())
+  {
+    GroupLibrary &group = groups_[group_name];
+    group.dimension = dimension;
+    group.nearest_neighbors.reset(new ompl::NearestNeighborsGNAT<Entry*>());
+    group.nearest_neighbors->setDistanceFunction(&OmplRosPlanLibrary::distance);
+    return &group;
+  }
+  if(it->second.dimension != dimension)
+  {
+    ROS_ERROR("Library paths for group %s have dimension %u, not %u",group_name.c_str(),it->second.dimension,dimension);
+    return NULL;
+  }
+  return &(it->second);
+}
+
+void OmplRosPlanLibrary::getNearestPaths(const std::string &group_name,
+                                         const Waypoint &start,
+                                         const Waypoint &goal,
+                                         const boost::uint64_t &scene_signature,
+                                         std::vector<Path> &paths) const
+{
+  paths.clear();
+  if(start.empty() || start.size() != goal.size())
+    return;
+  // a query is an entry made of only the start and the goal
+  Entry query;
+  query.num_waypoints = 2;
+  query.dimension = start.size();
+  query.storage = start;
+  query.storage.insert(query.storage.end(),goal.begin(),goal.end());
+  query.waypoints = &(query.storage[0]);
+
+  boost::mutex::scoped_lock lock(mutex_);
+  std::map<std::string,GroupLibrary>::const_iterator group = groups_.find(group_name);
+  if(group == groups_.end() || group->second.dimension != query.dimension || group->second.nearest_neighbors->size() == 0)
+    return;
+  std::vector<Entry*> nearest;
+  group->second.nearest_neighbors->nearestK(&query,max_candidates_,nearest);
+
+  // nearestK returns the closest entries first, this order is kept within the same and other scene parts
+  std::vector<Entry*>::iterator last = nearest.begin();
+  while(last != nearest.end() && distance(*last,&query) <= max_distance_)
+    ++last;
+  nearest.erase(last,nearest.end());
+  std::vector<Entry*> same_scene, other_scene;
+  for(unsigned int i=0; i < nearest.size(); i++)
+  {
+    if(nearest[i]->scene_signature == scene_signature)
+      same_scene.push_back(nearest[i]);
+    else
+      other_scene.push_back(nearest[i]);
+  }
+  same_scene.insert(same_scene.end(),other_scene.begin(),other_scene.end());
+
+  paths.resize(same_scene.size());
+  for(unsigned int i=0; i < same_scene.size(); i++)
+  {
+    const Entry &entry = *same_scene[i];
+    paths[i].resize(entry.num_waypoints);
+    for(unsigned int j=0; j < entry.num_waypoints; j++)
+      paths[i][j].assign(entry.waypoints+j*entry.dimension,entry.waypoints+(j+1)*entry.dimension);
+  }
+}
+
+unsigned int OmplRosPlanLibrary::size() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  unsigned int num_entries = 0;
+  for(std::map<std::string,GroupLibrary>::const_iterator it = groups_.begin(); it != groups_.end(); ++it)
+    num_entries += it->second.entries.size();
+  return num_entries;
+}
+
+double OmplRosPlanLibrary::distance(const Entry* a, const Entry* b)
+{
+  const double *a_start = a->start(), *a_goal = a->goal();
+  const double *b_start = b->start(), *b_goal = b->goal();
+  double sum = 0.0;
+  for(unsigned int i=0; i < a->dimension; i++)
+  {
+    double start_difference = a_start[i] - b_start[i];
+    double goal_difference = a_goal[i] - b_goal[i];
+    sum += start_difference*start_difference + goal_difference*goal_difference;
+  }
+  return sqrt(sum);
+}
+
+boost::uint64_t OmplRosPlanLibrary::computeSceneSignature(const arm_navigation_msgs::PlanningScene &planning_scene)
+{
+  std::vector<std::string> ids;
+  for(unsigned int i=0; i < planning_scene.collision_objects.size(); i++)
+    ids.push_back(planning_scene.collision_objects[i].id);
+  for(unsigned int i=0; i < planning_scene.attached_collision_objects.size(); i++)
+    ids.push_back(planning_scene.attached_collision_objects[i].link_name+"/"+planning_scene.attached_collision_objects[i].object.id);
+  // the order of the objects in the scene does not matter
+  std::sort(ids.begin(),ids.end());
+  size_t seed = 0;
+  for(unsigned int i=0; i < ids.size(); i++)
+    boost::hash_combine(seed,ids[i]);
+  boost::hash_combine(seed,planning_scene.collision_map.boxes.empty());
+  return seed;
+}
+
+void OmplRosPlanLibrary::stateToWaypoint(const ompl::base::StateSpacePtr &state_space,
+                                         const ompl::base::State *state,
+                                         Waypoint &waypoint)
+{
+  waypoint.clear();
+  ompl::base::State *mutable_state = const_cast<ompl::base::State*>(state);
+  for(unsigned int i=0; ; i++)
+  {
+    double *value = state_space->getValueAddressAtIndex(mutable_state,i);
+    if(value == NULL)
+      break;
+    waypoint.push_back(*value);
+  }
+}
+
+bool OmplRosPlanLibrary::waypointToState(const ompl::base::StateSpacePtr &state_space,
+                                         const Waypoint &waypoint,
+                                         ompl::base::State *state)
+{
+  for(unsigned int i=0; i < waypoint.size(); i++)
+  {
+    double *value = state_space->getValueAddressAtIndex(state,i);
+    if(value == NULL)
+      return false;
+    *value = waypoint[i];
+  }
+  return state_space->getValueAddressAtIndex(state,waypoint.size()) == NULL;
+}
+
+}
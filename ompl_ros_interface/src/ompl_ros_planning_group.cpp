@@ -36,6 +36,9 @@
 
 #include <ompl_ros_interface/ompl_ros_planning_group.h>
 #include <planning_environment/models/model_utils.h>
+#include <planning_environment/util/latency_statistics.h>
+#include <ompl/base/goals/GoalStates.h>
+#include <algorithm>
 
 namespace ompl_ros_interface
 {
@@ -58,6 +61,7 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
   double longest_valid_segment_fraction;
   node_handle_.param(group_name_+"/longest_valid_segment_fraction",longest_valid_segment_fraction,0.005);
   state_space_->setLongestValidSegmentFraction(longest_valid_segment_fraction);
+  node_handle_.param("plan_library/repair_time_fraction",plan_library_repair_fraction_,0.5);
 
   //Setup the projection evaluator for this group
   if(!initializeProjectionEvaluator())
@@ -75,6 +79,13 @@ bool OmplRosPlanningGroup::initialize(const ros::NodeHandle &node_handle,
     return false;
 
   planner_->setStateValidityChecker(static_cast<ompl::base::StateValidityCheckerPtr> (state_validity_checker_));
+
+  double validity_cache_resolution;
+  int validity_cache_size;
+  node_handle_.param(group_name_+"/validity_cache_resolution",validity_cache_resolution,1e-5);
+  node_handle_.param(group_name_+"/validity_cache_size",validity_cache_size,100000);
+  state_validity_checker_->setValidityCacheParameters(validity_cache_resolution,std::max(validity_cache_size,1));
+  planner_->getSpaceInformation()->setMotionValidator(ompl::base::MotionValidatorPtr(new ompl_ros_interface::OmplRosMotionValidator(planner_->getSpaceInformation())));
   planner_->setPlanner(ompl_planner_);
 
   return true;
@@ -104,18 +115,41 @@ bool OmplRosPlanningGroup::initializePhysicalGroup()
 
 bool OmplRosPlanningGroup::initializeProjectionEvaluator()
 {
-  std::string projection_evaluator;
-  if(!node_handle_.hasParam(group_name_+"/projection_evaluator"))
+  // a planner configuration can override the projection evaluator of the group
+  std::string projection_evaluator, param_prefix;
+  if(node_handle_.hasParam("planner_configs/"+planner_config_name_+"/projection_evaluator"))
+    param_prefix = "planner_configs/"+planner_config_name_;
+  else if(node_handle_.hasParam(group_name_+"/projection_evaluator"))
+    param_prefix = group_name_;
+  else
   {
     ROS_ERROR("Projection evaluator not defined for group %s",group_name_.c_str());
     return false;
   }
-  node_handle_.getParam(group_name_+"/projection_evaluator",projection_evaluator);
+  node_handle_.getParam(param_prefix+"/projection_evaluator",projection_evaluator);
   ompl::base::ProjectionEvaluatorPtr ompl_projection_evaluator;
   try
   {
-    ompl_projection_evaluator.reset(new ompl_ros_interface::OmplRosProjectionEvaluator(state_space_.get(),
-                                                                                       projection_evaluator));
+    if(projection_evaluator == "link_position")
+    {
+      std::string projection_link;
+      if(!node_handle_.getParam(param_prefix+"/projection_link",projection_link) &&
+         !node_handle_.getParam(physical_joint_group_->getName()+"/tip_name",projection_link))
+      {
+        ROS_ERROR("The link_position projection evaluator for group %s needs a projection_link or tip_name",group_name_.c_str());
+        return false;
+      }
+      int projection_cells;
+      node_handle_.param(param_prefix+"/projection_cells",projection_cells,20);
+      ompl_projection_evaluator.reset(new ompl_ros_interface::OmplRosLinkPositionProjectionEvaluator(state_space_,
+                                                                                                     collision_models_interface_->getKinematicModel(),
+                                                                                                     physical_joint_group_->getName(),
+                                                                                                     projection_link,
+                                                                                                     std::max(projection_cells,1)));
+    }
+    else
+      ompl_projection_evaluator.reset(new ompl_ros_interface::OmplRosProjectionEvaluator(state_space_.get(),
+                                                                                         projection_evaluator));
   }
   catch(...)
   {
@@ -433,17 +467,48 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
   if(!setStartAndGoalStates(request,response))
     return finish(false);
   
-  bool solved = planner_->solve(request.motion_plan_request.allowed_planning_time.toSec());
+  ros::WallTime start_time = ros::WallTime::now();
+  ros::WallTime deadline = start_time + ros::WallDuration(request.motion_plan_request.allowed_planning_time.toSec());
+  bool solved = false, from_library = false, repaired = false;
+  if(plan_library_)
+  {
+    planning_environment::ScopedLatencyTimer library_timer("plan_library");
+    solved = from_library = computePlanFromLibrary(deadline,repaired);
+    library_timer.stop();
+    if(!solved)
+      planning_environment::LatencyStatistics::getInstance().incrementCounter("plan_library_misses");
+    else if(repaired)
+      planning_environment::LatencyStatistics::getInstance().incrementCounter("plan_library_repairs");
+    else
+      planning_environment::LatencyStatistics::getInstance().incrementCounter("plan_library_hits");
+  }
+  if(!solved)
+  {
+    planning_environment::ScopedLatencyTimer solve_timer("solve");
+    ompl::base::PlannerTerminationCondition ptc(boost::bind(&OmplRosPlanningGroup::shouldTerminate, this, deadline));
+    solved = planner_->solve(ptc);
+    solve_timer.stop();
+  }
+  ROS_DEBUG("State validity cache: %u hits, %u misses",
+            state_validity_checker_->getValidityCache().getNumHits(),
+            state_validity_checker_->getValidityCache().getNumMisses());
   
   if(solved)
   {
-    ROS_DEBUG("Found solution for request in %f seconds",planner_->getLastPlanComputationTime());
-    response.planning_time = ros::Duration(planner_->getLastPlanComputationTime());
+    if(from_library)
+      response.planning_time = ros::Duration((ros::WallTime::now()-start_time).toSec());
+    else
+      response.planning_time = ros::Duration(planner_->getLastPlanComputationTime());
+    ROS_DEBUG("Found solution for request in %f seconds",response.planning_time.toSec());
+    planning_environment::ScopedLatencyTimer simplify_timer("path_simplification");
     planner_->getPathSimplifier()->reduceVertices(planner_->getSolutionPath());
     planner_->getPathSimplifier()->collapseCloseVertices(planner_->getSolutionPath());
+    simplify_timer.stop();
     
     try
     {
+      if(plan_library_ && (!from_library || repaired) && planner_->haveExactSolutionPath())
+        addSolutionToLibrary();
       response.trajectory = getSolutionPath();
       response.error_code.val = arm_navigation_msgs::ArmNavigationErrorCodes::SUCCESS;
       return finish(true);
@@ -464,8 +529,145 @@ bool OmplRosPlanningGroup::computePlan(arm_navigation_msgs::GetMotionPlan::Reque
 }
 
 
+bool OmplRosPlanningGroup::shouldTerminate(const ros::WallTime &deadline) const
+{
+  return terminate_ || ros::WallTime::now() > deadline;
+}
+
+static void freePathStates(const ompl::base::SpaceInformationPtr &space_information,
+                           ompl::geometric::PathGeometric &path)
+{
+  for(unsigned int i=0; i < path.states.size(); i++)
+    space_information->freeState(path.states[i]);
+  path.states.clear();
+}
+
+bool OmplRosPlanningGroup::computePlanFromLibrary(const ros::WallTime &deadline,
+                                                  bool &repaired)
+{
+  repaired = false;
+  // Only goals that are states can be looked up, other goals (e.g. sampled from IK) are planned from scratch
+  ompl::base::GoalPtr goal = planner_->getGoal();
+  const ompl::base::GoalStates *goal_states = dynamic_cast<const ompl::base::GoalStates*>(goal.get());
+  if(!goal_states || goal_states->getStateCount() == 0 || planner_->getProblemDefinition()->getStartStateCount() == 0)
+    return false;
+
+  ompl::base::SpaceInformationPtr space_information = planner_->getSpaceInformation();
+  ompl::base::ScopedState<> start(state_space_);
+  start = planner_->getProblemDefinition()->getStartState(0);
+  boost::uint64_t scene_signature = OmplRosPlanLibrary::computeSceneSignature(collision_models_interface_->getLastPlanningScene());
+  // leave the rest of the allowed time for planning from scratch
+  ros::WallTime repair_deadline = ros::WallTime::now() + 
+    ros::WallDuration((deadline-ros::WallTime::now()).toSec()*plan_library_repair_fraction_);
+
+  OmplRosPlanLibrary::Waypoint start_waypoint, goal_waypoint;
+  OmplRosPlanLibrary::stateToWaypoint(state_space_,start.get(),start_waypoint);
+  ompl::geometric::PathGeometric solution(space_information);
+  bool found = false, replanned = false;
+  for(unsigned int i=0; i < goal_states->getStateCount() && !found; i++)
+  {
+    OmplRosPlanLibrary::stateToWaypoint(state_space_,goal_states->getState(i),goal_waypoint);
+    std::vector<OmplRosPlanLibrary::Path> paths;
+    plan_library_->getNearestPaths(group_name_,start_waypoint,goal_waypoint,scene_signature,paths);
+    for(unsigned int j=0; j < paths.size() && !found; j++)
+    {
+      // the stored path is followed from the current start to the current goal
+      ompl::geometric::PathGeometric path(space_information);
+      path.states.push_back(space_information->cloneState(start.get()));
+      bool converted = true;
+      for(unsigned int k=1; k+1 < paths[j].size() && converted; k++)
+      {
+        path.states.push_back(space_information->allocState());
+        converted = OmplRosPlanLibrary::waypointToState(state_space_,paths[j][k],path.states.back());
+      }
+      path.states.push_back(space_information->cloneState(goal_states->getState(i)));
+      if(converted)
+      {
+        found = repairPath(path,repair_deadline,solution,repaired);
+        replanned = replanned || repaired;
+      }
+    }
+  }
+
+  // repairing a path replaces the start and goal of the planner 
+  if(replanned)
+  {
+    planner_->clear();
+    planner_->getProblemDefinition()->clearStartStates();
+    planner_->addStartState(start);
+    planner_->setGoal(goal);
+  }
+  if(!found)
+  {
+    repaired = false;
+    return false;
+  }
+  ROS_DEBUG("Found solution in the plan library (%s)",repaired ? "repaired" : "unchanged");
+  goal->setSolutionPath(ompl::base::PathPtr(new ompl::geometric::PathGeometric(solution)));
+  return true;
+}
+
+bool OmplRosPlanningGroup::repairPath(const ompl::geometric::PathGeometric &path,
+                                      const ros::WallTime &deadline,
+                                      ompl::geometric::PathGeometric &repaired_path,
+                                      bool &repaired)
+{
+  ompl::base::SpaceInformationPtr space_information = planner_->getSpaceInformation();
+  repaired = false;
+  repaired_path.states.push_back(space_information->cloneState(path.states[0]));
+  unsigned int i = 0;
+  while(i+1 < path.states.size())
+  {
+    if(shouldTerminate(deadline))
+      break;
+    if(space_information->checkMotion(path.states[i],path.states[i+1]))
+    {
+      repaired_path.states.push_back(space_information->cloneState(path.states[i+1]));
+      i++;
+      continue;
+    }
+    // replan from the last valid waypoint to the next valid one
+    unsigned int next = i+1;
+    while(next+1 < path.states.size() && !space_information->isValid(path.states[next]))
+      next++;
+    if(!space_information->isValid(path.states[next]))
+      break;
+    ompl::base::ScopedState<> segment_start(state_space_), segment_goal(state_space_);
+    segment_start = path.states[i];
+    segment_goal = path.states[next];
+    planner_->clear();
+    planner_->setStartAndGoalStates(segment_start,segment_goal);
+    repaired = true;
+    ompl::base::PlannerTerminationCondition ptc(boost::bind(&OmplRosPlanningGroup::shouldTerminate, this, deadline));
+    if(!planner_->solve(ptc) || !planner_->haveExactSolutionPath())
+      break;
+    const ompl::geometric::PathGeometric &segment = planner_->getSolutionPath();
+    for(unsigned int j=1; j < segment.states.size(); j++)
+      repaired_path.states.push_back(space_information->cloneState(segment.states[j]));
+    i = next;
+  }
+  if(i+1 < path.states.size())
+  {
+    freePathStates(space_information,repaired_path);
+    return false;
+  }
+  return true;
+}
+
+void OmplRosPlanningGroup::addSolutionToLibrary()
+{
+  const ompl::geometric::PathGeometric &solution = planner_->getSolutionPath();
+  OmplRosPlanLibrary::Path path(solution.states.size());
+  for(unsigned int i=0; i < solution.states.size(); i++)
+    OmplRosPlanLibrary::stateToWaypoint(state_space_,solution.states[i],path[i]);
+  plan_library_->addPath(group_name_,
+                         OmplRosPlanLibrary::computeSceneSignature(collision_models_interface_->getLastPlanningScene()),
+                         path);
+}
+
 bool OmplRosPlanningGroup::finish(const bool &result)
 {
+  stopGoalSampling();
   if(collision_models_interface_->getPlanningSceneState() != NULL) {
     collision_models_interface_->resetToStartState(*collision_models_interface_->getPlanningSceneState());
   }
@@ -0,0 +1,119 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <ompl_ros_interface/ompl_ros_state_validity_cache.h>
+#include <cmath>
+
+namespace ompl_ros_interface
+{
+
+OmplRosStateValidityCache::OmplRosStateValidityCache(const ompl::base::StateSpacePtr &state_space,
+                                                     double resolution,
+                                                     unsigned int max_size) :
+  state_space_(state_space),
+  resolution_(resolution),
+  max_size_(max_size),
+  num_hits_(0),
+  num_misses_(0)
+{
+}
+
+void OmplRosStateValidityCache::computeKey(const ompl::base::State *state, double resolution, Key &key) const
+{
+  ompl::base::State *mutable_state = const_cast<ompl::base::State*>(state);
+  for(unsigned int i=0; ; i++)
+  {
+    double *value = state_space_->getValueAddressAtIndex(mutable_state,i);
+    if(value == NULL)
+      break;
+    key.push_back(static_cast<boost::int64_t>(floor(*value/resolution + 0.5)));
+  }
+}
+
+bool OmplRosStateValidityCache::lookup(const ompl::base::State *state, bool &valid)
+{
+  double resolution;
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    resolution = resolution_;
+  }
+  if(resolution <= 0.0)
+    return false;
+  //the key is built outside the lock, each caller has its own
+  Key key;
+  computeKey(state,resolution,key);
+
+  boost::mutex::scoped_lock lock(lock_);
+  if(resolution != resolution_)
+    return false;
+  boost::unordered_map<Key, bool, boost::hash<Key> >::const_iterator it = results_.find(key);
+  if(it == results_.end())
+  {
+    num_misses_++;
+    return false;
+  }
+  num_hits_++;
+  valid = it->second;
+  return true;
+}
+
+void OmplRosStateValidityCache::insert(const ompl::base::State *state, bool valid)
+{
+  double resolution;
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    resolution = resolution_;
+  }
+  if(resolution <= 0.0)
+    return;
+  Key key;
+  computeKey(state,resolution,key);
+
+  boost::mutex::scoped_lock lock(lock_);
+  if(resolution != resolution_)
+    return;
+  if(results_.size() >= max_size_)
+    results_.clear();
+  results_[key] = valid;
+}
+
+void OmplRosStateValidityCache::clear()
+{
+  boost::mutex::scoped_lock lock(lock_);
+  results_.clear();
+  num_hits_ = 0;
+  num_misses_ = 0;
+}
+
+}
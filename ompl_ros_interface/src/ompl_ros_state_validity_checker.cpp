@@ -35,15 +35,32 @@
 /** \author Sachin Chitta */
 
 #include <ompl_ros_interface/ompl_ros_state_validity_checker.h>
+#include <planning_environment/util/latency_statistics.h>
 
 namespace ompl_ros_interface
 {    
+bool OmplRosStateValidityChecker::isValid(const ompl::base::State *ompl_state) const
+{
+  bool valid;
+  if(validity_cache_.lookup(ompl_state,valid))
+  {
+    planning_environment::LatencyStatistics::getInstance().incrementCounter("state_validity_cache_hits");
+    return valid;
+  }
+  planning_environment::LatencyStatistics::getInstance().incrementCounter("state_validity_checks");
+  planning_environment::ScopedLatencyTimer timer("state_validity_check");
+  valid = checkState(ompl_state);
+  validity_cache_.insert(ompl_state,valid);
+  return valid;
+}
+
 void OmplRosStateValidityChecker::configureOnRequest(planning_models::KinematicState *kinematic_state,
                                                      planning_models::KinematicState::JointStateGroup *joint_state_group,
                                                      const arm_navigation_msgs::GetMotionPlan::Request &request)
 {
   kinematic_state_ = kinematic_state;
   joint_state_group_ = joint_state_group;
+  validity_cache_.clear();
 
   goal_constraint_evaluator_set_.clear();
   path_constraint_evaluator_set_.clear();
@@ -61,6 +78,9 @@ void OmplRosStateValidityChecker::configureOnRequest(planning_models::KinematicS
   path_constraint_evaluator_set_.add(path_constraints.position_constraints);
   path_constraint_evaluator_set_.add(path_constraints.orientation_constraints);
   path_constraint_evaluator_set_.add(path_constraints.visibility_constraints);
+
+  goal_constraint_evaluator_set_.compile(kinematic_state_->getKinematicModel());
+  path_constraint_evaluator_set_.compile(kinematic_state_->getKinematicModel());
 }
 
 arm_navigation_msgs::Constraints OmplRosStateValidityChecker::getPhysicalConstraints(const arm_navigation_msgs::Constraints &constraints)
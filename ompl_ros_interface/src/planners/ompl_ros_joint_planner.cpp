@@ -227,6 +227,12 @@ bool OmplRosJointPlanner::setPoseGoal(arm_navigation_msgs::GetMotionPlan::Reques
     response.error_code.val = response.error_code.PLANNING_FAILED;
     return false;
   }
+  // The sampling thread of a previous pose goal may still be waiting on the IK sampler, make sure it is gone 
+  // before the sampler is reconfigured
+  ik_sampler_.stopSampling();
+  ompl::base::GoalLazySamples *previous_goal = dynamic_cast<ompl::base::GoalLazySamples*>(planner_->getGoal().get());
+  if(previous_goal)
+    previous_goal->stopSampling();
   ik_sampler_.configureOnRequest(request,response,100);
   ompl::base::GoalPtr goal;
   goal.reset(new ompl::base::GoalLazySamples(planner_->getSpaceInformation(),boost::bind(&OmplRosIKSampler::sampleGoals,&ik_sampler_,_1,_2)));
@@ -242,6 +248,12 @@ bool OmplRosJointPlanner::initializeStateValidityChecker(ompl_ros_interface::Omp
     return true;
 }
 
+void OmplRosJointPlanner::stopGoalSampling()
+{
+  if(ik_sampler_available_)
+    ik_sampler_.stopSampling();
+}
+
 arm_navigation_msgs::RobotTrajectory OmplRosJointPlanner::getSolutionPath()
 {
   arm_navigation_msgs::RobotTrajectory robot_trajectory;
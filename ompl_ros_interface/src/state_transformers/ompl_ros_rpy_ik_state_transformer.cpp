@@ -35,6 +35,7 @@
 /** \author Sachin Chitta, Ioan Sucan */
 
 #include <ompl_ros_interface/state_transformers/ompl_ros_rpy_ik_state_transformer.h>
+#include <planning_environment/util/latency_statistics.h>
 
 namespace ompl_ros_interface
 {
@@ -104,11 +105,15 @@ bool OmplRosRPYIKStateTransformer::inverseTransform(const ompl::base::State &omp
                    pose.orientation.z << " " << 
                    pose.orientation.w);
 
-  if(kinematics_solver_->searchPositionIK(pose,
-                                          seed_state_.joint_state.position,
-                                          1.0,
-                                          solution_state_.joint_state.position,
-                                          error_code))
+  planning_environment::LatencyStatistics::getInstance().incrementCounter("ik_calls");
+  planning_environment::ScopedLatencyTimer ik_timer("ik");
+  bool ik_found = kinematics_solver_->searchPositionIK(pose,
+                                                       seed_state_.joint_state.position,
+                                                       1.0,
+                                                       solution_state_.joint_state.position,
+                                                       error_code);
+  ik_timer.stop();
+  if(ik_found)
   {
     robot_state.joint_state = solution_state_.joint_state;
     return true;
@@ -39,9 +39,8 @@
 namespace ompl_ros_interface
 {    
 
-bool OmplRosJointStateValidityChecker::isValid(const ompl::base::State *ompl_state) const
+bool OmplRosJointStateValidityChecker::checkState(const ompl::base::State *ompl_state) const
 {
-  //ros::WallTime n1 = ros::WallTime::now();
   ompl_ros_interface::omplStateToKinematicStateGroup(ompl_state,
                                                      ompl_state_to_kinematic_state_mapping_,
                                                      joint_state_group_);
@@ -62,14 +61,11 @@ bool OmplRosJointStateValidityChecker::isValid(const ompl::base::State *ompl_sta
   }
 
   joint_state_group_->updateKinematicLinks();
-  //ros::WallTime n2 = ros::WallTime::now();
   if(collision_models_interface_->isKinematicStateInCollision(*kinematic_state_))
   {
     ROS_DEBUG("State is in collision");
-    //ROS_INFO_STREAM("Positive collision check took " << (ros::WallTime::now()-n2).toSec());
     return false;
   }
-  //ROS_INFO_STREAM("Negative collision check took " << (ros::WallTime::now()-n2).toSec());
   return true;
 }
 
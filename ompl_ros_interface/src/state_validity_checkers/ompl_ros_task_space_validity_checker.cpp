@@ -39,7 +39,7 @@
 namespace ompl_ros_interface
 {
 
-bool OmplRosTaskSpaceValidityChecker::isValid(const ompl::base::State *ompl_state) const
+bool OmplRosTaskSpaceValidityChecker::checkState(const ompl::base::State *ompl_state) const
 {
   arm_navigation_msgs::RobotState robot_state_msg;
   if(!state_transformer_->inverseTransform(*ompl_state,
@@ -140,6 +140,7 @@ void OmplRosTaskSpaceValidityChecker::configureOnRequest(planning_models::Kinema
 {
   kinematic_state_ = kinematic_state;
   joint_state_group_ = joint_state_group;
+  validity_cache_.clear();
 
   goal_constraint_evaluator_set_.clear();
   path_constraint_evaluator_set_.clear();
@@ -158,6 +159,9 @@ void OmplRosTaskSpaceValidityChecker::configureOnRequest(planning_models::Kinema
   path_constraint_evaluator_set_.add(path_constraints.orientation_constraints);
   path_constraint_evaluator_set_.add(path_constraints.visibility_constraints);
 
+  goal_constraint_evaluator_set_.compile(kinematic_state_->getKinematicModel());
+  path_constraint_evaluator_set_.compile(kinematic_state_->getKinematicModel());
+
   arm_navigation_msgs::RobotState default_state = state_transformer_->getDefaultState();
   if(!getRobotStateToJointModelGroupMapping(default_state,joint_state_group_->getJointModelGroup(),robot_state_to_joint_state_group_mapping_))
     return;
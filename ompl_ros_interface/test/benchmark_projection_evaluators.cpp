@@ -0,0 +1,167 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+/** Compares the time to solution of planner configurations that only differ in their 
+    projection evaluator on the scenarios of test_ompl_planning */
+
+#include <ros/ros.h>
+#include <arm_navigation_msgs/SetPlanningSceneDiff.h>
+#include <arm_navigation_msgs/GetMotionPlan.h>
+#include <planning_environment/models/collision_models.h>
+#include <algorithm>
+#include <numeric>
+
+static const std::string SET_PLANNING_SCENE_DIFF_SERVICE="/environment_server/set_planning_scene_diff";
+static const std::string PLANNER_SERVICE_NAME="/ompl_planning/plan_kinematic_path";
+
+struct Scenario
+{
+  std::string name;
+  arm_navigation_msgs::SetPlanningSceneDiff::Request scene;
+  arm_navigation_msgs::GetMotionPlan::Request request;
+};
+
+static void runScenario(ros::ServiceClient &set_planning_scene_diff_client,
+                        ros::ServiceClient &planning_service_client,
+                        Scenario &scenario,
+                        const std::vector<std::string> &planner_ids,
+                        unsigned int runs)
+{
+  arm_navigation_msgs::SetPlanningSceneDiff::Response scene_response;
+  if(!set_planning_scene_diff_client.call(scenario.scene,scene_response))
+  {
+    ROS_ERROR("Could not set the planning scene for scenario %s",scenario.name.c_str());
+    return;
+  }
+  for(unsigned int i=0; i < planner_ids.size(); i++)
+  {
+    scenario.request.motion_plan_request.planner_id = planner_ids[i];
+    std::vector<double> planning_times;
+    unsigned int failures = 0;
+    for(unsigned int j=0; j < runs; j++)
+    {
+      arm_navigation_msgs::GetMotionPlan::Response response;
+      if(!planning_service_client.call(scenario.request,response) ||
+         response.error_code.val != response.error_code.SUCCESS)
+      {
+        failures++;
+        continue;
+      }
+      planning_times.push_back(response.planning_time.toSec());
+    }
+    if(planning_times.empty())
+    {
+      printf("%-10s %-24s %3u/%-3u solved\n",scenario.name.c_str(),planner_ids[i].c_str(),0,runs);
+      continue;
+    }
+    std::sort(planning_times.begin(),planning_times.end());
+    double mean = std::accumulate(planning_times.begin(),planning_times.end(),0.0)/planning_times.size();
+    printf("%-10s %-24s %3u/%-3u solved  mean %8.4fs  median %8.4fs  max %8.4fs\n",
+           scenario.name.c_str(),planner_ids[i].c_str(),runs-failures,runs,
+           mean,planning_times[planning_times.size()/2],planning_times.back());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "benchmark_projection_evaluators");
+  ros::NodeHandle nh, private_nh("~");
+
+  int runs;
+  private_nh.param("runs",runs,20);
+  std::vector<std::string> planner_ids;
+  XmlRpc::XmlRpcValue planner_list;
+  if(private_nh.getParam("planner_ids",planner_list) && planner_list.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for(int32_t i = 0; i < planner_list.size(); ++i)
+      planner_ids.push_back(static_cast<std::string>(planner_list[i]));
+  }
+  else
+  {
+    planner_ids.push_back("SBLkConfig1");
+    planner_ids.push_back("SBLkConfigLink");
+    planner_ids.push_back("LBKPIECEkConfig1");
+    planner_ids.push_back("LBKPIECEkConfigLink");
+  }
+
+  planning_environment::CollisionModels cm("robot_description");
+  ros::service::waitForService(SET_PLANNING_SCENE_DIFF_SERVICE);
+  ros::service::waitForService(PLANNER_SERVICE_NAME);
+  ros::ServiceClient set_planning_scene_diff_client = nh.serviceClient<arm_navigation_msgs::SetPlanningSceneDiff>(SET_PLANNING_SCENE_DIFF_SERVICE);
+  ros::ServiceClient planning_service_client = nh.serviceClient<arm_navigation_msgs::GetMotionPlan>(PLANNER_SERVICE_NAME);
+
+  // the request of test_ompl_planning, moving the right arm from its default state
+  arm_navigation_msgs::GetMotionPlan::Request request;
+  request.motion_plan_request.group_name = "right_arm";
+  request.motion_plan_request.num_planning_attempts = 1;
+  request.motion_plan_request.allowed_planning_time = ros::Duration(5.0);
+  const std::vector<std::string>& joint_names = cm.getKinematicModel()->getModelGroup("right_arm")->getJointModelNames();
+  request.motion_plan_request.goal_constraints.joint_constraints.resize(joint_names.size());
+  for(unsigned int i = 0; i < joint_names.size(); i++) {
+    request.motion_plan_request.goal_constraints.joint_constraints[i].joint_name = joint_names[i];
+    request.motion_plan_request.goal_constraints.joint_constraints[i].position = 0.0;
+    request.motion_plan_request.goal_constraints.joint_constraints[i].tolerance_above = 0.001;
+    request.motion_plan_request.goal_constraints.joint_constraints[i].tolerance_below = 0.001;
+  }      
+  request.motion_plan_request.goal_constraints.joint_constraints[0].position = -2.0;
+  request.motion_plan_request.goal_constraints.joint_constraints[3].position = -.2;
+  request.motion_plan_request.goal_constraints.joint_constraints[5].position = -.2;
+
+  std::vector<Scenario> scenarios(2);
+  scenarios[0].name = "free";
+  scenarios[0].request = request;
+
+  arm_navigation_msgs::CollisionObject pole;
+  pole.header.stamp = ros::Time::now();
+  pole.header.frame_id = "odom_combined";
+  pole.id = "pole";
+  pole.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
+  pole.shapes.resize(1);
+  pole.shapes[0].type = arm_navigation_msgs::Shape::CYLINDER;
+  pole.shapes[0].dimensions.resize(2);
+  pole.shapes[0].dimensions[0] = 0.1;
+  pole.shapes[0].dimensions[1] = 1.5;
+  pole.poses.resize(1);
+  pole.poses[0].position.x = .6;
+  pole.poses[0].position.y = -.6;
+  pole.poses[0].position.z = .75;
+  pole.poses[0].orientation.w = 1.0;
+  scenarios[1].name = "pole";
+  scenarios[1].scene.planning_scene_diff.collision_objects.push_back(pole);
+  scenarios[1].request = request;
+
+  for(unsigned int i=0; i < scenarios.size() && ros::ok(); i++)
+    runScenario(set_planning_scene_diff_client,planning_service_client,scenarios[i],planner_ids,std::max(runs,1));
+  return 0;
+}
@@ -81,6 +81,54 @@ protected:
   void GetAndSetPlanningScene() {
     ASSERT_TRUE(set_planning_scene_diff_client_.call(get_req, get_res));
   }
+
+  void AddPole() {
+    arm_navigation_msgs::CollisionObject pole;
+  
+    pole.header.stamp = ros::Time::now();
+    pole.header.frame_id = "odom_combined";
+    pole.id = "pole";
+    pole.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
+    pole.shapes.resize(1);
+    pole.shapes[0].type = arm_navigation_msgs::Shape::CYLINDER;
+    pole.shapes[0].dimensions.resize(2);
+    pole.shapes[0].dimensions[0] = 0.1;
+    pole.shapes[0].dimensions[1] = 1.5;
+    pole.poses.resize(1);
+    pole.poses[0].position.x = .6;
+    pole.poses[0].position.y = -.6;
+    pole.poses[0].position.z = .75;
+    pole.poses[0].orientation.w = 1.0;
+
+    get_req.planning_scene_diff.collision_objects.push_back(pole);
+
+    GetAndSetPlanningScene();
+
+    mplan_req.motion_plan_request.goal_constraints.joint_constraints[0].position = -2.0;
+    mplan_req.motion_plan_request.goal_constraints.joint_constraints[3].position = -.2;
+    mplan_req.motion_plan_request.goal_constraints.joint_constraints[5].position = -.2;
+  }
+
+  void PlanAroundPole(unsigned int num_plans) {
+    for(unsigned int i = 0; i < num_plans; i++) {
+      arm_navigation_msgs::GetMotionPlan::Response mplan_res;
+      ASSERT_TRUE(planning_service_client_.call(mplan_req, mplan_res));
+    
+      ASSERT_EQ(mplan_res.error_code.val,mplan_res.error_code.SUCCESS);
+    
+      EXPECT_GT(mplan_res.trajectory.joint_trajectory.points.size(), 0);
+    
+      arm_navigation_msgs::ArmNavigationErrorCodes error_code;
+      std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
+    
+      EXPECT_TRUE(cm_->isJointTrajectoryValid(get_res.planning_scene,
+                                              mplan_res.trajectory.joint_trajectory,
+                                              mplan_req.motion_plan_request.goal_constraints,                              
+                                              mplan_req.motion_plan_request.path_constraints,
+                                              error_code,
+                                              trajectory_error_codes, false));
+    }
+  }
       
 protected:
 
@@ -100,49 +148,15 @@ protected:
 
 TEST_F(OmplPlanningTest, TestPole)
 {
-  arm_navigation_msgs::CollisionObject pole;
-  
-  pole.header.stamp = ros::Time::now();
-  pole.header.frame_id = "odom_combined";
-  pole.id = "pole";
-  pole.operation.operation = arm_navigation_msgs::CollisionObjectOperation::ADD;
-  pole.shapes.resize(1);
-  pole.shapes[0].type = arm_navigation_msgs::Shape::CYLINDER;
-  pole.shapes[0].dimensions.resize(2);
-  pole.shapes[0].dimensions[0] = 0.1;
-  pole.shapes[0].dimensions[1] = 1.5;
-  pole.poses.resize(1);
-  pole.poses[0].position.x = .6;
-  pole.poses[0].position.y = -.6;
-  pole.poses[0].position.z = .75;
-  pole.poses[0].orientation.w = 1.0;
-
-  get_req.planning_scene_diff.collision_objects.push_back(pole);
-
-  GetAndSetPlanningScene();
-
-  mplan_req.motion_plan_request.goal_constraints.joint_constraints[0].position = -2.0;
-  mplan_req.motion_plan_request.goal_constraints.joint_constraints[3].position = -.2;
-  mplan_req.motion_plan_request.goal_constraints.joint_constraints[5].position = -.2;
-
-  for(unsigned int i = 0; i < 10; i++) {
-    arm_navigation_msgs::GetMotionPlan::Response mplan_res;
-    ASSERT_TRUE(planning_service_client_.call(mplan_req, mplan_res));
-    
-    ASSERT_EQ(mplan_res.error_code.val,mplan_res.error_code.SUCCESS);
-    
-    EXPECT_GT(mplan_res.trajectory.joint_trajectory.points.size(), 0);
-    
-    arm_navigation_msgs::ArmNavigationErrorCodes error_code;
-    std::vector<arm_navigation_msgs::ArmNavigationErrorCodes> trajectory_error_codes;
-    
-    EXPECT_TRUE(cm_->isJointTrajectoryValid(get_res.planning_scene,
-                                            mplan_res.trajectory.joint_trajectory,
-                                            mplan_req.motion_plan_request.goal_constraints,                              
-                                            mplan_req.motion_plan_request.path_constraints,
-                                            error_code,
-                                            trajectory_error_codes, false));
-  }
+  AddPole();
+  PlanAroundPole(10);
+}
+
+TEST_F(OmplPlanningTest, TestPolePortfolio)
+{
+  AddPole();
+  mplan_req.motion_plan_request.planner_id = "PortfolioConfig1";
+  PlanAroundPole(10);
 }
 
 int main(int argc, char **argv)
@@ -0,0 +1,163 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <gtest/gtest.h>
+#include <ompl_ros_interface/ompl_ros_plan_library.h>
+#include <cstdio>
+#include <fstream>
+
+using ompl_ros_interface::OmplRosPlanLibrary;
+
+static OmplRosPlanLibrary::Path makePath(double start, double goal, unsigned int num_waypoints)
+{
+  OmplRosPlanLibrary::Path path(num_waypoints,OmplRosPlanLibrary::Waypoint(2));
+  for(unsigned int i=0; i < num_waypoints; i++)
+  {
+    double value = start + (goal-start)*i/(num_waypoints-1);
+    path[i][0] = value;
+    path[i][1] = -value;
+  }
+  return path;
+}
+
+static OmplRosPlanLibrary::Waypoint makeWaypoint(double value)
+{
+  OmplRosPlanLibrary::Waypoint waypoint(2);
+  waypoint[0] = value;
+  waypoint[1] = -value;
+  return waypoint;
+}
+
+TEST(OmplRosPlanLibrary, NearestPaths)
+{
+  OmplRosPlanLibrary library(2,0.5,0.01);
+  EXPECT_TRUE(library.addPath("arm",1,makePath(0.0,1.0,3)));
+  EXPECT_TRUE(library.addPath("arm",2,makePath(0.1,1.0,4)));
+  EXPECT_TRUE(library.addPath("arm",1,makePath(2.0,3.0,5)));
+  EXPECT_TRUE(library.addPath("other_arm",1,makePath(0.0,1.0,6)));
+  EXPECT_EQ(library.size(),4u);
+
+  // a path for the same scene comes first even if another one is closer
+  std::vector<OmplRosPlanLibrary::Path> paths;
+  library.getNearestPaths("arm",makeWaypoint(0.1),makeWaypoint(1.0),1,paths);
+  ASSERT_EQ(paths.size(),2u);
+  EXPECT_EQ(paths[0].size(),3u);
+  EXPECT_EQ(paths[1].size(),4u);
+
+  // otherwise by distance
+  library.getNearestPaths("arm",makeWaypoint(0.1),makeWaypoint(1.0),3,paths);
+  ASSERT_EQ(paths.size(),2u);
+  EXPECT_EQ(paths[0].size(),4u);
+
+  // far away paths are never returned
+  library.getNearestPaths("arm",makeWaypoint(5.0),makeWaypoint(6.0),1,paths);
+  EXPECT_TRUE(paths.empty());
+  library.getNearestPaths("unknown_arm",makeWaypoint(0.0),makeWaypoint(1.0),1,paths);
+  EXPECT_TRUE(paths.empty());
+}
+
+TEST(OmplRosPlanLibrary, Duplicates)
+{
+  OmplRosPlanLibrary library(3,1.0,0.01);
+  EXPECT_TRUE(library.addPath("arm",1,makePath(0.0,1.0,3)));
+  EXPECT_FALSE(library.addPath("arm",1,makePath(0.0,1.0,5)));
+  // the same motion in a different scene is kept
+  EXPECT_TRUE(library.addPath("arm",2,makePath(0.0,1.0,5)));
+  // waypoints of a different dimension are rejected
+  OmplRosPlanLibrary::Path path = makePath(0.0,1.0,3);
+  path[1].push_back(0.0);
+  EXPECT_FALSE(library.addPath("arm",1,path));
+  EXPECT_EQ(library.size(),2u);
+}
+
+TEST(OmplRosPlanLibrary, SaveAndLoad)
+{
+  std::string filename = "test_plan_library.bin";
+  {
+    OmplRosPlanLibrary library;
+    library.addPath("arm",7,makePath(0.0,1.0,3));
+    library.addPath("arm",7,makePath(0.5,1.5,4));
+    library.addPath("a_much_longer_group_name",7,makePath(0.0,1.0,5));
+    EXPECT_TRUE(library.save(filename));
+  }
+  OmplRosPlanLibrary library;
+  ASSERT_TRUE(library.load(filename));
+  EXPECT_EQ(library.size(),3u);
+  std::vector<OmplRosPlanLibrary::Path> paths;
+  library.getNearestPaths("arm",makeWaypoint(0.5),makeWaypoint(1.5),7,paths);
+  ASSERT_FALSE(paths.empty());
+  ASSERT_EQ(paths[0].size(),4u);
+  EXPECT_DOUBLE_EQ(paths[0][1][0],0.5+1.0/3.0);
+  EXPECT_DOUBLE_EQ(paths[0][1][1],-(0.5+1.0/3.0));
+  library.getNearestPaths("a_much_longer_group_name",makeWaypoint(0.0),makeWaypoint(1.0),7,paths);
+  ASSERT_FALSE(paths.empty());
+  EXPECT_EQ(paths[0].size(),5u);
+
+  // new paths are added next to the mapped ones and saved together with them
+  EXPECT_TRUE(library.addPath("arm",7,makePath(3.0,4.0,2)));
+  EXPECT_TRUE(library.save(filename));
+  OmplRosPlanLibrary reloaded;
+  ASSERT_TRUE(reloaded.load(filename));
+  EXPECT_EQ(reloaded.size(),4u);
+  remove(filename.c_str());
+}
+
+TEST(OmplRosPlanLibrary, CorruptFile)
+{
+  std::string filename = "test_plan_library_corrupt.bin";
+  {
+    OmplRosPlanLibrary library;
+    library.addPath("arm",7,makePath(0.0,1.0,3));
+    EXPECT_TRUE(library.save(filename));
+  }
+  // drop the last waypoint
+  std::ifstream in(filename.c_str(),std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+  in.close();
+  std::ofstream out(filename.c_str(),std::ios::binary | std::ios::trunc);
+  out.write(contents.c_str(),contents.size()-sizeof(double));
+  out.close();
+
+  OmplRosPlanLibrary library;
+  EXPECT_FALSE(library.load(filename));
+  EXPECT_EQ(library.size(),0u);
+  EXPECT_FALSE(library.load("no_such_plan_library.bin"));
+  remove(filename.c_str());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
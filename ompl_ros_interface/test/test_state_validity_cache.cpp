@@ -0,0 +1,144 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <gtest/gtest.h>
+#include <ompl_ros_interface/ompl_ros_state_validity_cache.h>
+#include <ompl_ros_interface/ompl_ros_motion_validator.h>
+#include <ompl/base/spaces/RealVectorStateSpace.h>
+#include <ompl/base/ScopedState.h>
+#include <boost/bind.hpp>
+
+static ompl::base::StateSpacePtr makeStateSpace()
+{
+  ompl::base::StateSpacePtr state_space(new ompl::base::RealVectorStateSpace(2));
+  ompl::base::RealVectorBounds bounds(2);
+  bounds.setLow(-1.0);
+  bounds.setHigh(1.0);
+  state_space->as<ompl::base::RealVectorStateSpace>()->setBounds(bounds);
+  return state_space;
+}
+
+// states with x in [-0.1,0.1] are invalid
+static bool isStateValid(const ompl::base::State *state, unsigned int *num_checks)
+{
+  (*num_checks)++;
+  double x = state->as<ompl::base::RealVectorStateSpace::StateType>()->values[0];
+  return x < -0.1 || x > 0.1;
+}
+
+TEST(OmplRosStateValidityCache, LookupAndInsert)
+{
+  ompl::base::StateSpacePtr state_space = makeStateSpace();
+  ompl_ros_interface::OmplRosStateValidityCache cache(state_space,1e-3,3);
+  ompl::base::ScopedState<ompl::base::RealVectorStateSpace> state(state_space);
+  state->values[0] = 0.1;
+  state->values[1] = 0.2;
+
+  bool valid = false;
+  EXPECT_FALSE(cache.lookup(state.get(),valid));
+  cache.insert(state.get(),true);
+  EXPECT_TRUE(cache.lookup(state.get(),valid));
+  EXPECT_TRUE(valid);
+
+  // states closer than the resolution share their result
+  state->values[0] = 0.1 + 1e-4;
+  EXPECT_TRUE(cache.lookup(state.get(),valid));
+  state->values[0] = 0.1 + 1e-2;
+  EXPECT_FALSE(cache.lookup(state.get(),valid));
+  cache.insert(state.get(),false);
+  EXPECT_TRUE(cache.lookup(state.get(),valid));
+  EXPECT_FALSE(valid);
+  EXPECT_EQ(cache.getNumHits(),3u);
+  EXPECT_EQ(cache.getNumMisses(),2u);
+
+  // the cache starts over once it is full
+  state->values[1] = 0.5;
+  cache.insert(state.get(),true);
+  state->values[1] = 0.6;
+  cache.insert(state.get(),true);
+  EXPECT_EQ(cache.size(),1u);
+
+  cache.clear();
+  EXPECT_EQ(cache.size(),0u);
+  EXPECT_EQ(cache.getNumHits(),0u);
+
+  cache.setResolution(0.0);
+  cache.insert(state.get(),true);
+  EXPECT_FALSE(cache.lookup(state.get(),valid));
+}
+
+TEST(OmplRosMotionValidator, Bisection)
+{
+  ompl::base::StateSpacePtr state_space = makeStateSpace();
+  state_space->setLongestValidSegmentFraction(0.001);
+  ompl::base::SpaceInformationPtr si(new ompl::base::SpaceInformation(state_space));
+  unsigned int num_checks = 0;
+  si->setStateValidityChecker(boost::bind(&isStateValid,_1,&num_checks));
+  si->setMotionValidator(ompl::base::MotionValidatorPtr(new ompl_ros_interface::OmplRosMotionValidator(si)));
+  si->setup();
+
+  ompl::base::ScopedState<ompl::base::RealVectorStateSpace> start(state_space), goal(state_space);
+  start->values[0] = -1.0;
+  start->values[1] = 0.0;
+  goal->values[0] = 1.0;
+  goal->values[1] = 0.0;
+  unsigned int num_segments = state_space->validSegmentCount(start.get(),goal.get());
+  ASSERT_GT(num_segments,100u);
+
+  // the obstacle in the middle is found by the first intermediate check
+  EXPECT_FALSE(si->checkMotion(start.get(),goal.get()));
+  EXPECT_EQ(num_checks,2u);
+
+  // a valid motion checks every intermediate state once
+  num_checks = 0;
+  goal->values[0] = -0.3;
+  num_segments = state_space->validSegmentCount(start.get(),goal.get());
+  EXPECT_TRUE(si->checkMotion(start.get(),goal.get()));
+  EXPECT_EQ(num_checks,num_segments);
+
+  // the incremental check reports the last valid state before the obstacle
+  goal->values[0] = 1.0;
+  num_segments = state_space->validSegmentCount(start.get(),goal.get());
+  ompl::base::ScopedState<ompl::base::RealVectorStateSpace> last_valid_state(state_space);
+  std::pair<ompl::base::State*, double> last_valid(last_valid_state.get(),0.0);
+  EXPECT_FALSE(si->checkMotion(start.get(),goal.get(),last_valid));
+  EXPECT_LT(last_valid_state->values[0],-0.1);
+  EXPECT_GT(last_valid_state->values[0],-0.1-2.0/num_segments-1e-9);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
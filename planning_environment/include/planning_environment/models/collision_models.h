@@ -38,6 +38,8 @@
 #define PLANNING_ENVIRONMENT_MODELS_COLLISION_MODELS_
 
 #include "planning_environment/models/robot_models.h"
+#include "planning_environment/util/kinematic_state_constraint_evaluator.h"
+#include <planning_models/kinematic_state_pool.h>
 #include <tf/tf.h>
 #include <collision_space/environmentODE.h>
 #include <arm_navigation_msgs/PlanningScene.h>
@@ -253,6 +255,14 @@ public:
                              const arm_navigation_msgs::Constraints path_constraints,
 			     bool verbose = false);
 
+  /** \brief Same as above, with the constraints already added to (and preferably compiled in) evaluator sets, so they can be reused across states */
+  bool isKinematicStateValid(const planning_models::KinematicState& state,
+                             const std::vector<std::string>& names,
+                             arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                             const KinematicConstraintEvaluatorSet& goal_constraint_evaluator_set,
+                             const KinematicConstraintEvaluatorSet& path_constraint_evaluator_set,
+			     bool verbose = false);
+
   bool isJointTrajectoryValid(const arm_navigation_msgs::PlanningScene& planning_scene,
                               const trajectory_msgs::JointTrajectory &trajectory,
                               const arm_navigation_msgs::Constraints& goal_constraints,
@@ -479,6 +489,9 @@ protected:
 	
   collision_space::EnvironmentModel* ode_collision_model_;
 
+  /** \brief Reusable states for setPlanningScene() / revertPlanningScene() */
+  planning_models::KinematicStatePool* state_pool_;
+
   bool planning_scene_set_;
 
   double default_scale_;
@@ -55,7 +55,12 @@ public:
   // Constructors
   //
 	
-  CollisionModelsInterface(const std::string &description, bool register_with_server = true);
+  /** 
+   * \brief If register_with_server is set the environment server is asked to sync planning 
+   * scenes to this instance; advertise_sync_server can be cleared for additional copies in the 
+   * same node that have their scenes set through setPlanningSceneWithCallbacks 
+   */
+  CollisionModelsInterface(const std::string &description, bool register_with_server = true, bool advertise_sync_server = true);
 
   virtual ~CollisionModelsInterface(void);
  
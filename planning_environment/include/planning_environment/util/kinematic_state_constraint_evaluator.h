@@ -60,6 +60,7 @@ public:
 	
   KinematicConstraintEvaluator(void)
   {
+    m_model = NULL;
   }
 	
   virtual ~KinematicConstraintEvaluator(void)
@@ -69,6 +70,17 @@ public:
   /** \brief Clear the stored constraint */
   virtual void clear(void) = 0;
 
+  /** \brief Resolve the joint and link names used by the constraint
+      to indices in the states of \e model. Deciding states of that
+      model then skips the name lookups; states of other models are
+      still decided by name. Returns false if a name is not part of
+      the model */
+  virtual bool compile(const planning_models::KinematicModel *model)
+  {
+    m_model = NULL;
+    return true;
+  }
+
   /** \brief Decide whether the constraint is satisfied in the indicated state or group, if specified */
   virtual bool decide(const planning_models::KinematicState *state,
                       bool verbose=false) const = 0;
@@ -77,7 +89,30 @@ public:
   virtual void print(std::ostream &out = std::cout) const
   {
   }
+
+protected:
+
+  /** \brief Get the link state by index if the constraint was compiled for the model of the state, by name otherwise */
+  const planning_models::KinematicState::LinkState* getLinkState(const planning_models::KinematicState *state,
+                                                                  unsigned int index, const std::string &name) const
+  {
+    if (m_model && state->getKinematicModel() == m_model)
+      return state->getLinkStateVector()[index];
+    return state->getLinkState(name);
+  }
+
+  /** \brief The model the constraint is compiled for, if any */
+  const planning_models::KinematicModel *m_model;
 };
+
+/** \brief Find the index of the joint a joint constraint refers to
+    (by joint or variable name) in the states of \e model and whether
+    the joint is continuous */
+bool getJointConstraintIndex(const planning_models::KinematicModel *model, const std::string &joint_name,
+                             unsigned int &index, bool &continuous);
+
+/** \brief Find the index of a link in the states of \e model */
+bool getLinkIndex(const planning_models::KinematicModel *model, const std::string &link_name, unsigned int &index);
     
 class JointConstraintEvaluator : public KinematicConstraintEvaluator
 {
@@ -86,11 +121,16 @@ public:
   JointConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
     m_joint = NULL;
+    m_joint_index = 0;
+    m_continuous = false;
   }
 	
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::JointConstraint &jc);
 
+  /** \brief Resolve the joint index and whether the joint is continuous */
+  virtual bool compile(const planning_models::KinematicModel *model);
+
   /** \brief Decide whether the constraint is satisfied in the indicated state or group, if specified */
   virtual bool decide(const planning_models::KinematicState  *state,
                       bool verbose=false) const;
@@ -108,6 +148,8 @@ protected:
 	
   arm_navigation_msgs::JointConstraint         m_jc;
   const planning_models::KinematicModel::JointModel *m_joint;    
+  unsigned int m_joint_index;
+  bool m_continuous;
 };
     
 	
@@ -117,11 +159,15 @@ public:
 	
   OrientationConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = 0;
   }
 	
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::OrientationConstraint &pc);
 
+  /** \brief Resolve the index of the constrained link */
+  virtual bool compile(const planning_models::KinematicModel *model);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
@@ -146,7 +192,9 @@ protected:
   arm_navigation_msgs::OrientationConstraint  m_oc;
   double m_roll, m_pitch, m_yaw;
   tf::Matrix3x3 m_rotation_matrix;
+  tf::Matrix3x3 m_rotation_matrix_inverse;
   boost::scoped_ptr<bodies::Body> m_constraint_region;
+  unsigned int m_link_index;
 	
 };
 
@@ -156,11 +204,15 @@ public:
 	
   VisibilityConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = 0;
   }
 	
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::VisibilityConstraint &vc);
 
+  /** \brief Resolve the index of the sensor link */
+  virtual bool compile(const planning_models::KinematicModel *model);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
@@ -177,6 +229,7 @@ public:
 protected:	
   arm_navigation_msgs::VisibilityConstraint  m_vc;
   tf::Transform m_sensor_offset_pose;
+  unsigned int m_link_index;
 };
 
 class PositionConstraintEvaluator : public KinematicConstraintEvaluator
@@ -185,11 +238,15 @@ public:
 	
   PositionConstraintEvaluator(void) : KinematicConstraintEvaluator()
   {
+    m_link_index = 0;
   }
 	
   /** \brief This function assumes the constraint has been transformed into the proper frame, if such a transform is needed */
   bool use(const arm_navigation_msgs::PositionConstraint &pc);
 
+  /** \brief Resolve the index of the constrained link */
+  virtual bool compile(const planning_models::KinematicModel *model);
+
   /** \brief Clear the stored constraint */
   virtual void clear(void);
 	
@@ -215,6 +272,7 @@ protected:
   double                                       m_x, m_y, m_z;
   tf::Vector3                                    m_offset;
   boost::scoped_ptr<bodies::Body> m_constraint_region;
+  unsigned int m_link_index;
 };
         
 class KinematicConstraintEvaluatorSet
@@ -223,6 +281,7 @@ public:
 	
   KinematicConstraintEvaluatorSet(void)
   {
+    m_model = NULL;
   }
 	
   ~KinematicConstraintEvaluatorSet(void)
@@ -245,6 +304,14 @@ public:
   /** \brief Add a set of orientation constraints */
   bool add(const std::vector<arm_navigation_msgs::VisibilityConstraint> &pc);
 	
+  /** \brief Compile the constraints for states of \e model: joint
+      constraints become flat arrays of joint indices and bounds, and
+      the other evaluators resolve their link indices. Constraints
+      added afterwards require compiling again. Returns false if a
+      constraint refers to names not in the model, in which case
+      states are decided by name */
+  bool compile(const planning_models::KinematicModel *model);
+
   /** \brief Decide whether the set of constraints is satisfied  */
   bool decide(const planning_models::KinematicState* state,
               bool verbose=false) const;
@@ -278,6 +345,19 @@ protected:
   std::vector<arm_navigation_msgs::PositionConstraint>  m_pc;
   std::vector<arm_navigation_msgs::OrientationConstraint>  m_oc;
   std::vector<arm_navigation_msgs::VisibilityConstraint> m_vc;
+
+  /** \brief The evaluators for constraints on links */
+  std::vector<KinematicConstraintEvaluator*>         m_link_kce;
+
+  /** \brief The model the set is compiled for, if any */
+  const planning_models::KinematicModel *m_model;
+
+  /** \brief Compiled joint constraints, one entry per joint constraint */
+  std::vector<unsigned int> m_joint_indices;
+  std::vector<double> m_joint_positions;
+  std::vector<double> m_joint_tolerances_above;
+  std::vector<double> m_joint_tolerances_below;
+  std::vector<char> m_joint_continuous;
 };
 } // planning_environment
 
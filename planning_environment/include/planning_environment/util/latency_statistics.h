@@ -0,0 +1,193 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef PLANNING_ENVIRONMENT_UTIL_LATENCY_STATISTICS_
+#define PLANNING_ENVIRONMENT_UTIL_LATENCY_STATISTICS_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <arm_navigation_msgs/LatencyStatistics.h>
+#include <arm_navigation_msgs/GetLatencyStatistics.h>
+
+namespace planning_environment
+{
+
+/** 
+ * \brief Process-wide collection of per-stage timings and per-request counters.
+ *
+ * Stages (planning, collision checks, IK calls, filtering, ...) report samples through
+ * addSample() or a ScopedLatencyTimer, counters are accumulated with incrementCounter() 
+ * and turned into one sample per request by finishRequest(). For every name the number of 
+ * samples, mean and max since the last reset are kept, together with a window of the most 
+ * recent samples that the percentiles are computed from.
+ *
+ * Collection is off unless the node sets the parameter ~latency_statistics/enabled; when
+ * disabled every call returns after reading a single flag, without taking a lock.
+ *
+ * Counters belong to the request being served. Each thread counts into its own table 
+ * without locking and hands the counts to its request when it calls flushCounters() or 
+ * finishRequest(), or when the thread exits. Threads that work on behalf of a request 
+ * (e.g. goal sampling workers) join it with setRequestCounters(), so concurrent requests 
+ * served by different threads never mix their counts.
+ */
+class LatencyStatistics
+{
+public:
+
+  /** \brief The counters accumulated for one request */
+  struct RequestCounters
+  {
+    boost::mutex lock;
+    std::map<const char*, unsigned int> counts;
+  };
+  typedef boost::shared_ptr<RequestCounters> RequestCountersPtr;
+
+  /** \brief Get the instance shared by everything in this process */
+  static LatencyStatistics& getInstance();
+
+  /** 
+   * \brief Read the configuration from the node handle and, if enabled, advertise 
+   * the statistics topic and the get_latency_statistics service in its namespace 
+   */
+  void initialize(ros::NodeHandle& node_handle);
+
+  bool isEnabled() const
+  {
+    return __atomic_load_n(&enabled_, __ATOMIC_RELAXED);
+  }
+
+  void setEnabled(bool enabled)
+  {
+    __atomic_store_n(&enabled_, enabled, __ATOMIC_RELAXED);
+  }
+
+  /** \brief Record one sample for the named stage. The name is normally a string literal */
+  void addSample(const char* name, double value);
+
+  /** \brief Increment a counter of the calling thread's request. The name must outlive the request */
+  void incrementCounter(const char* name, unsigned int count = 1);
+
+  /** \brief The counters of the request the calling thread is working on */
+  RequestCountersPtr getRequestCounters();
+
+  /** \brief Make the calling thread count into the given request's counters */
+  void setRequestCounters(const RequestCountersPtr& counters);
+
+  /** \brief Hand the counts of the calling thread to its request */
+  void flushCounters();
+
+  /** 
+   * \brief Record every counter of the calling thread's request as a sample of 
+   * <name>_per_request, reset the counters and publish the statistics if the topic 
+   * has been advertised 
+   */
+  void finishRequest();
+
+  void getStatistics(arm_navigation_msgs::LatencyStatistics& statistics) const;
+
+  void reset();
+
+private:
+
+  LatencyStatistics();
+
+  struct Stage
+  {
+    Stage() : count(0), sum(0.0), max(0.0), next(0) {}
+    unsigned int count;
+    double sum;
+    double max;
+    std::vector<double> window;
+    unsigned int next;
+  };
+
+  void addSampleLocked(const std::string& name, double value);
+
+  bool getStatisticsService(arm_navigation_msgs::GetLatencyStatistics::Request& req,
+                            arm_navigation_msgs::GetLatencyStatistics::Response& res);
+
+  bool enabled_;
+  unsigned int window_size_;
+
+  mutable boost::mutex lock_;
+  std::map<std::string, Stage> stages_;
+  std::set<std::string> counter_names_;
+
+  bool publish_;
+  ros::Publisher statistics_publisher_;
+  ros::ServiceServer statistics_service_;
+};
+
+/**
+ * \brief Times the enclosing scope and records it as a sample of the named stage.
+ * The name must outlive the timer; string literals are the intended use.
+ */
+class ScopedLatencyTimer
+{
+public:
+  ScopedLatencyTimer(const char* name) : 
+    name_(LatencyStatistics::getInstance().isEnabled() ? name : NULL)
+  {
+    if(name_ != NULL) {
+      start_ = ros::WallTime::now();
+    }
+  }
+
+  ~ScopedLatencyTimer()
+  {
+    stop();
+  }
+
+  /** \brief Record the sample now instead of at the end of the scope */
+  void stop()
+  {
+    if(name_ != NULL) {
+      LatencyStatistics::getInstance().addSample(name_, (ros::WallTime::now()-start_).toSec());
+      name_ = NULL;
+    }
+  }
+
+private:
+  const char* name_;
+  ros::WallTime start_;
+};
+
+}
+
+#endif
@@ -37,6 +37,7 @@
 #include "planning_environment/models/collision_models.h"
 #include "planning_environment/models/model_utils.h"
 #include "planning_environment/util/construct_object.h"
+#include "planning_environment/util/latency_statistics.h"
 #include <collision_space/environmentODE.h>
 #include <sstream>
 #include <vector>
@@ -57,6 +58,7 @@ inline static std::string stripTFPrefix(const std::string& s) {
 planning_environment::CollisionModels::CollisionModels(const std::string &description) : RobotModels(description)
 {
   planning_scene_set_ = false;
+  state_pool_ = new planning_models::KinematicStatePool(kmodel_);
   loadCollisionFromParamServer();
 }
 
@@ -65,6 +67,7 @@ planning_environment::CollisionModels::CollisionModels(boost::shared_ptr<urdf::M
                                                        collision_space::EnvironmentModel* ode_collision_model) : RobotModels(urdf, kmodel)
 {
   ode_collision_model_ = ode_collision_model;
+  state_pool_ = new planning_models::KinematicStatePool(kmodel_);
 }
 
 planning_environment::CollisionModels::~CollisionModels(void)
@@ -73,6 +76,7 @@ planning_environment::CollisionModels::~CollisionModels(void)
   deleteAllAttachedObjects();
   shapes::deleteShapeVector(collision_map_shapes_);
   delete ode_collision_model_;
+  delete state_pool_;
 }
 
 void planning_environment::CollisionModels::setupModelFromParamServer(collision_space::EnvironmentModel* model)
@@ -228,6 +232,8 @@ void planning_environment::CollisionModels::loadCollisionFromParamServer()
 planning_models::KinematicState* 
 planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msgs::PlanningScene& planning_scene) {
 
+  ScopedLatencyTimer timer("set_planning_scene");
+
   if(planning_scene_set_) {
     ROS_WARN("Must revert before setting planning scene again");
     return NULL;
@@ -250,11 +256,11 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
     scene_transform_map_[planning_scene.fixed_frame_transforms[i].child_frame_id] = planning_scene.fixed_frame_transforms[i];
   }
 
-  planning_models::KinematicState* state = new planning_models::KinematicState(kmodel_);
+  planning_models::KinematicState* state = state_pool_->getState();
   bool complete = setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);
   if(!complete) {
     ROS_WARN_STREAM("Incomplete robot state in setPlanningScene");
-    delete state;
+    state_pool_->releaseState(state);
     return NULL;
   }
   std::vector<arm_navigation_msgs::CollisionObject> conv_objects;
@@ -264,7 +270,7 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
   for(unsigned int i = 0; i < planning_scene.collision_objects.size(); i++) {
     if(planning_scene.collision_objects[i].operation.operation != arm_navigation_msgs::CollisionObjectOperation::ADD) {
       ROS_WARN_STREAM("Planning scene shouldn't have collision operations other than add");
-      delete state;
+      state_pool_->releaseState(state);
       return NULL;
     }
     conv_objects.push_back(planning_scene.collision_objects[i]);
@@ -273,15 +279,15 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
   for(unsigned int i = 0; i < planning_scene.attached_collision_objects.size(); i++) {
     if(planning_scene.attached_collision_objects[i].object.operation.operation != arm_navigation_msgs::CollisionObjectOperation::ADD) {
       ROS_WARN_STREAM("Planning scene shouldn't have collision operations other than add");
-      delete state;
+      state_pool_->releaseState(state);
       return NULL;
     }
     conv_att_objects.push_back(planning_scene.attached_collision_objects[i]);
     convertAttachedCollisionObjectToNewWorldFrame(*state, conv_att_objects.back());
   }
 
-  //now we delete temp_state to release the lock
-  delete state;
+  //now we release temp_state so it drops the lock
+  state_pool_->releaseState(state);
   
   for(unsigned int i = 0; i < conv_objects.size(); i++) {
     addStaticObject(conv_objects[i]);
@@ -291,7 +297,7 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
   }
 
   //now we create again after adding the attached objects
-  state = new planning_models::KinematicState(kmodel_);
+  state = state_pool_->getState();
   setRobotStateAndComputeTransforms(planning_scene.robot_state, *state);  
 
   //this updates the attached bodies before we mask the collision map
@@ -339,7 +345,7 @@ planning_environment::CollisionModels::setPlanningScene(const arm_navigation_msg
 void planning_environment::CollisionModels::revertPlanningScene(planning_models::KinematicState* ks) {
   bodiesLock();
   planning_scene_set_ = false;
-  delete ks;
+  state_pool_->releaseState(ks);
   deleteAllStaticObjects();
   deleteAllAttachedObjects();
   revertAllowedCollisionToDefault();
@@ -1348,6 +1354,8 @@ void planning_environment::CollisionModels::getCollisionSpaceAttachedCollisionOb
 
 bool planning_environment::CollisionModels::isKinematicStateInCollision(const planning_models::KinematicState& state)                                                                     
 {
+  LatencyStatistics::getInstance().incrementCounter("collision_checks");
+  ScopedLatencyTimer timer("collision_check");
   ode_collision_model_->lock();
   ode_collision_model_->updateRobotModel(&state);
   bool in_coll = ode_collision_model_->isCollision();
@@ -1470,6 +1478,28 @@ bool planning_environment::CollisionModels::isKinematicStateValid(const planning
                                                                   const arm_navigation_msgs::Constraints goal_constraints,
                                                                   const arm_navigation_msgs::Constraints path_constraints,
 								  bool verbose)
+{
+  KinematicConstraintEvaluatorSet goal_constraint_evaluator_set;
+  goal_constraint_evaluator_set.add(goal_constraints.joint_constraints);
+  goal_constraint_evaluator_set.add(goal_constraints.position_constraints);
+  goal_constraint_evaluator_set.add(goal_constraints.orientation_constraints);
+  goal_constraint_evaluator_set.add(goal_constraints.visibility_constraints);
+
+  KinematicConstraintEvaluatorSet path_constraint_evaluator_set;
+  path_constraint_evaluator_set.add(path_constraints.joint_constraints);
+  path_constraint_evaluator_set.add(path_constraints.position_constraints);
+  path_constraint_evaluator_set.add(path_constraints.orientation_constraints);
+  path_constraint_evaluator_set.add(path_constraints.visibility_constraints);
+
+  return isKinematicStateValid(state, joint_names, error_code, goal_constraint_evaluator_set, path_constraint_evaluator_set, verbose);
+}
+
+bool planning_environment::CollisionModels::isKinematicStateValid(const planning_models::KinematicState& state,
+                                                                  const std::vector<std::string>& joint_names,
+                                                                  arm_navigation_msgs::ArmNavigationErrorCodes& error_code,
+                                                                  const KinematicConstraintEvaluatorSet& goal_constraint_evaluator_set,
+                                                                  const KinematicConstraintEvaluatorSet& path_constraint_evaluator_set,
+								  bool verbose)
 {
   if(!state.areJointsWithinBounds(joint_names)) {
     if(verbose) {
@@ -1488,16 +1518,16 @@ bool planning_environment::CollisionModels::isKinematicStateValid(const planning
     error_code.val = error_code.JOINT_LIMITS_VIOLATED;
     return false;
   }
-  if(!doesKinematicStateObeyConstraints(state, path_constraints, false)) {
+  if(!path_constraint_evaluator_set.decide(&state, false)) {
     if(verbose) {
-      doesKinematicStateObeyConstraints(state, path_constraints, true);
+      path_constraint_evaluator_set.decide(&state, true);
     }
     error_code.val = error_code.PATH_CONSTRAINTS_VIOLATED;
     return false;
   }
-  if(!doesKinematicStateObeyConstraints(state, goal_constraints, false)) {
+  if(!goal_constraint_evaluator_set.decide(&state, false)) {
     if(verbose) {
-      doesKinematicStateObeyConstraints(state, goal_constraints, true);
+      goal_constraint_evaluator_set.decide(&state, true);
     }
     error_code.val = error_code.GOAL_CONSTRAINTS_VIOLATED;
     return false;
@@ -1627,8 +1657,16 @@ bool planning_environment::CollisionModels::isJointTrajectoryValid(planning_mode
     return false;
   }
 
+  //the path constraints are compiled once for all the points
+  KinematicConstraintEvaluatorSet emp_goal_constraint_evaluator_set;
+  KinematicConstraintEvaluatorSet path_constraint_evaluator_set;
+  path_constraint_evaluator_set.add(path_constraints.joint_constraints);
+  path_constraint_evaluator_set.add(path_constraints.position_constraints);
+  path_constraint_evaluator_set.add(path_constraints.orientation_constraints);
+  path_constraint_evaluator_set.add(path_constraints.visibility_constraints);
+  path_constraint_evaluator_set.compile(state.getKinematicModel());
+
   //now we can start checking the actual 
-  arm_navigation_msgs::Constraints emp_goal_constraints;
   for(unsigned int i = 0; i < trajectory.points.size(); i++) {
     arm_navigation_msgs::ArmNavigationErrorCodes suc;
     suc.val = error_code.SUCCESS;
@@ -1640,7 +1678,7 @@ bool planning_environment::CollisionModels::isJointTrajectoryValid(planning_mode
     state.setKinematicState(joint_value_map);
 
     if(!isKinematicStateValid(state, trajectory.joint_names, suc, 
-                              emp_goal_constraints, path_constraints)) {
+                              emp_goal_constraint_evaluator_set, path_constraint_evaluator_set)) {
       //this means we return the last error code if we are evaluating the whole trajectory
       error_code = suc;
       trajectory_error_codes.back() = suc;
@@ -41,9 +41,10 @@
 
 static const std::string REGISTER_PLANNING_SCENE_NAME = "register_planning_scene";
 
-planning_environment::CollisionModelsInterface::CollisionModelsInterface(const std::string& description, bool register_with_server)
+planning_environment::CollisionModelsInterface::CollisionModelsInterface(const std::string& description, bool register_with_server, bool advertise_sync_server)
   : CollisionModels(description)
 {
+  action_server_ = NULL;
   planning_scene_state_ = NULL;
 
   set_planning_scene_callback_ = NULL;
@@ -60,9 +61,11 @@ planning_environment::CollisionModelsInterface::CollisionModelsInterface(const s
   }
   
   //need to create action server before we request
-  action_server_ = new actionlib::SimpleActionServer<arm_navigation_msgs::SyncPlanningSceneAction>(priv_nh_, "sync_planning_scene",
-                                                                                                   boost::bind(&CollisionModelsInterface::syncPlanningSceneCallback, this, _1), false);
-  action_server_->start();
+  if(advertise_sync_server) {
+    action_server_ = new actionlib::SimpleActionServer<arm_navigation_msgs::SyncPlanningSceneAction>(priv_nh_, "sync_planning_scene",
+                                                                                                     boost::bind(&CollisionModelsInterface::syncPlanningSceneCallback, this, _1), false);
+    action_server_->start();
+  }
 
   if(register_with_server) {
     env_server_register_client_ = root_nh.serviceClient<std_srvs::Empty>(env_service_name);
@@ -40,24 +40,75 @@
 #include <angles/angles.h>
 #include <cassert>
 
+bool planning_environment::getJointConstraintIndex(const planning_models::KinematicModel *model, const std::string &joint_name,
+                                                   unsigned int &index, bool &continuous)
+{
+  const std::vector<planning_models::KinematicModel::JointModel*>& joint_models = model->getJointModels();
+  for(unsigned int i = 0; i < joint_models.size(); i++) {
+    if(joint_models[i]->getName() == joint_name || joint_models[i]->hasVariable(joint_name)) {
+      if(joint_models[i]->getComputatationOrderMapIndex().empty()) {
+        return false;
+      }
+      index = i;
+      const planning_models::KinematicModel::RevoluteJointModel *revolute_joint = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint_models[i]);
+      continuous = revolute_joint && revolute_joint->continuous_;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool planning_environment::getLinkIndex(const planning_models::KinematicModel *model, const std::string &link_name, unsigned int &index)
+{
+  const std::vector<planning_models::KinematicModel::LinkModel*>& link_models = model->getLinkModels();
+  for(unsigned int i = 0; i < link_models.size(); i++) {
+    if(link_models[i]->getName() == link_name) {
+      index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
 bool planning_environment::JointConstraintEvaluator::use(const arm_navigation_msgs::JointConstraint &jc)
 {
   m_jc     = jc;
   return true;
 }
 
+bool planning_environment::JointConstraintEvaluator::compile(const planning_models::KinematicModel *model)
+{
+  m_model = NULL;
+  if(!getJointConstraintIndex(model, m_jc.joint_name, m_joint_index, m_continuous)) {
+    ROS_WARN_STREAM("No joint in model with name " << m_jc.joint_name);
+    return false;
+  }
+  m_model = model;
+  return true;
+}
+
 bool planning_environment::JointConstraintEvaluator::decide(const planning_models::KinematicState* state, 
                                                             bool verbose) const
 {
-  std::vector<double> cur_joint_values;
-  const planning_models::KinematicState::JointState* joint = state->getJointState(m_jc.joint_name);
-  if(!joint) {
-    ROS_WARN_STREAM("No joint in state with name " << m_jc.joint_name);
+  const planning_models::KinematicState::JointState* joint;
+  bool continuous;
+  if(m_model && state->getKinematicModel() == m_model) {
+    joint = state->getJointStateVector()[m_joint_index];
+    continuous = m_continuous;
+  } else {
+    joint = state->getJointState(m_jc.joint_name);
+    if(!joint) {
+      ROS_WARN_STREAM("No joint in state with name " << m_jc.joint_name);
+      return false;
+    }
+    const planning_models::KinematicModel::RevoluteJointModel *revolute_joint = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint->getJointModel());
+    continuous = revolute_joint && revolute_joint->continuous_;
   }
-  cur_joint_values = joint->getJointStateValues();
+  const std::vector<double>& cur_joint_values = joint->getJointStateValues();
 
   if(cur_joint_values.size() == 0) {
     ROS_WARN_STREAM("Trying to decide joint with no value " << joint->getName());
+    return false;
   }
   if(cur_joint_values.size() > 1) {
     ROS_WARN_STREAM("Trying to decide joint value with more than one value " << joint->getName());
@@ -66,9 +117,7 @@ bool planning_environment::JointConstraintEvaluator::decide(const planning_model
   double current_joint_position = cur_joint_values[0];
   double dif;
   
-  const planning_models::KinematicModel::RevoluteJointModel *revolute_joint = dynamic_cast<const planning_models::KinematicModel::RevoluteJointModel*>(joint->getJointModel());
-
-  if(revolute_joint && revolute_joint->continuous_)
+  if(continuous)
     dif = angles::shortest_angular_distance(m_jc.position,current_joint_position);
   else
     dif = current_joint_position - m_jc.position;
@@ -194,12 +243,35 @@ bool planning_environment::OrientationConstraintEvaluator::use(const arm_navigat
   tf::Quaternion q;
   tf::quaternionMsgToTF(m_oc.orientation,q);
   m_rotation_matrix = tf::Matrix3x3(q);
+  m_rotation_matrix_inverse = m_rotation_matrix.inverse();
   geometry_msgs::Pose id;
   id.orientation.w = 1.0;
   ROS_DEBUG("Orientation constraint: %f %f %f %f",m_oc.orientation.x,m_oc.orientation.y,m_oc.orientation.z,m_oc.orientation.w);
   return true;
 }
 
+bool planning_environment::PositionConstraintEvaluator::compile(const planning_models::KinematicModel *model)
+{
+  m_model = NULL;
+  if(!getLinkIndex(model, m_pc.link_name, m_link_index)) {
+    ROS_WARN_STREAM("No link in model with name " << m_pc.link_name);
+    return false;
+  }
+  m_model = model;
+  return true;
+}
+
+bool planning_environment::OrientationConstraintEvaluator::compile(const planning_models::KinematicModel *model)
+{
+  m_model = NULL;
+  if(!getLinkIndex(model, m_oc.link_name, m_link_index)) {
+    ROS_WARN_STREAM("No link in model with name " << m_oc.link_name);
+    return false;
+  }
+  m_model = model;
+  return true;
+}
+
 void planning_environment::PositionConstraintEvaluator::clear(void)
 {
 }
@@ -211,7 +283,7 @@ void planning_environment::OrientationConstraintEvaluator::clear(void)
 bool planning_environment::PositionConstraintEvaluator::decide(const planning_models::KinematicState  *state,
                                                                bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_pc.link_name);
+  const planning_models::KinematicState::LinkState* link_state = getLinkState(state, m_link_index, m_pc.link_name);
 
   if(!link_state) 
   {
@@ -237,7 +309,7 @@ bool planning_environment::PositionConstraintEvaluator::decide(const planning_mo
 bool planning_environment::OrientationConstraintEvaluator::decide(const planning_models::KinematicState *state,
                                                                   bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_oc.link_name);
+  const planning_models::KinematicState::LinkState* link_state = getLinkState(state, m_link_index, m_oc.link_name);
 
   if(!link_state) 
   {
@@ -251,13 +323,13 @@ bool planning_environment::OrientationConstraintEvaluator::decide(const planning
   tfScalar yaw, pitch, roll;
   if(m_oc.type == m_oc.HEADER_FRAME)
   {
-    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix.inverse();
+    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix_inverse;
     result.getRPY(roll, pitch, yaw);
     //    result.getEulerYPR(yaw, pitch, roll);
   }
   else
   {
-    tf::Matrix3x3 result = m_rotation_matrix.inverse() * link_state->getGlobalLinkTransform().getBasis();
+    tf::Matrix3x3 result = m_rotation_matrix_inverse * link_state->getGlobalLinkTransform().getBasis();
     result.getRPY(roll, pitch, yaw);
   }
   if(fabs(roll) < m_oc.absolute_roll_tolerance &&
@@ -291,12 +363,13 @@ bool planning_environment::OrientationConstraintEvaluator::decide(const planning
 
 void planning_environment::PositionConstraintEvaluator::evaluate(const planning_models::KinematicState* state, double& distPos, bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_pc.link_name);
+  const planning_models::KinematicState::LinkState* link_state = getLinkState(state, m_link_index, m_pc.link_name);
 
   if(!link_state) 
   {
     ROS_WARN_STREAM("No link in state with name " << m_pc.link_name);
     distPos = DBL_MAX;
+    return;
   }
 
   double dx = link_state->getGlobalLinkTransform().getOrigin().x() - m_pc.position.x;
@@ -308,24 +381,25 @@ void planning_environment::PositionConstraintEvaluator::evaluate(const planning_
 
 void planning_environment::OrientationConstraintEvaluator::evaluate(const planning_models::KinematicState* state, double& distAng, bool verbose) const
 {
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(m_oc.link_name);
+  const planning_models::KinematicState::LinkState* link_state = getLinkState(state, m_link_index, m_oc.link_name);
 
   if(!link_state) 
   {
     ROS_WARN_STREAM("No link in state with name " << m_oc.link_name);
     distAng = DBL_MAX;
+    return;
   }
 
   distAng = 0.0;
   tfScalar yaw, pitch, roll;
   if(m_oc.type == m_oc.HEADER_FRAME)
   {
-    tf::Matrix3x3 result = m_rotation_matrix.inverse() * link_state->getGlobalLinkTransform().getBasis();
+    tf::Matrix3x3 result = m_rotation_matrix_inverse * link_state->getGlobalLinkTransform().getBasis();
     result.getEulerYPR(yaw, pitch, roll);
   }
   else
   {
-    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix.inverse();
+    tf::Matrix3x3 result = link_state->getGlobalLinkTransform().getBasis() *  m_rotation_matrix_inverse;
     result.getRPY(roll, pitch, yaw);
   }
   distAng += fabs(yaw); 
@@ -411,14 +485,18 @@ void planning_environment::KinematicConstraintEvaluatorSet::clear(void)
   for (unsigned int i = 0 ; i < m_kce.size() ; ++i)
     delete m_kce[i];
   m_kce.clear();	
+  m_link_kce.clear();
   m_jc.clear();
   m_pc.clear();
   m_oc.clear();
+  m_vc.clear();
+  m_model = NULL;
 }
 	
 bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vector<arm_navigation_msgs::JointConstraint> &jc)
 {
   bool result = true;
+  m_model = NULL;
   for (unsigned int i = 0 ; i < jc.size() ; ++i)
   {
     JointConstraintEvaluator *ev = new JointConstraintEvaluator();
@@ -432,11 +510,13 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
 bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vector<arm_navigation_msgs::PositionConstraint> &pc)
 {
   bool result = true;
+  m_model = NULL;
   for (unsigned int i = 0 ; i < pc.size() ; ++i)
   {
     PositionConstraintEvaluator *ev = new PositionConstraintEvaluator();
     result = result && ev->use(pc[i]);
     m_kce.push_back(ev);
+    m_link_kce.push_back(ev);
     m_pc.push_back(pc[i]);
   }
   return result;
@@ -445,11 +525,13 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
 bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vector<arm_navigation_msgs::OrientationConstraint> &oc)
 {
   bool result = true;
+  m_model = NULL;
   for (unsigned int i = 0 ; i < oc.size() ; ++i)
   {
     OrientationConstraintEvaluator *ev = new OrientationConstraintEvaluator();
     result = result && ev->use(oc[i]);
     m_kce.push_back(ev);
+    m_link_kce.push_back(ev);
     m_oc.push_back(oc[i]);
   }
   return result;
@@ -459,19 +541,70 @@ bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vecto
 bool planning_environment::KinematicConstraintEvaluatorSet::add(const std::vector<arm_navigation_msgs::VisibilityConstraint> &vc)
 {
   bool result = true;
+  m_model = NULL;
   for (unsigned int i = 0 ; i < vc.size() ; ++i)
   {
     VisibilityConstraintEvaluator *ev = new VisibilityConstraintEvaluator();
     result = result && ev->use(vc[i]);
     m_kce.push_back(ev);
+    m_link_kce.push_back(ev);
     m_vc.push_back(vc[i]);
   }
   return result;
 }
 
+bool planning_environment::KinematicConstraintEvaluatorSet::compile(const planning_models::KinematicModel *model)
+{
+  m_model = NULL;
+  m_joint_indices.resize(m_jc.size());
+  m_joint_positions.resize(m_jc.size());
+  m_joint_tolerances_above.resize(m_jc.size());
+  m_joint_tolerances_below.resize(m_jc.size());
+  m_joint_continuous.resize(m_jc.size());
+  
+  bool result = true;
+  for (unsigned int i = 0 ; i < m_jc.size() ; ++i)
+  {
+    bool continuous = false;
+    if (!getJointConstraintIndex(model, m_jc[i].joint_name, m_joint_indices[i], continuous))
+    {
+      ROS_WARN_STREAM("No joint in model with name " << m_jc[i].joint_name);
+      result = false;
+    }
+    m_joint_positions[i] = m_jc[i].position;
+    m_joint_tolerances_above[i] = m_jc[i].tolerance_above;
+    m_joint_tolerances_below[i] = m_jc[i].tolerance_below;
+    m_joint_continuous[i] = continuous;
+  }
+  for (unsigned int i = 0 ; i < m_kce.size() ; ++i)
+    if (!m_kce[i]->compile(model))
+      result = false;
+  
+  if (result)
+    m_model = model;
+  return result;
+}
+
 bool planning_environment::KinematicConstraintEvaluatorSet::decide(const planning_models::KinematicState* state, 
                                                                    bool verbose) const
 {
+  // the compiled path; the individual evaluators are used when details need to be printed
+  if (m_model && !verbose && state->getKinematicModel() == m_model)
+  {
+    const std::vector<planning_models::KinematicState::JointState*>& joint_states = state->getJointStateVector();
+    for (unsigned int i = 0 ; i < m_joint_indices.size() ; ++i)
+    {
+      double value = joint_states[m_joint_indices[i]]->getJointStateValues()[0];
+      double dif = m_joint_continuous[i] ? angles::shortest_angular_distance(m_joint_positions[i], value) : value - m_joint_positions[i];
+      if (dif > m_joint_tolerances_above[i] || dif < -m_joint_tolerances_below[i])
+        return false;
+    }
+    for (unsigned int i = 0 ; i < m_link_kce.size() ; ++i)
+      if (!m_link_kce[i]->decide(state, false))
+        return false;
+    return true;
+  }
+
   for (unsigned int i = 0 ; i < m_kce.size() ; ++i) {
     if (!m_kce[i]->decide(state, verbose)) {
       return false;            
@@ -504,11 +637,21 @@ bool planning_environment::VisibilityConstraintEvaluator::use(const arm_navigati
   tf::poseMsgToTF(m_vc.sensor_pose.pose,m_sensor_offset_pose);
   return true;
 }
+bool planning_environment::VisibilityConstraintEvaluator::compile(const planning_models::KinematicModel *model)
+{
+  m_model = NULL;
+  if(!getLinkIndex(model, m_vc.sensor_pose.header.frame_id, m_link_index)) {
+    ROS_WARN_STREAM("No link in model with name " << m_vc.sensor_pose.header.frame_id);
+    return false;
+  }
+  m_model = model;
+  return true;
+}
 bool planning_environment::VisibilityConstraintEvaluator::decide(const planning_models::KinematicState* state,
                                                                  bool verbose) const
 {
-  std::string link_name = m_vc.sensor_pose.header.frame_id;
-  const planning_models::KinematicState::LinkState* link_state = state->getLinkState(link_name);
+  const std::string& link_name = m_vc.sensor_pose.header.frame_id;
+  const planning_models::KinematicState::LinkState* link_state = getLinkState(state, m_link_index, link_name);
   if(!link_state) {
     ROS_WARN_STREAM("No link state for link " << link_name);
     return false;
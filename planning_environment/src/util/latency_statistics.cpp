@@ -0,0 +1,268 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <planning_environment/util/latency_statistics.h>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+
+namespace
+{
+
+/** \brief Counts of one thread that have not been handed to its request yet */
+struct ThreadCounters
+{
+  ~ThreadCounters()
+  {
+    flush();
+  }
+
+  void flush()
+  {
+    if(counts.empty() || !request) {
+      return;
+    }
+    boost::mutex::scoped_lock lock(request->lock);
+    for(std::map<const char*, unsigned int>::const_iterator it = counts.begin();
+        it != counts.end();
+        it++) {
+      request->counts[it->first] += it->second;
+    }
+    counts.clear();
+  }
+
+  planning_environment::LatencyStatistics::RequestCountersPtr request;
+  std::map<const char*, unsigned int> counts;
+};
+
+boost::thread_specific_ptr<ThreadCounters> thread_counters;
+
+ThreadCounters& getThreadCounters()
+{
+  ThreadCounters* counters = thread_counters.get();
+  if(counters == NULL) {
+    counters = new ThreadCounters();
+    counters->request.reset(new planning_environment::LatencyStatistics::RequestCounters());
+    thread_counters.reset(counters);
+  }
+  return *counters;
+}
+
+}
+
+planning_environment::LatencyStatistics& planning_environment::LatencyStatistics::getInstance()
+{
+  static LatencyStatistics instance;
+  return instance;
+}
+
+planning_environment::LatencyStatistics::LatencyStatistics() : 
+  enabled_(false), 
+  window_size_(1000),
+  publish_(false)
+{
+}
+
+void planning_environment::LatencyStatistics::initialize(ros::NodeHandle& node_handle)
+{
+  bool enabled, publish;
+  int window_size;
+  node_handle.param("latency_statistics/enabled", enabled, false);
+  node_handle.param("latency_statistics/window_size", window_size, 1000);
+  node_handle.param("latency_statistics/publish", publish, true);
+  if(window_size < 1) {
+    ROS_WARN_STREAM("Latency statistics window size must be positive, using 1000");
+    window_size = 1000;
+  }
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    window_size_ = window_size;
+  }
+  if(!enabled) {
+    setEnabled(false);
+    return;
+  }
+  ROS_INFO_STREAM("Recording latency statistics over the last " << window_size << " samples");
+  ros::Publisher statistics_publisher;
+  if(publish) {
+    statistics_publisher = node_handle.advertise<arm_navigation_msgs::LatencyStatistics>("latency_statistics", 1, true);
+  }
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    publish_ = publish;
+    statistics_publisher_ = statistics_publisher;
+  }
+  statistics_service_ = node_handle.advertiseService("get_latency_statistics", 
+                                                     &LatencyStatistics::getStatisticsService, this);
+  setEnabled(true);
+}
+
+void planning_environment::LatencyStatistics::addSample(const char* name, double value)
+{
+  if(!isEnabled()) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(lock_);
+  addSampleLocked(name, value);
+}
+
+void planning_environment::LatencyStatistics::addSampleLocked(const std::string& name, double value)
+{
+  Stage& stage = stages_[name];
+  if(stage.count == 0 || value > stage.max) {
+    stage.max = value;
+  }
+  stage.count++;
+  stage.sum += value;
+  if(stage.window.size() < window_size_) {
+    stage.window.push_back(value);
+  } else {
+    stage.window[stage.next] = value;
+    stage.next = (stage.next+1) % stage.window.size();
+  }
+}
+
+void planning_environment::LatencyStatistics::incrementCounter(const char* name, unsigned int count)
+{
+  if(!isEnabled()) {
+    return;
+  }
+  getThreadCounters().counts[name] += count;
+}
+
+planning_environment::LatencyStatistics::RequestCountersPtr planning_environment::LatencyStatistics::getRequestCounters()
+{
+  return getThreadCounters().request;
+}
+
+void planning_environment::LatencyStatistics::setRequestCounters(const RequestCountersPtr& counters)
+{
+  ThreadCounters& thread = getThreadCounters();
+  thread.flush();
+  thread.request = counters;
+}
+
+void planning_environment::LatencyStatistics::flushCounters()
+{
+  if(thread_counters.get() != NULL) {
+    thread_counters->flush();
+  }
+}
+
+void planning_environment::LatencyStatistics::finishRequest()
+{
+  if(!isEnabled()) {
+    return;
+  }
+  ThreadCounters& thread = getThreadCounters();
+  thread.flush();
+  // the same name may have been counted under different pointers
+  std::map<std::string, unsigned int> totals;
+  {
+    boost::mutex::scoped_lock lock(thread.request->lock);
+    for(std::map<const char*, unsigned int>::const_iterator it = thread.request->counts.begin();
+        it != thread.request->counts.end();
+        it++) {
+      totals[it->first] += it->second;
+    }
+    thread.request->counts.clear();
+  }
+  ros::Publisher statistics_publisher;
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    for(std::map<std::string, unsigned int>::const_iterator it = totals.begin();
+        it != totals.end();
+        it++) {
+      counter_names_.insert(it->first);
+    }
+    // counters this request did not touch still count as a zero sample
+    for(std::set<std::string>::const_iterator it = counter_names_.begin();
+        it != counter_names_.end();
+        it++) {
+      std::map<std::string, unsigned int>::const_iterator total = totals.find(*it);
+      addSampleLocked(*it+"_per_request", total == totals.end() ? 0 : total->second);
+    }
+    if(publish_) {
+      statistics_publisher = statistics_publisher_;
+    }
+  }
+  if(statistics_publisher) {
+    arm_navigation_msgs::LatencyStatistics statistics;
+    getStatistics(statistics);
+    statistics_publisher.publish(statistics);
+  }
+}
+
+void planning_environment::LatencyStatistics::getStatistics(arm_navigation_msgs::LatencyStatistics& statistics) const
+{
+  statistics.header.stamp = ros::Time::now();
+  statistics.node_name = ros::this_node::getName();
+  statistics.stages.clear();
+
+  boost::mutex::scoped_lock lock(lock_);
+  std::vector<double> sorted;
+  for(std::map<std::string, Stage>::const_iterator it = stages_.begin();
+      it != stages_.end();
+      it++) {
+    const Stage& stage = it->second;
+    arm_navigation_msgs::LatencyStageStatistics stage_statistics;
+    stage_statistics.name = it->first;
+    stage_statistics.count = stage.count;
+    if(stage.count > 0) {
+      stage_statistics.mean = stage.sum/stage.count;
+      stage_statistics.max = stage.max;
+      sorted = stage.window;
+      std::sort(sorted.begin(), sorted.end());
+      stage_statistics.p50 = sorted[(sorted.size()-1)/2];
+      stage_statistics.p99 = sorted[((sorted.size()-1)*99)/100];
+    }
+    statistics.stages.push_back(stage_statistics);
+  }
+}
+
+void planning_environment::LatencyStatistics::reset()
+{
+  boost::mutex::scoped_lock lock(lock_);
+  stages_.clear();
+  counter_names_.clear();
+}
+
+bool planning_environment::LatencyStatistics::getStatisticsService(arm_navigation_msgs::GetLatencyStatistics::Request& req,
+                                                                    arm_navigation_msgs::GetLatencyStatistics::Response& res)
+{
+  getStatistics(res.statistics);
+  if(req.reset) {
+    reset();
+  }
+  return true;
+}
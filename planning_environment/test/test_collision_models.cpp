@@ -662,6 +662,65 @@ TEST_F(TestCollisionModels, TestTrajectoryValidity)
   EXPECT_EQ(error_code.val, error_code.COLLISION_CONSTRAINTS_VIOLATED);
 }
 
+TEST_F(TestCollisionModels, TestCompiledConstraints)
+{
+  planning_environment::CollisionModels cm("robot_description");
+
+  planning_models::KinematicState kin_state(cm.getKinematicModel());
+  kin_state.setKinematicStateToDefault();
+
+  arm_navigation_msgs::Constraints constraints;
+  constraints.joint_constraints.resize(2);
+  constraints.joint_constraints[0].joint_name = "r_shoulder_pan_joint";
+  constraints.joint_constraints[0].position = -1.0;
+  constraints.joint_constraints[0].tolerance_below = 0.1;
+  constraints.joint_constraints[0].tolerance_above = 0.1;
+  //continuous joint, checked across the wrap
+  constraints.joint_constraints[1].joint_name = "r_forearm_roll_joint";
+  constraints.joint_constraints[1].position = M_PI-.05;
+  constraints.joint_constraints[1].tolerance_below = 0.1;
+  constraints.joint_constraints[1].tolerance_above = 0.1;
+
+  constraints.orientation_constraints.resize(1);
+  constraints.orientation_constraints[0].link_name = "r_wrist_roll_link";
+  constraints.orientation_constraints[0].orientation.w = 1.0;
+  constraints.orientation_constraints[0].absolute_roll_tolerance = M_PI;
+  constraints.orientation_constraints[0].absolute_pitch_tolerance = M_PI;
+  constraints.orientation_constraints[0].absolute_yaw_tolerance = M_PI;
+
+  planning_environment::KinematicConstraintEvaluatorSet by_name;
+  by_name.add(constraints.joint_constraints);
+  by_name.add(constraints.orientation_constraints);
+
+  planning_environment::KinematicConstraintEvaluatorSet compiled;
+  compiled.add(constraints.joint_constraints);
+  compiled.add(constraints.orientation_constraints);
+  ASSERT_TRUE(compiled.compile(cm.getKinematicModel()));
+
+  std::map<std::string, double> jm;
+  for(unsigned int i = 0; i < 100; i++) {
+    jm["r_shoulder_pan_joint"] = -1.2+.004*i;
+    jm["r_forearm_roll_joint"] = -M_PI+.0013*i;
+    kin_state.setKinematicState(jm);
+    EXPECT_EQ(by_name.decide(&kin_state), compiled.decide(&kin_state)) << i;
+  }
+
+  jm["r_shoulder_pan_joint"] = -1.0;
+  jm["r_forearm_roll_joint"] = -M_PI+.01;
+  kin_state.setKinematicState(jm);
+  EXPECT_TRUE(compiled.decide(&kin_state));
+
+  jm["r_forearm_roll_joint"] = 0.0;
+  kin_state.setKinematicState(jm);
+  EXPECT_FALSE(compiled.decide(&kin_state));
+
+  //names not in the model can't be compiled
+  constraints.joint_constraints[0].joint_name = "no_such_joint";
+  planning_environment::KinematicConstraintEvaluatorSet bad;
+  bad.add(constraints.joint_constraints);
+  EXPECT_FALSE(bad.compile(cm.getKinematicModel()));
+}
+
 TEST_F(TestCollisionModels, TestConversionFunctionsForObjects)
 {
 
@@ -43,12 +43,17 @@
 namespace planning_models
 {
 
+class KinematicStatePool;
+
 /** \brief Definition of a kinematic state - the parts of the robot
     state which can change.  It is not thread safe, however multiple 
-    instances can be created */
+    instances can be created.  The joint and link states are stored
+    contiguously in a single arena laid out in model order */
 class KinematicState 
 {
 
+  friend class KinematicStatePool;
+
 public:
   
   class JointState; /** \brief Forward definition of a joint state */;
@@ -190,6 +195,10 @@ public:
     //updates all attached bodies given set link transforms
     void updateAttachedBodies();
 
+    /** \brief Rebuild the attached body states from the bodies
+        currently attached to the link model */
+    void resetAttachedBodyStates();
+
     const KinematicModel::LinkModel* getLinkModel() const 
     {
       return link_model_;
@@ -490,10 +499,23 @@ public:
   
 private:
 
+  /** \brief Construct the joint and link states in the arena and build the lookup tables */
+  void buildStates();
+
+  /** \brief Collect the attached body states of all links */
+  void setAttachedBodyStates();
+
   void setLinkStatesParents();
 
   const KinematicModel* kinematic_model_;
 
+  /** \brief Whether this state currently holds the model's shared lock;
+      states idling in a KinematicStatePool do not */
+  bool model_locked_;
+
+  /** \brief Storage for all joint states followed by all link states */
+  char* arena_;
+
   unsigned int dimension_;
   std::map<std::string, unsigned int> kinematic_state_index_map_;
 
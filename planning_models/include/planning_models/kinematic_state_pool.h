@@ -0,0 +1,94 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#ifndef PLANNING_MODELS_KINEMATIC_STATE_POOL_
+#define PLANNING_MODELS_KINEMATIC_STATE_POOL_
+
+#include "kinematic_state.h"
+#include <boost/thread/mutex.hpp>
+
+namespace planning_models
+{
+
+/** \brief A thread-safe pool of kinematic states for a single model.
+    States handed out by getState() are reset to the values a freshly
+    constructed state would have; states returned with releaseState()
+    keep their storage so that the next request does not allocate.
+
+    Idle states do not hold the model's shared lock, so attached
+    bodies may be added to or removed from the model while states are
+    pooled; the attached body states are rebuilt when a state is
+    handed out again.  The pool must be destroyed before the model. */
+class KinematicStatePool
+{
+public:
+
+  /** \brief Create a pool for \e kinematic_model that keeps at most
+      \e max_idle_states states around between requests */
+  KinematicStatePool(const KinematicModel* kinematic_model, unsigned int max_idle_states = 4);
+
+  ~KinematicStatePool(void);
+
+  /** \brief Get a state for the model, reusing an idle one if available.
+      The caller must give the state back with releaseState() */
+  KinematicState* getState(void);
+
+  /** \brief Return a state obtained from getState() to the pool */
+  void releaseState(KinematicState* state);
+
+  /** \brief The number of states currently waiting to be reused */
+  unsigned int getIdleStateCount(void) const;
+
+  const KinematicModel* getKinematicModel(void) const
+  {
+    return kinematic_model_;
+  }
+
+private:
+
+  const KinematicModel* kinematic_model_;
+
+  unsigned int max_idle_states_;
+
+  /** \brief The values of a freshly constructed state, used to reset reused states */
+  std::vector<double> default_values_;
+
+  std::vector<KinematicState*> idle_states_;
+
+  mutable boost::mutex lock_;
+};
+
+}
+
+#endif
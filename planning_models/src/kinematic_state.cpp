@@ -36,18 +36,71 @@
 
 #include <planning_models/kinematic_state.h>
 #include <ros/console.h>
+#include <new>
+
+namespace
+{
+// offset of the link states within the arena, rounded up so that the
+// transforms they contain stay 16-byte aligned
+inline std::size_t linkStateArenaOffset(std::size_t num_joints)
+{
+  std::size_t joint_bytes = num_joints*sizeof(planning_models::KinematicState::JointState);
+  return (joint_bytes + 15) & ~static_cast<std::size_t>(15);
+}
+}
 
 planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_model) :
-  kinematic_model_(kinematic_model), dimension_(0)
+  kinematic_model_(kinematic_model), model_locked_(true), arena_(NULL), dimension_(0)
+{
+  kinematic_model_->sharedLock();
+  buildStates();
+}
+
+planning_models::KinematicState::KinematicState(const KinematicState& ks) :
+  kinematic_model_(ks.getKinematicModel()), model_locked_(true), arena_(NULL), dimension_(0)
 {
   kinematic_model_->sharedLock();
+  buildStates();
+
+  //actually setting values
+  std::vector<double> current_joint_values;
+  ks.getKinematicStateValues(current_joint_values);
+  setKinematicState(current_joint_values);
+}
 
+planning_models::KinematicState::~KinematicState() 
+{
+  if(model_locked_) {
+    kinematic_model_->sharedUnlock();
+  }
+  for(std::map<std::string, JointStateGroup*>::iterator it = joint_state_group_map_.begin();
+      it != joint_state_group_map_.end();
+      it++) {
+    delete it->second;
+  }
+  for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
+    link_state_vector_[i]->~LinkState();
+  }
+  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
+    joint_state_vector_[i]->~JointState();
+  }
+  ::operator delete(arena_);
+}
+
+void planning_models::KinematicState::buildStates()
+{
   const std::vector<KinematicModel::JointModel*>& joint_model_vector = kinematic_model_->getJointModels();
+  const std::vector<KinematicModel::LinkModel*>& link_model_vector = kinematic_model_->getLinkModels();
+
+  std::size_t link_offset = linkStateArenaOffset(joint_model_vector.size());
+  arena_ = static_cast<char*>(::operator new(link_offset + link_model_vector.size()*sizeof(LinkState)));
+  JointState* joint_states = reinterpret_cast<JointState*>(arena_);
+  LinkState* link_states = reinterpret_cast<LinkState*>(arena_ + link_offset);
+
   joint_state_vector_.resize(joint_model_vector.size());
-  //joint_index_location_.resize(joint_model_vector.size());
   unsigned int vector_index_counter = 0;
   for(unsigned int i = 0; i < joint_model_vector.size(); i++) {
-    joint_state_vector_[i] = new JointState(joint_model_vector[i]);
+    joint_state_vector_[i] = new (joint_states + i) JointState(joint_model_vector[i]);
     joint_state_map_[joint_state_vector_[i]->getName()] = joint_state_vector_[i];
     unsigned int joint_dim = joint_state_vector_[i]->getDimension();
     dimension_ += joint_dim;
@@ -58,15 +111,12 @@ planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_
     }
     vector_index_counter += joint_dim;
   }
-  const std::vector<KinematicModel::LinkModel*>& link_model_vector = kinematic_model_->getLinkModels();
   link_state_vector_.resize(link_model_vector.size());
   for(unsigned int i = 0; i < link_model_vector.size(); i++) {
-    link_state_vector_[i] = new LinkState(link_model_vector[i]);
+    link_state_vector_[i] = new (link_states + i) LinkState(link_model_vector[i]);
     link_state_map_[link_state_vector_[i]->getName()] = link_state_vector_[i];
-    for(unsigned int j = 0; j < link_state_vector_[i]->getAttachedBodyStateVector().size(); j++) {
-      attached_body_state_vector_.push_back(link_state_vector_[i]->getAttachedBodyStateVector()[j]);
-    }
   }
+  setAttachedBodyStates();
   setLinkStatesParents();
 
   //now make joint_state_groups
@@ -78,64 +128,14 @@ planning_models::KinematicState::KinematicState(const KinematicModel* kinematic_
   }
 }
 
-planning_models::KinematicState::KinematicState(const KinematicState& ks) :
-  kinematic_model_(ks.getKinematicModel()), dimension_(0)
+void planning_models::KinematicState::setAttachedBodyStates()
 {
-  kinematic_model_->sharedLock();
-  const std::vector<JointState*>& joint_state_vector = ks.getJointStateVector();
-  unsigned int vector_index_counter = 0;
-  joint_state_vector_.resize(joint_state_vector.size());
-  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
-    joint_state_vector_[i] = new JointState(joint_state_vector[i]->getJointModel());
-    joint_state_map_[joint_state_vector_[i]->getName()] = joint_state_vector_[i];
-    const std::vector<std::string>& name_order = joint_state_vector_[i]->getJointStateNameOrder();
-    for(unsigned int j = 0; j < name_order.size(); j++) {
-      joint_state_map_[name_order[j]] = joint_state_vector_[i];
-      kinematic_state_index_map_[name_order[j]] = vector_index_counter+j;
-    }
-    unsigned int joint_dim = joint_state_vector_[i]->getDimension();
-    dimension_ += joint_dim;
-    vector_index_counter += joint_dim;
-    //joint_index_location_[i] = vector_index_counter;
-    //vector_index_counter += joint_dim;
-  }
-  const std::vector<LinkState*>& link_state_vector = ks.getLinkStateVector();
-  link_state_vector_.resize(link_state_vector.size());
-  for(unsigned int i = 0; i < link_state_vector.size(); i++) {
-    link_state_vector_[i] = new LinkState(link_state_vector[i]->getLinkModel());
-    link_state_map_[link_state_vector_[i]->getName()] = link_state_vector_[i];
+  attached_body_state_vector_.clear();
+  for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
     for(unsigned int j = 0; j < link_state_vector_[i]->getAttachedBodyStateVector().size(); j++) {
       attached_body_state_vector_.push_back(link_state_vector_[i]->getAttachedBodyStateVector()[j]);
     }
   }
-  setLinkStatesParents();
-  
-  const std::map<std::string, JointStateGroup*>& joint_state_groups_map = ks.getJointStateGroupMap();
-  for(std::map<std::string, JointStateGroup*>::const_iterator it = joint_state_groups_map.begin();
-      it != joint_state_groups_map.end();
-      it++) {
-    joint_state_group_map_[it->first] = new JointStateGroup(it->second->getJointModelGroup(), this);
-  }
-  //actually setting values
-  std::map<std::string, double> current_joint_values;
-  ks.getKinematicStateValues(current_joint_values);
-  setKinematicState(current_joint_values);
-}
-
-planning_models::KinematicState::~KinematicState() 
-{
-  kinematic_model_->sharedUnlock();
-  for(unsigned int i = 0; i < joint_state_vector_.size(); i++) {
-    delete joint_state_vector_[i];
-  }
-  for(unsigned int i = 0; i < link_state_vector_.size(); i++) {
-    delete link_state_vector_[i];
-  }
-  for(std::map<std::string, JointStateGroup*>::iterator it = joint_state_group_map_.begin();
-      it != joint_state_group_map_.end();
-      it++) {
-    delete it->second;
-  }
 }
 
 bool planning_models::KinematicState::setKinematicState(const std::vector<double>& joint_state_values) {
@@ -515,6 +515,21 @@ planning_models::KinematicState::LinkState::LinkState(const planning_models::Kin
 {
   global_link_transform_.setIdentity();
   global_collision_body_transform_.setIdentity();
+  resetAttachedBodyStates();
+}
+
+planning_models::KinematicState::LinkState::~LinkState() 
+{
+  for(unsigned int i = 0; i < attached_body_state_vector_.size(); i++) {
+    delete attached_body_state_vector_[i];
+  }
+}
+
+void planning_models::KinematicState::LinkState::resetAttachedBodyStates()
+{
+  for(unsigned int i = 0; i < attached_body_state_vector_.size(); i++) {
+    delete attached_body_state_vector_[i];
+  }
   const std::vector<planning_models::KinematicModel::AttachedBodyModel*>& attached_body_vector = link_model_->getAttachedBodyModels();
   attached_body_state_vector_.resize(attached_body_vector.size());
   unsigned int j = 0;
@@ -525,13 +540,6 @@ planning_models::KinematicState::LinkState::LinkState(const planning_models::Kin
   }
 }
 
-planning_models::KinematicState::LinkState::~LinkState() 
-{
-  for(unsigned int i = 0; i < attached_body_state_vector_.size(); i++) {
-    delete attached_body_state_vector_[i];
-  }
-}
-
 void planning_models::KinematicState::LinkState::computeTransform() {
   tf::Transform ident;
   ident.setIdentity();
@@ -0,0 +1,123 @@
+/*********************************************************************
+* Software License Agreement (BSD License)
+* 
+*  Copyright (c) 2011, Willow Garage, Inc.
+*  All rights reserved.
+* 
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+* 
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+* 
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*********************************************************************/
+
+#include <planning_models/kinematic_state_pool.h>
+#include <ros/console.h>
+
+planning_models::KinematicStatePool::KinematicStatePool(const KinematicModel* kinematic_model, 
+                                                        unsigned int max_idle_states) :
+  kinematic_model_(kinematic_model), max_idle_states_(max_idle_states)
+{
+}
+
+planning_models::KinematicStatePool::~KinematicStatePool(void)
+{
+  boost::mutex::scoped_lock lock(lock_);
+  for(unsigned int i = 0; i < idle_states_.size(); i++) {
+    delete idle_states_[i];
+  }
+  idle_states_.clear();
+}
+
+planning_models::KinematicState* planning_models::KinematicStatePool::getState(void)
+{
+  KinematicState* state = NULL;
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    if(!idle_states_.empty()) {
+      state = idle_states_.back();
+      idle_states_.pop_back();
+    }
+  }
+
+  if(state == NULL) {
+    state = new KinematicState(kinematic_model_);
+    boost::mutex::scoped_lock lock(lock_);
+    if(default_values_.empty()) {
+      state->getKinematicStateValues(default_values_);
+    }
+    return state;
+  }
+
+  kinematic_model_->sharedLock();
+  state->model_locked_ = true;
+
+  //attached bodies may have changed while the state was idle; the old
+  //attached body models may be gone, so the states are always rebuilt
+  bool attached_changed = !state->attached_body_state_vector_.empty();
+  const std::vector<KinematicState::LinkState*>& link_states = state->link_state_vector_;
+  for(unsigned int i = 0; i < link_states.size(); i++) {
+    if(!link_states[i]->getAttachedBodyStateVector().empty() ||
+       !link_states[i]->getLinkModel()->getAttachedBodyModels().empty()) {
+      link_states[i]->resetAttachedBodyStates();
+      attached_changed = true;
+    }
+  }
+  if(attached_changed) {
+    state->setAttachedBodyStates();
+  }
+
+  std::vector<double> default_values;
+  {
+    boost::mutex::scoped_lock lock(lock_);
+    default_values = default_values_;
+  }
+  state->setKinematicState(default_values);
+  return state;
+}
+
+void planning_models::KinematicStatePool::releaseState(KinematicState* state)
+{
+  if(state == NULL) return;
+  if(state->getKinematicModel() != kinematic_model_) {
+    ROS_WARN("Kinematic state released to a pool for a different model");
+    delete state;
+    return;
+  }
+  boost::mutex::scoped_lock lock(lock_);
+  if(idle_states_.size() >= max_idle_states_) {
+    lock.unlock();
+    delete state;
+    return;
+  }
+  kinematic_model_->sharedUnlock();
+  state->model_locked_ = false;
+  idle_states_.push_back(state);
+}
+
+unsigned int planning_models::KinematicStatePool::getIdleStateCount(void) const
+{
+  boost::mutex::scoped_lock lock(lock_);
+  return idle_states_.size();
+}
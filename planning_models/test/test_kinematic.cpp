@@ -36,6 +36,7 @@
 
 #include <planning_models/kinematic_model.h>
 #include <planning_models/kinematic_state.h>
+#include <planning_models/kinematic_state_pool.h>
 #include <gtest/gtest.h>
 #include <sstream>
 #include <ctype.h>
@@ -503,6 +504,82 @@ TEST(FK, OneRobot)
 
   delete model;
 }
+TEST(StatePool, ReuseAndAttach)
+{
+  static const std::string MODEL2 = 
+    "<?xml version=\"1.0\" ?>" 
+    "<robot name=\"myrobot\">" 
+    "  <link name=\"base_link\">"
+    "    <collision name=\"base_collision\">"
+    "    <geometry name=\"base_collision_geom\">"
+    "      <box size=\"0.65 0.65 0.23\"/>"
+    "    </geometry>"
+    "    </collision>"
+    "   </link>"
+    "</robot>";
+
+  std::vector<planning_models::KinematicModel::MultiDofConfig> multi_dof_configs;
+  planning_models::KinematicModel::MultiDofConfig config("base_joint");
+  config.type = "Planar";
+  config.parent_frame_id = "odom_combined";
+  config.child_frame_id = "base_link";
+  multi_dof_configs.push_back(config);
+
+  urdf::Model urdfModel;
+  urdfModel.initString(MODEL2);
+
+  std::vector<planning_models::KinematicModel::GroupConfig> gcs;
+  planning_models::KinematicModel* model = new planning_models::KinematicModel(urdfModel,gcs,multi_dof_configs);
+
+  {
+    planning_models::KinematicStatePool pool(model, 1);
+
+    planning_models::KinematicState* state = pool.getState();
+    std::map<std::string, double> joint_values;
+    joint_values["planar_x"]=10.0;
+    joint_values["planar_y"]=8.0;
+    joint_values["planar_th"]=0.0;
+    state->setKinematicState(joint_values);
+    EXPECT_NEAR(10.0, state->getLinkState("base_link")->getGlobalLinkTransform().getOrigin().x(), 1e-5);
+    
+    pool.releaseState(state);
+    EXPECT_EQ(1u, pool.getIdleStateCount());
+
+    //idle states don't hold the model lock, so attaching must not block
+    std::vector<shapes::Shape*> shape_vector(1, new shapes::Box(.1,.1,.1));
+    tf::Transform ident;
+    ident.setIdentity();
+    std::vector<tf::Transform> poses(1, ident);
+    std::vector<std::string> touch_links;
+    model->addAttachedBodyModel("base_link", 
+                                new planning_models::KinematicModel::AttachedBodyModel(model->getLinkModel("base_link"),
+                                                                                       "box",
+                                                                                       poses,
+                                                                                       touch_links,
+                                                                                       shape_vector));
+    
+    planning_models::KinematicState* reused = pool.getState();
+    EXPECT_EQ(state, reused);
+    EXPECT_EQ(0u, pool.getIdleStateCount());
+    EXPECT_NEAR(0.0, reused->getLinkState("base_link")->getGlobalLinkTransform().getOrigin().x(), 1e-5);
+    ASSERT_EQ(1u, reused->getAttachedBodyStateVector().size());
+    EXPECT_EQ(std::string("box"), reused->getAttachedBodyStateVector()[0]->getName());
+
+    //a second outstanding state is built fresh, and the pool only keeps one
+    planning_models::KinematicState* other = pool.getState();
+    EXPECT_NE(reused, other);
+    pool.releaseState(reused);
+    pool.releaseState(other);
+    EXPECT_EQ(1u, pool.getIdleStateCount());
+
+    model->clearAllAttachedBodyModels();
+    reused = pool.getState();
+    EXPECT_EQ(0u, reused->getAttachedBodyStateVector().size());
+    pool.releaseState(reused);
+  }
+  delete model;
+}
+
 int main(int argc, char **argv)
 {
   testing::InitGoogleTest(&argc, argv);
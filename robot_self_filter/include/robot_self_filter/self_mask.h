@@ -67,11 +67,13 @@ namespace robot_self_filter
           SeeLink(void)
           {
             body = unscaledBody = NULL;
+            shape = NULL;
           }
             
           std::string   name;
           bodies::Body *body;
           bodies::Body *unscaledBody;
+          shapes::Shape *shape;
           tf::Transform   constTransf;
           double        volume;
         };
@@ -123,7 +125,36 @@ namespace robot_self_filter
          */
         void maskIntersection (const pcl::PointCloud<pcl::PointXYZ>& data_in, const tf::Vector3 &sensor, const double min_sensor_dist,
                   std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &intersectionCallback = NULL);
+
+        /** \brief Compute the intersection mask for an organized
+            pointcloud, such as the ones produced by depth
+            cameras. Instead of casting a ray from every point, the
+            padded robot bodies are rasterized into a depth buffer
+            as seen from the sensor, and each point is classified by
+            comparing its range against that buffer. Clouds that are
+            not organized, or whose pixels do not follow a pinhole
+            projection centered at the sensor, are passed on to
+            maskIntersection(). For SHADOW points, the callback
+            receives the point where the pixel's ray leaves the
+            nearest body.
+         */
+        void maskIntersectionOrganized (const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::string &sensor_frame, const double min_sensor_dist,
+                  std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &intersectionCallback = NULL);
         
+        /** \brief Compute the intersection mask for a pointcloud
+            whose points were acquired at different times, such as a
+            tilting laser sweep. \e time_offsets holds the acquisition
+            time of every point, in seconds relative to the cloud's
+            stamp. Points are grouped in slices of \e slice_duration
+            seconds, and each slice is masked against the robot and
+            sensor posed as they were in the middle of the slice.
+            Slices are processed in parallel. The callback, if any,
+            is called after all slices are done.
+         */
+        void maskIntersectionDeskewed (const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::vector<double> &time_offsets,
+                  const std::string &sensor_frame, const double min_sensor_dist, const double slice_duration,
+                  std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &intersectionCallback = NULL);
+
         /** \brief Assume subsequent calls to getMaskX() will be in the frame passed to this function.
          *   The frame in which the sensor is located is optional */
         void assumeFrame (const std::string &frame_id, const ros::Time &stamp);
@@ -164,14 +195,42 @@ namespace robot_self_filter
         /** \brief Configure the filter. */
         bool configure (const std::vector<LinkInfo> &links);
         
+        /** \brief Free the copies of the bodies used for masking slices in parallel. */
+        void freeSliceBodies (void);
+
+        /** \brief Make sure there are \e count copies of the bodies to pose independently. */
+        void createSliceBodies (unsigned int count);
+        
         /** \brief Compute bounding spheres for the checked robot links. */
         void computeBoundingSpheres (void);
+
+        /** \brief Look up the pose of every checked link and the
+            position of the sensor in \e frame_id at \e stamp. Links
+            that cannot be looked up get the identity pose. */
+        bool lookupPoses (const std::string &frame_id, const ros::Time &stamp, const std::string &sensor_frame,
+                          std::vector<tf::Transform> &link_poses, tf::Vector3 &sensor_pos) const;
+
+        /** \brief Compute the intersection mask value of a point for
+            a set of posed links, seen from \e sensor_pos. \e bound
+            encloses all the link bodies. */
+        int classifyIntersection (const std::vector<SeeLink> &links, const bodies::BoundingSphere &bound, const tf::Vector3 &sensor_pos,
+                                  const tf::Vector3 &pt, const boost::function<void(const tf::Vector3&)> &callback) const;
         
         /** \brief Perform the actual mask computation. */
         void maskAuxContainment (const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask);
 
         /** \brief Perform the actual mask computation. */
         void maskAuxIntersection (const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback);
+
+        /** \brief Fit the projection that maps directions from the
+            sensor to (column, row, 1) pixel coordinates of an
+            organized cloud, up to scale. Returns false if the cloud
+            does not follow such a projection. */
+        bool computeImageProjection (const pcl::PointCloud<pcl::PointXYZ>& data_in, tf::Matrix3x3 &projection) const;
+
+        /** \brief Perform the mask computation using a depth buffer. */
+        void maskAuxIntersectionOrganized (const pcl::PointCloud<pcl::PointXYZ>& data_in, const tf::Matrix3x3 &projection,
+                                           std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback);
         
         tf::TransformListener               &tf_;
         ros::NodeHandle                     nh_;
@@ -180,8 +239,16 @@ namespace robot_self_filter
         double                              min_sensor_dist_;
         
         std::vector<SeeLink>                bodies_;
+
+        /** \brief Copies of bodies_ (sharing their shapes) used when several robot poses are checked at once */
+        std::vector< std::vector<SeeLink> > slice_bodies_;
         std::vector<double>                 bspheresRadius2_;
         std::vector<bodies::BoundingSphere> bspheres_;
+
+        /** \brief Depth buffer: range from the sensor at which each
+            pixel's ray enters and leaves the nearest padded body */
+        std::vector<float>                  near_depth_;
+        std::vector<float>                  far_depth_;
     };
 }
 
@@ -48,6 +48,7 @@ namespace filters
       SelfFilter (ros::NodeHandle nh) : nh_(nh)
       {
         nh_.param<double> ("min_sensor_dist", min_sensor_dist_, 0.01);
+        nh_.param<bool> ("depth_image_mode", depth_image_mode_, false);
         double default_padding, default_scale;
         nh_.param<double> ("self_see_default_padding", default_padding, .01);
         nh_.param<double> ("self_see_default_scale", default_scale, 1.0);
@@ -163,7 +164,7 @@ namespace filters
         } 
         else 
         {
-          sm_->maskIntersection (data_in, sensor_frame_, min_sensor_dist_, keep);
+          computeMask (data_in, keep);
         }	
         fillResult (data_in, keep, data_out);
         return (true);
@@ -188,13 +189,23 @@ namespace filters
         } 
         else 
         {
-          sm_->maskIntersection (data_in, sensor_frame_, min_sensor_dist_, keep);
+          computeMask (data_in, keep);
         }
         fillResult (data_in, keep, data_out);
         fillDiff (data_in,keep,data_diff);
         return (true);
       }
 
+      /** \brief Compute the intersection mask; with depth_image_mode
+          set, organized clouds are masked against a depth buffer */
+      void computeMask (const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &keep)
+      {
+        if (depth_image_mode_)
+          sm_->maskIntersectionOrganized (data_in, sensor_frame_, min_sensor_dist_, keep);
+        else
+          sm_->maskIntersection (data_in, sensor_frame_, min_sensor_dist_, keep);
+      }
+
       void fillDiff (const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::vector<int> &keep, pcl::PointCloud<pcl::PointXYZ>& data_out)
       {
         const unsigned int np = data_in.points.size ();
@@ -325,6 +336,7 @@ namespace filters
       std::string sensor_frame_;
       std::string annotate_;
       double min_sensor_dist_;
+      bool depth_image_mode_;
   };
 }
 
@@ -41,6 +41,7 @@
 #include <message_filters/subscriber.h>
 #include <pcl_conversions/pcl_conversions.h>
 #include <pcl/filters/voxel_grid.h>
+#include <cstring>
 
 class SelfFilter
 {
@@ -49,6 +50,10 @@ class SelfFilter
     {
       nh_.param<std::string> ("sensor_frame", sensor_frame_, std::string ());
       nh_.param<double> ("subsample_value", subsample_param_, 0.01);
+      nh_.param<bool> ("depth_image_mode", depth_image_mode_, false);
+      nh_.param<std::string> ("point_time_field", point_time_field_, std::string ());
+      nh_.param<double> ("deskew_slice_duration", deskew_slice_duration_, 0.05);
+      nh_.param<double> ("min_sensor_dist", min_sensor_dist_, 0.01);
       self_filter_ = new filters::SelfFilter<pcl::PointCloud<pcl::PointXYZ> > (nh_);
 
       sub_ = new message_filters::Subscriber<sensor_msgs::PointCloud2> (root_handle_, "cloud_in", 1);	
@@ -79,6 +84,41 @@ class SelfFilter
     }
       
   private:
+    /** \brief Read the acquisition time of every point, relative to
+        the cloud stamp, from a FLOAT32 or FLOAT64 field */
+    bool getPointTimes (const sensor_msgs::PointCloud2 &cloud, const std::string &field_name, std::vector<double> &times)
+    {
+      for (unsigned int f = 0 ; f < cloud.fields.size () ; ++f)
+      {
+        const sensor_msgs::PointField &field = cloud.fields[f];
+        if (field.name != field_name)
+          continue;
+        if (field.datatype != sensor_msgs::PointField::FLOAT32 && field.datatype != sensor_msgs::PointField::FLOAT64)
+        {
+          ROS_WARN ("Point time field '%s' is not a floating point field", field_name.c_str ());
+          return false;
+        }
+        
+        times.resize (cloud.width * cloud.height);
+        for (unsigned int r = 0 ; r < cloud.height ; ++r)
+          for (unsigned int c = 0 ; c < cloud.width ; ++c)
+          {
+            const unsigned char *ptr = &cloud.data[r * cloud.row_step + c * cloud.point_step + field.offset];
+            if (field.datatype == sensor_msgs::PointField::FLOAT32)
+            {
+              float value;
+              memcpy (&value, ptr, sizeof (value));
+              times[r * cloud.width + c] = value;
+            }
+            else
+              memcpy (&times[r * cloud.width + c], ptr, sizeof (double));
+          }
+        return true;
+      }
+      ROS_WARN_ONCE ("Cloud has no point time field '%s'; filtering without deskewing", field_name.c_str ());
+      return false;
+    }
+
     void 
       noFilterCallback (const sensor_msgs::PointCloud2ConstPtr &cloud)
     {
@@ -95,7 +135,32 @@ class SelfFilter
       pcl::PointCloud<pcl::PointXYZ> cloud, cloud_filtered;
       pcl::fromROSMsg (*cloud2, cloud);
 
-      if (subsample_param_ != 0)
+      std::vector<double> point_times;
+      if (!point_time_field_.empty () && !sensor_frame_.empty () && getPointTimes (*cloud2, point_time_field_, point_times))
+      {
+        // points have to keep their times, so downsampling happens after filtering
+        pcl::PointCloud<pcl::PointXYZ> cloud_self_filtered;
+        self_filter_->getSelfMask ()->maskIntersectionDeskewed (cloud, point_times, sensor_frame_, min_sensor_dist_, 
+                                                                deskew_slice_duration_, mask);
+        self_filter_->fillResult (cloud, mask, subsample_param_ != 0 ? cloud_self_filtered : cloud_filtered);
+        if (subsample_param_ != 0)
+        {
+          grid_.setLeafSize (subsample_param_, subsample_param_, subsample_param_);
+          grid_.setInputCloud (boost::make_shared <pcl::PointCloud<pcl::PointXYZ> > (cloud_self_filtered));
+          grid_.filter (cloud_filtered);
+        }
+      }
+      else if (subsample_param_ != 0 && depth_image_mode_ && cloud.height > 1)
+      {
+        // downsampling would destroy the image structure, so filter first
+        pcl::PointCloud<pcl::PointXYZ> cloud_self_filtered;
+        self_filter_->updateWithSensorFrame (cloud, cloud_self_filtered, sensor_frame_);
+
+        grid_.setLeafSize (subsample_param_, subsample_param_, subsample_param_);
+        grid_.setInputCloud (boost::make_shared <pcl::PointCloud<pcl::PointXYZ> > (cloud_self_filtered));
+        grid_.filter (cloud_filtered);
+      }
+      else if (subsample_param_ != 0)
       {
         pcl::PointCloud<pcl::PointXYZ> cloud_downsampled;
         // Set up the downsampling filter
@@ -129,6 +194,10 @@ class SelfFilter
     filters::SelfFilter<pcl::PointCloud<pcl::PointXYZ> > *self_filter_;
     std::string sensor_frame_;
     double subsample_param_;
+    bool depth_image_mode_;
+    std::string point_time_field_;
+    double deskew_slice_duration_;
+    double min_sensor_dist_;
 
     ros::Publisher                                        pointCloudPublisher_;
     ros::Subscriber                                       no_filter_sub_;
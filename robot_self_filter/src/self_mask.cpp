@@ -35,6 +35,11 @@
 #include <algorithm>
 #include <sstream>
 #include <climits>
+#include <cmath>
+#include <Eigen/Eigenvalues>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #if defined(IS_ASSIMP3)
 #include <assimp/scene.h>
@@ -48,17 +53,51 @@
 
 void robot_self_filter::SelfMask::freeMemory (void)
 {
+  freeSliceBodies();
   for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
   {
     if (bodies_[i].body)
 	    delete bodies_[i].body;
     if (bodies_[i].unscaledBody)
 	    delete bodies_[i].unscaledBody;
+    if (bodies_[i].shape)
+	    delete bodies_[i].shape;
   }
     
   bodies_.clear ();
 }
 
+void robot_self_filter::SelfMask::freeSliceBodies (void)
+{
+  for (unsigned int k = 0 ; k < slice_bodies_.size() ; ++k)
+    for (unsigned int i = 0 ; i < slice_bodies_[k].size() ; ++i)
+    {
+      delete slice_bodies_[k][i].body;
+      delete slice_bodies_[k][i].unscaledBody;
+    }
+  slice_bodies_.clear ();
+}
+
+void robot_self_filter::SelfMask::createSliceBodies (unsigned int count)
+{
+  // body construction is not thread safe (convex hulls), so this happens up front
+  while (slice_bodies_.size() < count)
+  {
+    std::vector<SeeLink> copy(bodies_.size());
+    for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
+    {
+      copy[i].name = bodies_[i].name;
+      copy[i].constTransf = bodies_[i].constTransf;
+      copy[i].volume = bodies_[i].volume;
+      copy[i].body = bodies::createBodyFromShape(bodies_[i].shape);
+      copy[i].body->setScale(bodies_[i].body->getScale());
+      copy[i].body->setPadding(bodies_[i].body->getPadding());
+      copy[i].unscaledBody = bodies::createBodyFromShape(bodies_[i].shape);
+    }
+    slice_bodies_.push_back(copy);
+  }
+}
+
 
 namespace robot_self_filter
 {
@@ -180,12 +219,15 @@ bool robot_self_filter::SelfMask::configure(const std::vector<LinkInfo> &links)
             ROS_DEBUG_STREAM("Self see link name " <<  links[i].name << " padding " << links[i].padding);
       sl.volume = sl.body->computeVolume();
       sl.unscaledBody = bodies::createBodyFromShape(shape);
+      // kept to create more copies of the body when masking several poses at once
+      sl.shape = shape;
       bodies_.push_back(sl);
     }
     else
+    {
       ROS_WARN("Unable to create point inclusion body for link '%s'", links[i].name.c_str());
-    
-    delete shape;
+      delete shape;
+    }
   }
     
   if (missing.str().size() > 0)
@@ -256,6 +298,32 @@ void robot_self_filter::SelfMask::maskIntersection(const pcl::PointCloud<pcl::Po
   }
 }
 
+void robot_self_filter::SelfMask::maskIntersectionOrganized(const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::string &sensor_frame, const double min_sensor_dist,
+                                                            std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback)
+{
+  if (sensor_frame.empty() || data_in.height <= 1)
+  {
+    maskIntersection(data_in, sensor_frame, min_sensor_dist, mask, callback);
+    return;
+  }
+  
+  mask.resize(data_in.points.size());
+  if (bodies_.empty())
+    std::fill(mask.begin(), mask.end(), (int)OUTSIDE);
+  else
+  {
+    assumeFrame(data_in.header.frame_id, ros::Time(data_in.header.stamp), sensor_frame, min_sensor_dist);
+    tf::Matrix3x3 projection;
+    if (computeImageProjection(data_in, projection))
+      maskAuxIntersectionOrganized(data_in, projection, mask, callback);
+    else
+    {
+      ROS_DEBUG("Organized cloud does not follow a pinhole projection from the sensor; masking points individually");
+      maskAuxIntersection(data_in, mask, callback);
+    }
+  }
+}
+
 void robot_self_filter::SelfMask::computeBoundingSpheres(void)
 {
   const unsigned int bs = bodies_.size();
@@ -336,99 +404,443 @@ void robot_self_filter::SelfMask::maskAuxContainment(const pcl::PointCloud<pcl::
 {
     const unsigned int bs = bodies_.size();
     const unsigned int np = data_in.points.size();
+    if (np == 0)
+      return;
     
-    // compute a sphere that bounds the entire robot
-    bodies::BoundingSphere bound;
-    bodies::mergeBoundingSpheres(bspheres_, bound);	  
-    tfScalar radiusSquared = bound.radius * bound.radius;
-    
-    // we now decide which points we keep
-    //#pragma omp parallel for schedule(dynamic) 
-    for (int i = 0 ; i < (int)np ; ++i)
+    // gather the coordinates in separate arrays, so that each body
+    // can test all the points in one batch
+    std::vector<float> x(np), y(np), z(np);
+    for (unsigned int i = 0 ; i < np ; ++i)
     {
-      tf::Vector3 pt = tf::Vector3(data_in.points[i].x, data_in.points[i].y, data_in.points[i].z);
-      int out = OUTSIDE;
-      if (bound.center.distance2(pt) < radiusSquared)
-          for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-        if (bodies_[j].body->containsPoint(pt))
-            out = INSIDE;
-      
-      mask[i] = out;
+      x[i] = data_in.points[i].x;
+      y[i] = data_in.points[i].y;
+      z[i] = data_in.points[i].z;
     }
+    
+    std::vector<unsigned char> inside(np, 0);
+    for (unsigned int j = 0 ; j < bs ; ++j)
+      bodies_[j].body->containsPoints(&x[0], &y[0], &z[0], np, &inside[0]);
+    
+    for (unsigned int i = 0 ; i < np ; ++i)
+      mask[i] = inside[i] ? INSIDE : OUTSIDE;
 }
 
 void robot_self_filter::SelfMask::maskAuxIntersection(const pcl::PointCloud<pcl::PointXYZ>& data_in, std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback)
 {
-  const unsigned int bs = bodies_.size();
   const unsigned int np = data_in.points.size();
   
   // compute a sphere that bounds the entire robot
   bodies::BoundingSphere bound;
   bodies::mergeBoundingSpheres(bspheres_, bound);	  
-  tfScalar radiusSquared = bound.radius * bound.radius;
-
-  //std::cout << "Testing " << np << " points\n";
 
   // we now decide which points we keep
   //#pragma omp parallel for schedule(dynamic) 
   for (int i = 0 ; i < (int)np ; ++i)
   {
-    bool print = false;
-    //if(i%100 == 0) print = true;
     tf::Vector3 pt = tf::Vector3(data_in.points[i].x, data_in.points[i].y, data_in.points[i].z);
-    int out = OUTSIDE;
+    mask[i] = classifyIntersection(bodies_, bound, sensor_pos_, pt, callback);
+  }
+}
 
-    // we first check is the point is in the unscaled body. 
-    // if it is, the point is definitely inside
-    if (bound.center.distance2(pt) < radiusSquared)
-      for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-        if (bodies_[j].unscaledBody->containsPoint(pt)) 
-        {
-          if(print)
-          std::cout << "Point " << i << " in unscaled body part " << bodies_[j].name << std::endl;
+int robot_self_filter::SelfMask::classifyIntersection(const std::vector<SeeLink> &links, const bodies::BoundingSphere &bound, const tf::Vector3 &sensor_pos,
+                                                      const tf::Vector3 &pt, const boost::function<void(const tf::Vector3&)> &callback) const
+{
+  const unsigned int bs = links.size();
+  tfScalar radiusSquared = bound.radius * bound.radius;
+  int out = OUTSIDE;
+
+  // we first check is the point is in the unscaled body. 
+  // if it is, the point is definitely inside
+  if (bound.center.distance2(pt) < radiusSquared)
+    for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
+      if (links[j].unscaledBody->containsPoint(pt)) 
         out = INSIDE;
-        }
 
-        // if the point is not inside the unscaled body,
-        if (out == OUTSIDE)
+  // if the point is not inside the unscaled body,
+  if (out == OUTSIDE)
+  {
+    // we check it the point is a shadow point 
+    tf::Vector3 dir(sensor_pos - pt);
+    tfScalar  lng = dir.length();
+    if (lng < min_sensor_dist_) 
+      out = INSIDE;
+    else
+    {		
+      dir /= lng;
+      std::vector<tf::Vector3> intersections;
+      for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j) 
+      {
+        intersections.clear();
+        if (links[j].body->intersectsRay(pt, dir, &intersections, 1))
         {
-          // we check it the point is a shadow point 
-          tf::Vector3 dir(sensor_pos_ - pt);
-          tfScalar  lng = dir.length();
-          if (lng < min_sensor_dist_) 
+          if (dir.dot(sensor_pos - intersections[0]) >= 0.0)
           {
-            out = INSIDE;
-            //std::cout << "Point " << i << " less than min sensor distance away\n";
-          }
-          else
-          {		
-            dir /= lng;
-            std::vector<tf::Vector3> intersections;
-            for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j) 
-            {
-              if (bodies_[j].body->intersectsRay(pt, dir, &intersections, 1))
-              {
-                if (dir.dot(sensor_pos_ - intersections[0]) >= 0.0)
-                {
-                  if (callback)
-                    callback(intersections[0]);
-                  out = SHADOW;
-                  if(print) std::cout << "Point " << i << " shadowed by body part " << bodies_[j].name << std::endl;
-                }
-             }
-		       }
-           // if it is not a shadow point, we check if it is inside the scaled body
-           if (out == OUTSIDE && bound.center.distance2(pt) < radiusSquared)
-             for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
-               if (bodies_[j].body->containsPoint(pt)) 
-               {
-                 if(print) 
-                   std::cout << "Point " << i << " in scaled body part " << bodies_[j].name << std::endl;
-                 out = INSIDE;
-               }
+            if (callback)
+              callback(intersections[0]);
+            out = SHADOW;
           }
         }
-        mask[i] = out;
+      }
+      // if it is not a shadow point, we check if it is inside the scaled body
+      if (out == OUTSIDE && bound.center.distance2(pt) < radiusSquared)
+        for (unsigned int j = 0 ; out == OUTSIDE && j < bs ; ++j)
+          if (links[j].body->containsPoint(pt)) 
+            out = INSIDE;
+    }
+  }
+  return out;
+}
+
+namespace robot_self_filter
+{
+    /** \brief Collects intersection points so that callbacks can be run outside of parallel sections */
+    struct IntersectionCollector
+    {
+      IntersectionCollector(std::vector<tf::Vector3> *points) : points_(points)
+      {
+      }
+      
+      void operator()(const tf::Vector3 &pt) const
+      {
+        points_->push_back(pt);
+      }
+      
+      std::vector<tf::Vector3> *points_;
+    };
+}
+
+bool robot_self_filter::SelfMask::lookupPoses(const std::string &frame_id, const ros::Time &stamp, const std::string &sensor_frame,
+                                              std::vector<tf::Transform> &link_poses, tf::Vector3 &sensor_pos) const
+{
+  bool ok = true;
+  link_poses.resize(bodies_.size());
+  for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
+  {
+    tf::StampedTransform transf;
+    try
+    {
+      tf_.lookupTransform(frame_id, bodies_[i].name, stamp, transf);
+      link_poses[i] = transf;
+    }
+    catch(tf::TransformException& ex)
+    {
+      link_poses[i].setIdentity();
+      ok = false;
+    }
+  }
+  
+  try
+  {
+    tf::StampedTransform transf;
+    tf_.lookupTransform(frame_id, sensor_frame, stamp, transf);
+    sensor_pos = transf.getOrigin();
+  }
+  catch(tf::TransformException& ex)
+  {
+    sensor_pos.setValue(0, 0, 0);
+    ok = false;
+  }
+  return ok;
+}
+
+void robot_self_filter::SelfMask::maskIntersectionDeskewed(const pcl::PointCloud<pcl::PointXYZ>& data_in, const std::vector<double> &time_offsets,
+                                                           const std::string &sensor_frame, const double min_sensor_dist, const double slice_duration,
+                                                           std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback)
+{
+  const unsigned int np = data_in.points.size();
+  if (time_offsets.size() != np || slice_duration <= 0.0 || sensor_frame.empty())
+  {
+    if (time_offsets.size() != np)
+      ROS_WARN("Got %u point times for %u points; masking without deskewing", (unsigned int)time_offsets.size(), np);
+    maskIntersection(data_in, sensor_frame, min_sensor_dist, mask, callback);
+    return;
+  }
+
+  mask.resize(np);
+  if (bodies_.empty() || np == 0)
+  {
+    std::fill(mask.begin(), mask.end(), (int)OUTSIDE);
+    return;
+  }
+  min_sensor_dist_ = min_sensor_dist;
+  
+  // bucket the points into time slices
+  double tmin = INFINITY, tmax = -INFINITY;
+  for (unsigned int i = 0 ; i < np ; ++i)
+    if (std::isfinite(time_offsets[i]))
+    {
+      tmin = std::min(tmin, time_offsets[i]);
+      tmax = std::max(tmax, time_offsets[i]);
+    }
+  if (tmin > tmax)
+    tmin = tmax = 0.0;
+  const unsigned int ns = std::max(1, (int)ceil((tmax - tmin) / slice_duration));
+  std::vector< std::vector<unsigned int> > slices(ns);
+  for (unsigned int i = 0 ; i < np ; ++i)
+  {
+    unsigned int k = 0;
+    if (std::isfinite(time_offsets[i]))
+      k = std::min(ns - 1, (unsigned int)((time_offsets[i] - tmin) / slice_duration));
+    slices[k].push_back(i);
+  }
+  
+  // the transform history kept by tf is interpolated at the middle of every slice
+  const ros::Time stamp(data_in.header.stamp);
+  const std::string &frame_id = data_in.header.frame_id;
+  std::string err;
+  for (unsigned int i = 0 ; i < bodies_.size() ; ++i)
+    if (!tf_.waitForTransform(frame_id, bodies_[i].name, stamp + ros::Duration(tmax), ros::Duration(.1), ros::Duration(.01), &err))
+      ROS_ERROR("WaitForTransform timed out from %s to %s after 100ms.  Error string: %s", bodies_[i].name.c_str(), frame_id.c_str(), err.c_str());
+  
+  std::vector< std::vector<tf::Transform> > link_poses(ns);
+  std::vector<tf::Vector3> sensor_positions(ns);
+  unsigned int failed = 0;
+  for (unsigned int k = 0 ; k < ns ; ++k)
+    if (!slices[k].empty())
+    {
+      double t = std::min(tmax, tmin + (k + 0.5) * slice_duration);
+      if (!lookupPoses(frame_id, stamp + ros::Duration(t), sensor_frame, link_poses[k], sensor_positions[k]))
+        failed++;
+    }
+  if (failed > 0)
+    ROS_ERROR("Unable to look up the robot pose for %u of %u time slices of the cloud in frame %s", failed, ns, frame_id.c_str());
+  
+  int threads = 1;
+#ifdef _OPENMP
+  threads = std::min(omp_get_max_threads(), (int)ns);
+#endif
+  createSliceBodies(threads);
+  std::vector< std::vector<tf::Vector3> > slice_intersections(callback ? ns : 0);
+
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+  for (int k = 0 ; k < (int)ns ; ++k)
+  {
+    if (slices[k].empty())
+      continue;
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    std::vector<SeeLink> &links = slice_bodies_[thread];
+    std::vector<bodies::BoundingSphere> spheres(links.size());
+    for (unsigned int j = 0 ; j < links.size() ; ++j)
+    {
+      links[j].body->setPose(link_poses[k][j] * links[j].constTransf);
+      links[j].unscaledBody->setPose(link_poses[k][j] * links[j].constTransf);
+      links[j].body->computeBoundingSphere(spheres[j]);
+    }
+    bodies::BoundingSphere bound;
+    bodies::mergeBoundingSpheres(spheres, bound);
+    
+    boost::function<void(const tf::Vector3&)> collect;
+    if (callback)
+      collect = IntersectionCollector(&slice_intersections[k]);
+    
+    const std::vector<unsigned int> &slice = slices[k];
+    for (unsigned int i = 0 ; i < slice.size() ; ++i)
+    {
+      const pcl::PointXYZ &p = data_in.points[slice[i]];
+      mask[slice[i]] = classifyIntersection(links, bound, sensor_positions[k], tf::Vector3(p.x, p.y, p.z), collect);
+    }
+  }
+  
+  for (unsigned int k = 0 ; k < slice_intersections.size() ; ++k)
+    for (unsigned int i = 0 ; i < slice_intersections[k].size() ; ++i)
+      callback(slice_intersections[k][i]);
+}
+
+namespace robot_self_filter
+{
+    static inline bool isValidPoint(const pcl::PointXYZ &p)
+    {
+      return std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
+    }
+
+    /** \brief Compute the range of pixels a bounding sphere can
+        project to. The cone of rays from the sensor that touch the
+        sphere is enclosed in a 16-sided pyramid, whose edges are
+        projected; returns false if the whole image has to be
+        considered (sensor inside the sphere, or part of the sphere
+        behind the sensor) */
+    static bool computeSphereFootprint(const tf::Matrix3x3 &projection, const tf::Vector3 &sensor, const bodies::BoundingSphere &sphere,
+                                       int width, int height, int &c0, int &c1, int &r0, int &r1)
+    {
+      static const unsigned int SIDES = 16;
+      
+      tf::Vector3 axis(sphere.center - sensor);
+      double dist2 = axis.length2();
+      double radius2 = sphere.radius * sphere.radius;
+      if (dist2 <= radius2 * 1.001 + 1e-9)
+        return false;
+      
+      double dist = sqrt(dist2);
+      axis /= dist;
+      double tan_half = sphere.radius / sqrt(dist2 - radius2) / cos(M_PI / SIDES);
+      tf::Vector3 e1 = axis.cross(fabs(axis.x()) < 0.9 ? tf::Vector3(1, 0, 0) : tf::Vector3(0, 1, 0)).normalized();
+      tf::Vector3 e2 = axis.cross(e1);
+      
+      double cmin = INFINITY, cmax = -INFINITY, rmin = INFINITY, rmax = -INFINITY;
+      for (unsigned int k = 0 ; k < SIDES ; ++k)
+      {
+        double theta = 2.0 * M_PI * k / SIDES;
+        tf::Vector3 q = projection * (axis + tan_half * (cos(theta) * e1 + sin(theta) * e2));
+        if (q.z() <= 1e-9)
+          return false;
+        double c = q.x() / q.z();
+        double r = q.y() / q.z();
+        cmin = std::min(cmin, c); cmax = std::max(cmax, c);
+        rmin = std::min(rmin, r); rmax = std::max(rmax, r);
+      }
+      
+      c0 = (int)std::max(0.0, floor(cmin) - 1.0);
+      r0 = (int)std::max(0.0, floor(rmin) - 1.0);
+      c1 = (int)std::min((double)width - 1.0, ceil(cmax) + 1.0);
+      r1 = (int)std::min((double)height - 1.0, ceil(rmax) + 1.0);
+      return true;
+    }
+}
+
+bool robot_self_filter::SelfMask::computeImageProjection(const pcl::PointCloud<pcl::PointXYZ>& data_in, tf::Matrix3x3 &projection) const
+{
+  const unsigned int width = data_in.width;
+  const unsigned int height = data_in.height;
+  if (width < 2 || height < 2 || data_in.points.size() != width * height)
+    return false;
+  
+  // pixel coordinates are scaled to [0, 1] to keep the fit well conditioned
+  const double su = 1.0 / width;
+  const double sv = 1.0 / height;
+  const unsigned int stride = std::max(1u, (unsigned int)sqrt(width * height / 1024.0));
+  
+  // each sample gives two linear constraints on the 9 entries of the
+  // projection; the solution is the null vector of the stacked constraints
+  Eigen::Matrix<double, 9, 9> ata = Eigen::Matrix<double, 9, 9>::Zero();
+  std::vector<tf::Vector3> rays;
+  std::vector<unsigned int> pixels;
+  for (unsigned int r = 0 ; r < height ; r += stride)
+    for (unsigned int c = 0 ; c < width ; c += stride)
+    {
+      const pcl::PointXYZ &p = data_in.points[r * width + c];
+      if (!isValidPoint(p))
+        continue;
+      tf::Vector3 ray(p.x - sensor_pos_.x(), p.y - sensor_pos_.y(), p.z - sensor_pos_.z());
+      double l = ray.length();
+      if (l < 1e-6)
+        continue;
+      ray /= l;
+      
+      double u = c * su, v = r * sv;
+      Eigen::Matrix<double, 9, 1> a1, a2;
+      a1 << ray.x(), ray.y(), ray.z(), 0.0, 0.0, 0.0, -u * ray.x(), -u * ray.y(), -u * ray.z();
+      a2 << 0.0, 0.0, 0.0, ray.x(), ray.y(), ray.z(), -v * ray.x(), -v * ray.y(), -v * ray.z();
+      ata += a1 * a1.transpose() + a2 * a2.transpose();
+      rays.push_back(ray);
+      pixels.push_back(r * width + c);
+    }
+  
+  if (rays.size() < 16)
+    return false;
+  
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9> > solver(ata);
+  Eigen::Matrix<double, 9, 1> h = solver.eigenvectors().col(0);
+  
+  // points are in front of the sensor
+  tf::Vector3 depth_row(h(6), h(7), h(8));
+  double sign = depth_row.dot(rays[0]) < 0.0 ? -1.0 : 1.0;
+  projection.setValue(sign * h(0) / su, sign * h(1) / su, sign * h(2) / su,
+                      sign * h(3) / sv, sign * h(4) / sv, sign * h(5) / sv,
+                      sign * h(6), sign * h(7), sign * h(8));
+  
+  // the fit must reproduce the pixel of every sample
+  for (unsigned int i = 0 ; i < rays.size() ; ++i)
+  {
+    tf::Vector3 q = projection * rays[i];
+    if (q.z() <= 0.0)
+      return false;
+    double c = q.x() / q.z() - (double)(pixels[i] % width);
+    double r = q.y() / q.z() - (double)(pixels[i] / width);
+    if (fabs(c) > 0.75 || fabs(r) > 0.75)
+      return false;
+  }
+  return true;
+}
+
+void robot_self_filter::SelfMask::maskAuxIntersectionOrganized(const pcl::PointCloud<pcl::PointXYZ>& data_in, const tf::Matrix3x3 &projection,
+                                                               std::vector<int> &mask, const boost::function<void(const tf::Vector3&)> &callback)
+{
+  const unsigned int bs = bodies_.size();
+  const unsigned int np = data_in.points.size();
+  const int width = data_in.width;
+  const int height = data_in.height;
+  
+  near_depth_.assign(np, INFINITY);
+  far_depth_.assign(np, INFINITY);
+  
+  // rasterize the padded bodies: for the pixels each body can
+  // project to, record where the pixel's ray enters and leaves it
+  std::vector<tf::Vector3> intersections;
+  for (unsigned int j = 0 ; j < bs ; ++j)
+  {
+    int c0 = 0, c1 = width - 1, r0 = 0, r1 = height - 1;
+    computeSphereFootprint(projection, sensor_pos_, bspheres_[j], width, height, c0, c1, r0, r1);
+    bool sensor_inside = bodies_[j].body->containsPoint(sensor_pos_);
+    
+    for (int r = r0 ; r <= r1 ; ++r)
+      for (int c = c0 ; c <= c1 ; ++c)
+      {
+        const int i = r * width + c;
+        const pcl::PointXYZ &p = data_in.points[i];
+        if (!isValidPoint(p))
+          continue;
+        tf::Vector3 dir(p.x - sensor_pos_.x(), p.y - sensor_pos_.y(), p.z - sensor_pos_.z());
+        tfScalar lng = dir.length();
+        if (lng < 1e-9)
+          continue;
+        dir /= lng;
+        
+        intersections.clear();
+        if (!bodies_[j].body->intersectsRay(sensor_pos_, dir, &intersections, 2) && !sensor_inside)
+          continue;
+        double near = sensor_inside ? 0.0 : INFINITY;
+        double far = 0.0;
+        for (unsigned int k = 0 ; k < intersections.size() ; ++k)
+        {
+          double t = dir.dot(intersections[k] - sensor_pos_);
+          near = std::min(near, t);
+          far = std::max(far, t);
+        }
+        if (near < near_depth_[i])
+        {
+          near_depth_[i] = near;
+          far_depth_[i] = far;
+        }
+      }
+  }
+  
+  // classify every point against the depth buffer
+  for (unsigned int i = 0 ; i < np ; ++i)
+  {
+    const pcl::PointXYZ &p = data_in.points[i];
+    if (!isValidPoint(p))
+    {
+      mask[i] = OUTSIDE;
+      continue;
+    }
+    tf::Vector3 dir(p.x - sensor_pos_.x(), p.y - sensor_pos_.y(), p.z - sensor_pos_.z());
+    tfScalar lng = dir.length();
+    int out;
+    if (lng < min_sensor_dist_ || (lng >= near_depth_[i] && lng <= far_depth_[i]))
+      out = INSIDE;
+    else if (lng < near_depth_[i])
+      out = OUTSIDE;
+    else
+    {
+      // the ray from the sensor to this point passes through the robot
+      out = SHADOW;
+      if (callback)
+        callback(sensor_pos_ + dir * (far_depth_[i] / lng));
+    }
+    mask[i] = out;
   }
 }
 
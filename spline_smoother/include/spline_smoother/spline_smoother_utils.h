@@ -226,6 +226,28 @@ bool getTotalTime(const spline_smoother::SplineTrajectory &spline,
 bool getTotalTime(const spline_smoother::LSPBTrajectoryMsg &spline, 
                   double &t);
 
+/*! 
+  \brief Compute the (absolute) end time of every segment in the spline, i.e. a prefix sum of the segment durations
+  \param spline The input spline representation of the trajectory.
+  \param segment_end_times A reference that will be filled in with the end time of each segment, segment_end_times.back() is the total time.
+*/
+void getSegmentEndTimes(const spline_smoother::SplineTrajectory &spline, 
+                        std::vector<double> &segment_end_times);
+
+void getSegmentEndTimes(const spline_smoother::LSPBTrajectoryMsg &spline, 
+                        std::vector<double> &segment_end_times);
+
+/*! 
+  \brief Find the index of the segment corresponding to an input time by binary search over the segment end times. Time complexity: O(log n)
+  \return The index of the first segment whose end time is greater than or equal to the input time, or the index of the last segment if the input time is past the end of the trajectory. Returns -1 if there are no segments.
+  \param segment_end_times The segment end times, as computed by getSegmentEndTimes
+  \param time Time at which trajectory needs to be sampled. time = 0.0 corresponds to start of the trajectory.
+  \param start_index (optional) parameter to specify the index to start the search from
+*/
+int findSplineSegmentIndex(const std::vector<double> &segment_end_times,
+                           const double& time,
+                           int start_index=0);
+
 bool sampleSplineTrajectory(const spline_smoother::SplineTrajectorySegment &spline, 
                             const double& input_time, 
                             trajectory_msgs::JointTrajectoryPoint &point_out);
@@ -234,6 +256,17 @@ bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectorySegmentMsg &spl
                             const double& input_time, 
                             trajectory_msgs::JointTrajectoryPoint &point_out);
 
+/*! 
+  \brief Sample the spline trajectory at the specified times
+  
+  The segment lookup uses a prefix sum of the segment durations. If the input times are 
+  sorted (the common case), the segments are found by a single forward sweep, otherwise each
+  time is looked up by binary search. Points are sampled directly into traj_out.
+  \return true on success, false if any failure occurs
+  \param spline The input spline representation of the trajectory.
+  \param times The set of times (in seconds) where the trajectory needs to be sampled, time = 0.0 corresponds to the start of the trajectory.
+  \param traj_out The output trajectory
+*/
 bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline, 
                             const std::vector<double> &times, 
                             trajectory_msgs::JointTrajectory& traj_out);
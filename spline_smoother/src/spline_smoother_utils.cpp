@@ -38,6 +38,7 @@
 #include <spline_smoother/LSPBTrajectoryMsg.h>
 #include <spline_smoother/SplineTrajectory.h>
 #include <angles/angles.h>
+#include <algorithm>
 
 namespace spline_smoother
 {
@@ -161,6 +162,48 @@ bool getTotalTime(const spline_smoother::LSPBTrajectoryMsg &spline,
 }
 
 
+template <typename SplineType>
+static void getSegmentEndTimesImpl(const SplineType &spline, 
+                                   std::vector<double> &segment_end_times)
+{
+  segment_end_times.resize(spline.segments.size());
+  double t = 0.0;
+  for(int i=0; i < (int)spline.segments.size(); i++)
+  {
+    t += spline.segments[i].duration.toSec();
+    segment_end_times[i] = t;
+  }
+}
+
+void getSegmentEndTimes(const spline_smoother::SplineTrajectory &spline, 
+                        std::vector<double> &segment_end_times)
+{
+  getSegmentEndTimesImpl(spline,segment_end_times);
+}
+
+void getSegmentEndTimes(const spline_smoother::LSPBTrajectoryMsg &spline, 
+                        std::vector<double> &segment_end_times)
+{
+  getSegmentEndTimesImpl(spline,segment_end_times);
+}
+
+int findSplineSegmentIndex(const std::vector<double> &segment_end_times,
+                           const double& time,
+                           int start_index)
+{
+  if(segment_end_times.empty())
+    return -1;
+  if(start_index < 0 || start_index >= (int)segment_end_times.size())
+    start_index = 0;
+  std::vector<double>::const_iterator it = std::lower_bound(segment_end_times.begin()+start_index,segment_end_times.end(),time);
+  if(it == segment_end_times.end())
+  {
+    ROS_DEBUG("Did not find spline segment corresponding to input time: %f",time);
+    return segment_end_times.size()-1;
+  }
+  return it - segment_end_times.begin();
+}
+
 bool sampleSplineTrajectory(const spline_smoother::SplineTrajectorySegment &spline, 
                             const double& input_time, 
                             trajectory_msgs::JointTrajectoryPoint &point_out)
@@ -242,48 +285,69 @@ bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectorySegmentMsg &spl
   return true;
 }
 
-bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline, 
-                            const std::vector<double> &times, 
-                            trajectory_msgs::JointTrajectory& traj_out)
+template <typename SplineType>
+static bool sampleSplineTrajectoryImpl(const SplineType& spline, 
+                                       const std::vector<double> &times, 
+                                       trajectory_msgs::JointTrajectory& traj_out)
 {
   bool success = true;
-  trajectory_msgs::JointTrajectoryPoint point_out;
-  spline_smoother::SplineTrajectorySegment spline_segment;
-  double segment_time;
   traj_out.points.clear();
   traj_out.points.resize(times.size());
+  traj_out.joint_names = spline.names;
+  if(times.empty())
+    return true;
+  if(spline.segments.empty())
+  {
+    ROS_ERROR("Cannot sample a spline with no segments");
+    return false;
+  }
+
+  std::vector<double> segment_end_times;
+  getSegmentEndTimes(spline,segment_end_times);
+
+  bool sorted = true;
+  for(unsigned int i=1; i < times.size(); i++)
+  {
+    if(times[i] < times[i-1])
+    {
+      sorted = false;
+      break;
+    }
+  }
+
+  int num_segments = spline.segments.size();
+  int index = 0;
   for(int i=0; i < (int)times.size(); i++)
   {
     ROS_DEBUG("Input time:%d %f",i,times[i]);
-    success = success && findSplineSegment(spline,times[i],spline_segment,segment_time);
-    success = success && sampleSplineTrajectory(spline_segment,segment_time,point_out);    
-    point_out.time_from_start = ros::Duration(times[i]);
-    traj_out.points[i] = point_out;
+    if(sorted)
+    {
+      // times are non-decreasing, so the segment index only ever moves forward
+      while(index < num_segments-1 && times[i] > segment_end_times[index])
+        index++;
+    }
+    else
+      index = findSplineSegmentIndex(segment_end_times,times[i]);
+    double segment_start_time = (index == 0) ? 0.0 : segment_end_times[index-1];
+    double segment_time = std::min(times[i],segment_end_times[index]) - segment_start_time;
+    success = success && sampleSplineTrajectory(spline.segments[index],segment_time,traj_out.points[i]);
+    traj_out.points[i].time_from_start = ros::Duration(times[i]);
   }
-  traj_out.joint_names = spline.names;
   return success;
 }
 
+bool sampleSplineTrajectory(const spline_smoother::SplineTrajectory& spline, 
+                            const std::vector<double> &times, 
+                            trajectory_msgs::JointTrajectory& traj_out)
+{
+  return sampleSplineTrajectoryImpl(spline,times,traj_out);
+}
+
 bool sampleSplineTrajectory(const spline_smoother::LSPBTrajectoryMsg& spline, 
                             const std::vector<double> &times, 
                             trajectory_msgs::JointTrajectory& traj_out)
 {
-  bool success = true;
-  trajectory_msgs::JointTrajectoryPoint point_out;
-  spline_smoother::LSPBTrajectorySegmentMsg spline_segment;
-  double segment_time;
-  traj_out.points.clear();
-  traj_out.points.resize(times.size());
-  for(int i=0; i < (int)times.size(); i++)
-  {
-    ROS_DEBUG("Input time:%d %f",i,times[i]);
-    success = success && findSplineSegment(spline,times[i],spline_segment,segment_time);
-    success = success && sampleSplineTrajectory(spline_segment,segment_time,point_out);    
-    point_out.time_from_start = ros::Duration(times[i]);
-    traj_out.points[i] = point_out;
-  }
-  traj_out.joint_names = spline.names;
-  return success;
+  return sampleSplineTrajectoryImpl(spline,times,traj_out);
 }
 
 /*! 
@@ -37,6 +37,7 @@
 #include <gtest/gtest.h>
 #include <spline_smoother/spline_smoother_utils.h>
 #include <stdlib.h>
+#include <algorithm>
 
 static double getRandomNumber(double min, double max)
 {
@@ -134,3 +135,76 @@ TEST(TestUtils, testTridiagonalSolver2)
     EXPECT_NEAR(x[i], solved_x[i], tolerance);
   }
 }
+
+TEST(TestUtils, testFindSplineSegmentIndex)
+{
+  spline_smoother::SplineTrajectory spline;
+  spline.segments.resize(4);
+  for (int i=0; i<4; i++)
+    spline.segments[i].duration = ros::Duration(0.5*(i+1));
+
+  std::vector<double> end_times;
+  spline_smoother::getSegmentEndTimes(spline, end_times);
+  ASSERT_EQ((int)end_times.size(), 4);
+  EXPECT_NEAR(end_times[3], 5.0, 1e-8);
+
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(end_times, 0.0), 0);
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(end_times, 0.5), 0);
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(end_times, 0.6), 1);
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(end_times, 3.2), 3);
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(end_times, 10.0), 3);
+  EXPECT_EQ(spline_smoother::findSplineSegmentIndex(std::vector<double>(), 1.0), -1);
+}
+
+TEST(TestUtils, testSampleSplineTrajectorySortedAndUnsorted)
+{
+  srand(2);
+
+  // random cubic spline with 20 segments and 3 joints
+  spline_smoother::SplineTrajectory spline;
+  spline.names.resize(3);
+  spline.segments.resize(20);
+  for (int i=0; i<20; i++)
+  {
+    spline.segments[i].duration = ros::Duration(getRandomNumber(0.1, 0.5));
+    spline.segments[i].joints.resize(3);
+    for (int j=0; j<3; j++)
+    {
+      spline.segments[i].joints[j].coefficients.resize(4);
+      for (int k=0; k<4; k++)
+        spline.segments[i].joints[j].coefficients[k] = getRandomNumber(-1.0, 1.0);
+    }
+  }
+  double total_time;
+  spline_smoother::getTotalTime(spline, total_time);
+
+  std::vector<double> sorted_times, unsorted_times;
+  for (double t=0.0; t<total_time+0.1; t+=0.01)
+    sorted_times.push_back(t);
+  unsorted_times = sorted_times;
+  std::reverse(unsorted_times.begin(), unsorted_times.end());
+
+  trajectory_msgs::JointTrajectory sorted_traj, unsorted_traj;
+  EXPECT_TRUE(spline_smoother::sampleSplineTrajectory(spline, sorted_times, sorted_traj));
+  EXPECT_TRUE(spline_smoother::sampleSplineTrajectory(spline, unsorted_times, unsorted_traj));
+  ASSERT_EQ(sorted_traj.points.size(), sorted_times.size());
+  ASSERT_EQ(unsorted_traj.points.size(), sorted_times.size());
+
+  int n = sorted_times.size();
+  for (int i=0; i<n; i++)
+  {
+    // compare against the linear segment search
+    spline_smoother::SplineTrajectorySegment segment;
+    double segment_time;
+    trajectory_msgs::JointTrajectoryPoint expected;
+    ASSERT_TRUE(spline_smoother::findSplineSegment(spline, sorted_times[i], segment, segment_time));
+    spline_smoother::sampleSplineTrajectory(segment, segment_time, expected);
+    for (int j=0; j<3; j++)
+    {
+      EXPECT_NEAR(expected.positions[j], sorted_traj.points[i].positions[j], 1e-8);
+      EXPECT_NEAR(expected.velocities[j], sorted_traj.points[i].velocities[j], 1e-8);
+      EXPECT_NEAR(expected.positions[j], unsorted_traj.points[n-1-i].positions[j], 1e-8);
+      EXPECT_NEAR(expected.accelerations[j], unsorted_traj.points[n-1-i].accelerations[j], 1e-8);
+    }
+  }
+}
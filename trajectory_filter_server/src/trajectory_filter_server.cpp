@@ -36,6 +36,7 @@
 
 #include <trajectory_filter_server/trajectory_filter_server.h>
 #include <pluginlib/class_loader.h>
+#include <planning_environment/util/latency_statistics.h>
 
 namespace trajectory_filter_server
 {
@@ -93,6 +94,8 @@ bool TrajectoryFilterServer::init()
   if(!loadURDF())
     return false;
 
+  planning_environment::LatencyStatistics::getInstance().initialize(private_handle_);
+
   if(service_type_ == FILTER_JOINT_TRAJECTORY)
     filter_service_ = private_handle_.advertiseService("filter_trajectory", &TrajectoryFilterServer::filter, this);
   if(service_type_ == FILTER_JOINT_TRAJECTORY_WITH_CONSTRAINTS)
@@ -110,7 +113,11 @@ bool TrajectoryFilterServer::filter(arm_navigation_msgs::FilterJointTrajectory::
   arm_navigation_msgs::FilterJointTrajectory orig_request;
   orig_request.request = req;
   arm_navigation_msgs::FilterJointTrajectory chain_response;
-  if (!filter_chain_.update(orig_request,chain_response))
+  planning_environment::ScopedLatencyTimer filter_timer("filter");
+  bool filtered = filter_chain_.update(orig_request,chain_response);
+  filter_timer.stop();
+  planning_environment::LatencyStatistics::getInstance().finishRequest();
+  if (!filtered)
   {
     ROS_WARN("Filter chain failed to process trajectory");
     resp.error_code.val = chain_response.response.error_code.val;
@@ -131,7 +138,11 @@ bool TrajectoryFilterServer::filterConstraints(arm_navigation_msgs::FilterJointT
   getLimits(req.trajectory,req.limits);
   arm_navigation_msgs::FilterJointTrajectoryWithConstraints orig_request;
   orig_request.request = req;
-  if (!filter_constraints_chain_.update(orig_request,filter_response))
+  planning_environment::ScopedLatencyTimer filter_timer("filter");
+  bool filtered = filter_constraints_chain_.update(orig_request,filter_response);
+  filter_timer.stop();
+  planning_environment::LatencyStatistics::getInstance().finishRequest();
+  if (!filtered)
   {
     ROS_WARN("Filter chain failed to process trajectory");
     resp.error_code.val = filter_response.response.error_code.val;